@@ -5,6 +5,7 @@
 **/
 
 #include "AgentSpawner.h"
+#include "BattleFrame.h"
 #include "Traits/Directed.h"
 #include "Traits/Damage.h"
 #include "Traits/Collider.h"
@@ -21,6 +22,7 @@
 #include "Traits/Appear.h"
 #include "Traits/Tracing.h"
 #include "Traits/GridData.h"
+#include "Traits/GridOwner.h"
 #include "Traits/RegisterMultiple.h"
 #include "Traits/Team.h"
 #include "Traits/Avoiding.h"
@@ -29,7 +31,12 @@
 #include "BattleFrameBattleControl.h"
 #include "BattleFrameFunctionLibraryRT.h"
 #include "Traits/Activated.h"
+#include "Traits/Rendering.h"
+#include "Traits/RenderBatchData.h"
+#include "Traits/Pooled.h"
 #include "SubjectHandle.h"
+#include "Async/ParallelFor.h"
+#include "Math/RandomStream.h"
 
 
 AAgentSpawner::AAgentSpawner() 
@@ -110,60 +117,8 @@ TArray<FSubjectHandle> AAgentSpawner::SpawnAgentsRectangular
         return SpawnedAgents;
     }
 
-    FSubjectRecord AgentConfig = DataAsset->ExtraTraits;
-
-    AgentConfig.SetTrait(DataAsset->Agent);
-    AgentConfig.SetTrait(DataAsset->SubType);
-    AgentConfig.SetTrait(FTeam(Team));
-    AgentConfig.SetTrait(DataAsset->Collider);
-    AgentConfig.SetTrait(FLocated());
-    AgentConfig.SetTrait(FDirected());
-    AgentConfig.SetTrait(DataAsset->Scale);
-    AgentConfig.SetTrait(DataAsset->Health);
-    AgentConfig.SetTrait(DataAsset->Damage);
-    AgentConfig.SetTrait(DataAsset->Debuff);
-    AgentConfig.SetTrait(DataAsset->Defence);
-    AgentConfig.SetTrait(DataAsset->Sleep);
-    AgentConfig.SetTrait(DataAsset->Move);
-    AgentConfig.SetTrait(FMoving());
-    AgentConfig.SetTrait(DataAsset->Patrol);
-    AgentConfig.SetTrait(DataAsset->Navigation);
-    AgentConfig.SetTrait(DataAsset->Avoidance);
-    AgentConfig.SetTrait(FAvoiding());
-    AgentConfig.SetTrait(DataAsset->Appear);
-    AgentConfig.SetTrait(DataAsset->Trace);
-    AgentConfig.SetTrait(FTracing());
-    AgentConfig.SetTrait(DataAsset->Chase);
-    AgentConfig.SetTrait(DataAsset->Attack);
-    AgentConfig.SetTrait(DataAsset->Hit);
-    AgentConfig.SetTrait(DataAsset->Death);
-    AgentConfig.SetTrait(DataAsset->Animation);
-    AgentConfig.SetTrait(DataAsset->HealthBar);
-    AgentConfig.SetTrait(DataAsset->TextPop);
-    AgentConfig.SetTrait(FPoppingText());
-    AgentConfig.SetTrait(DataAsset->Curves);
-    AgentConfig.SetTrait(FTemporalDamaging());
-    AgentConfig.SetTrait(FSlowing());
-    AgentConfig.SetTrait(DataAsset->Statistics);
-
-    // Apply Multipliers
-    auto& HealthTrait = AgentConfig.GetTraitRef<FHealth>();
-    HealthTrait.Current *= Multipliers.HealthMult;
-    HealthTrait.Maximum *= Multipliers.HealthMult;
-
-    auto& TextPopUp = AgentConfig.GetTraitRef<FTextPopUp>();
-    TextPopUp.WhiteTextBelowPercent *= Multipliers.HealthMult;
-    TextPopUp.OrangeTextAbovePercent *= Multipliers.HealthMult;
-
-    auto& DamageTrait = AgentConfig.GetTraitRef<FDamage>();
-    DamageTrait.Damage *= Multipliers.DamageMult;
-
-    auto& ScaledTrait = AgentConfig.GetTraitRef<FScaled>();
-    ScaledTrait.Scale *= Multipliers.ScaleMult;
-    ScaledTrait.RenderScale *= Multipliers.ScaleMult;
-
-    auto& MoveTrait = AgentConfig.GetTraitRef<FMove>();
-    MoveTrait.XY.MoveSpeed *= Multipliers.MoveSpeedMult;
+    FSubjectRecord AgentConfig;
+    MakeAgentPrototype(DataAsset, Team, Multipliers, AgentConfig);
 
     while (SpawnedAgents.Num() < Quantity)// the following traits varies from agent to agent
     {
@@ -305,60 +260,8 @@ TArray<FSubjectHandle> AAgentSpawner::SpawnAgentsByConfigRectangular
         return SpawnedAgents;
     }
 
-    FSubjectRecord AgentRecord = AgentConfig->ExtraTraits;
-
-    AgentRecord.SetTrait(AgentConfig->Agent);
-    AgentRecord.SetTrait(AgentConfig->SubType);
-    AgentRecord.SetTrait(FTeam(Team));
-    AgentRecord.SetTrait(AgentConfig->Collider);
-    AgentRecord.SetTrait(FLocated());
-    AgentRecord.SetTrait(FDirected());
-    AgentRecord.SetTrait(AgentConfig->Scale);
-    AgentRecord.SetTrait(AgentConfig->Health);
-    AgentRecord.SetTrait(AgentConfig->Damage);
-    AgentRecord.SetTrait(AgentConfig->Debuff);
-    AgentRecord.SetTrait(AgentConfig->Defence);
-    AgentRecord.SetTrait(AgentConfig->Sleep);
-    AgentRecord.SetTrait(AgentConfig->Move);
-    AgentRecord.SetTrait(FMoving());
-    AgentRecord.SetTrait(AgentConfig->Chase);
-    AgentRecord.SetTrait(AgentConfig->Patrol);
-    AgentRecord.SetTrait(AgentConfig->Navigation);
-    AgentRecord.SetTrait(AgentConfig->Avoidance);
-    AgentRecord.SetTrait(FAvoiding());
-    AgentRecord.SetTrait(AgentConfig->Appear);
-    AgentRecord.SetTrait(AgentConfig->Trace);
-    AgentRecord.SetTrait(FTracing());
-    AgentRecord.SetTrait(AgentConfig->Attack);
-    AgentRecord.SetTrait(AgentConfig->Hit);
-    AgentRecord.SetTrait(AgentConfig->Death);
-    AgentRecord.SetTrait(AgentConfig->Animation);
-    AgentRecord.SetTrait(AgentConfig->HealthBar);
-    AgentRecord.SetTrait(AgentConfig->TextPop);
-    AgentRecord.SetTrait(FPoppingText());
-    AgentRecord.SetTrait(AgentConfig->Curves);
-    AgentRecord.SetTrait(FTemporalDamaging());
-    AgentRecord.SetTrait(FSlowing());
-    AgentRecord.SetTrait(AgentConfig->Statistics);
-
-    // Apply Multipliers
-    auto& HealthTrait = AgentRecord.GetTraitRef<FHealth>();
-    HealthTrait.Current *= Multipliers.HealthMult;
-    HealthTrait.Maximum *= Multipliers.HealthMult;
-
-    auto& TextPopUp = AgentRecord.GetTraitRef<FTextPopUp>();
-    TextPopUp.WhiteTextBelowPercent *= Multipliers.HealthMult;
-    TextPopUp.OrangeTextAbovePercent *= Multipliers.HealthMult;
-
-    auto& DamageTrait = AgentRecord.GetTraitRef<FDamage>();
-    DamageTrait.Damage *= Multipliers.DamageMult;
-
-    auto& ScaledTrait = AgentRecord.GetTraitRef<FScaled>();
-    ScaledTrait.Scale *= Multipliers.ScaleMult;
-    ScaledTrait.RenderScale *= Multipliers.ScaleMult;
-
-    auto& MoveTrait = AgentRecord.GetTraitRef<FMove>();
-    MoveTrait.XY.MoveSpeed *= Multipliers.MoveSpeedMult;
+    FSubjectRecord AgentRecord;
+    MakeAgentPrototype(AgentConfig, Team, Multipliers, AgentRecord);
 
     while (SpawnedAgents.Num() < Quantity)// the following traits varies from agent to agent
     {
@@ -445,6 +348,508 @@ TArray<FSubjectHandle> AAgentSpawner::SpawnAgentsByConfigRectangular
     return SpawnedAgents;
 }
 
+void AAgentSpawner::MakeAgentPrototype(const UAgentConfigDataAsset* DataAsset, const int32 Team, const FSpawnerMult& Multipliers, FSubjectRecord& OutRecord) const
+{
+    OutRecord = DataAsset->ExtraTraits;
+
+    OutRecord.SetTrait(DataAsset->Agent);
+    OutRecord.SetTrait(DataAsset->SubType);
+    OutRecord.SetTrait(FTeam(Team));
+    OutRecord.SetTrait(DataAsset->Collider);
+    OutRecord.SetTrait(FLocated());
+    OutRecord.SetTrait(FDirected());
+    OutRecord.SetTrait(DataAsset->Scale);
+    OutRecord.SetTrait(DataAsset->Health);
+    OutRecord.SetTrait(DataAsset->Damage);
+    OutRecord.SetTrait(DataAsset->Debuff);
+    OutRecord.SetTrait(DataAsset->Defence);
+    OutRecord.SetTrait(DataAsset->Sleep);
+    OutRecord.SetTrait(DataAsset->Move);
+    OutRecord.SetTrait(FMoving());
+    OutRecord.SetTrait(DataAsset->Patrol);
+    OutRecord.SetTrait(DataAsset->Navigation);
+    OutRecord.SetTrait(DataAsset->Avoidance);
+    OutRecord.SetTrait(FAvoiding());
+    OutRecord.SetTrait(DataAsset->Appear);
+    OutRecord.SetTrait(DataAsset->Trace);
+    OutRecord.SetTrait(FTracing());
+    OutRecord.SetTrait(DataAsset->Chase);
+    OutRecord.SetTrait(DataAsset->Attack);
+    OutRecord.SetTrait(DataAsset->Hit);
+    OutRecord.SetTrait(DataAsset->Death);
+    OutRecord.SetTrait(DataAsset->Animation);
+    OutRecord.SetTrait(DataAsset->HealthBar);
+    OutRecord.SetTrait(DataAsset->TextPop);
+    OutRecord.SetTrait(FPoppingText());
+    OutRecord.SetTrait(DataAsset->Curves);
+    OutRecord.SetTrait(FTemporalDamaging());
+    OutRecord.SetTrait(FSlowing());
+    OutRecord.SetTrait(FStatusEffects());
+    OutRecord.SetTrait(DataAsset->Statistics);
+
+    // Apply Multipliers
+    auto& HealthTrait = OutRecord.GetTraitRef<FHealth>();
+    HealthTrait.Current *= Multipliers.HealthMult;
+    HealthTrait.Maximum *= Multipliers.HealthMult;
+
+    auto& TextPopUp = OutRecord.GetTraitRef<FTextPopUp>();
+    TextPopUp.WhiteTextBelowPercent *= Multipliers.HealthMult;
+    TextPopUp.OrangeTextAbovePercent *= Multipliers.HealthMult;
+
+    auto& DamageTrait = OutRecord.GetTraitRef<FDamage>();
+    DamageTrait.Damage *= Multipliers.DamageMult;
+
+    auto& ScaledTrait = OutRecord.GetTraitRef<FScaled>();
+    ScaledTrait.Scale *= Multipliers.ScaleMult;
+    ScaledTrait.RenderScale *= Multipliers.ScaleMult;
+
+    auto& MoveTrait = OutRecord.GetTraitRef<FMove>();
+    MoveTrait.XY.MoveSpeed *= Multipliers.MoveSpeedMult;
+}
+
+TArray<FSubjectHandle> AAgentSpawner::SpawnAgentsBulk
+(
+    bool bAutoActivate,
+    int32 ConfigIndex,
+    int32 Quantity,
+    int32 Team,
+    FVector Origin,
+    FVector2D Region,
+    FVector2D LaunchVelocity,
+    EInitialDirection InitialDirection,
+    FVector2D CustomDirection,
+    FSpawnerMult Multipliers,
+    bool bTimeSliced
+)
+{
+    TRACE_CPUPROFILER_EVENT_SCOPE_STR("SpawnAgentsBulk");
+
+    TArray<FSubjectHandle> SpawnedAgents;
+
+    if (!CurrentWorld)
+    {
+        CurrentWorld = GetWorld();
+
+        if (!CurrentWorld)
+        {
+            return SpawnedAgents;
+        }
+    }
+
+    if (!Mechanism)
+    {
+        Mechanism = UMachine::ObtainMechanism(CurrentWorld);
+
+        if (!Mechanism)
+        {
+            return SpawnedAgents;
+        }
+    }
+
+    if (!BattleControl)
+    {
+        BattleControl = Cast<ABattleFrameBattleControl>(UGameplayStatics::GetActorOfClass(CurrentWorld, ABattleFrameBattleControl::StaticClass()));
+
+        if (!BattleControl)
+        {
+            return SpawnedAgents;
+        }
+    }
+
+    if (!AgentConfigAssets.IsValidIndex(ConfigIndex) || Quantity <= 0)
+    {
+        return SpawnedAgents;
+    }
+
+    FPendingAgentWave& Wave = PendingWaves.AddDefaulted_GetRef();
+    Wave.ConfigAsset = AgentConfigAssets[ConfigIndex];
+    Wave.Quantity = Quantity;
+    Wave.Team = Team;
+    Wave.Origin = Origin;
+    Wave.Region = Region;
+    Wave.LaunchVelocity = LaunchVelocity;
+    Wave.InitialDirection = InitialDirection;
+    Wave.CustomDirection = CustomDirection;
+    Wave.Multipliers = Multipliers;
+    Wave.bAutoActivate = bAutoActivate;
+    Wave.WaveId = ++LastWaveId;
+
+    // 配置或其VAT数据仍在加载时整波在队列里等待，不在这里同步加载 | while the config or its VAT data is still loading the whole wave waits in the queue, nothing is loaded synchronously here
+    if (!BattleControl->RequestAgentConfig(Wave.ConfigAsset) || !PrepareWave(Wave))
+    {
+        if (Wave.ConfigAsset.IsNull())
+        {
+            PendingWaves.Pop();
+        }
+
+        return SpawnedAgents;
+    }
+
+    if (bTimeSliced)
+    {
+        // 本帧在预算内能生成多少就生成多少，剩下的交给Tick | spawn what fits in this frame's budget, Tick takes the rest
+        const double Deadline = FPlatformTime::Seconds() + TimeSlicedSpawnBudgetMs * 0.001;
+        const int32 WaveIndex = PendingWaves.Num() - 1;
+
+        while (PendingWaves[WaveIndex].NextIndex < Quantity && FPlatformTime::Seconds() < Deadline)
+        {
+            SpawnWaveSlice(PendingWaves[WaveIndex], TimeSlicedSpawnBatch, SpawnedAgents);
+        }
+
+        if (PendingWaves[WaveIndex].NextIndex >= Quantity)
+        {
+            PendingWaves.RemoveAt(WaveIndex);
+        }
+    }
+    else
+    {
+        SpawnWaveSlice(Wave, Quantity, SpawnedAgents);
+        PendingWaves.Pop();
+    }
+
+    return SpawnedAgents;
+}
+
+bool AAgentSpawner::PrepareWave(FPendingAgentWave& Wave)
+{
+    TRACE_CPUPROFILER_EVENT_SCOPE_STR("PrepareWave");
+
+    UAgentConfigDataAsset* DataAsset = Wave.ConfigAsset.Get();
+
+    if (!IsValid(DataAsset))
+    {
+        return false;
+    }
+
+    Wave.DataAsset = DataAsset;
+    MakeAgentPrototype(DataAsset, Wave.Team, Wave.Multipliers, Wave.Prototype);
+
+    if (BattleControl->bRecycleAgents)
+    {
+        Wave.bRecycle = true;
+        Wave.PoolKey = FAgentPoolKey{ DataAsset, Wave.Team };
+        Wave.Prototype.SetTrait(FRecyclable{ Wave.PoolKey });
+    }
+
+    // 动画长度表对整波相同，先写进原型，激活时不再逐个重建 | anim lengths are the same for the whole wave, fill them on the prototype so activation does not rebuild them per agent
+    auto& Animation = Wave.Prototype.GetTraitRef<FAnimation>();
+    Animation.AnimToTextureData = Animation.AnimToTextureDataAsset.Get();// already in memory, RequestAgentConfig said so
+
+    if (IsValid(Animation.AnimToTextureData) && Animation.AnimLengthArray.IsEmpty())
+    {
+        for (const FAnimToTextureAnimInfo& CurrentAnim : Animation.AnimToTextureData->Animations)
+        {
+            Animation.AnimLengthArray.Add((CurrentAnim.EndFrame - CurrentAnim.StartFrame) / Animation.AnimToTextureData->SampleRate);
+        }
+    }
+
+    // 逐单位的出生点与朝向并行算好，随机流按序号播种，与线程划分无关 | work out every spawn point and direction in parallel, random streams are seeded by index so the result does not depend on the thread split
+    const FVector ForwardDirection = GetActorForwardVector().GetSafeNormal2D();
+    const APawn* PlayerPawn = UGameplayStatics::GetPlayerPawn(CurrentWorld, 0);
+    const bool bHasPlayer = IsValid(PlayerPawn);
+    const FVector PlayerLocation = bHasPlayer ? PlayerPawn->GetActorLocation() : FVector::ZeroVector;
+    const FVector CustomDirection3D = FVector(Wave.CustomDirection, 0).GetSafeNormal2D();
+
+    const auto& Move = Wave.Prototype.GetTraitRef<FMove>();
+    const float GroundOffset = Wave.Prototype.GetTraitRef<FCollider>().Radius * Wave.Prototype.GetTraitRef<FScaled>().Scale;
+    const uint32 Seed = FMath::Rand();
+
+    Wave.Points.SetNumUninitialized(Wave.Quantity);
+
+    ParallelFor(Wave.Quantity, [&](int32 Index)
+    {
+        FRandomStream Random(static_cast<int32>(HashCombine(Seed, Index)));
+        FAgentSpawnPoint& Point = Wave.Points[Index];
+
+        Point.Location = Wave.Origin + FVector(Random.FRandRange(-Wave.Region.X / 2, Wave.Region.X / 2), Random.FRandRange(-Wave.Region.Y / 2, Wave.Region.Y / 2), 0);
+        Point.FlyingHeight = 0;
+
+        if (Move.Z.bCanFly)
+        {
+            Point.FlyingHeight = Random.FRandRange(Move.Z.FlyHeightRange.X, Move.Z.FlyHeightRange.Y);
+            Point.Location.Z += Point.FlyingHeight;
+        }
+        else
+        {
+            Point.Location.Z += GroundOffset;
+        }
+
+        switch (Wave.InitialDirection)
+        {
+            case EInitialDirection::FacePlayer:
+            {
+                Point.Direction = bHasPlayer ? (PlayerLocation - Point.Location).GetSafeNormal2D() : ForwardDirection;
+                break;
+            }
+
+            case EInitialDirection::FaceForward:
+            {
+                Point.Direction = ForwardDirection;
+                break;
+            }
+
+            case EInitialDirection::CustomDirection:
+            {
+                Point.Direction = CustomDirection3D;
+                break;
+            }
+
+            default:
+            {
+                Point.Direction = ForwardDirection;
+                break;
+            }
+        }
+    });
+
+    Wave.bPrepared = true;
+
+    return true;
+}
+
+template<typename... TraitTypes>
+static void ResetTraitsFromRecord(FSubjectHandle Agent, FSubjectRecord& Record)
+{
+    (Agent.SetTrait(Record.GetTraitRef<TraitTypes>()), ...);
+}
+
+void AAgentSpawner::ResetPooledAgent(FSubjectHandle Agent, FSubjectRecord& Prototype)
+{
+    // 池中单位与原型特征布局相同，只覆盖数值，渲染槽位保留 | a pooled agent has the prototype's trait layout, only the values are overwritten and the render slot stays
+    Agent.RemoveTrait<FPooled>();
+    Agent.RemoveTrait<FDying>();
+
+    ResetTraitsFromRecord<
+        FAgent, FSubType, FTeam, FCollider, FLocated, FDirected, FScaled, FHealth, FDamage, FDebuff, FDefence,
+        FSleep, FMove, FMoving, FPatrol, FNavigation, FAvoidance, FAvoiding, FAppear, FTrace, FTracing, FChase,
+        FAttack, FHit, FDeath, FAnimation, FHealthBar, FTextPopUp, FPoppingText, FCurves, FTemporalDamaging,
+        FSlowing, FStatusEffects, FStatistics>(Agent, Prototype);
+
+    FRendering* Rendering = Agent.GetTraitPtr<FRendering, EParadigm::Unsafe>();
+
+    if (Rendering)
+    {
+        Rendering->SnapshotStep = 0;// no snapshot to blend from
+
+        if (Rendering->Renderer.IsValid() && Rendering->InstanceId >= 0)
+        {
+            FRenderBatchData& Data = Rendering->Renderer.GetTraitRef<FRenderBatchData, EParadigm::Unsafe>();
+
+            Data.Lock();
+            Data.InsidePool_Array[Rendering->InstanceId] = false;
+            Data.Unlock();
+        }
+    }
+}
+
+int32 AAgentSpawner::SpawnWaveSlice(FPendingAgentWave& Wave, const int32 MaxCount, TArray<FSubjectHandle>& OutAgents)
+{
+    TRACE_CPUPROFILER_EVENT_SCOPE_STR("SpawnWaveSlice");
+
+    const int32 Begin = Wave.NextIndex;
+    const int32 Count = FMath::Min(FMath::Max(MaxCount, 1), Wave.Points.Num() - Begin);
+    const int32 FirstOut = OutAgents.Num();
+
+    if (Count <= 0)
+    {
+        return 0;
+    }
+
+    // 只在生成时按值克隆原型，不再逐个复制再修改整条记录，开启回收时先复用池中单位 | the prototype is cloned once per subject as it is spawned, no per agent copy of the whole record. With recycling, pooled agents go first
+    OutAgents.Reserve(FirstOut + Count);
+
+    for (int32 i = 0; i < Count; ++i)
+    {
+        FSubjectHandle Agent = Wave.bRecycle ? BattleControl->TakePooledAgent(Wave.PoolKey) : FSubjectHandle();
+
+        if (Agent.IsValid())
+        {
+            ResetPooledAgent(Agent, Wave.Prototype);
+        }
+        else
+        {
+            Agent = Mechanism->SpawnSubject(Wave.Prototype);
+        }
+
+        OutAgents.Add(Agent);
+    }
+
+    // 逐单位字段并行写入，每个任务只写自己的主体，期间不改结构 | per agent fields in parallel, each task only writes its own subject and nothing changes structure meanwhile
+    const FVector2D LaunchVelocity = Wave.LaunchVelocity;
+    const bool bLaunching = LaunchVelocity.Size() > 0;
+
+    ParallelFor(Count, [&](int32 i)
+    {
+        const FAgentSpawnPoint& Point = Wave.Points[Begin + i];
+        FSubjectHandle Agent = OutAgents[FirstOut + i];
+
+        FLocated* Located = Agent.GetTraitPtr<FLocated, EParadigm::Unsafe>();
+        FDirected* Directed = Agent.GetTraitPtr<FDirected, EParadigm::Unsafe>();
+        FMoving* Moving = Agent.GetTraitPtr<FMoving, EParadigm::Unsafe>();
+        FPatrol* Patrol = Agent.GetTraitPtr<FPatrol, EParadigm::Unsafe>();
+
+        if (!Located || !Directed || !Moving || !Patrol) return;
+
+        Located->Location = Point.Location;
+        Located->PreLocation = Point.Location;
+        Located->InitialLocation = Point.Location;
+
+        Directed->Direction = Point.Direction;
+
+        Moving->FlyingHeight = Point.FlyingHeight;
+        Moving->Goal = Point.Location;
+
+        if (bLaunching)
+        {
+            Moving->LaunchVelSum = Point.Direction * LaunchVelocity.X + FVector::UpVector * LaunchVelocity.Y;
+            Moving->bLaunching = true;
+        }
+
+        Patrol->Origin = Point.Location;
+    });
+
+    if (Wave.bAutoActivate)
+    {
+        for (int32 i = FirstOut; i < OutAgents.Num(); ++i)
+        {
+            ActivateAgent(OutAgents[i]);
+        }
+    }
+
+    Wave.NextIndex += Count;
+
+    return Count;
+}
+
+void AAgentSpawner::Tick(float DeltaTime)
+{
+    Super::Tick(DeltaTime);
+
+    if (!Mechanism || !BattleControl)
+    {
+        return;
+    }
+
+    // 资源到齐的单位补上激活 | activate held agents whose assets have arrived
+    if (!HeldAgents.IsEmpty())
+    {
+        TRACE_CPUPROFILER_EVENT_SCOPE_STR("ActivateHeldAgents");
+
+        TArray<FSubjectHandle> ReadyAgents;
+
+        for (auto It = HeldAgents.CreateIterator(); It; ++It)
+        {
+            const FSubjectHandle Agent = *It;
+            const FAnimation* Animation = Agent.IsValid() ? Agent.GetTraitPtr<FAnimation, EParadigm::Unsafe>() : nullptr;
+
+            if (!Animation)
+            {
+                It.RemoveCurrent();
+                continue;
+            }
+
+            const FSoftObjectPath& AnimPath = Animation->AnimToTextureDataAsset.ToSoftObjectPath();
+
+            if (BattleControl->RequestSoftObject(AnimPath) || BattleControl->HasLoadFailed(AnimPath))
+            {
+                ReadyAgents.Add(Agent);
+                It.RemoveCurrent();
+            }
+        }
+
+        for (const FSubjectHandle& Agent : ReadyAgents)
+        {
+            ActivateAgent(Agent);
+        }
+    }
+
+    if (PendingWaves.IsEmpty())
+    {
+        return;
+    }
+
+    TRACE_CPUPROFILER_EVENT_SCOPE_STR("SpawnPendingWaves");
+
+    // 每帧至少推进一批，保证大波次最终生成完，资源未到齐的波次让后面的先走 | at least one batch per frame so a large wave always finishes, waves still loading let later ones go first
+    const double Deadline = FPlatformTime::Seconds() + TimeSlicedSpawnBudgetMs * 0.001;
+    TArray<FSubjectHandle> SpawnedAgents;
+    int32 WaveIndex = 0;
+
+    struct FSpawnedSlice
+    {
+        int32 WaveId;
+        int32 Begin;
+        int32 End;
+        bool bComplete;
+    };
+
+    TArray<FSpawnedSlice> SpawnedSlices;
+
+    while (WaveIndex < PendingWaves.Num())
+    {
+        FPendingAgentWave& Wave = PendingWaves[WaveIndex];
+
+        if (!Wave.bPrepared)
+        {
+            if (BattleControl->HasLoadFailed(Wave.ConfigAsset.ToSoftObjectPath()))
+            {
+                UE_LOG(LogBattleFrame, Warning, TEXT("Agent config %s failed to load, wave dropped | 单位配置加载失败，丢弃该波次"), *Wave.ConfigAsset.ToString());
+                PendingWaves.RemoveAt(WaveIndex);
+                continue;
+            }
+
+            if (!BattleControl->RequestAgentConfig(Wave.ConfigAsset) || !PrepareWave(Wave))
+            {
+                ++WaveIndex;
+                continue;
+            }
+        }
+
+        const int32 Begin = SpawnedAgents.Num();
+        SpawnWaveSlice(Wave, TimeSlicedSpawnBatch, SpawnedAgents);
+
+        const bool bComplete = Wave.NextIndex >= Wave.Points.Num();
+        SpawnedSlices.Add({ Wave.WaveId, Begin, SpawnedAgents.Num(), bComplete });
+
+        if (bComplete)
+        {
+            PendingWaves.RemoveAt(WaveIndex);
+        }
+
+        if (FPlatformTime::Seconds() >= Deadline)
+        {
+            break;
+        }
+    }
+
+    // 遍历结束后再广播，回调中可以安全地排入新的波次 | broadcast once the queue is no longer iterated, so handlers may queue new waves
+    if (OnWaveSpawned.IsBound())
+    {
+        for (const FSpawnedSlice& Slice : SpawnedSlices)
+        {
+            const TArray<FSubjectHandle> Agents(SpawnedAgents.GetData() + Slice.Begin, Slice.End - Slice.Begin);
+            OnWaveSpawned.Broadcast(Slice.WaveId, Agents, Slice.bComplete);
+        }
+    }
+}
+
+int32 AAgentSpawner::GetPendingSpawnCount() const
+{
+    int32 Count = 0;
+
+    for (const FPendingAgentWave& Wave : PendingWaves)
+    {
+        Count += Wave.bPrepared ? Wave.Points.Num() - Wave.NextIndex : Wave.Quantity;
+    }
+
+    return Count;
+}
+
+int32 AAgentSpawner::GetLastWaveId() const
+{
+    return LastWaveId;
+}
+
 void AAgentSpawner::ActivateAgent( FSubjectHandle Agent )// strange apparatus bug : don't use get ref or the value may expire later when use
 {
     TRACE_CPUPROFILER_EVENT_SCOPE_STR("ActivateAgent");
@@ -460,9 +865,24 @@ void AAgentSpawner::ActivateAgent( FSubjectHandle Agent )// strange apparatus bu
     auto SubType = Agent.GetTrait<FSubType>();
     auto Avoidance = Agent.GetTrait<FAvoidance>();
 
-    Animation.AnimToTextureData = Animation.AnimToTextureDataAsset.LoadSynchronous(); // DataAsset Solid Pointer
+    // VAT数据仍在加载时先不激活，由Tick重试，没有战斗控制器时才同步加载 | while the VAT data is still loading the agent stays inactive and Tick retries it, it is only loaded synchronously without a battle control
+    if (BattleControl)
+    {
+        const FSoftObjectPath& AnimPath = Animation.AnimToTextureDataAsset.ToSoftObjectPath();
+        Animation.AnimToTextureData = Cast<UAnimToTextureDataAsset>(BattleControl->RequestSoftObject(AnimPath)); // DataAsset Solid Pointer
+
+        if (!Animation.AnimToTextureData && !AnimPath.IsNull() && !BattleControl->HasLoadFailed(AnimPath))
+        {
+            HeldAgents.Add(Agent);
+            return;
+        }
+    }
+    else
+    {
+        Animation.AnimToTextureData = Animation.AnimToTextureDataAsset.LoadSynchronous(); // DataAsset Solid Pointer
+    }
 
-    if (IsValid(Animation.AnimToTextureData))
+    if (IsValid(Animation.AnimToTextureData) && Animation.AnimLengthArray.IsEmpty())// bulk waves carry them on the prototype
     {
         for (FAnimToTextureAnimInfo CurrentAnim : Animation.AnimToTextureData->Animations)
         {
@@ -499,6 +919,12 @@ void AAgentSpawner::ActivateAgent( FSubjectHandle Agent )// strange apparatus bu
 
     Agent.SetTrait(FGridData{ Agent.CalcHash(), FVector3f(Located.Location), Collider.Radius * Scaled.Scale, Agent });
 
+    // 回收复用的单位保留原有网格记录，它的旧格子条目由网格自己清理 | a recycled agent keeps its grid record, the grid cleans up its old cell entry itself
+    if (!Agent.HasTrait<FGridOwner>())
+    {
+        Agent.SetTrait(FGridOwner());
+    }
+
     UBattleFrameFunctionLibraryRT::SetSubjectSubTypeTraitByIndex(SubType.Index, Agent);
     UBattleFrameFunctionLibraryRT::SetSubjectTeamTraitByIndex(FMath::Clamp(Team.index, 0, 9), Agent);
     UBattleFrameFunctionLibraryRT::SetSubjectAvoGroupTraitByIndex(FMath::Clamp(Avoidance.Group, 0, 9), Agent);
@@ -523,6 +949,7 @@ void AAgentSpawner::ActivateAgent( FSubjectHandle Agent )// strange apparatus bu
     }
 
     Agent.SetTrait(FActivated());
+    ++ABattleFrameBattleControl::AgentActivationVersion;
 }
 
 void AAgentSpawner::KillAllAgents()
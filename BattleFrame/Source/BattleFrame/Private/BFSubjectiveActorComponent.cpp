@@ -1,6 +1,7 @@
 #include "BFSubjectiveActorComponent.h"
 #include "Traits/Health.h"
 #include "Traits/GridData.h"
+#include "Traits/GridOwner.h"
 #include "Traits/Located.h"
 #include "Traits/Directed.h"
 #include "Traits/Scaled.h"
@@ -10,6 +11,7 @@
 #include "Traits/IsSubjective.h"
 #include "Traits/TemporalDamaging.h"
 #include "Traits/Slowing.h"
+#include "Traits/StatusEffects.h"
 
 UBFSubjectiveActorComponent::UBFSubjectiveActorComponent()
 {
@@ -62,9 +64,11 @@ void UBFSubjectiveActorComponent::InitializeTraits(AActor* OwnerActor)
 
     const auto SubjectHandle = GetHandle();
     SetTrait(FGridData{ SubjectHandle.CalcHash(), FVector3f(GetTrait<FLocated>().Location), GetTrait<FCollider>().Radius, SubjectHandle });
+    SetTrait(FGridOwner());
 
     SetTrait(FTemporalDamaging());
     SetTrait(FSlowing());
+    SetTrait(FStatusEffects());
     SetTrait(FIsSubjective());
     SetTrait(FActivated());
 }
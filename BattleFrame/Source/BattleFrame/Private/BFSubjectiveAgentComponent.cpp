@@ -1,6 +1,7 @@
 #include "BFSubjectiveAgentComponent.h"
 #include "Traits/Health.h"
 #include "Traits/GridData.h"
+#include "Traits/GridOwner.h"
 #include "Traits/Located.h"
 #include "Traits/Directed.h"
 #include "Traits/Scaled.h"
@@ -10,6 +11,7 @@
 #include "Traits/IsSubjective.h"
 #include "Traits/TemporalDamaging.h"
 #include "Traits/Slowing.h"
+#include "Traits/StatusEffects.h"
 #include "Traits/Damage.h"
 #include "Traits/SubType.h"
 #include "Traits/Agent.h"
@@ -114,9 +116,11 @@ void UBFSubjectiveAgentComponent::InitializeTraits(AActor* OwnerActor)
     AgentConfig.SetTrait(DataAsset->Curves);
     AgentConfig.SetTrait(FTemporalDamaging());
     AgentConfig.SetTrait(FSlowing());
+    AgentConfig.SetTrait(FStatusEffects());
     AgentConfig.SetTrait(DataAsset->Statistics);
     AgentConfig.SetTrait(FIsSubjective());
     AgentConfig.SetTrait(FActivated());
+    ++ABattleFrameBattleControl::AgentActivationVersion;
 
     // Apply Multipliers
     auto& Health = AgentConfig.GetTraitRef<FHealth>();
@@ -213,6 +217,7 @@ void UBFSubjectiveAgentComponent::InitializeTraits(AActor* OwnerActor)
     UBattleFrameFunctionLibraryRT::SetRecordAvoGroupTraitByIndex(FMath::Clamp(Avoidance.Group, 0, 9), AgentConfig);
 
     AgentConfig.SetTrait(FGridData{ this->GetHandle().CalcHash(), FVector3f(Located.Location), Collider.Radius * Scaled.Scale, this->GetHandle() });
+    AgentConfig.SetTrait(FGridOwner());
 
     this->GetHandle()->SetTraits(AgentConfig);
 
@@ -8,6 +8,8 @@
 
 #define LOCTEXT_NAMESPACE "FBattleFrameModule"
 
+DEFINE_LOG_CATEGORY(LogBattleFrame);
+
 void FBattleFrameModule::StartupModule()
 {
 	// This code will execute after your module is loaded into memory; the exact timing is specified in the .uplugin file per-module
@@ -5,7 +5,10 @@
 */
 
 #include "BattleFrameBattleControl.h"
+#include "BattleFrame.h"
+#include "AgentConfigDataAsset.h"
 #include "Kismet/GameplayStatics.h"
+#include "Camera/PlayerCameraManager.h"
 #include "EngineUtils.h"
 #include "DrawDebugHelpers.h"
 
@@ -21,12 +24,150 @@
 // BattleFrame 插件
 #include "NeighborGridActor.h"
 #include "NeighborGridComponent.h"
+#include "RVOAgentLines.h"
 
 #include "BattleFrameInterface.h"
 
+#include "ProfilingDebugging/CountersTrace.h"
+#include "ProfilingDebugging/CsvProfiler.h"
+#include "Algo/Sort.h"
+#include "Algo/StableSort.h"
+#include "BattleFrameStageTuner.h"
+#include "BattleFrameStats.h"
+#include <atomic>
+#include <algorithm>
+
 
 
 ABattleFrameBattleControl* ABattleFrameBattleControl::Instance = nullptr;
+std::atomic<uint32> ABattleFrameBattleControl::AgentActivationVersion{ 0 };
+
+// 避障阶段的堆分配计数，在Insights中查看，稳定状态下应为0 | Heap allocations made by the avoidance pass, should read 0 in steady state
+TRACE_DECLARE_INT_COUNTER(BattleFrame_AvoidHeapAllocations, TEXT("BattleFrame/AvoidHeapAllocations"));
+static std::atomic<int32> GAvoidHeapAllocations{ 0 };
+
+// 本帧因预算顺延到下一帧的索敌请求数 | Trace requests carried over to the next frame by the trace budget
+TRACE_DECLARE_INT_COUNTER(BattleFrame_TracesDeferred, TEXT("BattleFrame/TracesDeferred"));
+
+// 本帧提交的调试线数，以及超过上限被丢弃的调试图形数 | Debug lines submitted this frame, and debug shapes dropped past the cap
+TRACE_DECLARE_INT_COUNTER(BattleFrame_DebugLines, TEXT("BattleFrame/DebugLines"));
+TRACE_DECLARE_INT_COUNTER(BattleFrame_DebugShapesDropped, TEXT("BattleFrame/DebugShapesDropped"));
+
+// 每个工作线程一份的避障临时缓存，容量跨帧保留，每个单位开始时只清空不释放 | Per worker scratch for the avoidance pass
+struct FAvoidanceScratch
+{
+	TArray<FGridData> SubjectNeighbors;
+	TArray<uint32> SeenHashes;
+	TArray<FGridData> SphereObstacleNeighbors;
+	TArray<FObstacleSegment> ObstacleSegments;
+
+	FORCEINLINE SIZE_T GetAllocatedSize() const
+	{
+		return SubjectNeighbors.GetAllocatedSize() + SeenHashes.GetAllocatedSize() + SphereObstacleNeighbors.GetAllocatedSize() + ObstacleSegments.GetAllocatedSize();
+	}
+};
+
+static thread_local FAvoidanceScratch GAvoidanceScratch;
+
+/*
+ * 按接收Actor分组派发缓冲的事件 | Deliver buffered events grouped by receiving actor.
+ * Actors implementing IBattleFrameBatchInterface get one call with all of their events, in the order they were buffered,
+ * actors implementing only IBattleFrameInterface get one call per event. Game thread only.
+ */
+template<typename DataType, typename SingleType, typename BatchType>
+static void DispatchEvents(TBattleFrameEventBuffer<DataType>& Buffer, SingleType&& ExecuteSingle, BatchType&& ExecuteBatch)
+{
+	static TArray<DataType> Events;
+	static TArray<DataType> Batch;
+	static TArray<TPair<AActor*, int32>> Receivers;
+
+	Events.Reset();
+	Buffer.Flush(Events);
+
+	if (Events.IsEmpty()) return;
+
+	Receivers.Reset();
+
+	for (int32 i = 0; i < Events.Num(); ++i)
+	{
+		const FSubjectHandle& Subject = Events[i].SelfSubject;
+		if (!Subject.IsValid()) continue;
+
+		const auto Subjective = Subject.GetSubjective();
+		AActor* Actor = Subjective ? Subjective->GetActor() : nullptr;
+
+		if (Actor)
+		{
+			Receivers.Emplace(Actor, i);
+		}
+	}
+
+	// 稳定排序，同一Actor的事件保持缓冲顺序 | stable, so each actor sees its events in buffered order
+	Algo::StableSortBy(Receivers, [](const TPair<AActor*, int32>& Receiver) { return Receiver.Key; });
+
+	for (int32 Start = 0; Start < Receivers.Num();)
+	{
+		AActor* Actor = Receivers[Start].Key;
+		int32 End = Start + 1;
+
+		while (End < Receivers.Num() && Receivers[End].Key == Actor)
+		{
+			++End;
+		}
+
+		// 之前的回调可能已销毁此Actor | an earlier callback may have destroyed it
+		if (IsValid(Actor))
+		{
+			UClass* ActorClass = Actor->GetClass();
+
+			if (ActorClass->ImplementsInterface(UBattleFrameBatchInterface::StaticClass()))
+			{
+				Batch.Reset();
+
+				for (int32 i = Start; i < End; ++i)
+				{
+					Batch.Add(Events[Receivers[i].Value]);
+				}
+
+				ExecuteBatch(Actor, Batch);
+			}
+			else if (ActorClass->ImplementsInterface(UBattleFrameInterface::StaticClass()))
+			{
+				for (int32 i = Start; i < End; ++i)
+				{
+					ExecuteSingle(Actor, Events[Receivers[i].Value]);
+				}
+			}
+		}
+
+		Start = End;
+	}
+}
+
+// 各阶段选取的线程数、批次与实测单个成本，用 csvprofile 采集 | Per stage threads, batch and measured cost, captured by csvprofile
+CSV_DEFINE_CATEGORY(BattleFrameTuner, true);
+
+DECLARE_DWORD_COUNTER_STAT(TEXT("Agents"), STAT_BattleFrame_Agents, STATGROUP_BattleFrame);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Neighbors Examined"), STAT_BattleFrame_NeighborsExamined, STATGROUP_BattleFrame);
+DECLARE_DWORD_COUNTER_STAT(TEXT("ORCA Lines Built"), STAT_BattleFrame_OrcaLinesBuilt, STATGROUP_BattleFrame);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Traces Issued"), STAT_BattleFrame_TracesIssued, STATGROUP_BattleFrame);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Damage Events"), STAT_BattleFrame_DamageEvents, STATGROUP_BattleFrame);
+
+#if !UE_BUILD_SHIPPING
+static FAutoConsoleCommand GDumpStageTuningCommand(
+	TEXT("BattleFrame.Tuner.Dump"),
+	TEXT("Log the threads count, batch size and measured cost per item the adaptive tuner picked for each stage, next to the fixed batch baseline."),
+	FConsoleCommandDelegate::CreateLambda([]()
+	{
+		if (!ABattleFrameBattleControl::Instance) return;
+
+		ABattleFrameBattleControl::Instance->StageTuner.ForEachStage([](const FBattleFrameStageTuning& Tuning)
+		{
+			UE_LOG(LogTemp, Log, TEXT("%-24s Items=%-7d Threads=%-3d Baseline=%-3d Batch=%-7d Cost=%.1f ns/item Last=%.3f ms"),
+				*Tuning.Name.ToString(), Tuning.ItemsCount, Tuning.ThreadsCount, Tuning.BaselineThreadsCount, Tuning.BatchSize, Tuning.SecondsPerItem * 1e9, Tuning.LastSeconds * 1e3);
+		});
+	}));
+#endif
 
 void ABattleFrameBattleControl::BeginPlay()
 {
@@ -49,16 +190,25 @@ void ABattleFrameBattleControl::Tick(float DeltaTime)
 	{
 		Mechanism = UMachine::ObtainMechanism(CurrentWorld);
 
-		NeighborGrids.Reset(); // to do : add in multiple grid support
-
-		for (TActorIterator<ANeighborGridActor> It(CurrentWorld); It; ++It)
+		// 网格列表只在网格增删时重建 | the grid list is rebuilt only when a grid begins or ends play
+		if (UNLIKELY(NeighborGridsVersion != UNeighborGridComponent::GridListVersion))
 		{
-			NeighborGrids.Add(It->GetComponent());
+			NeighborGridsVersion = UNeighborGridComponent::GridListVersion;
+			NeighborGrids.Reset();
+
+			for (TActorIterator<ANeighborGridActor> It(CurrentWorld); It; ++It)
+			{
+				if (UNeighborGridComponent* Grid = It->GetComponent())
+				{
+					NeighborGrids.Add(Grid);
+				}
+			}
 		}
 
 		if (UNLIKELY(!bIsFilterReady))
 		{
 			DefineFilters();
+			DefineStageGraphs();
 		}
 	}
 
@@ -66,6 +216,57 @@ void ABattleFrameBattleControl::Tick(float DeltaTime)
 
 	float SafeDeltaTime = FMath::Clamp(DeltaTime, 0, 0.0333f);
 
+	StageTuner.bEnabled = bAdaptiveBatching;
+
+
+	//------------------数据统计 | Statistics---------------------
+
+	// 上一帧的计数与各阶段耗时 | Last frame's counters and stage timings
+	PublishFrameStats();
+
+	FBattleFrameStageTuner::FScope TickTiming(StageTuner, TEXT("BattleControlTick"));
+
+	// 推进模拟 | Advance Simulation
+	#pragma region
+	{
+		if (bFixedTimeStep)
+		{
+			// 固定步长，每帧可跑零到多步，超过上限的欠账直接丢弃以免越追越慢 | Fixed step, zero or more per frame, debt beyond the cap is dropped so a slow frame cannot snowball
+			const float StepTime = 1.f / FMath::Max(FixedStepRate, 1.f);
+			const int32 MaxSteps = FMath::Max(MaxStepsPerFrame, 1);
+
+			SimAccumulator += FMath::Max(DeltaTime, 0.f);
+
+			int32 Steps = 0;
+
+			while (SimAccumulator >= StepTime && Steps < MaxSteps)
+			{
+				SnapshotRenderState();
+				SimulateStep(StepTime, StepTime);
+				SimAccumulator -= StepTime;
+				++Steps;
+			}
+
+			SimAccumulator = FMath::Min(SimAccumulator, StepTime);
+			RenderAlpha = FMath::Clamp(SimAccumulator / StepTime, 0.f, 1.f);
+		}
+		else
+		{
+			SimAccumulator = 0.f;
+			RenderAlpha = 1.f;
+			SimulateStep(DeltaTime, SafeDeltaTime);
+		}
+	}
+	#pragma endregion
+
+	RenderFrame(SafeDeltaTime);
+}
+
+void ABattleFrameBattleControl::SimulateStep(float DeltaTime, float SafeDeltaTime)
+{
+	TRACE_CPUPROFILER_EVENT_SCOPE_STR("BattleControlSimulateStep");
+
+	++SimStepCount;
 
 	//------------------数据统计 | Statistics---------------------
 
@@ -86,7 +287,7 @@ void ABattleFrameBattleControl::Tick(float DeltaTime)
 		TRACE_CPUPROFILER_EVENT_SCOPE_STR("Agent Statistics");
 
 		auto Chain = Mechanism->EnchainSolid(AgentStatFilter);
-		UBattleFrameFunctionLibraryRT::CalculateThreadsCountAndBatchSize(Chain->IterableNum(), MaxThreadsAllowed, MinBatchSizeAllowed, ThreadsCount, BatchSize);
+		FBattleFrameStageTuner::FScope StageTuning(StageTuner, TEXT("Agent Statistics"), Chain->IterableNum(), MaxThreadsAllowed, MinBatchSizeAllowed, ThreadsCount, BatchSize);
 
 		Chain->OperateConcurrently([&](FSolidSubjectHandle Subject, FStatistics& Stats)
 		{
@@ -130,7 +331,7 @@ void ABattleFrameBattleControl::Tick(float DeltaTime)
 		TRACE_CPUPROFILER_EVENT_SCOPE_STR("AgentAppearMain");
 
 		auto Chain = Mechanism->EnchainSolid(AgentAppeaFilter);
-		UBattleFrameFunctionLibraryRT::CalculateThreadsCountAndBatchSize(Chain->IterableNum(), MaxThreadsAllowed, MinBatchSizeAllowed, ThreadsCount, BatchSize);
+		FBattleFrameStageTuner::FScope StageTuning(StageTuner, TEXT("AgentAppearMain"), Chain->IterableNum(), MaxThreadsAllowed, MinBatchSizeAllowed, ThreadsCount, BatchSize);
 
 		Chain->OperateConcurrently(
 			[&](FSolidSubjectHandle Subject,
@@ -223,67 +424,10 @@ void ABattleFrameBattleControl::Tick(float DeltaTime)
 	}
 	#pragma endregion
 
-	// 出生动画 | Birth Anim
-	#pragma region
-	{
-		TRACE_CPUPROFILER_EVENT_SCOPE_STR("AgentAppearAnim");
-
-		auto Chain = Mechanism->EnchainSolid(AgentAppearAnimFilter);
-		UBattleFrameFunctionLibraryRT::CalculateThreadsCountAndBatchSize(Chain->IterableNum(), MaxThreadsAllowed, MinBatchSizeAllowed, ThreadsCount, BatchSize);
-
-		Chain->OperateConcurrently(
-			[&](FSolidSubjectHandle Subject,
-				FAnimation& Animation,
-				FAppear& Appear,
-				FAppearAnim& AppearAnim)
-			{
-				if (AppearAnim.animTime == 0)
-				{
-					// 状态机
-					Animation.SubjectState = ESubjectState::Appearing;
-					Animation.PreviousSubjectState = ESubjectState::Dirty;
-				}
-				
-				if (AppearAnim.animTime >= Appear.Duration)
-				{
-					Subject.RemoveTraitDeferred<FAppearAnim>();
-				}
-
-				AppearAnim.animTime += SafeDeltaTime;
-
-			}, ThreadsCount, BatchSize);
-	}
-	#pragma endregion
-
-	// 出生淡入 | Dissolve In
+	// 出生表现，按读写集合并行 | Appear visuals, run as a stage graph
 	#pragma region
 	{
-		TRACE_CPUPROFILER_EVENT_SCOPE_STR("AgentAppearDissolve");
-
-		auto Chain = Mechanism->EnchainSolid(AgentAppearDissolveFilter);
-		UBattleFrameFunctionLibraryRT::CalculateThreadsCountAndBatchSize(Chain->IterableNum(), MaxThreadsAllowed, MinBatchSizeAllowed, ThreadsCount, BatchSize);
-
-		Chain->OperateConcurrently(
-			[&](FSolidSubjectHandle Subject,
-				FAnimation& Animation,
-				FAppearDissolve& AppearDissolve,
-				FCurves& Curves)
-			{
-				auto Curve = Curves.DissolveIn.GetRichCurve();
-
-				if (!Curve || Curve->GetNumKeys() == 0) return;
-
-				const auto EndTime = Curve->GetLastKey().Time;
-				Animation.Dissolve = 1 - Curve->Eval(FMath::Clamp(AppearDissolve.dissolveTime, 0, EndTime));
-
-				if (AppearDissolve.dissolveTime > EndTime)
-				{
-					Subject.RemoveTraitDeferred<FAppearDissolve>();
-				}
-
-				AppearDissolve.dissolveTime += SafeDeltaTime;
-
-			}, ThreadsCount, BatchSize);
+		AppearStages.Run(FBattleFrameStageContext{ Mechanism, SafeDeltaTime, MaxThreadsAllowed, MinBatchSizeAllowed }, bParallelStages);
 	}
 	#pragma endregion
 
@@ -321,54 +465,94 @@ void ABattleFrameBattleControl::Tick(float DeltaTime)
 
 		// Trace By Filter
 		auto Chain = Mechanism->EnchainSolid(AgentTraceFilter);
-		UBattleFrameFunctionLibraryRT::CalculateThreadsCountAndBatchSize(Chain->IterableNum(), MaxThreadsAllowed, 200, ThreadsCount, BatchSize);
 
-		TArray<FValidSubjects> ValidSubjectsArray;
-		ValidSubjectsArray.SetNum(ThreadsCount);
+		// 每个需要索敌的单位占一格，用原子游标压实，无锁 | One slot per agent due for a trace, compacted through an atomic cursor with no lock
+		TraceRequests.SetNumUninitialized(Chain->IterableNum());
+		std::atomic<int32> TraceRequestsNum{ 0 };
+
+		// 只计收集这一遍，索敌本身不按这里的线程数执行 | times the gather pass only, the traces below are not split by these threads
+		FBattleFrameStageTuner::FScope StageTuning(StageTuner, TEXT("AgentTrace"), Chain->IterableNum(), MaxThreadsAllowed, 200, ThreadsCount, BatchSize);
 
 		// Gather all agent that need to do tracing
-		Chain->OperateConcurrently([&](FSolidSubjectHandle Subject, FLocated& Located, FTrace& Trace, FTracing& Tracing, FMoving& Moving)
+		auto GatherAgent = [&](auto Subject, FLocated& Located, FTrace& Trace, FTracing& Tracing, FMoving& Moving)
 			{
-				bool bShouldTrace = false;
+				// Decide which cooldown to use, chasing agents are served first when over budget
+				float CoolDown = 0;
+				uint8 Priority = 1;
 
-				if (Tracing.TimeLeft <= 0)
+				switch (Moving.MoveState)
 				{
-					// Decide which cooldown to use
-					float CoolDown = 0;
+				case EMoveState::Sleeping: // 休眠时索敌
+					CoolDown = Trace.SectorTrace.Sleep.CoolDown;
+					Priority = 2;
+					break;
 
-					switch (Moving.MoveState)
-					{
-					case EMoveState::Sleeping: // 休眠时索敌
-						CoolDown = Trace.SectorTrace.Sleep.CoolDown;
-						break;
+				case EMoveState::Patrolling: // 巡逻时索敌
+					CoolDown = Trace.SectorTrace.Patrol.CoolDown;
+					break;
 
-					case EMoveState::Patrolling: // 巡逻时索敌
-						CoolDown = Trace.SectorTrace.Patrol.CoolDown;
-						break;
+				case EMoveState::PatrolWaiting: // 巡逻时索敌
+					CoolDown = Trace.SectorTrace.Patrol.CoolDown;
+					break;
 
-					case EMoveState::PatrolWaiting: // 巡逻时索敌
-						CoolDown = Trace.SectorTrace.Patrol.CoolDown;
-						break;
+				case EMoveState::ChasingTarget: // 追逐时索敌
+					CoolDown = Trace.SectorTrace.Chase.CoolDown;
+					Priority = 0;
+					break;
 
-					case EMoveState::ChasingTarget: // 追逐时索敌
-						CoolDown = Trace.SectorTrace.Chase.CoolDown;
-						break;
+				case EMoveState::ReachedTarget: // 追逐时索敌
+					CoolDown = Trace.SectorTrace.Chase.CoolDown;
+					Priority = 0;
+					break;
 
-					case EMoveState::ReachedTarget: // 追逐时索敌
-						CoolDown = Trace.SectorTrace.Chase.CoolDown;
-						break;
+				case EMoveState::MovingToLocation: // 一般情况
+					CoolDown = Trace.SectorTrace.Common.CoolDown;
+					break;
 
-					case EMoveState::MovingToLocation: // 一般情况
-						CoolDown = Trace.SectorTrace.Common.CoolDown;
-						break;
+				case EMoveState::ArrivedAtLocation: // 一般情况
+					CoolDown = Trace.SectorTrace.Common.CoolDown;
+					break;
+				}
 
-					case EMoveState::ArrivedAtLocation: // 一般情况
-						CoolDown = Trace.SectorTrace.Common.CoolDown;
-						break;
+				// 首次见到的单位把相位散开到一个冷却内，同批生成的单位不会同帧索敌 | Spread the first trace over one cooldown, so agents spawned together do not all trace on one frame
+				if (UNLIKELY(!Tracing.bPhaseStaggered))
+				{
+					Tracing.bPhaseStaggered = true;
+
+					if (bStaggerTracePhase)
+					{
+						const float Phase = static_cast<float>((Subject.CalcHash() * 2654435761u) >> 8) / static_cast<float>(1 << 24);
+						Tracing.TimeLeft = CoolDown * Phase;
+					}
+				}
+
+				if (Tracing.TimeLeft <= 0)
+				{
+					// Trace Event Begin, once per cooldown, a request carried over to later frames does not begin again
+					if (Tracing.PendingTime == 0.f && Subject.HasTrait<FIsSubjective>())
+					{
+						FTraceData TraceData;
+						TraceData.SelfSubject = FSubjectHandle(Subject);
+						TraceData.State = ETraceEventState::Begin;
+						OnTraceQueue.Enqueue(TraceData);
 					}
 
-					Tracing.TimeLeft = CoolDown;
-					bShouldTrace = true;
+					if (Trace.bEnable)
+					{
+						// 冷却在真正执行时才重置，未排上的请求下一帧继续排队 | Cooldown restarts when the trace is served, unserved requests queue again next frame
+						const int32 RequestIndex = TraceRequestsNum.fetch_add(1, std::memory_order_relaxed);
+
+						if (LIKELY(RequestIndex < TraceRequests.Num()))
+						{
+							TraceRequests[RequestIndex] = FTraceRequest{ FSubjectHandle(Subject), CoolDown, Tracing.PendingTime, Priority };
+						}
+
+						Tracing.PendingTime += SafeDeltaTime;
+					}
+					else
+					{
+						Tracing.TimeLeft = CoolDown;
+					}
 				}
 				else
 				{
@@ -398,44 +582,66 @@ void ABattleFrameBattleControl::Tick(float DeltaTime)
 					}
 				}
 
-				if (bShouldTrace)// we add iterables into separate arrays and then apend them.
-				{
-					if (Trace.bEnable)
-					{
-						uint32 ThreadId = FPlatformTLS::GetCurrentThreadId();
-						uint32 index = ThreadId % ThreadsCount;// this may not evenly distribute, but well enough
+			};
 
-						if (LIKELY(ValidSubjectsArray.IsValidIndex(index)))
-						{
-							ValidSubjectsArray[index].Lock();// we lock child arrays individually
-							ValidSubjectsArray[index].Subjects.Add(Subject);
-							ValidSubjectsArray[index].Unlock();
-						}
-					}
+		// 与避障相同按Z序分段收集，Z序过期时按存储顺序 | gather in the same Z-order runs as avoidance, storage order while the Z-order is out of date
+		if (SpatialSortInterval > 0 && !bTraceOutsideSpatialOrder && SpatialOrderVersion == AgentActivationVersion.load(std::memory_order_relaxed))
+		{
+			const int32 NumVisited = ForEachInSpatialOrder(AgentTraceFilter, ThreadsCount, [&](const FSubjectHandle& Agent)
+			{
+				GatherAgent(Agent,
+					*Agent.GetTraitPtr<FLocated, EParadigm::Unsafe>(),
+					*Agent.GetTraitPtr<FTrace, EParadigm::Unsafe>(),
+					*Agent.GetTraitPtr<FTracing, EParadigm::Unsafe>(),
+					*Agent.GetTraitPtr<FMoving, EParadigm::Unsafe>());
+			});
 
-					// Trace Event Begin
-					if (Subject.HasTrait<FIsSubjective>())
-					{
-						FTraceData TraceData;
-						TraceData.SelfSubject = FSubjectHandle(Subject);
-						TraceData.State = ETraceEventState::Begin;
-						OnTraceQueue.Enqueue(TraceData);
-					}
-				}
+			// 索敌单位不全在避障集合里时，此后一直按存储顺序收集 | some tracing agent lies outside the avoidance filter, keep storage order from now on
+			bTraceOutsideSpatialOrder = NumVisited != Chain->IterableNum();
+		}
+		else
+		{
+			Chain->OperateConcurrently([&](FSolidSubjectHandle Subject, FLocated& Located, FTrace& Trace, FTracing& Tracing, FMoving& Moving)
+				{
+					GatherAgent(Subject, Located, Trace, Tracing, Moving);
 
-			}, ThreadsCount, BatchSize);
+				}, ThreadsCount, BatchSize);
+		}
+
+		StageTuning.Stop();
 
-		TArray<FSolidSubjectHandle> ValidSubjects;
+		const int32 NumTraceRequests = FMath::Min(TraceRequestsNum.load(), TraceRequests.Num());
+		int32 NumTracesServed = NumTraceRequests;
 
-		for (auto& CurrentArray : ValidSubjectsArray)
+		// 超出预算时只执行优先级最高的一部分，等待时间会抬高优先级 | Over budget, serve the highest priority requests only, waiting raises a request's priority
+		if (TraceBudget > 0 && NumTraceRequests > TraceBudget)
 		{
-			ValidSubjects.Append(CurrentArray.Subjects);
+			NumTracesServed = TraceBudget;
+
+			const float AgingRate = 1.f / FMath::Max(TraceAgingTime, 0.01f);
+
+			for (int32 Index = 0; Index < NumTraceRequests; ++Index)
+			{
+				FTraceRequest& Request = TraceRequests[Index];
+				Request.Score = Request.Priority - Request.Waited * AgingRate;
+			}
+
+			std::nth_element(TraceRequests.GetData(), TraceRequests.GetData() + NumTracesServed, TraceRequests.GetData() + NumTraceRequests, [](const FTraceRequest& A, const FTraceRequest& B)
+				{
+					return A.Score != B.Score ? A.Score < B.Score : A.Waited > B.Waited;
+				});
 		}
 
+		FBattleFrameCounters::Add(EBattleFrameCounter::TracesIssued, NumTracesServed);
+		TRACE_COUNTER_SET(BattleFrame_TracesDeferred, NumTraceRequests - NumTracesServed);
+
+		FBattleFrameStageTuner::FScope TraceTiming(StageTuner, TEXT("AgentTraceServe"));
+
 		// Do Trace
-		ParallelFor(ValidSubjects.Num(), [&](int32 Index)
+		ParallelFor(NumTracesServed, [&](int32 Index)
 			{
-				FSolidSubjectHandle Subject = ValidSubjects[Index];
+				const FTraceRequest& Request = TraceRequests[Index];
+				FSubjectHandle Subject = Request.Subject;
 
 				FLocated& Located = Subject.GetTraitRef<FLocated>();
 				FDirected& Directed = Subject.GetTraitRef<FDirected>();
@@ -444,6 +650,8 @@ void ABattleFrameBattleControl::Tick(float DeltaTime)
 
 				FTrace& Trace = Subject.GetTraitRef<FTrace>();
 				FTracing& Tracing = Subject.GetTraitRef<FTracing>();
+				Tracing.TimeLeft = Request.CoolDown;
+				Tracing.PendingTime = 0.f;
 				FSleep& Sleep = Subject.GetTraitRef<FSleep>();
 				FPatrol& Patrol = Subject.GetTraitRef<FPatrol>();
 				FChase& Chase = Subject.GetTraitRef<FChase>();
@@ -743,13 +951,114 @@ void ABattleFrameBattleControl::Tick(float DeltaTime)
 
 	//-----------------------移动 | Move------------------------
 
+	// 解析流场 | Resolve Flow Fields
+	#pragma region
+	{
+		TRACE_CPUPROFILER_EVENT_SCOPE_STR("ResolveFlowFields");
+		ResolveFlowFields();
+	}
+	#pragma endregion
+
+	// 模拟LOD | Simulation LOD
+	#pragma region
+	{
+		TRACE_CPUPROFILER_EVENT_SCOPE_STR("AgentSimLOD");
+
+		// 以玩家角色为中心，没有角色时用相机 | centered on the player pawn, the camera when there is none
+		bool bHasOrigin = false;
+		FVector Origin = FVector::ZeroVector;
+
+		if (bSimLOD && !SimLODLevels.IsEmpty())
+		{
+			if (const APawn* PlayerPawn = UGameplayStatics::GetPlayerPawn(CurrentWorld, 0))
+			{
+				Origin = PlayerPawn->GetActorLocation();
+				bHasOrigin = true;
+			}
+			else if (const APlayerCameraManager* CameraManager = UGameplayStatics::GetPlayerCameraManager(CurrentWorld, 0))
+			{
+				Origin = CameraManager->GetCameraLocation();
+				bHasOrigin = true;
+			}
+		}
+
+		// 关闭后再跑一遍，把所有单位恢复到全速 | once more after turning off, to put every agent back to full rate
+		if (bHasOrigin || bSimLODActive)
+		{
+			bSimLODActive = bHasOrigin;
+
+			auto Chain = Mechanism->EnchainSolid(AgentSimLODFilter);
+			FBattleFrameStageTuner::FScope StageTuning(StageTuner, TEXT("AgentSimLOD"), Chain->IterableNum(), MaxThreadsAllowed, MinBatchSizeAllowed, ThreadsCount, BatchSize);
+
+			Chain->OperateConcurrently([&](FAgent& Agent, FLocated& Located)
+			{
+				int32 Level = 0;
+
+				if (bHasOrigin)
+				{
+					const float DistSqr = FVector::DistSquared(Located.Location, Origin);
+					float LevelMinDistance = -1.f;
+
+					// 取满足距离的最远一级，不依赖数组顺序 | take the farthest level the distance reaches, whatever the array order
+					for (int32 i = 0; i < SimLODLevels.Num(); ++i)
+					{
+						const float MinDistance = SimLODLevels[i].MinDistance;
+
+						if (MinDistance > LevelMinDistance && DistSqr >= FMath::Square(MinDistance))
+						{
+							LevelMinDistance = MinDistance;
+							Level = i + 1;
+						}
+					}
+				}
+
+				if (Level == 0)
+				{
+					// 关闭时不再有后续帧清零，补偿时间直接丢弃 | when turning off no later step clears it, so the catch up is dropped
+					Agent.SimLODLevel = 0;
+					Agent.bSimUpdate = true;
+					Agent.bSimSkipCosmetics = false;
+					Agent.SimCatchUpTime = bHasOrigin ? Agent.SimSkippedTime : 0.f;
+					Agent.SimSkippedTime = 0.f;
+					return;
+				}
+
+				const FSimLODLevel& LODLevel = SimLODLevels[Level - 1];
+				const uint32 Interval = static_cast<uint32>(FMath::Max(LODLevel.UpdateInterval, 1));
+
+				// 每个单位分到固定的轮转槽位，同一层每帧只有1/N的单位更新 | each agent owns a fixed round robin slot, so a level updates 1/N of its agents every frame
+				if (Agent.SimLODPhase == INDEX_NONE)
+				{
+					Agent.SimLODPhase = static_cast<int32>(SimLODPhaseCounter.fetch_add(1, std::memory_order_relaxed) & 0x7FFFFFFF);
+				}
+
+				Agent.SimLODLevel = Level;
+				Agent.bSimSkipCosmetics = LODLevel.bSkipCosmetics;
+				Agent.bSimUpdate = (static_cast<uint32>(Agent.SimLODPhase) + SimStepCount) % Interval == 0;
+
+				if (Agent.bSimUpdate)
+				{
+					Agent.SimCatchUpTime = Agent.SimSkippedTime;
+					Agent.SimSkippedTime = 0.f;
+				}
+				else
+				{
+					Agent.SimCatchUpTime = 0.f;
+					Agent.SimSkippedTime += SafeDeltaTime;
+				}
+
+			}, ThreadsCount, BatchSize);
+		}
+	}
+	#pragma endregion
+
 	// 休眠 | Sleep
 	#pragma region
 	{
 		TRACE_CPUPROFILER_EVENT_SCOPE_STR("AgentSleep");
 
 		auto Chain = Mechanism->EnchainSolid(AgentSleepFilter);
-		UBattleFrameFunctionLibraryRT::CalculateThreadsCountAndBatchSize(Chain->IterableNum(), MaxThreadsAllowed, MinBatchSizeAllowed, ThreadsCount, BatchSize);
+		FBattleFrameStageTuner::FScope StageTuning(StageTuner, TEXT("AgentSleep"), Chain->IterableNum(), MaxThreadsAllowed, MinBatchSizeAllowed, ThreadsCount, BatchSize);
 
 		Chain->OperateConcurrently(
 			[&](FSolidSubjectHandle Subject,
@@ -781,7 +1090,7 @@ void ABattleFrameBattleControl::Tick(float DeltaTime)
 		TRACE_CPUPROFILER_EVENT_SCOPE_STR("AgentPatrol");
 
 		auto Chain = Mechanism->EnchainSolid(AgentPatrolFilter);
-		UBattleFrameFunctionLibraryRT::CalculateThreadsCountAndBatchSize(Chain->IterableNum(), MaxThreadsAllowed, MinBatchSizeAllowed, ThreadsCount, BatchSize);
+		FBattleFrameStageTuner::FScope StageTuning(StageTuner, TEXT("AgentPatrol"), Chain->IterableNum(), MaxThreadsAllowed, MinBatchSizeAllowed, ThreadsCount, BatchSize);
 
 		Chain->OperateConcurrently(
 			[&](FSolidSubjectHandle Subject,
@@ -847,7 +1156,7 @@ void ABattleFrameBattleControl::Tick(float DeltaTime)
 		TRACE_CPUPROFILER_EVENT_SCOPE_STR("SpeedLimitOverride");
 
 		auto Chain = Mechanism->EnchainSolid(SpeedLimitOverrideFilter);
-		UBattleFrameFunctionLibraryRT::CalculateThreadsCountAndBatchSize(Chain->IterableNum(), MaxThreadsAllowed, MinBatchSizeAllowed, ThreadsCount, BatchSize);
+		FBattleFrameStageTuner::FScope StageTuning(StageTuner, TEXT("SpeedLimitOverride"), Chain->IterableNum(), MaxThreadsAllowed, MinBatchSizeAllowed, ThreadsCount, BatchSize);
 
 		Chain->OperateConcurrently(
 			[&](FCollider Collider,
@@ -923,10 +1232,11 @@ void ABattleFrameBattleControl::Tick(float DeltaTime)
 	{
 		TRACE_CPUPROFILER_EVENT_SCOPE_STR("AgentMove");
 		auto Chain = Mechanism->EnchainSolid(AgentMoveFilter);
-		UBattleFrameFunctionLibraryRT::CalculateThreadsCountAndBatchSize(Chain->IterableNum(), MaxThreadsAllowed, MinBatchSizeAllowed, ThreadsCount, BatchSize);
+		FBattleFrameStageTuner::FScope StageTuning(StageTuner, TEXT("AgentMove"), Chain->IterableNum(), MaxThreadsAllowed, MinBatchSizeAllowed, ThreadsCount, BatchSize);
 
 		Chain->OperateConcurrently(
 			[&](FSolidSubjectHandle Subject,
+				FAgent& Agent,
 				FLocated& Located,
 				FDirected& Directed,
 				FScaled& Scaled,
@@ -941,6 +1251,12 @@ void ABattleFrameBattleControl::Tick(float DeltaTime)
 				FDefence& Defence,
 				FSlowing& Slowing)
 			{
+				// 远处的单位轮到才更新，并补上跳过的时间 | far agents only update on their turn, catching up on the skipped time
+				if (!Agent.bSimUpdate) return;
+
+				const float AgentSafeDeltaTime = SafeDeltaTime + Agent.SimCatchUpTime;
+				const float AgentDeltaTime = DeltaTime + Agent.SimCatchUpTime;
+
 				// 死亡区域检测			
 				if (Located.Location.Z < Move.Z.KillZ)
 				{
@@ -958,11 +1274,8 @@ void ABattleFrameBattleControl::Tick(float DeltaTime)
 					return;
 				}
 
-				if (Navigation.bIsDirtyData)
-				{
-					Navigation.FlowField = Navigation.FlowFieldToUse.LoadSynchronous();
-					Navigation.bIsDirtyData = false;
-				}
+				// 流场在ResolveFlowFields中解析，加载中的单位原地等待 | flow fields are resolved in ResolveFlowFields, agents whose field is still loading wait in place
+				if (UNLIKELY(Navigation.bIsDirtyData)) return;
 
 				const bool bIsValidFF = IsValid(Navigation.FlowField);
 
@@ -1067,15 +1380,9 @@ void ABattleFrameBattleControl::Tick(float DeltaTime)
 
 							if (bIsTraceResultHasBindFlowField)
 							{
-								FBindFlowField BindFlowField = Tracing.TraceResult.GetTraitRef<FBindFlowField, EParadigm::Unsafe>();
+								const FBindFlowField& BindFlowField = Tracing.TraceResult.GetTraitRef<FBindFlowField, EParadigm::Unsafe>();
 
-								if (BindFlowField.bIsDirtyData)
-								{
-									BindFlowField.FlowField = BindFlowField.FlowFieldToBind.LoadSynchronous();
-									BindFlowField.bIsDirtyData = false;
-								}
-
-								if (IsValid(BindFlowField.FlowField)) // 从目标获取指向目标的流场
+								if (!BindFlowField.bIsDirtyData && IsValid(BindFlowField.FlowField)) // 从目标获取指向目标的流场
 								{
 									bool bInside_TargetFF;
 									FCellStruct& Cell_TargetFF = BindFlowField.FlowField->GetCellAtLocation(AgentLocation, bInside_TargetFF);
@@ -1220,7 +1527,7 @@ void ABattleFrameBattleControl::Tick(float DeltaTime)
 					Moving.MoveSpeedMult = bIsChasing ? Chase.MoveSpeedMult : 1;
 
 					// 减速效果累加
-					Slowing.CombinedSlowMult = 1;
+					Slowing.CombinedSlowMult = bInlineStatusEffects ? Slowing.InlineSlowMult : 1;
 					for (const auto& Slower : Slowing.Slowers) Slowing.CombinedSlowMult *= 1 - Slower.GetTraitRef<FSlower, EParadigm::Unsafe>().SlowStrength;
 					Slowing.CombinedSlowMult = FMath::Lerp(Slowing.CombinedSlowMult, 1, Defence.SlowImmune);// 减速抗性
 
@@ -1410,12 +1717,12 @@ void ABattleFrameBattleControl::Tick(float DeltaTime)
 						}
 
 						// 计算新角速度
-						float NewAngularVelocity = Moving.CurrentAngularVelocity + Acceleration * DeltaTime;
+						float NewAngularVelocity = Moving.CurrentAngularVelocity + Acceleration * AgentDeltaTime;
 						NewAngularVelocity = FMath::Clamp(NewAngularVelocity, -Move.Yaw.TurnSpeed, Move.Yaw.TurnSpeed);
 
 						// 使用平均速度计算实际转动角度
 						const float AvgAngularVelocity = 0.5f * (Moving.CurrentAngularVelocity + NewAngularVelocity);
-						float AppliedDeltaYaw = AvgAngularVelocity * DeltaTime;
+						float AppliedDeltaYaw = AvgAngularVelocity * AgentDeltaTime;
 
 						// 防止角度过冲
 						if (FMath::Abs(AppliedDeltaYaw) > FMath::Abs(DeltaYaw))
@@ -1495,7 +1802,7 @@ void ABattleFrameBattleControl::Tick(float DeltaTime)
 							if (UNLIKELY(AgentLocation.Z - CollisionThreshold > Collider.Radius * Scaled.Scale * 0.1f))// need a bit of tolerance or it will be hard to decide is it is on ground or in the air
 							{
 								// 应用重力
-								Moving.CurrentVelocity.Z += Move.Z.Gravity * SafeDeltaTime;
+								Moving.CurrentVelocity.Z += Move.Z.Gravity * AgentSafeDeltaTime;
 
 								// 进入/保持下落状态
 								if (!Moving.bFalling)
@@ -1517,7 +1824,7 @@ void ABattleFrameBattleControl::Tick(float DeltaTime)
 								}
 
 								// 平滑移动到地面
-								Located.Location.Z = FMath::FInterpTo(AgentLocation.Z, CollisionThreshold, SafeDeltaTime, 25.0f);
+								Located.Location.Z = FMath::FInterpTo(AgentLocation.Z, CollisionThreshold, AgentSafeDeltaTime, 25.0f);
 							}
 						}
 					}
@@ -1530,7 +1837,7 @@ void ABattleFrameBattleControl::Tick(float DeltaTime)
 						else
 						{
 							// 应用重力
-							Moving.CurrentVelocity.Z += Move.Z.Gravity * SafeDeltaTime;
+							Moving.CurrentVelocity.Z += Move.Z.Gravity * AgentSafeDeltaTime;
 
 							if (!Moving.bFalling)
 							{
@@ -1553,11 +1860,21 @@ void ABattleFrameBattleControl::Tick(float DeltaTime)
 	#pragma region
 	{
 		TRACE_CPUPROFILER_EVENT_SCOPE_STR("AgentAvoid");
-		auto Chain = Mechanism->EnchainSolid(AgentMoveFilter);
-		UBattleFrameFunctionLibraryRT::CalculateThreadsCountAndBatchSize(Chain->IterableNum(), MaxThreadsAllowed, MinBatchSizeAllowed, ThreadsCount, BatchSize);
 
-		Chain->OperateConcurrently(
-			[&](FSolidSubjectHandle Subject,
+		// 按间隔、有单位离开或有新单位激活时重排 | re-sort on the interval, when an agent left, or as soon as any agent was activated
+		const bool bSpatialOrder = SpatialSortInterval > 0;
+
+		if (bSpatialOrder && (bSpatialOrderDirty || SpatialOrderVersion != AgentActivationVersion.load(std::memory_order_relaxed) || ++FramesSinceSpatialSort >= SpatialSortInterval))
+		{
+			SortAgentsSpatially();
+		}
+
+		auto Chain = Mechanism->EnchainSolid(AgentMoveFilter);
+		FBattleFrameStageTuner::FScope StageTuning(StageTuner, TEXT("AgentAvoid"), Chain->IterableNum(), MaxThreadsAllowed, MinBatchSizeAllowed, ThreadsCount, BatchSize);
+
+		auto AvoidAgent =
+			[&](auto Subject,
+				FAgent& Agent,
 				FLocated& Located,
 				FScaled& Scaled,
 				FCollider& Collider,
@@ -1569,6 +1886,17 @@ void ABattleFrameBattleControl::Tick(float DeltaTime)
 				FTracing& Tracing,
 				FGridData& GridData)
 			{
+				// 没轮到的远处单位沿用上次的速度，只推进位置 | far agents off their turn keep their last velocity and only advance
+				if (!Agent.bSimUpdate)
+				{
+					Located.PreLocation = Located.Location;
+					Located.Location += Moving.CurrentVelocity * SafeDeltaTime;
+					return;
+				}
+
+				const float AgentSafeDeltaTime = SafeDeltaTime + Agent.SimCatchUpTime;
+				const float AgentDeltaTime = DeltaTime + Agent.SimCatchUpTime;
+
 				//----------------------------- 避障 ----------------------------//
 				//TRACE_CPUPROFILER_EVENT_SCOPE_STR("Avoid");
 
@@ -1576,10 +1904,13 @@ void ABattleFrameBattleControl::Tick(float DeltaTime)
 
 				if (LIKELY(IsValid(NeighborGrid)) && LIKELY(Avoidance.bEnable))
 				{
+					FAvoidanceScratch& Scratch = GAvoidanceScratch;
+					const SIZE_T ScratchSize = Scratch.GetAllocatedSize();
+
 					const auto SelfLocation = Located.Location;
 					const auto SelfRadius = Avoiding.Radius;
 					const auto TraceDist = Avoidance.TraceDist;
-					const float CombinedRadiusSqr = FMath::Square(SelfRadius + TraceDist);
+					const FVector3f SelfLocation3f = FVector3f(SelfLocation);
 					const int32 MaxNeighbors = Avoidance.MaxNeighbors;
 					uint32 SelfHash = GridData.SubjectHash;
 
@@ -1588,7 +1919,6 @@ void ABattleFrameBattleControl::Tick(float DeltaTime)
 						//TRACE_CPUPROFILER_EVENT_SCOPE_STR("AvoidAgents");
 
 						const FVector SubjectRange3D(TraceDist + SelfRadius, TraceDist + SelfRadius, SelfRadius);
-						TArray<FIntVector> NeighbourCellCoords = NeighborGrid->GetNeighborCells(SelfLocation, SubjectRange3D);
 
 						// 使用最大堆收集最近的SubjectNeighbors
 						auto SubjectCompare = [&](const FGridData& A, const FGridData& B)
@@ -1596,11 +1926,16 @@ void ABattleFrameBattleControl::Tick(float DeltaTime)
 							return A.DistSqr > B.DistSqr;
 						};
 
-						TArray<FGridData> SubjectNeighbors;
+						TArray<FGridData>& SubjectNeighbors = Scratch.SubjectNeighbors;
+						SubjectNeighbors.Reset();
 						SubjectNeighbors.Reserve(MaxNeighbors);
 
-						TArray<uint32> SeenHashes;
-						SeenHashes.Reserve(MaxNeighbors);
+						// 多格注册的单位会在多个格子里出现，多层网格则不会 | multi-cell registration repeats subjects, the hierarchical grid does not
+						const bool bDedupe = NeighborGrid->CoarseLevels.IsEmpty();
+
+						TArray<uint32>& SeenHashes = Scratch.SeenHashes;
+						SeenHashes.Reset();
+						SeenHashes.Reserve(bDedupe ? MaxNeighbors : 0);
 
 						FFilter SubjectFilter = SubjectFilterBase;
 
@@ -1620,35 +1955,30 @@ void ABattleFrameBattleControl::Tick(float DeltaTime)
 							SubjectFilter.Include<FDying>();// dying subject only collide with dying subjects
 						}
 
-						// this for loop is the most expensive code of all
-						for (const auto& Coord : NeighbourCellCoords)
-						{
-							//TRACE_CPUPROFILER_EVENT_SCOPE_STR("ForEachCell");
-							auto& Subjects = NeighborGrid->GetCellAt(NeighborGrid->SubjectCells, Coord).Subjects;
+						int32 NumExamined = 0;
 
-							for (auto& Data : Subjects)
+						auto ProcessNeighbor = [&](const FGridData& Data, float DistSqr)
 							{
-								// we put faster cache friendly checks before slower checks
-								// 排除自身
-								if (UNLIKELY(Data.SubjectHash == SelfHash)) continue;
-
-								// 距离检查
-								const float DistSqr = FVector::DistSquared(SelfLocation, FVector(Data.Location));
-								if (DistSqr > CombinedRadiusSqr) continue;
+								++NumExamined;
 
 								// 去重
-								if (UNLIKELY(SeenHashes.Contains(Data.SubjectHash))) continue;
-								SeenHashes.Add(Data.SubjectHash);
+								if (bDedupe)
+								{
+									if (UNLIKELY(SeenHashes.Contains(Data.SubjectHash))) return;
+									SeenHashes.Add(Data.SubjectHash);
+								}
 
 								// Filter By Traits
-								if (UNLIKELY(!Data.SubjectHandle.Matches(SubjectFilter))) continue;
+								if (UNLIKELY(!Data.SubjectHandle.Matches(SubjectFilter))) return;
 
 								// we limit the amount of subjects. we keep the nearest MaxNeighbors amount of neighbors
 								// 动态维护堆
+								// cell data is shared between threads, write the distance into a local copy
 								if (LIKELY(SubjectNeighbors.Num() < MaxNeighbors))
 								{
-									Data.DistSqr = DistSqr;
-									SubjectNeighbors.HeapPush(Data, SubjectCompare);
+									FGridData Neighbor = Data;
+									Neighbor.DistSqr = DistSqr;
+									SubjectNeighbors.HeapPush(MoveTemp(Neighbor), SubjectCompare);
 								}
 								else
 								{
@@ -1656,13 +1986,31 @@ void ABattleFrameBattleControl::Tick(float DeltaTime)
 
 									if (UNLIKELY(DistSqr < HeapTop.DistSqr))
 									{
-										Data.DistSqr = DistSqr;
+										FGridData Neighbor = Data;
+										Neighbor.DistSqr = DistSqr;
 										SubjectNeighbors.HeapPopDiscard(SubjectCompare);
-										SubjectNeighbors.HeapPush(Data, SubjectCompare);
+										SubjectNeighbors.HeapPush(MoveTemp(Neighbor), SubjectCompare);
 									}
-								}								
-							}
-						}
+								}
+							};
+
+						// 靠近边界时也查询相邻网格，那边的单位归它们所有 | near a border the neighboring grids are queried too, they own the subjects on their side
+						NeighborGrid->ForEachGridInBox(SelfLocation, SubjectRange3D, [&](const UNeighborGridComponent* Grid)
+						{
+							// this for loop is the most expensive code of all
+							Grid->ForEachCellInBox(SelfLocation, SubjectRange3D, [&](int32 CellIndex, const FIntVector& Coord)
+							{
+								//TRACE_CPUPROFILER_EVENT_SCOPE_STR("ForEachCell");
+								// we put faster cache friendly checks before slower checks
+								// 排除自身和距离检查在SoA数组上批量完成 | self and distance rejects run batched over the SoA arrays
+								Grid->ForEachSubjectInRange<false>(CellIndex, SelfLocation3f, SelfRadius + TraceDist, SelfHash, ProcessNeighbor);
+							});
+
+							// 粗层上的大体型单位 | large subjects on the coarse levels
+							Grid->ForEachCoarseSubjectInRange<false>(SelfLocation3f, SelfRadius + TraceDist, SelfHash, ProcessNeighbor);
+						});
+
+						FBattleFrameCounters::Add(EBattleFrameCounter::NeighborsExamined, NumExamined);
 
 						//TRACE_CPUPROFILER_EVENT_SCOPE_STR("CalVelAgents");
 						Avoidance.MaxSpeed = Moving.DesiredVelocity.Size2D();
@@ -1670,8 +2018,7 @@ void ABattleFrameBattleControl::Tick(float DeltaTime)
 						Avoiding.CurrentVelocity = RVO::Vector2(Moving.CurrentVelocity.X, Moving.CurrentVelocity.Y);
 
 						// suggest the velocity to avoid collision
-						TArray<FGridData> EmptyArray;
-						ComputeAvoidingVelocity(Avoidance, Avoiding, SubjectNeighbors, EmptyArray, SafeDeltaTime);
+						ComputeAvoidingVelocity(Avoidance, Avoiding, SubjectNeighbors, TArrayView<const FObstacleSegment>(), AgentSafeDeltaTime);
 
 						FVector AvoidingVelocity(Avoidance.AvoidingVelocity.x(), Avoidance.AvoidingVelocity.y(), 0);
 						FVector CurrentVelocity = Moving.CurrentVelocity * FVector(1, 1, 0);
@@ -1680,15 +2027,15 @@ void ABattleFrameBattleControl::Tick(float DeltaTime)
 						// apply velocity
 						if (LIKELY(!Moving.bFalling && !Moving.bLaunching && !Moving.bPushedBack))
 						{
-							InterpedVelocity = FMath::VInterpConstantTo(CurrentVelocity, AvoidingVelocity, DeltaTime, Move.XY.MoveAcceleration);
+							InterpedVelocity = FMath::VInterpConstantTo(CurrentVelocity, AvoidingVelocity, AgentDeltaTime, Move.XY.MoveAcceleration);
 						}
 						else if (Moving.bFalling)
 						{
-							InterpedVelocity = FMath::VInterpConstantTo(CurrentVelocity, AvoidingVelocity, DeltaTime, 100);
+							InterpedVelocity = FMath::VInterpConstantTo(CurrentVelocity, AvoidingVelocity, AgentDeltaTime, 100);
 						}
 						else if (Moving.bLaunching || Moving.bPushedBack)
 						{
-							InterpedVelocity = FMath::VInterpConstantTo(CurrentVelocity, AvoidingVelocity, DeltaTime, Move.XY.MoveDeceleration);
+							InterpedVelocity = FMath::VInterpConstantTo(CurrentVelocity, AvoidingVelocity, AgentDeltaTime, Move.XY.MoveDeceleration);
 						}
 
 						Moving.CurrentVelocity = FVector(InterpedVelocity.X, InterpedVelocity.Y, Moving.CurrentVelocity.Z);
@@ -1703,52 +2050,55 @@ void ABattleFrameBattleControl::Tick(float DeltaTime)
 
 						const float ObstacleRange = Avoidance.RVO_TimeHorizon_Obstacle * Avoidance.MaxSpeed + Avoiding.Radius;
 						const FVector ObstacleRange3D(ObstacleRange, ObstacleRange, Avoiding.Radius);
-						TArray<FIntVector> ObstacleCellCoords = NeighborGrid->GetNeighborCells(SelfLocation, ObstacleRange3D);
 
-						TSet<FGridData> ValidSphereObstacleNeighbors;
-						TSet<FGridData> ValidBoxObstacleNeighbors;
+						// 障碍物数量很少，线性去重比TSet更省 | obstacles per agent are few, a linear unique check beats hashing
+						TArray<FGridData>& ValidSphereObstacleNeighbors = Scratch.SphereObstacleNeighbors;
+						TArray<FObstacleSegment>& ValidObstacleSegments = Scratch.ObstacleSegments;
 
-						ValidSphereObstacleNeighbors.Reserve(MaxNeighbors);
-						ValidBoxObstacleNeighbors.Reserve(MaxNeighbors);
+						ValidSphereObstacleNeighbors.Reset();
+						ValidObstacleSegments.Reset();
 
 						// lambda to gather obstacles
 						auto ProcessSphereObstacles = [&](const FGridData& Obstacle)
 							{
-								ValidSphereObstacleNeighbors.Add(Obstacle);
+								ValidSphereObstacleNeighbors.AddUnique(Obstacle);
 							};
 
-						auto ProcessBoxObstacles = [&](const FGridData& Obstacle)
+						auto IsSegmentGathered = [&](const uint32 SegmentHash)
 							{
-								if (LIKELY(ValidBoxObstacleNeighbors.Contains(Obstacle))) return;
-								const FSubjectHandle ObstacleHandle = Obstacle.SubjectHandle;
-								if (UNLIKELY(!ObstacleHandle.IsValid()))return;
-								const auto ObstacleData = ObstacleHandle.GetTraitPtr<FBoxObstacle, EParadigm::Unsafe>();
-								if (UNLIKELY(!ObstacleData)) return;
-
-								const RVO::Vector2& ObstaclePoint = ObstacleData->point_;
-								const float ObstaclePointZ = ObstacleData->pointZ_;
-								const float ObstacleHalfHeight = ObstacleData->height_ * 0.5f;
-								const RVO::Vector2& NextObstaclePoint = ObstacleData->nextPoint_;
+								return ValidObstacleSegments.ContainsByPredicate([SegmentHash](const FObstacleSegment& Segment) { return Segment.SubjectHash == SegmentHash; });
+							};
 
+						auto ProcessObstacleSegment = [&](const FObstacleSegment& Segment)
+							{
 								// Z 轴范围检查
-								const float ObstacleZMin = ObstaclePointZ - ObstacleHalfHeight;
-								const float ObstacleZMax = ObstaclePointZ + ObstacleHalfHeight;
 								const float SubjectZMin = SelfLocation.Z - SelfRadius;
 								const float SubjectZMax = SelfLocation.Z + SelfRadius;
 
-								if (SubjectZMax < ObstacleZMin || SubjectZMin > ObstacleZMax) return;
+								if (SubjectZMax < Segment.ZMin || SubjectZMin > Segment.ZMax) return;
 
 								// 2D 碰撞检测（RVO）
 								RVO::Vector2 currentPos(Located.Location.X, Located.Location.Y);
 
-								float leftOfValue = RVO::leftOf(ObstaclePoint, NextObstaclePoint, currentPos);
+								float leftOfValue = RVO::leftOf(Segment.Point1, Segment.Point2, currentPos);
 
 								if (leftOfValue < 0.0f)
 								{
-									ValidBoxObstacleNeighbors.Add(Obstacle);
+									ValidObstacleSegments.Add(Segment);
 								}
 							};
 
+						// 动态长方体障碍物每帧从特征打包 | dynamic box obstacles are packed from their traits every frame
+						auto ProcessBoxObstacles = [&](const FGridData& Obstacle)
+							{
+								if (LIKELY(IsSegmentGathered(Obstacle.SubjectHash))) return;
+
+								FObstacleSegment Segment;
+								if (UNLIKELY(!UNeighborGridComponent::MakeObstacleSegment(Obstacle, Segment))) return;
+
+								ProcessObstacleSegment(Segment);
+							};
+
 						auto ProcessObstacles = [&](const TArray<FGridData, TInlineAllocator<8>>& Obstacles)
 							{
 								for (const auto& Obstacle : Obstacles)
@@ -1764,25 +2114,42 @@ void ABattleFrameBattleControl::Tick(float DeltaTime)
 								}
 							};
 
-						for (const FIntVector& Coord : ObstacleCellCoords)
+						// 跨网格的障碍物在每个网格都有，上面的收集已去重 | obstacles spanning grids sit in each of them, the gathering above dedupes
+						NeighborGrid->ForEachGridInBox(SelfLocation, ObstacleRange3D, [&](const UNeighborGridComponent* Grid)
 						{
-							const auto& ObstacleCell = NeighborGrid->GetCellAt(NeighborGrid->ObstacleCells, Coord);							
-							ProcessObstacles(ObstacleCell.Subjects);
-						}
+							Grid->ForEachCellInBox(SelfLocation, ObstacleRange3D, [&](int32 CellIndex, const FIntVector& Coord)
+							{
+								ProcessObstacles(Grid->ObstacleCells[CellIndex].Subjects);
+							});
 
-						for (const FIntVector& Coord : ObstacleCellCoords)
-						{
-							const auto& StaticObstacleCell = NeighborGrid->GetCellAt(NeighborGrid->StaticObstacleCells, Coord);
-							ProcessObstacles(StaticObstacleCell.Subjects);
-						}
+							// 静态障碍物直接读取格子缓存，不查询特征 | static obstacles come straight from the packed per cell cache
+							Grid->ForEachCellInBox(SelfLocation, ObstacleRange3D, [&](int32 CellIndex, const FIntVector& Coord)
+							{
+								const FStaticObstacleCache& StaticCache = Grid->StaticObstacleCaches[CellIndex];
+
+								for (const FGridData& Sphere : StaticCache.Spheres)
+								{
+									ProcessSphereObstacles(Sphere);
+								}
 
-						TArray<FGridData> SphereObstacleNeighbors = ValidSphereObstacleNeighbors.Array();
-						TArray<FGridData> BoxObstacleNeighbors = ValidBoxObstacleNeighbors.Array();
+								for (const FObstacleSegment& Segment : StaticCache.Segments)
+								{
+									if (LIKELY(IsSegmentGathered(Segment.SubjectHash))) continue;
+									ProcessObstacleSegment(Segment);
+								}
+							});
+						});
 
-						ComputeAvoidingVelocity(Avoidance, Avoiding, SphereObstacleNeighbors, BoxObstacleNeighbors, SafeDeltaTime);
+						ComputeAvoidingVelocity(Avoidance, Avoiding, ValidSphereObstacleNeighbors, ValidObstacleSegments, AgentSafeDeltaTime);
 
 						Moving.CurrentVelocity = FVector(Avoidance.AvoidingVelocity.x(), Avoidance.AvoidingVelocity.y(), Moving.CurrentVelocity.Z);
 					}
+
+					// 缓存扩容即一次堆分配 | any scratch growth is a heap allocation
+					if (UNLIKELY(Scratch.GetAllocatedSize() != ScratchSize))
+					{
+						GAvoidHeapAllocations.fetch_add(1, std::memory_order_relaxed);
+					}
 				}
 
 				// 更新速度历史记录
@@ -1796,14 +2163,61 @@ void ABattleFrameBattleControl::Tick(float DeltaTime)
 					Moving.UpdateVelocityHistory(Moving.CurrentVelocity);
 				}
 
-				Moving.TimeLeft -= SafeDeltaTime;
+				Moving.TimeLeft -= AgentSafeDeltaTime;
 
 				//--------------------------- 执行位移 -----------------------------//
 
 				Located.PreLocation = Located.Location;
 				Located.Location += Moving.CurrentVelocity * SafeDeltaTime;
 
-			}, ThreadsCount, BatchSize);
+			};
+
+		// 排序后没有新单位激活，当前集合只会是SpatialOrder的子集，失效的单位在下面跳过 | with no activation since the sort, the live set is a subset of SpatialOrder and the leavers are skipped below
+		if (bSpatialOrder && SpatialOrderVersion == AgentActivationVersion.load(std::memory_order_relaxed))
+		{
+			// 每个线程处理一段连续且空间相邻的单位，邻居格子留在缓存里 | every thread takes one spatially coherent run, so the cells it touches stay cached
+			const int32 NumVisited = ForEachInSpatialOrder(AgentMoveFilter, ThreadsCount, [&](const FSubjectHandle& Agent)
+			{
+				AvoidAgent(Agent,
+					*Agent.GetTraitPtr<FAgent, EParadigm::Unsafe>(),
+					*Agent.GetTraitPtr<FLocated, EParadigm::Unsafe>(),
+					*Agent.GetTraitPtr<FScaled, EParadigm::Unsafe>(),
+					*Agent.GetTraitPtr<FCollider, EParadigm::Unsafe>(),
+					*Agent.GetTraitPtr<FMove, EParadigm::Unsafe>(),
+					*Agent.GetTraitPtr<FMoving, EParadigm::Unsafe>(),
+					*Agent.GetTraitPtr<FAvoidance, EParadigm::Unsafe>(),
+					*Agent.GetTraitPtr<FAvoiding, EParadigm::Unsafe>(),
+					*Agent.GetTraitPtr<FTrace, EParadigm::Unsafe>(),
+					*Agent.GetTraitPtr<FTracing, EParadigm::Unsafe>(),
+					*Agent.GetTraitPtr<FGridData, EParadigm::Unsafe>());
+			});
+
+			// 有单位死亡被跳过，说明集合变了，下一帧重排 | a skipped agent means the set changed, re-sort next frame
+			bSpatialOrderDirty = NumVisited != SpatialOrder.Num();
+		}
+		else
+		{
+			bSpatialOrderDirty = bSpatialOrder;
+
+			Chain->OperateConcurrently(
+				[&](FSolidSubjectHandle Subject,
+					FAgent& Agent,
+					FLocated& Located,
+					FScaled& Scaled,
+					FCollider& Collider,
+					FMove& Move,
+					FMoving& Moving,
+					FAvoidance& Avoidance,
+					FAvoiding& Avoiding,
+					FTrace& Trace,
+					FTracing& Tracing,
+					FGridData& GridData)
+				{
+					AvoidAgent(Subject, Agent, Located, Scaled, Collider, Move, Moving, Avoidance, Avoiding, Trace, Tracing, GridData);
+				}, ThreadsCount, BatchSize);
+		}
+
+		TRACE_COUNTER_SET(BattleFrame_AvoidHeapAllocations, GAvoidHeapAllocations.exchange(0));
 	}
 	#pragma endregion
 
@@ -1811,14 +2225,9 @@ void ABattleFrameBattleControl::Tick(float DeltaTime)
 	#pragma region
 	{
 		TRACE_CPUPROFILER_EVENT_SCOPE_STR("Update NeighborGrid");
+		FBattleFrameStageTuner::FScope StageTiming(StageTuner, TEXT("Update NeighborGrid"));
 
-		for (UNeighborGridComponent* Grid : NeighborGrids)
-		{
-			if (Grid)
-			{
-				Grid->Update();
-			}
-		}
+		UNeighborGridComponent::UpdateGrids(NeighborGrids);
 	}
 	#pragma endregion
 
@@ -1830,7 +2239,7 @@ void ABattleFrameBattleControl::Tick(float DeltaTime)
 		TRACE_CPUPROFILER_EVENT_SCOPE_STR("AgentAttackMain");
 
 		auto Chain = Mechanism->EnchainSolid(AgentAttackFilter);
-		UBattleFrameFunctionLibraryRT::CalculateThreadsCountAndBatchSize(Chain->IterableNum(), MaxThreadsAllowed, MinBatchSizeAllowed, ThreadsCount, BatchSize);
+		FBattleFrameStageTuner::FScope StageTuning(StageTuner, TEXT("AgentAttackMain"), Chain->IterableNum(), MaxThreadsAllowed, MinBatchSizeAllowed, ThreadsCount, BatchSize);
 
 		Chain->OperateConcurrently(
 			[&](FSolidSubjectHandle Subject,
@@ -1902,7 +2311,7 @@ void ABattleFrameBattleControl::Tick(float DeltaTime)
 		TRACE_CPUPROFILER_EVENT_SCOPE_STR("AgentAttacking");
 
 		auto Chain = Mechanism->EnchainSolid(AgentAttackingFilter);
-		UBattleFrameFunctionLibraryRT::CalculateThreadsCountAndBatchSize(Chain->IterableNum(), MaxThreadsAllowed, MinBatchSizeAllowed, ThreadsCount, BatchSize);
+		FBattleFrameStageTuner::FScope StageTuning(StageTuner, TEXT("AgentAttacking"), Chain->IterableNum(), MaxThreadsAllowed, MinBatchSizeAllowed, ThreadsCount, BatchSize);
 
 		Chain->OperateConcurrently(
 			[&](FSolidSubjectHandle Subject,
@@ -2191,1108 +2600,575 @@ void ABattleFrameBattleControl::Tick(float DeltaTime)
 
 	//------------------------受击 | Hit-------------------------
 
-	// 受击发光 | Glow
+	// 减速马甲 | Slower Ghost Subject
 	#pragma region
-	{
-		TRACE_CPUPROFILER_EVENT_SCOPE_STR("AgentHitGlow");
-
-		auto Chain = Mechanism->EnchainSolid(AgentHitGlowFilter);
-		UBattleFrameFunctionLibraryRT::CalculateThreadsCountAndBatchSize(Chain->IterableNum(), MaxThreadsAllowed, MinBatchSizeAllowed, ThreadsCount, BatchSize);
-
-		Chain->OperateConcurrently(
-			[&](FSolidSubjectHandle Subject,
-				FAnimation& Animation,
-				FHitGlow& HitGlow,
-				FCurves& Curves)
-			{
-				// 获取曲线
-				auto Curve = Curves.HitEmission.GetRichCurve();
-
-				// 检查曲线是否有关键帧
-				if (!Curve || Curve->GetNumKeys() == 0) return;
+	TickSlowers(SafeDeltaTime);
+	#pragma endregion
 
-				// 获取曲线的最后一个关键帧的时间
-				const auto EndTime = Curve->GetLastKey().Time;
+	// 延时伤害马甲 | Temporal Damager Ghost Subject
+	#pragma region
+	TickTemporalDamagers(SafeDeltaTime);
+	#pragma endregion
 
-				// 受击发光
-				Animation.HitGlow = Curve->Eval(HitGlow.GlowTime);
+	// 内联状态效果，关闭时槽位不会被写入，整段跳过 | Inline Status Effects, skipped whole when off since no slot is ever filled then
+	#pragma region
+	if (bInlineStatusEffects)
+	{
+		TickStatusEffects(SafeDeltaTime);
+	}
+	#pragma endregion
 
-				// 更新发光时间
-				if (HitGlow.GlowTime < EndTime)
-				{
-					HitGlow.GlowTime += SafeDeltaTime;
-				}
+	// 结算伤害，随后与受击表现一同更新血条 | Settle Damage, then health bars and hit visuals as a stage graph
+	#pragma region
+	{
+		TRACE_CPUPROFILER_EVENT_SCOPE_STR("DecideHealth");
 
-				// 计时器完成后删除 Trait
-				if (HitGlow.GlowTime >= EndTime)
-				{
-					Animation.HitGlow = 0; // 重置发光值
-					Subject->RemoveTraitDeferred<FHitGlow>(); // 延迟删除 Trait
-				}
+		// 先结算本帧所有伤害指令，再更新血条 | settle the frame's damage commands first, then the health bars
+		ResolveDamageCommands();
 
-			}, ThreadsCount, BatchSize);
+		HitStages.Run(FBattleFrameStageContext{ Mechanism, SafeDeltaTime, MaxThreadsAllowed, MinBatchSizeAllowed }, bParallelStages);
 	}
 	#pragma endregion
 
-	// 怪物受击形变 | Jiggle
+	//-----------------------死亡 | Death-------------------------
+
+	// 或死亡 | May Die Tag
 	#pragma region
 	{
-		TRACE_CPUPROFILER_EVENT_SCOPE_STR("AgentJiggle");
+		TRACE_CPUPROFILER_EVENT_SCOPE_STR("AgentMayDie");
 
-		auto Chain = Mechanism->EnchainSolid(AgentJiggleFilter);
-		UBattleFrameFunctionLibraryRT::CalculateThreadsCountAndBatchSize(Chain->IterableNum(), MaxThreadsAllowed, MinBatchSizeAllowed, ThreadsCount, BatchSize);
+		auto Chain = Mechanism->EnchainSolid(AgentMayDieFilter);
+		FBattleFrameStageTuner::FScope StageTuning(StageTuner, TEXT("AgentMayDie"), Chain->IterableNum(), MaxThreadsAllowed, MinBatchSizeAllowed, ThreadsCount, BatchSize);
 
 		Chain->OperateConcurrently(
 			[&](FSolidSubjectHandle Subject,
-				FScaled& Scaled,
-				FJiggle& Jiggle,
-				FHit& Hit,
-				FCurves& Curves)
+				FMayDie& MayDie)
 			{
-				// 获取曲线
-				auto Curve = Curves.HitJiggle.GetRichCurve();
-
-				// 检查曲线是否有关键帧
-				if (!Curve || Curve->GetNumKeys() == 0) return;
-
-				// 获取曲线的最后一个关键帧的时间
-				const auto EndTime = Curve->GetLastKey().Time;
-
-				// 受击变形
-				Scaled.RenderScale.X = FMath::Lerp(Scaled.Scale, Scaled.Scale * Curve->Eval(Jiggle.JiggleTime), Hit.JiggleStr);
-				Scaled.RenderScale.Y = FMath::Lerp(Scaled.Scale, Scaled.Scale * Curve->Eval(Jiggle.JiggleTime), Hit.JiggleStr);
-				Scaled.RenderScale.Z = FMath::Lerp(Scaled.Scale, Scaled.Scale * (2.f - Curve->Eval(Jiggle.JiggleTime)), Hit.JiggleStr);
-
-				// 更新形变时间
-				if (Jiggle.JiggleTime < EndTime)
+				if (MayDie.TimeLeft <= 0)
 				{
-					Jiggle.JiggleTime += SafeDeltaTime;
+					Subject.RemoveTraitDeferred<FMayDie>();
 				}
-
-				// 计时器完成后删除 Trait
-				if (Jiggle.JiggleTime >= EndTime)
+				else
 				{
-					Scaled.RenderScale = FVector(Scaled.Scale); // 恢复原始比例
-					Subject->RemoveTraitDeferred<FJiggle>(); // 延迟删除 Trait
+					MayDie.TimeLeft -= SafeDeltaTime;
 				}
 
 			}, ThreadsCount, BatchSize);
 	}
 	#pragma endregion
 
-	// 减速马甲 | Slower Ghost Subject
+	// 死亡总 | Death Main
 	#pragma region
 	{
-		TRACE_CPUPROFILER_EVENT_SCOPE_STR("AgentSlowed");
+		TRACE_CPUPROFILER_EVENT_SCOPE_STR("AgentDeathMain");
 
-		auto Chain = Mechanism->EnchainSolid(SlowerFilter);
-		UBattleFrameFunctionLibraryRT::CalculateThreadsCountAndBatchSize(Chain->IterableNum(), MaxThreadsAllowed, MinBatchSizeAllowed, ThreadsCount, BatchSize);
+		auto Chain = Mechanism->EnchainSolid(AgentDeathFilter);
+		FBattleFrameStageTuner::FScope StageTuning(StageTuner, TEXT("AgentDeathMain"), Chain->IterableNum(), MaxThreadsAllowed, MinBatchSizeAllowed, ThreadsCount, BatchSize);
 
 		Chain->OperateConcurrently(
-			[&](FSolidSubjectHandle Subject, 
-				FSlower& Slower)
+			[&](FSolidSubjectHandle Subject,
+				FLocated& Located,
+				FDirected& Directed,
+				FDeath& Death,
+				FDying& Dying,
+				FMoving& Moving)
 			{
-				// 减速对象不存在时终止
-				if (!Slower.SlowTarget.IsValid())
-				{
-					Subject.DespawnDeferred();
-					return;
-				}
+				if (!Death.bEnable) return;
 
-				// 第一次运行时，登记到agent的减速马甲列表
-				if (Slower.bJustSpawned)
+				if (Dying.Time == 0)
 				{
-					auto& TargetSlowing = Slower.SlowTarget.GetTraitRef<FSlowing, EParadigm::Unsafe>();
-
-					TargetSlowing.Lock();
-					TargetSlowing.Slowers.Add(FSubjectHandle(Subject));
-					TargetSlowing.Unlock();
+					// Actor
+					for (const FActorSpawnConfig& Config : Death.SpawnActor)
+					{
+						FActorSpawnConfig_Final NewConfig(Config);
+						NewConfig.OwnerSubject = FSubjectHandle(Subject);
+						NewConfig.AttachToSubject = FSubjectHandle(Subject);
+						NewConfig.SpawnTransform = ABattleFrameBattleControl::LocalOffsetToWorld(Dying.HitDirection.ToOrientationQuat(), Located.Location, NewConfig.Transform);
+						NewConfig.InitialRelativeTransform = NewConfig.SpawnTransform.GetRelativeTransform(FTransform(Directed.Direction.ToOrientationQuat(), Located.Location));
 
-					const bool bHasAnimation = Slower.SlowTarget.HasTrait<FAnimation>();
+						Mechanism->SpawnSubjectDeferred(NewConfig);
+					}
 
-					// 开启材质特效
-					if (bHasAnimation)
+					// Fx
+					for (const FFxConfig& Config : Death.SpawnFx)
 					{
-						auto& TargetAnimation = Slower.SlowTarget.GetTraitRef<FAnimation, EParadigm::Unsafe>();
+						FFxConfig_Final NewConfig(Config);
+						NewConfig.OwnerSubject = FSubjectHandle(Subject);
+						NewConfig.AttachToSubject = FSubjectHandle(Subject);
+						NewConfig.SpawnTransform = ABattleFrameBattleControl::LocalOffsetToWorld(Dying.HitDirection.ToOrientationQuat(), Located.Location, NewConfig.Transform);
+						NewConfig.InitialRelativeTransform = NewConfig.SpawnTransform.GetRelativeTransform(FTransform(Directed.Direction.ToOrientationQuat(), Located.Location));
+						NewConfig.LaunchSpeed = Dying.HitDirection.Size();
 
-						TargetAnimation.Lock();
-						switch (Slower.DmgType)
-						{
-							case EDmgType::Fire:
-								TargetAnimation.FireFx = 1;
-								break;
-							case EDmgType::Ice:
-								TargetAnimation.IceFx = 1;
-								break;
-							case EDmgType::Poison:
-								TargetAnimation.PoisonFx = 1;
-								break;
-						}
-						TargetAnimation.Unlock();
+						Mechanism->SpawnSubjectDeferred(NewConfig);
 					}
 
-					Slower.bJustSpawned = false;
-				}
-
-				// 持续时间结束，解除减速
-				if (Slower.SlowTimeout <= 0)
-				{
-					auto& TargetSlowing = Slower.SlowTarget.GetTraitRef<FSlowing, EParadigm::Unsafe>();
+					// Sound
+					for (const FSoundConfig& Config : Death.PlaySound)
+					{
+						FSoundConfig_Final NewConfig(Config);
+						NewConfig.OwnerSubject = FSubjectHandle(Subject);
+						NewConfig.AttachToSubject = FSubjectHandle(Subject);
+						NewConfig.SpawnTransform = ABattleFrameBattleControl::LocalOffsetToWorld(Dying.HitDirection.ToOrientationQuat(), Located.Location, NewConfig.Transform);
+						NewConfig.InitialRelativeTransform = NewConfig.SpawnTransform.GetRelativeTransform(FTransform(Directed.Direction.ToOrientationQuat(), Located.Location));
 
-					TargetSlowing.Lock();
-					TargetSlowing.Slowers.Remove(FSubjectHandle(Subject));
-					TargetSlowing.Unlock();
+						Mechanism->SpawnSubjectDeferred(NewConfig);
+					}
 
-					const bool bHasAnimation = Slower.SlowTarget.HasTrait<FAnimation>();
+					// Death Begin Event
+					if (Subject.HasTrait<FIsSubjective>())
+					{
+						FDeathData DeathData;
+						DeathData.SelfSubject = FSubjectHandle(Subject);
+						OnDeathQueue.Enqueue(DeathData);
+					}
 
-					// 重置材质特效
-					if (bHasAnimation)
+					if (Death.DespawnDelay > 0)
 					{
-						bool bHasSameDmgType = false;
+						Dying.Duration = Death.DespawnDelay;
 
-						// 是否还存在同伤害类型的减速马甲
-						TargetSlowing.Lock();
-						for (const auto& OtherSlower : TargetSlowing.Slowers)
+						// Stop attacking
+						if (Subject.HasTrait<FAttacking>())
 						{
-							if (OtherSlower.GetTrait<FSlower>().DmgType == Slower.DmgType)
-							{
-								bHasSameDmgType = true;
-								break;
-							}
+							Subject.RemoveTraitDeferred<FAttacking>();
 						}
-						TargetSlowing.Unlock();
-
-						// 是否还存在同伤害类型的延时伤害马甲
-						auto& TargetTemporalDamaging = Slower.SlowTarget.GetTraitRef<FTemporalDamaging, EParadigm::Unsafe>();
 
-						TargetTemporalDamaging.Lock();
-						for (const auto& OtherTemporalDamager : TargetTemporalDamaging.TemporalDamagers)
+						// Fade out
+						if (Death.bCanFadeout)
 						{
-							if (OtherTemporalDamager.GetTrait<FTemporalDamager>().DmgType == Slower.DmgType)
-							{
-								bHasSameDmgType = true;
-								break;
-							}
+							Subject.SetTraitDeferred(FDeathDissolve());
 						}
-						TargetTemporalDamaging.Unlock();
 
-						// 如果没有同伤害类型的马甲，可以重置材质特效了
-						if (!bHasSameDmgType)
+						// Anim
+						if (Death.bCanPlayAnim)
 						{
-							auto& TargetAnimation = Slower.SlowTarget.GetTraitRef<FAnimation, EParadigm::Unsafe>();
-
-							TargetAnimation.Lock();
-							switch (Slower.DmgType)
-							{
-								case EDmgType::Fire:
-									TargetAnimation.FireFx = 0;
-									break;
-								case EDmgType::Ice:
-									TargetAnimation.IceFx = 0;
-									break;
-								case EDmgType::Poison:
-									TargetAnimation.PoisonFx = 0;
-									break;
-							}
-							TargetAnimation.Unlock();
+							Subject.SetTraitDeferred(FDeathAnim());
 						}
 					}
+				}
 
-					Subject.DespawnDeferred();
-					return;
+				if (Dying.Time >= Dying.Duration)
+				{
+					if (bRecycleAgents && Subject.HasTrait<FRecyclable>())
+					{
+						PoolAgentDeferred(Subject);
+					}
+					else
+					{
+						Subject.DespawnDeferred();
+					}
+				}
+				else if (Moving.CurrentVelocity.Size2D() < KINDA_SMALL_NUMBER && Death.bDisableCollision && !Subject.HasTrait<FCorpse>())
+				{
+					Subject.SetTraitDeferred(FCorpse());
 				}
 
-				// 更新计时器
-				Slower.SlowTimeout -= SafeDeltaTime;
+				Dying.Time += SafeDeltaTime;
 
 			}, ThreadsCount, BatchSize);
 	}
 	#pragma endregion
 
-	// 延时伤害马甲 | Temporal Damager Ghost Subject
+	// 回收池 | Recycling Pool
 	#pragma region
 	{
-		TRACE_CPUPROFILER_EVENT_SCOPE_STR("AgentTemporalDamaging");
-
-		auto Chain = Mechanism->EnchainSolid(TemporalDamagerFilter);
-		UBattleFrameFunctionLibraryRT::CalculateThreadsCountAndBatchSize(Chain->IterableNum(), MaxThreadsAllowed, MinBatchSizeAllowed, ThreadsCount, BatchSize);
+		TRACE_CPUPROFILER_EVENT_SCOPE_STR("CollectPooledAgents");
+		CollectPooledAgents();
+	}
+	#pragma endregion
 
-		Chain->OperateConcurrently(
-			[&](FSolidSubjectHandle Subject, 
-				FTemporalDamager& TemporalDamager)
-			{
-				// 伤害对象不存在时终止
-				if (!TemporalDamager.TemporalDamageTarget.IsValid())
-				{
-					Subject.DespawnDeferred();
-					return;
-				}
+	// 死亡表现，按读写集合并行 | Death visuals, run as a stage graph
+	#pragma region
+	{
+		DeathStages.Run(FBattleFrameStageContext{ Mechanism, SafeDeltaTime, MaxThreadsAllowed, MinBatchSizeAllowed }, bParallelStages);
+	}
+	#pragma endregion
+}
 
-				// 第一次运行时，登记到agent的持续伤害马甲列表
-				if (TemporalDamager.bJustSpawned)
-				{
-					auto& TargetTemporalDamaging = TemporalDamager.TemporalDamageTarget.GetTraitRef<FTemporalDamaging, EParadigm::Unsafe>();
+void ABattleFrameBattleControl::RenderFrame(float SafeDeltaTime)
+{
+	TRACE_CPUPROFILER_EVENT_SCOPE_STR("BattleControlRenderFrame");
 
-					TargetTemporalDamaging.Lock();
-					TargetTemporalDamaging.TemporalDamagers.Add(FSubjectHandle(Subject));
-					TargetTemporalDamaging.Unlock();
+	//-------------------- 渲染 | Rendering ------------------------
 
-					const bool bHasAnimation = TemporalDamager.TemporalDamageTarget.HasTrait<FAnimation>();
+	// 动画状态机 | Anim State Machine
+	#pragma region
+	{
+		TRACE_CPUPROFILER_EVENT_SCOPE_STR("AgentStateMachine");
 
-					if (bHasAnimation)
-					{
-						auto& TargetAnimation = TemporalDamager.TemporalDamageTarget.GetTraitRef<FAnimation, EParadigm::Unsafe>();
+		auto Chain = Mechanism->EnchainSolid(AgentStateMachineFilter);
+		FBattleFrameStageTuner::FScope StageTuning(StageTuner, TEXT("AgentStateMachine"), Chain->IterableNum(), MaxThreadsAllowed, MinBatchSizeAllowed, ThreadsCount, BatchSize);
 
-						TargetAnimation.Lock();
-						switch (TemporalDamager.DmgType)
-						{
-							case EDmgType::Fire:
-								TargetAnimation.FireFx = 1;
-								break;
-							case EDmgType::Ice:
-								TargetAnimation.IceFx = 1;
-								break;
-							case EDmgType::Poison:
-								TargetAnimation.PoisonFx = 1;
-								break;
-						}
-						TargetAnimation.Unlock();
-					}
-
-					TemporalDamager.bJustSpawned = false;
-				}
+		Chain->OperateConcurrently(
+			[&](FSolidSubjectHandle Subject,
+				FAnimation& Anim,
+				FAppear& Appear,
+				FAttack& Attack,
+				FDeath& Death,
+				FMove& Move,
+				FMoving& Moving,
+				FSlowing& Slowing)
+			{
+				// 待机-移动切换 | Idle-Move Switch
+				const bool bIsAppearing = Subject.HasTrait<FAppearing>();
+				const bool bIsDying = Subject.HasTrait<FDying>();
 
-				// 持续伤害结束时终止
-				if (TemporalDamager.RemainingTemporalDamage <= 0 || TemporalDamager.CurrentSegment >= TemporalDamager.TemporalDmgSegment)
+				if (!bIsAppearing && !bIsDying)
 				{
-					auto& TargetTemporalDamaging = TemporalDamager.TemporalDamageTarget.GetTraitRef<FTemporalDamaging, EParadigm::Unsafe>();
-
-					// 从马甲列表移除
-					TargetTemporalDamaging.Lock();
-					TargetTemporalDamaging.TemporalDamagers.Remove(FSubjectHandle(Subject));
-					TargetTemporalDamaging.Unlock();
-
-					const bool bHasAnimation = TemporalDamager.TemporalDamageTarget.HasTrait<FAnimation>();
+					const bool bIsAttacking = Subject.HasTrait<FAttacking>();
 
-					// 重置材质特效
-					if (bHasAnimation)
+					if (bIsAttacking)
 					{
-						bool bHasSameDmgType = false;
-
-						// 是否还存在同伤害类型的延时伤害马甲
-						TargetTemporalDamaging.Lock();
-						for (const auto& OtherTemporalDamager : TargetTemporalDamaging.TemporalDamagers)
-						{
-							if (OtherTemporalDamager.GetTrait<FTemporalDamager>().DmgType == TemporalDamager.DmgType)
-							{
-								bHasSameDmgType = true;
-								break;
-							}
-						}
-						TargetTemporalDamaging.Unlock();
-
-						// 是否还存在同伤害类型的减速马甲
-						auto& TargetSlowing = TemporalDamager.TemporalDamageTarget.GetTraitRef<FSlowing, EParadigm::Unsafe>();
-
-						TargetSlowing.Lock();
-						for (const auto& OtherSlower : TargetSlowing.Slowers)
-						{
-							if (OtherSlower.GetTrait<FSlower>().DmgType == TemporalDamager.DmgType)
-							{
-								bHasSameDmgType = true;
-								break;
-							}
-						}
-						TargetSlowing.Unlock();
+						EAttackState State = Subject.GetTraitRef<FAttacking>().State;
 
-						// 如果没有同伤害类型的马甲，可以重置材质特效了
-						if (!bHasSameDmgType)
+						if (State == EAttackState::Cooling)// if is attacking but cooling, we use idle-move anim
 						{
-							auto& TargetAnimation = TemporalDamager.TemporalDamageTarget.GetTraitRef<FAnimation, EParadigm::Unsafe>();
-
-							TargetAnimation.Lock();
-							switch (TemporalDamager.DmgType)
-							{
-								case EDmgType::Fire:
-									TargetAnimation.FireFx = 0;
-									break;
-								case EDmgType::Ice:
-									TargetAnimation.IceFx = 0;
-									break;
-								case EDmgType::Poison:
-									TargetAnimation.PoisonFx = 0;
-									break;
-							}
-							TargetAnimation.Unlock();
+							const bool IsMoving = Moving.CurrentVelocity.Size2D() > Move.XY.MoveSpeed * 0.05f/* || Moving.CurrentAngularVelocity > Move.Yaw.TurnSpeed * 0.1f*/;// take into account angular velocity
+							Anim.SubjectState = IsMoving ? ESubjectState::Moving : ESubjectState::Idle;
 						}
 					}
-
-					Subject.DespawnDeferred();
-					return;
+					else
+					{
+						const bool IsMoving = Moving.CurrentVelocity.Size2D() > Move.XY.MoveSpeed * 0.05f/* || Moving.CurrentAngularVelocity > Move.Yaw.TurnSpeed * 0.1f*/;
+						Anim.SubjectState = IsMoving ? ESubjectState::Moving : ESubjectState::Idle;
+					}
 				}
 
-				TemporalDamager.TemporalDamageTimeout -= SafeDeltaTime;
-
-				// 倒计时结束，造成一次伤害
-				if (TemporalDamager.TemporalDamageTimeout <= 0)
+				// 动画状态机 | Anim State Machine
+				if ( Anim.AnimLerp == 1)
 				{
-					// 计算本次伤害值
-					float ThisSegmentDamage = 0.0f;
-
-					// 扣除目标生命值
-					if (TemporalDamager.TemporalDamageTarget.HasTrait<FHealth>())
+					switch (Anim.SubjectState)
 					{
-						auto& TargetHealth = TemporalDamager.TemporalDamageTarget.GetTraitRef<FHealth, EParadigm::Unsafe>();
-
-						if (TargetHealth.Current > 0)
+						case ESubjectState::None:
 						{
-							// 计算本次伤害值
-							float DamagePerSegment = TemporalDamager.TotalTemporalDamage / TemporalDamager.TemporalDmgSegment;
-
-							// 确保最后一段使用剩余伤害值
-							if (TemporalDamager.CurrentSegment == TemporalDamager.TemporalDmgSegment - 1)
-							{
-								ThisSegmentDamage = TemporalDamager.RemainingTemporalDamage;
-							}
-							else
+							if (Anim.SubjectState != Anim.PreviousSubjectState)
 							{
-								ThisSegmentDamage = FMath::Min(DamagePerSegment, TemporalDamager.RemainingTemporalDamage);
+								CopyAnimData(Anim);
+								Anim.AnimCurrentTime1 = GetGameTimeSinceCreation();
+								Anim.AnimIndex1 = Anim.IndexOfIdleAnim;
+								Anim.AnimPauseTime1 = 0;
+								Anim.AnimPlayRate1 = 0;
 							}
 
-							float ClampedDamage = FMath::Min(ThisSegmentDamage, TargetHealth.Current);
-
-							// 应用伤害
-							TargetHealth.DamageToTake.Enqueue(ClampedDamage);
-
-							// 记录伤害施加者
-							TargetHealth.DamageInstigator.Enqueue(TemporalDamager.TemporalDamageInstigator);
-
-							TargetHealth.HitDirection.Enqueue(FVector(0,0,0.0001f));
-
-							//Temporal.TemporalDamageTarget.SetFlag(NeedSettleDmgFlag, true);
-
-							// 生成伤害数字
-							if (TemporalDamager.TemporalDamageTarget.HasTrait<FTextPopUp>())
-							{
-								const auto& TextPopUp = TemporalDamager.TemporalDamageTarget.GetTraitRef<FTextPopUp, EParadigm::Unsafe>();
-
-								if (TextPopUp.Enable)
-								{
-									float Style;
-
-									if (ClampedDamage < TextPopUp.WhiteTextBelowPercent)
-									{
-										Style = 0;
-									}
-									else if (ClampedDamage < TextPopUp.OrangeTextAbovePercent)
-									{
-										Style = 1;
-									}
-									else
-									{
-										Style = 2;
-									}
-
-									float Radius = TemporalDamager.TemporalDamageTarget.HasTrait<FGridData>() ? TemporalDamager.TemporalDamageTarget.GetTraitRef<FGridData, EParadigm::Unsafe>().Radius : 0;
-									FVector Location = TemporalDamager.TemporalDamageTarget.HasTrait<FLocated>() ? TemporalDamager.TemporalDamageTarget.GetTraitRef<FLocated, EParadigm::Unsafe>().Location : FVector::ZeroVector;
-
-									QueueText(FTextPopConfig(TemporalDamager.TemporalDamageTarget, ClampedDamage, Style, TextPopUp.TextScale, Radius * 1.1, Location));
-								}
-							}
+							break;
 						}
-					}
-
-					// 更新伤害状态
-					TemporalDamager.RemainingTemporalDamage -= ThisSegmentDamage;
-					TemporalDamager.CurrentSegment++;
-
-					// 重置倒计时（仅当还有剩余伤害段数时）
-					if (TemporalDamager.CurrentSegment < TemporalDamager.TemporalDmgSegment && TemporalDamager.RemainingTemporalDamage > 0)
-					{
-						TemporalDamager.TemporalDamageTimeout = TemporalDamager.TemporalDmgInterval;
-					}
-				}
-
-			}, ThreadsCount, BatchSize);
-	}
-	#pragma endregion
-
-	// 结算伤害 | Settle Damage
-	#pragma region
-	{
-		TRACE_CPUPROFILER_EVENT_SCOPE_STR("DecideHealth");
-
-		auto Chain = Mechanism->EnchainSolid(DecideHealthFilter);// it processes hero and prop type too
-		UBattleFrameFunctionLibraryRT::CalculateThreadsCountAndBatchSize(Chain->IterableNum(), MaxThreadsAllowed, MinBatchSizeAllowed, ThreadsCount, BatchSize);
 
-		Chain->OperateConcurrently(
-			[&](FSolidSubjectHandle Subject, 
-				FHealth& Health, 
-				FLocated& Located)
-			{
-				// 结算伤害
-				while (!Health.DamageToTake.IsEmpty() && !Health.DamageInstigator.IsEmpty())
-				{
-					// 如果怪物死了，跳出循环
-					if (Health.Current <= 0) break;
-
-					FSubjectHandle Instigator = FSubjectHandle();
-					float DamageToTake = 0.f;
-					FVector HitDirection = FVector::ZeroVector;
-
-					Health.DamageInstigator.Dequeue(Instigator);
-					Health.DamageToTake.Dequeue(DamageToTake);
-					Health.HitDirection.Dequeue(HitDirection);
-
-					if (!Health.bLockHealth)
-					{
-						bool bIsValidStats = false;
-						FStatistics* Stats = nullptr;
-
-						if (Instigator.IsValid())
+						case ESubjectState::Appearing:
 						{
-							if (Instigator.HasTrait<FStatistics>())
+							if (Anim.SubjectState != Anim.PreviousSubjectState)
 							{
-								// 伤害与积分最后结算
-								Stats = Instigator.GetTraitPtr<FStatistics, EParadigm::Unsafe>();
-
-								if (Stats->bEnable)
-								{
-									bIsValidStats = true;
-								}
+								CopyAnimData(Anim);
+								Anim.AnimCurrentTime1 = GetGameTimeSinceCreation();
+								Anim.AnimIndex1 = Anim.IndexOfAppearAnim;
+								Anim.AnimPauseTime1 = Anim.AnimLengthArray.Num() > Anim.IndexOfAppearAnim ? Anim.AnimLengthArray[Anim.IndexOfAppearAnim] : 0;
+								Anim.AnimPlayRate1 = Anim.AnimPauseTime1 / Appear.Duration;
+								Anim.AnimLerp = 1;// since appearing is definitely the first anim to play
 							}
+
+							break;
 						}
 
-						if (Health.Current - DamageToTake > 0) // 不是致命伤害
+						case ESubjectState::Idle:
 						{
-							// 统计数据
-							if (bIsValidStats)
+							if (Anim.SubjectState != Anim.PreviousSubjectState)
 							{
-								Stats->Lock();
-								Stats->TotalDamage += DamageToTake;
-								Stats->Unlock();
+								CopyAnimData(Anim);
+								Anim.AnimCurrentTime1 = GetGameTimeSinceCreation();
+								Anim.AnimIndex1 = Anim.IndexOfIdleAnim;
+								Anim.AnimPauseTime1 = 0;
+								Anim.AnimOffsetTime1 = FMath::RandRange(Anim.IdleRandomTimeOffset.X, Anim.IdleRandomTimeOffset.Y);
 							}
+
+							Anim.AnimPlayRate1 = Anim.IdlePlayRate * Slowing.CombinedSlowMult;
+
+							break;
 						}
-						else // 是致命伤害
-						{
-							Subject.SetTraitDeferred(FDying{ 0,0,Instigator,HitDirection });	// 标记为死亡
 
-							if (Subject.HasTrait<FMove>())
+						case ESubjectState::Moving:
+						{
+							if (Anim.SubjectState != Anim.PreviousSubjectState)
 							{
-								Subject.GetTraitRef<FMove, EParadigm::Unsafe>().Z.bCanFly = false; // 如果在飞行会掉下来
+								CopyAnimData(Anim);
+								Anim.AnimCurrentTime1 = GetGameTimeSinceCreation();
+								Anim.AnimIndex1 = Anim.IndexOfMoveAnim;
+								Anim.AnimPauseTime1 = 0;
+								Anim.AnimOffsetTime1 = FMath::RandRange(Anim.MoveRandomTimeOffset.X, Anim.MoveRandomTimeOffset.Y);
 							}
 
-							// 统计数据
-							if (bIsValidStats)
-							{
-								int32 Score = Subject.HasTrait<FAgent>() ? Subject.GetTraitRef<FAgent, EParadigm::Unsafe>().Score : 0;
+							Anim.AnimPlayRate1 = Anim.MovePlayRate * Slowing.CombinedSlowMult;
 
-								Stats->Lock();
-								Stats->TotalDamage += FMath::Min(DamageToTake, Health.Current);
-								Stats->TotalKills += 1;
-								Stats->TotalScore += Score;
-								Stats->Unlock();
-							}
+							break;
 						}
 
-						// 扣除血量
-						Health.Current -= FMath::Min(DamageToTake, Health.Current);
-					}
-				}
-
-				// 更新血条
-				const bool bHasHealthBar = Subject.HasTrait<FHealthBar>();
+						case ESubjectState::Attacking:
+						{
+							if (Anim.SubjectState != Anim.PreviousSubjectState)
+							{
+								CopyAnimData(Anim);
+								Anim.AnimCurrentTime1 = GetGameTimeSinceCreation();
+							}
 
-				if (bHasHealthBar)
-				{
-					auto& HealthBar = Subject.GetTraitRef<FHealthBar>();
+							Anim.AnimIndex1 = Anim.IndexOfAttackAnim;
+							Anim.AnimPauseTime1 = Anim.AnimLengthArray.Num() > Anim.IndexOfAttackAnim ? Anim.AnimLengthArray[Anim.IndexOfAttackAnim] : 0;
+							Anim.AnimPlayRate1 = Anim.AnimPauseTime1 / Attack.DurationPerRound * Slowing.CombinedSlowMult;
 
-					if (HealthBar.bShowHealthBar)
-					{
-						HealthBar.TargetRatio = FMath::Clamp(Health.Current / Health.Maximum, 0, 1);
-						HealthBar.CurrentRatio = FMath::FInterpConstantTo(HealthBar.CurrentRatio, HealthBar.TargetRatio, SafeDeltaTime, HealthBar.InterpSpeed * 0.1);
+							break;
+						}
 
-						if (HealthBar.HideOnFullHealth)
+						case ESubjectState::Dying:
 						{
-							if (Health.Current == Health.Maximum)
-							{
-								HealthBar.Opacity = 0;
-							}
-							else
+							if (Anim.SubjectState != Anim.PreviousSubjectState)
 							{
-								HealthBar.Opacity = 1;
+								CopyAnimData(Anim);
+								Anim.AnimCurrentTime1 = GetGameTimeSinceCreation();
+								Anim.AnimIndex1 = Anim.IndexOfDeathAnim;
+								Anim.AnimPauseTime1 = Anim.AnimLengthArray.Num() > Anim.IndexOfDeathAnim ? Anim.AnimLengthArray[Anim.IndexOfDeathAnim] : 0;
+								Anim.AnimPlayRate1 = Anim.AnimPauseTime1 / Death.AnimLength;
 							}
-						}
-						else
-						{
-							HealthBar.Opacity = 1;
-						}
 
-						if (HealthBar.HideOnEmptyHealth && Health.Current <= 0)
-						{
-							HealthBar.Opacity = 0;
+							break;
 						}
 					}
-					else
-					{
-						HealthBar.Opacity = 0;
-					}
+
+					Anim.PreviousSubjectState = Anim.SubjectState;
 				}
 
+				Anim.AnimLerp = FMath::Clamp(Anim.AnimLerp + SafeDeltaTime * Anim.LerpSpeed, 0, 1);
+
 			}, ThreadsCount, BatchSize);
 	}
 	#pragma endregion
 
-	//-----------------------死亡 | Death-------------------------
-
-	// 或死亡 | May Die Tag
+	// 池初始化 | Init Pooling Info
 	#pragma region
 	{
-		TRACE_CPUPROFILER_EVENT_SCOPE_STR("AgentMayDie");
+		TRACE_CPUPROFILER_EVENT_SCOPE_STR("ClearValidTransforms");
 
-		auto Chain = Mechanism->EnchainSolid(AgentMayDieFilter);
-		UBattleFrameFunctionLibraryRT::CalculateThreadsCountAndBatchSize(Chain->IterableNum(), MaxThreadsAllowed, MinBatchSizeAllowed, ThreadsCount, BatchSize);
+		auto Chain = Mechanism->EnchainSolid(RenderBatchFilter);
+		FBattleFrameStageTuner::FScope StageTuning(StageTuner, TEXT("ClearValidTransforms"), Chain->IterableNum(), MaxThreadsAllowed, MinBatchSizeAllowed, ThreadsCount, BatchSize);
 
 		Chain->OperateConcurrently(
 			[&](FSolidSubjectHandle Subject,
-				FMayDie& MayDie)
+				FRenderBatchData& Data)
 			{
-				if (MayDie.TimeLeft <= 0)
-				{
-					Subject.RemoveTraitDeferred<FMayDie>();
-				}
-				else
-				{
-					MayDie.TimeLeft -= SafeDeltaTime;
-				}
+				Data.ValidTransforms.Reset();
+
+				Data.Text_Location_Array.Reset();
+				Data.Text_Value_Style_Scale_Offset_Array.Reset();
 
 			}, ThreadsCount, BatchSize);
 	}
 	#pragma endregion
 
-	// 死亡总 | Death Main
+	// 收集渲染数据 | Gather Render Data
 	#pragma region
 	{
-		TRACE_CPUPROFILER_EVENT_SCOPE_STR("AgentDeathMain");
+		TRACE_CPUPROFILER_EVENT_SCOPE_STR("AgentRender");
 
-		auto Chain = Mechanism->EnchainSolid(AgentDeathFilter);
-		UBattleFrameFunctionLibraryRT::CalculateThreadsCountAndBatchSize(Chain->IterableNum(), MaxThreadsAllowed, MinBatchSizeAllowed, ThreadsCount, BatchSize);
+		auto Chain = Mechanism->EnchainSolid(AgentRenderFilter);
+		FBattleFrameStageTuner::FScope StageTuning(StageTuner, TEXT("AgentRender"), Chain->IterableNum(), MaxThreadsAllowed, MinBatchSizeAllowed, ThreadsCount, BatchSize);
+
+		const bool bInterpolate = bFixedTimeStep && RenderAlpha < 1.f;
 
 		Chain->OperateConcurrently(
 			[&](FSolidSubjectHandle Subject,
+				FRendering& Rendering,
 				FLocated& Located,
 				FDirected& Directed,
-				FDeath& Death,
-				FDying& Dying,
-				FMoving& Moving)
+				FScaled& Scaled,
+				FCollider& Collider,
+				FAnimation& Anim,
+				FHealth& Health,
+				FHealthBar& HealthBar,
+				FPoppingText& PoppingText)
 			{
-				if (!Death.bEnable) return;
+				FRenderBatchData& Data = Rendering.Renderer.GetTraitRef<FRenderBatchData, EParadigm::Unsafe>();
 
-				if (Dying.Time == 0)
-				{
-					// Actor
-					for (const FActorSpawnConfig& Config : Death.SpawnActor)
-					{
-						FActorSpawnConfig_Final NewConfig(Config);
-						NewConfig.OwnerSubject = FSubjectHandle(Subject);
-						NewConfig.AttachToSubject = FSubjectHandle(Subject);
-						NewConfig.SpawnTransform = ABattleFrameBattleControl::LocalOffsetToWorld(Dying.HitDirection.ToOrientationQuat(), Located.Location, NewConfig.Transform);
-						NewConfig.InitialRelativeTransform = NewConfig.SpawnTransform.GetRelativeTransform(FTransform(Directed.Direction.ToOrientationQuat(), Located.Location));
+				FQuat Rotation{ FQuat::Identity };
+				Rotation = Directed.Direction.Rotation().Quaternion();
 
-						Mechanism->SpawnSubjectDeferred(NewConfig);
-					}
+				FVector RenderLocation = Located.Location;
 
-					// Fx
-					for (const FFxConfig& Config : Death.SpawnFx)
-					{
-						FFxConfig_Final NewConfig(Config);
-						NewConfig.OwnerSubject = FSubjectHandle(Subject);
-						NewConfig.AttachToSubject = FSubjectHandle(Subject);
-						NewConfig.SpawnTransform = ABattleFrameBattleControl::LocalOffsetToWorld(Dying.HitDirection.ToOrientationQuat(), Located.Location, NewConfig.Transform);
-						NewConfig.InitialRelativeTransform = NewConfig.SpawnTransform.GetRelativeTransform(FTransform(Directed.Direction.ToOrientationQuat(), Located.Location));
-						NewConfig.LaunchSpeed = Dying.HitDirection.Size();
+				// 固定步长下在最近两次模拟状态之间插值，上一步之后才出生的没有快照，直接用当前值 | Blend between the last two sim states, agents spawned after the last snapshot use the current state
+				if (bInterpolate && Rendering.SnapshotStep == SimStepCount)
+				{
+					RenderLocation = FMath::Lerp(Rendering.PrevLocation, Located.Location, RenderAlpha);
+					Rotation = FQuat::Slerp(Rendering.PrevDirection.Rotation().Quaternion(), Rotation, RenderAlpha);
+				}
 
-						Mechanism->SpawnSubjectDeferred(NewConfig);
-					}
+				FVector FinalScale(Data.Scale);
+				FinalScale *= Scaled.RenderScale;
 
-					// Sound
-					for (const FSoundConfig& Config : Death.PlaySound)
-					{
-						FSoundConfig_Final NewConfig(Config);
-						NewConfig.OwnerSubject = FSubjectHandle(Subject);
-						NewConfig.AttachToSubject = FSubjectHandle(Subject);
-						NewConfig.SpawnTransform = ABattleFrameBattleControl::LocalOffsetToWorld(Dying.HitDirection.ToOrientationQuat(), Located.Location, NewConfig.Transform);
-						NewConfig.InitialRelativeTransform = NewConfig.SpawnTransform.GetRelativeTransform(FTransform(Directed.Direction.ToOrientationQuat(), Located.Location));
+				float Radius = Collider.Radius * Scaled.Scale;
 
-						Mechanism->SpawnSubjectDeferred(NewConfig);
-					}
+				// 在计算转换时减去Radius
+				FTransform SubjectTransform(Rotation * Data.OffsetRotation.Quaternion(), RenderLocation + Data.OffsetLocation - FVector(0, 0, Radius), FinalScale); // 减去Z轴上的Radius					
 
-					// Death Begin Event
-					if (Subject.HasTrait<FIsSubjective>())
-					{
-						FDeathData DeathData;
-						DeathData.SelfSubject = FSubjectHandle(Subject);
-						OnDeathQueue.Enqueue(DeathData);
-					}
+				int32 InstanceId = Rendering.InstanceId;
 
-					if (Death.DespawnDelay > 0)
-					{
-						Dying.Duration = Death.DespawnDelay;
+				Data.Lock();
 
-						// Stop attacking
-						if (Subject.HasTrait<FAttacking>())
-						{
-							Subject.RemoveTraitDeferred<FAttacking>();
-						}
+				Data.ValidTransforms[InstanceId] = true;
+				Data.Transforms[InstanceId] = SubjectTransform;
 
-						// Fade out
-						if (Death.bCanFadeout)
-						{
-							Subject.SetTraitDeferred(FDeathDissolve());
-						}
+				// Transforms
+				Data.LocationArray[InstanceId] = SubjectTransform.GetLocation();
+				Data.OrientationArray[InstanceId] = SubjectTransform.GetRotation();
+				Data.ScaleArray[InstanceId] = SubjectTransform.GetScale3D();
 
-						// Anim
-						if (Death.bCanPlayAnim)
-						{
-							Subject.SetTraitDeferred(FDeathAnim());
-						}
-					}
-				}
+				// Pariticle color R
+				Data.Anim_Lerp_Array[InstanceId] = Anim.AnimLerp;
 
-				if (Dying.Time >= Dying.Duration)
-				{
-					Subject.DespawnDeferred();
-				}
-				else if (Moving.CurrentVelocity.Size2D() < KINDA_SMALL_NUMBER && Death.bDisableCollision && !Subject.HasTrait<FCorpse>())
+				// Dynamic params 0
+				Data.Anim_Index0_Index1_PauseTime0_PauseTime1_Array[InstanceId] = FVector4(Anim.AnimIndex0, Anim.AnimIndex1, Anim.AnimPauseTime0, Anim.AnimPauseTime1);
+
+				// Dynamic params 1
+				Data.Anim_TimeStamp0_TimeStamp1_PlayRate0_Playrate1_Array[InstanceId] = FVector4(Anim.AnimCurrentTime0 - Anim.AnimOffsetTime0, Anim.AnimCurrentTime1 - Anim.AnimOffsetTime1, Anim.AnimPlayRate0, Anim.AnimPlayRate1);
+
+				// Dynamic params 2
+				Data.Mat_Dissolve_HitGlow_Team_Fire_Array[InstanceId] = FVector4(Anim.Dissolve, Anim.HitGlow, Anim.Team, Anim.FireFx);
+
+				// Dynamic params 3
+				Data.Mat_Ice_Poison_Array[InstanceId] = FVector4(Anim.IceFx, Anim.PoisonFx, 0, 0);
+
+				// HealthBar
+				Data.HealthBar_Opacity_CurrentRatio_TargetRatio_Array[InstanceId] = FVector(HealthBar.Opacity, HealthBar.CurrentRatio, HealthBar.TargetRatio);
+
+				// PopText
+				Data.Text_Location_Array.Append(PoppingText.TextLocationArray);
+
+				float MaxFinalScale = FMath::Max3(FinalScale.X, FinalScale.Y, FinalScale.Z);
+
+				for (const auto& Text_Value_Style_Scale_Offset : PoppingText.Text_Value_Style_Scale_Offset_Array)
 				{
-					Subject.SetTraitDeferred(FCorpse());
+					Data.Text_Value_Style_Scale_Offset_Array.Add(Text_Value_Style_Scale_Offset * FVector4(1,1,1, MaxFinalScale));
 				}
 
-				Dying.Time += SafeDeltaTime;
+				Data.Unlock();
+
+				PoppingText.TextLocationArray.Empty();
+				PoppingText.Text_Value_Style_Scale_Offset_Array.Empty();
+
+				Subject.SetFlag(HasPoppingTextFlag, false);
 
 			}, ThreadsCount, BatchSize);
 	}
 	#pragma endregion
 
-	// 死亡消融 | Death Dissolve
+	// 回收池中的单位保留渲染槽位并隐藏 | Pooled agents keep their render slot, hidden
 	#pragma region
 	{
-		TRACE_CPUPROFILER_EVENT_SCOPE_STR("AgentDeathDissolve");
+		TRACE_CPUPROFILER_EVENT_SCOPE_STR("PooledAgentRender");
 
-		auto Chain = Mechanism->EnchainSolid(AgentDeathDissolveFilter);
-		UBattleFrameFunctionLibraryRT::CalculateThreadsCountAndBatchSize(Chain->IterableNum(), MaxThreadsAllowed, MinBatchSizeAllowed, ThreadsCount, BatchSize);
+		auto Chain = Mechanism->EnchainSolid(PooledRenderFilter);
+		FBattleFrameStageTuner::FScope StageTuning(StageTuner, TEXT("PooledAgentRender"), Chain->IterableNum(), MaxThreadsAllowed, MinBatchSizeAllowed, ThreadsCount, BatchSize);
 
 		Chain->OperateConcurrently(
 			[&](FSolidSubjectHandle Subject,
-				FAnimation& Animation,
-				FDeathDissolve& DeathDissolve,
-				FDeath& Death,
-				FCurves& Curves)
+				FRendering& Rendering)
 			{
-				// 获取曲线
-				auto Curve = Curves.DissolveOut.GetRichCurve();
-
-				// 检查曲线是否有关键帧
-				if (!Curve || Curve->GetNumKeys() == 0) return;
-				//{
-					// 如果没有关键帧，添加默认关键帧
-					//Curve->Reset();
-					//FKeyHandle Key1 = Curve->AddKey(0.0f, 1.0f); // 初始值
-					//FKeyHandle Key2 = Curve->AddKey(1.0f, 0.0f); // 结束值
-
-					//// 设置自动切线
-					//Curve->SetKeyInterpMode(Key1, RCIM_Cubic);
-					//Curve->SetKeyInterpMode(Key2, RCIM_Cubic);
-
-					//Curve->SetKeyTangentMode(Key1, RCTM_Auto);
-					//Curve->SetKeyTangentMode(Key2, RCTM_Auto);
-				//}
-
-				// 获取曲线的最后一个关键帧的时间
-				const auto EndTime = Curve->GetLastKey().Time;
-
-				// 计算溶解效果
-				if (DeathDissolve.dissolveTime >= Death.FadeOutDelay && (DeathDissolve.dissolveTime - Death.FadeOutDelay) < EndTime)
-				{
-					Animation.Dissolve = 1 - Curve->Eval(DeathDissolve.dissolveTime - Death.FadeOutDelay);
-				}
+				if (!Rendering.Renderer.IsValid() || Rendering.InstanceId < 0) return;
+
+				FRenderBatchData& Data = Rendering.Renderer.GetTraitRef<FRenderBatchData, EParadigm::Unsafe>();
 
-				// 更新溶解时间
-				DeathDissolve.dissolveTime += SafeDeltaTime;
+				Data.Lock();
+				Data.ValidTransforms[Rendering.InstanceId] = true;
+				Data.InsidePool_Array[Rendering.InstanceId] = true;
+				Data.Unlock();
 
 			}, ThreadsCount, BatchSize);
 	}
 	#pragma endregion
 
-	// 死亡动画 | Death Anim
+	// 池写入 | Write Pooling Info
 	#pragma region
 	{
-		TRACE_CPUPROFILER_EVENT_SCOPE_STR("AgentDeathAnim");
+		TRACE_CPUPROFILER_EVENT_SCOPE_STR("WritePoolingInfo");
 
-		auto Chain = Mechanism->EnchainSolid(AgentDeathAnimFilter);
-		UBattleFrameFunctionLibraryRT::CalculateThreadsCountAndBatchSize(Chain->IterableNum(), MaxThreadsAllowed, MinBatchSizeAllowed, ThreadsCount, BatchSize);
+		auto Chain = Mechanism->EnchainSolid(RenderBatchFilter);
+		FBattleFrameStageTuner::FScope StageTuning(StageTuner, TEXT("WritePoolingInfo"), Chain->IterableNum(), MaxThreadsAllowed, MinBatchSizeAllowed, ThreadsCount, BatchSize);
 
 		Chain->OperateConcurrently(
 			[&](FSolidSubjectHandle Subject,
-				FAnimation& Animation,
-				FDeathAnim& DeathAnim)
+				FRenderBatchData& Data)
 			{
-				if (DeathAnim.animTime == 0)
+				// 重置和隐藏限制数组成员
+				Data.FreeTransforms.Reset();
+
+				for (int32 i = Data.ValidTransforms.IndexOf(false);
+					i < Data.Transforms.Num();
+					i = Data.ValidTransforms.IndexOf(false, i + 1))
 				{
-					Animation.SubjectState = ESubjectState::Dying;
-					Animation.PreviousSubjectState = ESubjectState::Dirty;
+					Data.FreeTransforms.Add(i);
+					Data.InsidePool_Array[i] = true;
 				}
 
-				DeathAnim.animTime += SafeDeltaTime;
-
 			}, ThreadsCount, BatchSize);
 	}
 	#pragma endregion
 
-	//-------------------- 渲染 | Rendering ------------------------
-
-	// 动画状态机 | Anim State Machine
+	// 发送至Niagara | Send Data to Niagara
 	#pragma region
 	{
-		TRACE_CPUPROFILER_EVENT_SCOPE_STR("AgentStateMachine");
-
-		auto Chain = Mechanism->EnchainSolid(AgentStateMachineFilter);
-		UBattleFrameFunctionLibraryRT::CalculateThreadsCountAndBatchSize(Chain->IterableNum(), MaxThreadsAllowed, MinBatchSizeAllowed, ThreadsCount, BatchSize);
+		TRACE_CPUPROFILER_EVENT_SCOPE_STR("SendDataToNiagara");
+		FBattleFrameStageTuner::FScope StageTiming(StageTuner, TEXT("SendDataToNiagara"));
 
-		Chain->OperateConcurrently(
-			[&](FSolidSubjectHandle Subject,
-				FAnimation& Anim,
-				FAppear& Appear,
-				FAttack& Attack,
-				FDeath& Death,
-				FMove& Move,
-				FMoving& Moving,
-				FSlowing& Slowing)
+		Mechanism->Operate<FUnsafeChain>(RenderBatchFilter,
+			[&](FSubjectHandle Subject,
+				FRenderBatchData& Data)
 			{
-				// 待机-移动切换 | Idle-Move Switch
-				const bool bIsAppearing = Subject.HasTrait<FAppearing>();
-				const bool bIsDying = Subject.HasTrait<FDying>();
+				// ------------------Transform---------------------------------
 
-				if (!bIsAppearing && !bIsDying)
-				{
-					const bool bIsAttacking = Subject.HasTrait<FAttacking>();
+				UNiagaraDataInterfaceArrayFunctionLibrary::SetNiagaraArrayVector(
+					Data.SpawnedNiagaraSystem,
+					FName("LocationArray"),
+					Data.LocationArray
+				);
 
-					if (bIsAttacking)
-					{
-						EAttackState State = Subject.GetTraitRef<FAttacking>().State;
+				UNiagaraDataInterfaceArrayFunctionLibrary::SetNiagaraArrayQuat(
+					Data.SpawnedNiagaraSystem,
+					FName("OrientationArray"),
+					Data.OrientationArray
+				);
 
-						if (State == EAttackState::Cooling)// if is attacking but cooling, we use idle-move anim
-						{
-							const bool IsMoving = Moving.CurrentVelocity.Size2D() > Move.XY.MoveSpeed * 0.05f/* || Moving.CurrentAngularVelocity > Move.Yaw.TurnSpeed * 0.1f*/;// take into account angular velocity
-							Anim.SubjectState = IsMoving ? ESubjectState::Moving : ESubjectState::Idle;
-						}
-					}
-					else
-					{
-						const bool IsMoving = Moving.CurrentVelocity.Size2D() > Move.XY.MoveSpeed * 0.05f/* || Moving.CurrentAngularVelocity > Move.Yaw.TurnSpeed * 0.1f*/;
-						Anim.SubjectState = IsMoving ? ESubjectState::Moving : ESubjectState::Idle;
-					}
-				}
+				UNiagaraDataInterfaceArrayFunctionLibrary::SetNiagaraArrayVector(
+					Data.SpawnedNiagaraSystem,
+					FName("ScaleArray"),
+					Data.ScaleArray
+				);
 
-				// 动画状态机 | Anim State Machine
-				if ( Anim.AnimLerp == 1)
-				{
-					switch (Anim.SubjectState)
-					{
-						case ESubjectState::None:
-						{
-							if (Anim.SubjectState != Anim.PreviousSubjectState)
-							{
-								CopyAnimData(Anim);
-								Anim.AnimCurrentTime1 = GetGameTimeSinceCreation();
-								Anim.AnimIndex1 = Anim.IndexOfIdleAnim;
-								Anim.AnimPauseTime1 = 0;
-								Anim.AnimPlayRate1 = 0;
-							}
+				// -----------------VAT Auto Play------------------------------
 
-							break;
-						}
+				UNiagaraDataInterfaceArrayFunctionLibrary::SetNiagaraArrayFloat(
+					Data.SpawnedNiagaraSystem,
+					FName("Anim_Lerp_Array"),
+					Data.Anim_Lerp_Array
+				);
 
-						case ESubjectState::Appearing:
-						{
-							if (Anim.SubjectState != Anim.PreviousSubjectState)
-							{
-								CopyAnimData(Anim);
-								Anim.AnimCurrentTime1 = GetGameTimeSinceCreation();
-								Anim.AnimIndex1 = Anim.IndexOfAppearAnim;
-								Anim.AnimPauseTime1 = Anim.AnimLengthArray.Num() > Anim.IndexOfAppearAnim ? Anim.AnimLengthArray[Anim.IndexOfAppearAnim] : 0;
-								Anim.AnimPlayRate1 = Anim.AnimPauseTime1 / Appear.Duration;
-								Anim.AnimLerp = 1;// since appearing is definitely the first anim to play
-							}
+				UNiagaraDataInterfaceArrayFunctionLibrary::SetNiagaraArrayVector4(
+					Data.SpawnedNiagaraSystem,
+					FName("Anim_Index0_Index1_PauseTime0_PauseTime1_Array"),
+					Data.Anim_Index0_Index1_PauseTime0_PauseTime1_Array
+				);
 
-							break;
-						}
+				UNiagaraDataInterfaceArrayFunctionLibrary::SetNiagaraArrayVector4(
+					Data.SpawnedNiagaraSystem,
+					FName("Anim_TimeStamp0_TimeStamp1_PlayRate0_Playrate1_Array"),
+					Data.Anim_TimeStamp0_TimeStamp1_PlayRate0_Playrate1_Array
+				);
 
-						case ESubjectState::Idle:
-						{
-							if (Anim.SubjectState != Anim.PreviousSubjectState)
-							{
-								CopyAnimData(Anim);
-								Anim.AnimCurrentTime1 = GetGameTimeSinceCreation();
-								Anim.AnimIndex1 = Anim.IndexOfIdleAnim;
-								Anim.AnimPauseTime1 = 0;
-								Anim.AnimOffsetTime1 = FMath::RandRange(Anim.IdleRandomTimeOffset.X, Anim.IdleRandomTimeOffset.Y);
-							}
+				// ------------------Material FX---------------------------
 
-							Anim.AnimPlayRate1 = Anim.IdlePlayRate * Slowing.CombinedSlowMult;
+				UNiagaraDataInterfaceArrayFunctionLibrary::SetNiagaraArrayVector4(
+					Data.SpawnedNiagaraSystem,
+					FName("Mat_Dissolve_HitGlow_Team_Fire_Array"),
+					Data.Mat_Dissolve_HitGlow_Team_Fire_Array
+				);
 
-							break;
-						}
-
-						case ESubjectState::Moving:
-						{
-							if (Anim.SubjectState != Anim.PreviousSubjectState)
-							{
-								CopyAnimData(Anim);
-								Anim.AnimCurrentTime1 = GetGameTimeSinceCreation();
-								Anim.AnimIndex1 = Anim.IndexOfMoveAnim;
-								Anim.AnimPauseTime1 = 0;
-								Anim.AnimOffsetTime1 = FMath::RandRange(Anim.MoveRandomTimeOffset.X, Anim.MoveRandomTimeOffset.Y);
-							}
-
-							Anim.AnimPlayRate1 = Anim.MovePlayRate * Slowing.CombinedSlowMult;
-
-							break;
-						}
-
-						case ESubjectState::Attacking:
-						{
-							if (Anim.SubjectState != Anim.PreviousSubjectState)
-							{
-								CopyAnimData(Anim);
-								Anim.AnimCurrentTime1 = GetGameTimeSinceCreation();
-							}
-
-							Anim.AnimIndex1 = Anim.IndexOfAttackAnim;
-							Anim.AnimPauseTime1 = Anim.AnimLengthArray.Num() > Anim.IndexOfAttackAnim ? Anim.AnimLengthArray[Anim.IndexOfAttackAnim] : 0;
-							Anim.AnimPlayRate1 = Anim.AnimPauseTime1 / Attack.DurationPerRound * Slowing.CombinedSlowMult;
-
-							break;
-						}
-
-						case ESubjectState::Dying:
-						{
-							if (Anim.SubjectState != Anim.PreviousSubjectState)
-							{
-								CopyAnimData(Anim);
-								Anim.AnimCurrentTime1 = GetGameTimeSinceCreation();
-								Anim.AnimIndex1 = Anim.IndexOfDeathAnim;
-								Anim.AnimPauseTime1 = Anim.AnimLengthArray.Num() > Anim.IndexOfDeathAnim ? Anim.AnimLengthArray[Anim.IndexOfDeathAnim] : 0;
-								Anim.AnimPlayRate1 = Anim.AnimPauseTime1 / Death.AnimLength;
-							}
-
-							break;
-						}
-					}
-
-					Anim.PreviousSubjectState = Anim.SubjectState;
-				}
-
-				Anim.AnimLerp = FMath::Clamp(Anim.AnimLerp + SafeDeltaTime * Anim.LerpSpeed, 0, 1);
-
-			}, ThreadsCount, BatchSize);
-	}
-	#pragma endregion
-
-	// 池初始化 | Init Pooling Info
-	#pragma region
-	{
-		TRACE_CPUPROFILER_EVENT_SCOPE_STR("ClearValidTransforms");
-
-		auto Chain = Mechanism->EnchainSolid(RenderBatchFilter);
-		UBattleFrameFunctionLibraryRT::CalculateThreadsCountAndBatchSize(Chain->IterableNum(), MaxThreadsAllowed, MinBatchSizeAllowed, ThreadsCount, BatchSize);
-
-		Chain->OperateConcurrently(
-			[&](FSolidSubjectHandle Subject,
-				FRenderBatchData& Data)
-			{
-				Data.ValidTransforms.Reset();
-
-				Data.Text_Location_Array.Reset();
-				Data.Text_Value_Style_Scale_Offset_Array.Reset();
-
-			}, ThreadsCount, BatchSize);
-	}
-	#pragma endregion
-
-	// 收集渲染数据 | Gather Render Data
-	#pragma region
-	{
-		TRACE_CPUPROFILER_EVENT_SCOPE_STR("AgentRender");
-
-		auto Chain = Mechanism->EnchainSolid(AgentRenderFilter);
-		UBattleFrameFunctionLibraryRT::CalculateThreadsCountAndBatchSize(Chain->IterableNum(), MaxThreadsAllowed, MinBatchSizeAllowed, ThreadsCount, BatchSize);
-
-		Chain->OperateConcurrently(
-			[&](FSolidSubjectHandle Subject,
-				FRendering& Rendering,
-				FLocated& Located,
-				FDirected& Directed,
-				FScaled& Scaled,
-				FCollider& Collider,
-				FAnimation& Anim,
-				FHealth& Health,
-				FHealthBar& HealthBar,
-				FPoppingText& PoppingText)
-			{
-				FRenderBatchData& Data = Rendering.Renderer.GetTraitRef<FRenderBatchData, EParadigm::Unsafe>();
-
-				FQuat Rotation{ FQuat::Identity };
-				Rotation = Directed.Direction.Rotation().Quaternion();
-
-				FVector FinalScale(Data.Scale);
-				FinalScale *= Scaled.RenderScale;
-
-				float Radius = Collider.Radius * Scaled.Scale;
-
-				// 在计算转换时减去Radius
-				FTransform SubjectTransform(Rotation * Data.OffsetRotation.Quaternion(), Located.Location + Data.OffsetLocation - FVector(0, 0, Radius), FinalScale); // 减去Z轴上的Radius					
-
-				int32 InstanceId = Rendering.InstanceId;
-
-				Data.Lock();
-
-				Data.ValidTransforms[InstanceId] = true;
-				Data.Transforms[InstanceId] = SubjectTransform;
-
-				// Transforms
-				Data.LocationArray[InstanceId] = SubjectTransform.GetLocation();
-				Data.OrientationArray[InstanceId] = SubjectTransform.GetRotation();
-				Data.ScaleArray[InstanceId] = SubjectTransform.GetScale3D();
-
-				// Pariticle color R
-				Data.Anim_Lerp_Array[InstanceId] = Anim.AnimLerp;
-
-				// Dynamic params 0
-				Data.Anim_Index0_Index1_PauseTime0_PauseTime1_Array[InstanceId] = FVector4(Anim.AnimIndex0, Anim.AnimIndex1, Anim.AnimPauseTime0, Anim.AnimPauseTime1);
-
-				// Dynamic params 1
-				Data.Anim_TimeStamp0_TimeStamp1_PlayRate0_Playrate1_Array[InstanceId] = FVector4(Anim.AnimCurrentTime0 - Anim.AnimOffsetTime0, Anim.AnimCurrentTime1 - Anim.AnimOffsetTime1, Anim.AnimPlayRate0, Anim.AnimPlayRate1);
-
-				// Dynamic params 2
-				Data.Mat_Dissolve_HitGlow_Team_Fire_Array[InstanceId] = FVector4(Anim.Dissolve, Anim.HitGlow, Anim.Team, Anim.FireFx);
-
-				// Dynamic params 3
-				Data.Mat_Ice_Poison_Array[InstanceId] = FVector4(Anim.IceFx, Anim.PoisonFx, 0, 0);
-
-				// HealthBar
-				Data.HealthBar_Opacity_CurrentRatio_TargetRatio_Array[InstanceId] = FVector(HealthBar.Opacity, HealthBar.CurrentRatio, HealthBar.TargetRatio);
-
-				// PopText
-				Data.Text_Location_Array.Append(PoppingText.TextLocationArray);
-
-				float MaxFinalScale = FMath::Max3(FinalScale.X, FinalScale.Y, FinalScale.Z);
-
-				for (const auto& Text_Value_Style_Scale_Offset : PoppingText.Text_Value_Style_Scale_Offset_Array)
-				{
-					Data.Text_Value_Style_Scale_Offset_Array.Add(Text_Value_Style_Scale_Offset * FVector4(1,1,1, MaxFinalScale));
-				}
-
-				Data.Unlock();
-
-				PoppingText.TextLocationArray.Empty();
-				PoppingText.Text_Value_Style_Scale_Offset_Array.Empty();
-
-				Subject.SetFlag(HasPoppingTextFlag, false);
-
-			}, ThreadsCount, BatchSize);
-	}
-	#pragma endregion
-
-	// 池写入 | Write Pooling Info
-	#pragma region
-	{
-		TRACE_CPUPROFILER_EVENT_SCOPE_STR("WritePoolingInfo");
-
-		auto Chain = Mechanism->EnchainSolid(RenderBatchFilter);
-		UBattleFrameFunctionLibraryRT::CalculateThreadsCountAndBatchSize(Chain->IterableNum(), MaxThreadsAllowed, MinBatchSizeAllowed, ThreadsCount, BatchSize);
-
-		Chain->OperateConcurrently(
-			[&](FSolidSubjectHandle Subject,
-				FRenderBatchData& Data)
-			{
-				// 重置和隐藏限制数组成员
-				Data.FreeTransforms.Reset();
-
-				for (int32 i = Data.ValidTransforms.IndexOf(false);
-					i < Data.Transforms.Num();
-					i = Data.ValidTransforms.IndexOf(false, i + 1))
-				{
-					Data.FreeTransforms.Add(i);
-					Data.InsidePool_Array[i] = true;
-				}
-
-			}, ThreadsCount, BatchSize);
-	}
-	#pragma endregion
-
-	// 发送至Niagara | Send Data to Niagara
-	#pragma region
-	{
-		TRACE_CPUPROFILER_EVENT_SCOPE_STR("SendDataToNiagara");
-
-		Mechanism->Operate<FUnsafeChain>(RenderBatchFilter,
-			[&](FSubjectHandle Subject,
-				FRenderBatchData& Data)
-			{
-				// ------------------Transform---------------------------------
-
-				UNiagaraDataInterfaceArrayFunctionLibrary::SetNiagaraArrayVector(
-					Data.SpawnedNiagaraSystem,
-					FName("LocationArray"),
-					Data.LocationArray
-				);
-
-				UNiagaraDataInterfaceArrayFunctionLibrary::SetNiagaraArrayQuat(
-					Data.SpawnedNiagaraSystem,
-					FName("OrientationArray"),
-					Data.OrientationArray
-				);
-
-				UNiagaraDataInterfaceArrayFunctionLibrary::SetNiagaraArrayVector(
-					Data.SpawnedNiagaraSystem,
-					FName("ScaleArray"),
-					Data.ScaleArray
-				);
-
-				// -----------------VAT Auto Play------------------------------
-
-				UNiagaraDataInterfaceArrayFunctionLibrary::SetNiagaraArrayFloat(
-					Data.SpawnedNiagaraSystem,
-					FName("Anim_Lerp_Array"),
-					Data.Anim_Lerp_Array
-				);
-
-				UNiagaraDataInterfaceArrayFunctionLibrary::SetNiagaraArrayVector4(
-					Data.SpawnedNiagaraSystem,
-					FName("Anim_Index0_Index1_PauseTime0_PauseTime1_Array"),
-					Data.Anim_Index0_Index1_PauseTime0_PauseTime1_Array
-				);
-
-				UNiagaraDataInterfaceArrayFunctionLibrary::SetNiagaraArrayVector4(
-					Data.SpawnedNiagaraSystem,
-					FName("Anim_TimeStamp0_TimeStamp1_PlayRate0_Playrate1_Array"),
-					Data.Anim_TimeStamp0_TimeStamp1_PlayRate0_Playrate1_Array
-				);
-
-				// ------------------Material FX---------------------------
-
-				UNiagaraDataInterfaceArrayFunctionLibrary::SetNiagaraArrayVector4(
-					Data.SpawnedNiagaraSystem,
-					FName("Mat_Dissolve_HitGlow_Team_Fire_Array"),
-					Data.Mat_Dissolve_HitGlow_Team_Fire_Array
-				);
-
-				UNiagaraDataInterfaceArrayFunctionLibrary::SetNiagaraArrayVector4(
-					Data.SpawnedNiagaraSystem,
-					FName("Mat_Ice_Poison_Array"),
-					Data.Mat_Ice_Poison_Array
-				);
+				UNiagaraDataInterfaceArrayFunctionLibrary::SetNiagaraArrayVector4(
+					Data.SpawnedNiagaraSystem,
+					FName("Mat_Ice_Poison_Array"),
+					Data.Mat_Ice_Poison_Array
+				);
 
 				// ------------------HealthBar---------------------------------
 
@@ -3423,7 +3299,7 @@ void ABattleFrameBattleControl::Tick(float DeltaTime)
 					if (!bLifeIsInfinite)
 					{
 						const bool bLifeExpired = Config.LifeSpan == 0;
-						const bool bInvalidAttachment = Config.bAttached && !Config.AttachToSubject.IsValid();
+						const bool bInvalidAttachment = Config.bAttached && (!Config.AttachToSubject.IsValid() || Config.AttachToSubject.HasTrait<FPooled>());
 
 						if (!bHasValidChild || bLifeExpired || bInvalidAttachment)
 						{
@@ -3592,7 +3468,7 @@ void ABattleFrameBattleControl::Tick(float DeltaTime)
 					if (!bLifeIsInfinite)
 					{
 						const bool bLifeExpired = Config.LifeSpan == 0;
-						const bool bInvalidAttachment = Config.bAttached && !Config.AttachToSubject.IsValid();
+						const bool bInvalidAttachment = Config.bAttached && (!Config.AttachToSubject.IsValid() || Config.AttachToSubject.HasTrait<FPooled>());
 
 						if (!bHasValidChild || bLifeExpired || bInvalidAttachment)
 						{
@@ -3723,7 +3599,7 @@ void ABattleFrameBattleControl::Tick(float DeltaTime)
 					if (!bLifeIsInfinite)
 					{
 						const bool bLifeExpired = Config.LifeSpan == 0;
-						const bool bInvalidAttachment = Config.bAttached && Config.bDespawnWhenNoParent && !Config.AttachToSubject.IsValid();
+						const bool bInvalidAttachment = Config.bAttached && Config.bDespawnWhenNoParent && (!Config.AttachToSubject.IsValid() || Config.AttachToSubject.HasTrait<FPooled>());
 
 						if (!bHasValidChild || bLifeExpired || bInvalidAttachment)
 						{
@@ -3756,216 +3632,154 @@ void ABattleFrameBattleControl::Tick(float DeltaTime)
 	// WIP 事件接口 | Event Callback Interface
 	#pragma region
 	{
-		while (!OnAppearQueue.IsEmpty())
-		{
-			FAppearData Data;
-			OnAppearQueue.Dequeue(Data);
+		DispatchEvents(OnAppearQueue,
+			[](AActor* Actor, const FAppearData& Data) { IBattleFrameInterface::Execute_OnAppear(Actor, Data); },
+			[](AActor* Actor, const TArray<FAppearData>& Data) { IBattleFrameBatchInterface::Execute_OnAppearBatch(Actor, Data); });
 
-			if (Data.SelfSubject.IsValid())
-			{
-				AActor* DmgActor = Data.SelfSubject.GetSubjective()->GetActor();
-
-				if (DmgActor && DmgActor->GetClass()->ImplementsInterface(UBattleFrameInterface::StaticClass()))
-				{
-					IBattleFrameInterface::Execute_OnAppear(DmgActor, Data);
-				}
-			}
-		}
+		DispatchEvents(OnTraceQueue,
+			[](AActor* Actor, const FTraceData& Data) { IBattleFrameInterface::Execute_OnTrace(Actor, Data); },
+			[](AActor* Actor, const TArray<FTraceData>& Data) { IBattleFrameBatchInterface::Execute_OnTraceBatch(Actor, Data); });
 
-		while (!OnTraceQueue.IsEmpty())
-		{
-			FTraceData Data;
-			OnTraceQueue.Dequeue(Data);
+		DispatchEvents(OnMoveQueue,
+			[](AActor* Actor, const FMoveData& Data) { IBattleFrameInterface::Execute_OnMove(Actor, Data); },
+			[](AActor* Actor, const TArray<FMoveData>& Data) { IBattleFrameBatchInterface::Execute_OnMoveBatch(Actor, Data); });
 
-			if (Data.SelfSubject.IsValid())
-			{
-				AActor* DmgActor = Data.SelfSubject.GetSubjective()->GetActor();
+		DispatchEvents(OnAttackQueue,
+			[](AActor* Actor, const FAttackData& Data) { IBattleFrameInterface::Execute_OnAttack(Actor, Data); },
+			[](AActor* Actor, const TArray<FAttackData>& Data) { IBattleFrameBatchInterface::Execute_OnAttackBatch(Actor, Data); });
 
-				if (DmgActor && DmgActor->GetClass()->ImplementsInterface(UBattleFrameInterface::StaticClass()))
-				{
-					IBattleFrameInterface::Execute_OnTrace(DmgActor, Data);
-				}
-			}
-		}
+		DispatchEvents(OnHitQueue,
+			[](AActor* Actor, const FHitData& Data) { IBattleFrameInterface::Execute_OnHit(Actor, Data); },
+			[](AActor* Actor, const TArray<FHitData>& Data) { IBattleFrameBatchInterface::Execute_OnHitBatch(Actor, Data); });
 
-		while (!OnMoveQueue.IsEmpty())
-		{
-			FMoveData Data;
-			OnMoveQueue.Dequeue(Data);
+		DispatchEvents(OnDeathQueue,
+			[](AActor* Actor, const FDeathData& Data) { IBattleFrameInterface::Execute_OnDeath(Actor, Data); },
+			[](AActor* Actor, const TArray<FDeathData>& Data) { IBattleFrameBatchInterface::Execute_OnDeathBatch(Actor, Data); });
+	}
+	#pragma endregion
 
-			if (Data.SelfSubject.IsValid())
-			{
-				AActor* DmgActor = Data.SelfSubject.GetSubjective()->GetActor();
-
-				if (DmgActor && DmgActor->GetClass()->ImplementsInterface(UBattleFrameInterface::StaticClass()))
-				{
-					IBattleFrameInterface::Execute_OnMove(DmgActor, Data);
-				}
-			}
-		}
-
-		while (!OnAttackQueue.IsEmpty())
-		{
-			FAttackData Data;
-			OnAttackQueue.Dequeue(Data);
-
-			if (Data.SelfSubject.IsValid())
-			{
-				AActor* DmgActor = Data.SelfSubject.GetSubjective()->GetActor();
+	// WIP 调试图形 | Draw Debug Shapes
+	#pragma region
+	{
+		TRACE_CPUPROFILER_EVENT_SCOPE_STR("DrawDebugShapes");
 
-				if (DmgActor && DmgActor->GetClass()->ImplementsInterface(UBattleFrameInterface::StaticClass()))
-				{
-					IBattleFrameInterface::Execute_OnAttack(DmgActor, Data);
-				}
-			}
-		}
+		// 细分程度按到相机的距离 | tessellation follows the distance to the camera
+		FVector ViewLocation = FVector::ZeroVector;
 
-		while (!OnHitQueue.IsEmpty())
+		if (const APlayerCameraManager* CameraManager = UGameplayStatics::GetPlayerCameraManager(CurrentWorld, 0))
 		{
-			FHitData Data;
-			OnHitQueue.Dequeue(Data);
-
-			if (Data.SelfSubject.IsValid())
-			{
-				AActor* DmgActor = Data.SelfSubject.GetSubjective()->GetActor();
-
-				if (DmgActor && DmgActor->GetClass()->ImplementsInterface(UBattleFrameInterface::StaticClass()))
-				{
-					IBattleFrameInterface::Execute_OnHit(DmgActor, Data);
-				}
-			}
+			ViewLocation = CameraManager->GetCameraLocation();
 		}
 
-		while (!OnDeathQueue.IsEmpty())
-		{
-			FDeathData Data;
-			OnDeathQueue.Dequeue(Data);
-
-			if (Data.SelfSubject.IsValid())
-			{
-				AActor* DmgActor = Data.SelfSubject.GetSubjective()->GetActor();
-
-				if (DmgActor && DmgActor->GetClass()->ImplementsInterface(UBattleFrameInterface::StaticClass()))
-				{
-					IBattleFrameInterface::Execute_OnDeath(DmgActor, Data);
-				}
-			}
-		}
-	}
-	#pragma endregion
+		DebugDraw.MaxLines = MaxDebugLines;
+		DebugDraw.SegmentScale = DebugSegmentScale;
+		DebugDraw.BeginFrame(ViewLocation);
 
-	// WIP 调试图形 | Draw Debug Shapes
-	#pragma region
-	{
 		// 绘制胶囊体队列
-		while (!DebugCapsuleQueue.IsEmpty())
+		DebugCapsuleQueue.Drain([&](const FDebugCapsuleConfig& Config)
 		{
-			FDebugCapsuleConfig Config;
-			DebugCapsuleQueue.Dequeue(Config);
-
-			// 计算胶囊体半高（从中心到顶部/底部的距离）
-			const float HalfHeight = FMath::Max(0.0f, Config.Height * 0.5f);
-
-			DrawDebugCapsule(
-				CurrentWorld,
-				Config.Location,          // 胶囊体中心位置
-				HalfHeight,               // 半高（从中心到端点的距离）
-				Config.Radius,            // 半径
-				Config.Rotation.Quaternion(), // 转换为四元数
-				Config.Color,             // 配置的颜色
-				false,                    // 非持久
-				Config.Duration,          // 生命周期0=只持续1帧
-				0,						  
-				Config.LineThickness      // 线宽（胶囊体通常需要较细的线）
-			);
-		}
+			// 胶囊体半高（从中心到顶部/底部的距离）
+			DebugDraw.AddCapsule(Config.Location, FMath::Max(0.0f, Config.Height * 0.5f), Config.Radius, Config.Rotation.Quaternion(), Config.Color, Config.Duration, Config.LineThickness);
+		});
 
 		// 绘制线队列
-		while (!DebugLineQueue.IsEmpty())
+		DebugLineQueue.Drain([&](const FDebugLineConfig& Config)
 		{
-			FDebugLineConfig Config;
-			DebugLineQueue.Dequeue(Config);
-
-			DrawDebugLine(
-				CurrentWorld,
-				Config.StartLocation,
-				Config.EndLocation,
-				Config.Color,
-				false,
-				Config.Duration,
-				3,
-				Config.LineThickness
-			);
-		}
+			DebugDraw.AddLine(Config.StartLocation, Config.EndLocation, Config.Color, Config.Duration, Config.LineThickness, 3);
+		});
 
 		// 绘制球队列
-		while (!DebugSphereQueue.IsEmpty())
+		DebugSphereQueue.Drain([&](const FDebugSphereConfig& Config)
 		{
-			FDebugSphereConfig Config;
-			DebugSphereQueue.Dequeue(Config);
-
-			DrawDebugSphere(
-				CurrentWorld,
-				Config.Location,
-				Config.Radius,
-				12,
-				Config.Color,
-				false,
-				Config.Duration,
-				0,
-				Config.LineThickness
-			);
-		}
+			DebugDraw.AddSphere(Config.Location, Config.Radius, Config.Color, Config.Duration, Config.LineThickness);
+		});
 
 		// 绘制扇形队列
-		while (!DebugSectorQueue.IsEmpty())
+		DebugSectorQueue.Drain([&](const FDebugSectorConfig& Config)
 		{
-			FDebugSectorConfig Config;
-			DebugSectorQueue.Dequeue(Config);
-
-			DrawDebugSector(
-				CurrentWorld,
-				Config.Location,
-				Config.Direction,
-				Config.Radius,
-				Config.Angle, // 扇形角度
-				Config.Height,
-				Config.Color, // 橙色扇形
-				false, // 非持久
-				Config.Duration, // 显示0.1秒
-				0, // 深度优先级
-				Config.LineThickness // 线宽
-			);
-
-			//UE_LOG(LogTemp, Log, TEXT("Dequeue"));
-		}
+			DebugDraw.AddSector(Config.Location, Config.Direction, Config.Radius, Config.Angle, Config.Height, Config.Color, Config.Duration, Config.LineThickness);
+		});
 
-		// 绘制圆队列
-		while (!DebugCircleQueue.IsEmpty())
+		// 绘制圆队列（XY平面）
+		DebugCircleQueue.Drain([&](const FDebugCircleConfig& Config)
 		{
-			FDebugCircleConfig Config;
-			DebugCircleQueue.Dequeue(Config);
-
-			// 绘制圆形（XY平面）
-			DrawDebugCircle(
-				CurrentWorld,
-				Config.Location,  // 圆心位置
-				Config.Radius,    // 圆半径
-				36,               // 分段数（足够平滑）
-				Config.Color,     // 配置的颜色
-				false,            // 非持久
-				Config.Duration,  // 生命周期0=只持续1帧
-				3,                // 深度优先级
-				Config.LineThickness,// 线宽
-				FVector(1, 0, 0), // X轴
-				FVector(0, 1, 0), // Y轴
-				false             // 不绘制坐标轴
-			);
-		}
+			DebugDraw.AddCircle(Config.Location, Config.Radius, Config.Color, Config.Duration, Config.LineThickness, FVector(1, 0, 0), FVector(0, 1, 0), 3);
+		});
+
+		TRACE_COUNTER_SET(BattleFrame_DebugLines, DebugDraw.Num());
+		TRACE_COUNTER_SET(BattleFrame_DebugShapesDropped, DebugDraw.GetNumDropped());
+
+		// 整帧的线一次交给世界的线批处理器 | the whole frame of lines goes to the world's line batchers at once
+		DebugDraw.Flush(CurrentWorld);
 	}
 	#pragma endregion
 }
 
+void ABattleFrameBattleControl::PublishFrameStats()
+{
+	TRACE_CPUPROFILER_EVENT_SCOPE_STR("PublishFrameStats");
+
+	int64 Counters[FBattleFrameCounters::NumCounters];
+	FBattleFrameCounters::Collect(Counters);
+
+	FrameStats.AgentCount = AgentCount;
+	FrameStats.NeighborsExamined = Counters[static_cast<int32>(EBattleFrameCounter::NeighborsExamined)];
+	FrameStats.OrcaLinesBuilt = Counters[static_cast<int32>(EBattleFrameCounter::OrcaLinesBuilt)];
+	FrameStats.TracesIssued = Counters[static_cast<int32>(EBattleFrameCounter::TracesIssued)];
+	FrameStats.DamageEvents = Counters[static_cast<int32>(EBattleFrameCounter::DamageEvents)];
+
+	SET_DWORD_STAT(STAT_BattleFrame_Agents, FrameStats.AgentCount);
+	SET_DWORD_STAT(STAT_BattleFrame_NeighborsExamined, FrameStats.NeighborsExamined);
+	SET_DWORD_STAT(STAT_BattleFrame_OrcaLinesBuilt, FrameStats.OrcaLinesBuilt);
+	SET_DWORD_STAT(STAT_BattleFrame_TracesIssued, FrameStats.TracesIssued);
+	SET_DWORD_STAT(STAT_BattleFrame_DamageEvents, FrameStats.DamageEvents);
+
+	FrameStats.Stages.Reset();
+
+	StageTuner.ForEachStage([&](const FBattleFrameStageTuning& Tuning)
+	{
+		FBattleFrameStageStats& Stats = FrameStats.Stages.AddDefaulted_GetRef();
+		Stats.Stage = Tuning.Name;
+		Stats.Items = Tuning.ItemsCount;
+		Stats.Threads = Tuning.ThreadsCount;
+		Stats.BatchSize = Tuning.BatchSize;
+		Tuning.GetRecentTimes(Stats.MeanMs, Stats.P95Ms, Stats.MaxMs);
+
+	#if STATS
+		SET_FLOAT_STAT_FName(Tuning.MeanStatId.GetName(), Stats.MeanMs);
+		SET_FLOAT_STAT_FName(Tuning.P95StatId.GetName(), Stats.P95Ms);
+		SET_FLOAT_STAT_FName(Tuning.MaxStatId.GetName(), Stats.MaxMs);
+		SET_DWORD_STAT_FName(Tuning.ItemsStatId.GetName(), Stats.Items);
+		SET_DWORD_STAT_FName(Tuning.ThreadsStatId.GetName(), Stats.Threads);
+	#endif
+
+	#if CSV_PROFILER
+		FCsvProfiler::RecordCustomStat(Tuning.ThreadsStatName, CSV_CATEGORY_INDEX(BattleFrameTuner), Tuning.ThreadsCount, ECsvCustomStatOp::Set);
+		FCsvProfiler::RecordCustomStat(Tuning.BatchStatName, CSV_CATEGORY_INDEX(BattleFrameTuner), Tuning.BatchSize, ECsvCustomStatOp::Set);
+		FCsvProfiler::RecordCustomStat(Tuning.CostStatName, CSV_CATEGORY_INDEX(BattleFrameTuner), static_cast<float>(Tuning.SecondsPerItem * 1e9), ECsvCustomStatOp::Set);
+	#endif
+	});
+}
+
+void ABattleFrameBattleControl::SnapshotRenderState()
+{
+	TRACE_CPUPROFILER_EVENT_SCOPE_STR("SnapshotRenderState");
+
+	// 记下即将执行的这一步之前的状态，渲染时在两者之间插值 | Remember the state before the step about to run, rendering blends from it
+	const uint32 NextStep = SimStepCount + 1;
+
+	auto Chain = Mechanism->EnchainSolid(AgentRenderFilter);
+	FBattleFrameStageTuner::FScope StageTuning(StageTuner, TEXT("SnapshotRenderState"), Chain->IterableNum(), MaxThreadsAllowed, MinBatchSizeAllowed, ThreadsCount, BatchSize);
+
+	Chain->OperateConcurrently([&](FRendering& Rendering, const FLocated& Located, const FDirected& Directed)
+	{
+		Rendering.PrevLocation = Located.Location;
+		Rendering.PrevDirection = Directed.Direction;
+		Rendering.SnapshotStep = NextStep;
+
+	}, ThreadsCount, BatchSize);
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
 void ABattleFrameBattleControl::DefineFilters()
@@ -3973,7 +3787,7 @@ void ABattleFrameBattleControl::DefineFilters()
 	// this is a bit inconvenient but good for performance
 	bIsFilterReady = true;
 
-	AgentCountFilter = FFilter::Make<FAgent>();
+	AgentCountFilter = FFilter::Make<FAgent>().Exclude<FPooled>();
 	AgentStatFilter = FFilter::Make<FStatistics>();
 	AgentMayDieFilter = FFilter::Make<FMayDie>();
 	AgentAppeaFilter = FFilter::Make<FAgent, FRendering, FLocated, FDirected, FScaled, FAppear, FAppearing, FAnimation, FActivated>();
@@ -3990,12 +3804,17 @@ void ABattleFrameBattleControl::DefineFilters()
 	AgentDeathAnimFilter = FFilter::Make<FAgent, FRendering, FDeathAnim, FAnimation, FDying, FActivated>();
 	AgentSleepFilter = FFilter::Make<FAgent, FLocated, FDirected, FScaled, FCollider, FSleep, FSleeping, FTrace, FTracing, FMove, FMoving, FRendering, FActivated>().Exclude<FAppearing, FAttacking, FDying>();
 	AgentPatrolFilter = FFilter::Make<FAgent, FLocated, FDirected, FScaled, FCollider, FPatrol, FPatrolling, FTrace, FTracing, FMove, FMoving, FRendering, FActivated>().Exclude<FAppearing, FSleeping, FAttacking, FDying>();
+	AgentSimLODFilter = FFilter::Make<FAgent, FLocated, FActivated>();
 	AgentMoveFilter = FFilter::Make<FAgent, FRendering, FAnimation, FMove, FMoving, FChase, FLocated, FDirected, FScaled, FCollider, FAttack, FTrace, FTracing, FNavigation, FAvoidance, FAvoiding, FDefence, FPatrol, FGridData, FSlowing, FActivated>();
 	AgentStateMachineFilter = FFilter::Make<FAgent, FAnimation, FRendering, FAppear, FAttack, FDeath, FMoving, FSlowing, FActivated>();
 	AgentRenderFilter = FFilter::Make<FAgent, FRendering, FLocated, FDirected, FScaled, FCollider, FAnimation, FHealth, FHealthBar, FPoppingText, FActivated>();
 
 	TemporalDamagerFilter = FFilter::Make<FTemporalDamager>();
 	SlowerFilter = FFilter::Make<FSlower>();
+	StatusEffectsFilter = FFilter::Make<FStatusEffects, FSlowing, FActivated>().Exclude<FDying, FPooled>();
+	PooledRenderFilter = FFilter::Make<FPooled, FRendering>();
+	NavigationResolveFilter = FFilter::Make<FNavigation, FActivated>();
+	BindFlowFieldResolveFilter = FFilter::Make<FBindFlowField>();
 
 	SpawnActorsFilter = FFilter::Make<FActorSpawnConfig_Final>();
 	SpawnFxFilter = FFilter::Make<FFxConfig_Final>();
@@ -4007,1027 +3826,1220 @@ void ABattleFrameBattleControl::DefineFilters()
 	SubjectFilterBase = FFilter::Make<FLocated, FDirected, FScaled, FCollider, FAvoidance, FAvoiding, FGridData, FActivated>().Exclude<FSphereObstacle, FBoxObstacle, FCorpse>();
 }
 
-// Blueprint callable version that don't use get ref and defers
-void ABattleFrameBattleControl::ApplyDamageToSubjects(const FSubjectArray& Subjects, const FSubjectArray& IgnoreSubjects, const FSubjectHandle DmgInstigator, const FVector& HitFromLocation, const FDamage& Damage, const FDebuff& Debuff, TArray<FDmgResult>& DamageResults)
+void ABattleFrameBattleControl::DefineStageGraphs()
 {
-	// 使用TSet存储唯一敌人句柄
-	TSet<FSubjectHandle> UniqueHandles;
-
-	// 将IgnoreSubjects转换为TSet以提高查找效率
-	const TSet<FSubjectHandle> IgnoreSet(IgnoreSubjects.Subjects);
-
-	for (const auto& Overlapper : Subjects.Subjects)
-	{
-		// 使用TSet的Contains替代数组的Contains
-		if (IgnoreSet.Contains(Overlapper)) continue;
-
-		int32 PreviousNum = UniqueHandles.Num();
-		UniqueHandles.Add(Overlapper);
-
-		if (UniqueHandles.Num() == PreviousNum) continue;
-
-		if (!Overlapper.IsValid()) continue;
-
-		// Pre-calculate all trait checks
-		const bool bHasHealth = Overlapper.HasTrait<FHealth>();
-		const bool bHasLocated = Overlapper.HasTrait<FLocated>();
-		const bool bHasDirected = Overlapper.HasTrait<FDirected>();
-		const bool bHasScaled = Overlapper.HasTrait<FScaled>();
-		const bool bHasCollider = Overlapper.HasTrait<FCollider>();
-		const bool bHasGridData = Overlapper.HasTrait<FGridData>();
-		const bool bHasDefence = Overlapper.HasTrait<FDefence>();
-		const bool bHasTextPopUp = Overlapper.HasTrait<FTextPopUp>();
-		const bool bHasMoving = Overlapper.HasTrait<FMoving>();
-		const bool bHasSlowing = Overlapper.HasTrait<FSlowing>();
-		const bool bHasAnimation = Overlapper.HasTrait<FAnimation>();
-		const bool bHasSleep = Overlapper.HasTrait<FSleep>();
-		const bool bHasSleeping = Overlapper.HasTrait<FSleeping>();
-		const bool bHasHit = Overlapper.HasTrait<FHit>();
-		const bool bHasHitGlow = Overlapper.HasTrait<FHitGlow>();
-		const bool bHasJiggle = Overlapper.HasTrait<FJiggle>();
-		const bool bHasPatrolling = Overlapper.HasTrait<FPatrolling>();
-		const bool bHasTrace = Overlapper.HasTrait<FTrace>();
-		const bool bHasIsSubjective = Overlapper.HasTrait<FIsSubjective>();
-
-		FVector Location = bHasLocated ? Overlapper.GetTrait<FLocated>().Location : FVector::ZeroVector;
-		FVector Direction = bHasDirected ? Overlapper.GetTrait<FDirected>().Direction : FVector::ZeroVector;
+	// 阶段只在这里声明一次，每帧只需获取链并执行 | Stages are declared once here, each frame only enchains and runs them
 
-		FDmgResult DmgResult;
-		DmgResult.DamagedSubject = Overlapper;
+	//------------------------出生 | Appear-------------------------
 
-		// 击退
-		FVector HitDirection = FVector::OneVector;
+	AppearStages.Reset(&StageTuner);
 
-		if (bHasLocated)
+	// 出生动画 | Birth Anim
+	AppearStages.AddChainStage(TEXT("AgentAppearAnim"), AgentAppearAnimFilter,
+		TBattleFrameStageTraits<FAgent, FRendering, FActivated, FAppear>::Make(),
+		{ BATTLEFRAME_STAGE_FIELD(FAnimation, SubjectState), BATTLEFRAME_STAGE_FIELD(FAnimation, PreviousSubjectState), FBattleFrameStageResource::Make<FAppearAnim>() },
+		[](auto Chain, float SafeDeltaTime, int32 StageThreadsCount, int32 StageBatchSize)
 		{
-			HitDirection = (Location - HitFromLocation).GetSafeNormal2D();
-		}
+			TRACE_CPUPROFILER_EVENT_SCOPE_STR("AgentAppearAnim");
 
-		//-------------伤害和抗性------------
+			Chain->OperateConcurrently(
+				[&](FSolidSubjectHandle Subject,
+					FAnimation& Animation,
+					FAppear& Appear,
+					FAppearAnim& AppearAnim)
+				{
+					if (AppearAnim.animTime == 0)
+					{
+						// 状态机
+						Animation.SubjectState = ESubjectState::Appearing;
+						Animation.PreviousSubjectState = ESubjectState::Dirty;
+					}
+			
+					if (AppearAnim.animTime >= Appear.Duration)
+					{
+						Subject.RemoveTraitDeferred<FAppearAnim>();
+					}
 
-		float NormalDmgMult = 1;
-		float FireDmgMult = 1;
-		float IceDmgMult = 1;
-		float PoisonDmgMult = 1;
-		float PercentDmgMult = 1;
+					AppearAnim.animTime += SafeDeltaTime;
 
-		if (bHasHealth)
+				}, StageThreadsCount, StageBatchSize);
+		});
+
+	// 出生淡入 | Dissolve In
+	AppearStages.AddChainStage(TEXT("AgentAppearDissolve"), AgentAppearDissolveFilter,
+		TBattleFrameStageTraits<FAgent, FRendering, FActivated, FCurves>::Make(),
+		{ BATTLEFRAME_STAGE_FIELD(FAnimation, Dissolve), FBattleFrameStageResource::Make<FAppearDissolve>() },
+		[](auto Chain, float SafeDeltaTime, int32 StageThreadsCount, int32 StageBatchSize)
 		{
-			auto Health = Overlapper.GetTrait<FHealth>();
+			TRACE_CPUPROFILER_EVENT_SCOPE_STR("AgentAppearDissolve");
 
-			// 抗性 如果有的话
-			if (bHasDefence)
-			{
-				const auto Defence = Overlapper.GetTrait<FDefence>();
+			Chain->OperateConcurrently(
+				[&](FSolidSubjectHandle Subject,
+					FAnimation& Animation,
+					FAppearDissolve& AppearDissolve,
+					FCurves& Curves)
+				{
+					auto Curve = Curves.DissolveIn.GetRichCurve();
 
-				NormalDmgMult = 1 - Defence.NormalDmgImmune;
-				FireDmgMult = 1 - Defence.FireDmgImmune;
-				IceDmgMult = 1 - Defence.IceDmgImmune;
-				PoisonDmgMult = 1 - Defence.PoisonDmgImmune;
-				PercentDmgMult = 1.f - Defence.PercentDmgImmune;
-			}
+					if (!Curve || Curve->GetNumKeys() == 0) return;
 
-			// 基础伤害
-			float BaseDamage = 0;
+					const auto EndTime = Curve->GetLastKey().Time;
+					Animation.Dissolve = 1 - Curve->Eval(FMath::Clamp(AppearDissolve.dissolveTime, 0, EndTime));
 
-			switch (Damage.DmgType)
-			{
-				case EDmgType::Normal:
-					BaseDamage = Damage.Damage * NormalDmgMult;
-					break;
-				case EDmgType::Fire:
-					BaseDamage = Damage.Damage * FireDmgMult;
-					break;
-				case EDmgType::Ice:
-					BaseDamage = Damage.Damage * IceDmgMult;
-					break;
-				case EDmgType::Poison:
-					BaseDamage = Damage.Damage * PoisonDmgMult;
-					break;
-			}
+					if (AppearDissolve.dissolveTime > EndTime)
+					{
+						Subject.RemoveTraitDeferred<FAppearDissolve>();
+					}
 
-			// 百分比伤害
-			float PercentageDamage = Health.Maximum * Damage.PercentDmg * PercentDmgMult;
+					AppearDissolve.dissolveTime += SafeDeltaTime;
 
-			// 总伤害
-			float CombinedDamage = BaseDamage + PercentageDamage;
+				}, StageThreadsCount, StageBatchSize);
+		});
 
-			// 考虑暴击后伤害
-			auto [bIsCrit, PostCritDamage] = ProcessCritDamage(CombinedDamage, Damage.CritDmgMult, Damage.CritProbability);
 
-			// 限制伤害以不大于剩余血量
-			float ClampedDamage = FMath::Min(PostCritDamage, Health.Current);
+	//------------------------受击 | Hit-------------------------
 
-			DmgResult.IsCritical = bIsCrit;
-			DmgResult.DmgDealt = ClampedDamage;
+	HitStages.Reset(&StageTuner);
 
-			if (ClampedDamage == Health.Current)
-			{
-				DmgResult.IsKill = true;
-				Overlapper.SetTrait(FMayDie());
-			}
+	// 更新血条 | Health Bar
+	HitStages.AddChainStage(TEXT("AgentHealthBar"), DecideHealthFilter,// it processes hero and prop type too
+		TBattleFrameStageTraits<FHealth, FLocated, FActivated, FDying, FAgent>::Make(),
+		TBattleFrameStageTraits<FHealthBar>::Make(),
+		[](auto Chain, float SafeDeltaTime, int32 StageThreadsCount, int32 StageBatchSize)
+		{
+			TRACE_CPUPROFILER_EVENT_SCOPE_STR("AgentHealthBar");
 
-			// 应用伤害
-			Overlapper.GetTraitRef<FHealth, EParadigm::Unsafe>().DamageToTake.Enqueue(ClampedDamage);
+			Chain->OperateConcurrently(
+				[&](FSolidSubjectHandle Subject, 
+					FHealth& Health, 
+					FLocated& Located)
+				{
+					// 更新血条
+					const bool bHasHealthBar = Subject.HasTrait<FHealthBar>();
 
-			// 记录伤害施加者
-			if (DmgInstigator.IsValid())
-			{
-				Overlapper.GetTraitRef<FHealth, EParadigm::Unsafe>().DamageInstigator.Enqueue(DmgInstigator);
-				DmgResult.InstigatorSubject = DmgInstigator;
-			}
-			else
-			{
-				Overlapper.GetTraitRef<FHealth, EParadigm::Unsafe>().DamageInstigator.Enqueue(FSubjectHandle());
-			}
+					if (bHasHealthBar)
+					{
+						auto& HealthBar = Subject.GetTraitRef<FHealthBar>();
 
-			Overlapper.GetTraitRef<FHealth, EParadigm::Unsafe>().HitDirection.Enqueue(HitDirection);
+						if (HealthBar.bShowHealthBar)
+						{
+							HealthBar.TargetRatio = FMath::Clamp(Health.Current / Health.Maximum, 0, 1);
 
-			// ------------生成文字--------------
+							// 远处单位的血条直接跳到目标值 | far agents snap the bar instead of fading it
+							const FAgent* Agent = Subject.GetTraitPtr<FAgent, EParadigm::Unsafe>();
 
-			if (bHasTextPopUp && bHasLocated)
-			{
-				const auto TextPopUp = Overlapper.GetTrait<FTextPopUp>();
+							if (Agent && Agent->bSimSkipCosmetics)
+							{
+								HealthBar.CurrentRatio = HealthBar.TargetRatio;
+							}
+							else
+							{
+								HealthBar.CurrentRatio = FMath::FInterpConstantTo(HealthBar.CurrentRatio, HealthBar.TargetRatio, SafeDeltaTime, HealthBar.InterpSpeed * 0.1);
+							}
 
-				if (TextPopUp.Enable)
-				{
-					float Style = 0;
+							if (HealthBar.HideOnFullHealth)
+							{
+								if (Health.Current == Health.Maximum)
+								{
+									HealthBar.Opacity = 0;
+								}
+								else
+								{
+									HealthBar.Opacity = 1;
+								}
+							}
+							else
+							{
+								HealthBar.Opacity = 1;
+							}
 
-					if (!bIsCrit)
-					{
-						if (PostCritDamage < TextPopUp.WhiteTextBelowPercent)
-						{
-							Style = 0;
-						}
-						else if (PostCritDamage < TextPopUp.OrangeTextAbovePercent)
-						{
-							Style = 1;
+							if (HealthBar.HideOnEmptyHealth && Health.Current <= 0)
+							{
+								HealthBar.Opacity = 0;
+							}
 						}
 						else
 						{
-							Style = 2;
+							HealthBar.Opacity = 0;
 						}
 					}
-					else
-					{
-						Style = 3;
-					}
-
-					float Radius = bHasGridData ? Overlapper.GetTrait<FGridData>().Radius : 0;
-					QueueText(FTextPopConfig(Overlapper, PostCritDamage, Style, TextPopUp.TextScale, Radius * 1.1, Location));
-				}
-			}
 
-			//--------------Debuff--------------
+				}, StageThreadsCount, StageBatchSize);
+		});
 
-			// 持续伤害
-			if (Debuff.TemporalDmgParams.bDealTemporalDmg)
-			{
-				// Record for spawning of TemporalDamager
-				FTemporalDamager TemporalDamager;
+	// 受击发光 | Glow
+	HitStages.AddChainStage(TEXT("AgentHitGlow"), AgentHitGlowFilter,
+		TBattleFrameStageTraits<FAgent, FRendering, FActivated, FCurves>::Make(),
+		{ BATTLEFRAME_STAGE_FIELD(FAnimation, HitGlow), FBattleFrameStageResource::Make<FHitGlow>() },
+		[](auto Chain, float SafeDeltaTime, int32 StageThreadsCount, int32 StageBatchSize)
+		{
+			TRACE_CPUPROFILER_EVENT_SCOPE_STR("AgentHitGlow");
+
+			Chain->OperateConcurrently(
+				[&](FSolidSubjectHandle Subject,
+					FAgent& Agent,
+					FAnimation& Animation,
+					FHitGlow& HitGlow,
+					FCurves& Curves)
+				{
+					// 远处单位不播受击发光 | far agents skip the glow
+					if (Agent.bSimSkipCosmetics)
+					{
+						Animation.HitGlow = 0;
+						Subject->RemoveTraitDeferred<FHitGlow>();
+						return;
+					}
 
-				float TotalTemporalDmg = Debuff.TemporalDmgParams.TemporalDmg;
+					// 获取曲线
+					auto Curve = Curves.HitEmission.GetRichCurve();
 
-				switch (Damage.DmgType)
-				{
-					case EDmgType::Normal:
-						TotalTemporalDmg *= NormalDmgMult;
-						break;
-					case EDmgType::Fire:
-						TotalTemporalDmg *= FireDmgMult;
-						break;
-					case EDmgType::Ice:
-						TotalTemporalDmg *= IceDmgMult;
-						break;
-					case EDmgType::Poison:
-						TotalTemporalDmg *= PoisonDmgMult;
-						break;
-				}
+					// 检查曲线是否有关键帧
+					if (!Curve || Curve->GetNumKeys() == 0) return;
 
-				TemporalDamager.TotalTemporalDamage = TotalTemporalDmg;
+					// 获取曲线的最后一个关键帧的时间
+					const auto EndTime = Curve->GetLastKey().Time;
 
-				if (TemporalDamager.TotalTemporalDamage > 0)
-				{
-					TemporalDamager.TemporalDamageTarget = Overlapper;
-					TemporalDamager.RemainingTemporalDamage = TemporalDamager.TotalTemporalDamage;
+					// 受击发光
+					Animation.HitGlow = Curve->Eval(HitGlow.GlowTime);
 
-					if (DmgInstigator.IsValid())
+					// 更新发光时间
+					if (HitGlow.GlowTime < EndTime)
 					{
-						TemporalDamager.TemporalDamageInstigator = DmgInstigator;
+						HitGlow.GlowTime += SafeDeltaTime;
 					}
-					else
+
+					// 计时器完成后删除 Trait
+					if (HitGlow.GlowTime >= EndTime)
 					{
-						TemporalDamager.TemporalDamageInstigator = FSubjectHandle();
+						Animation.HitGlow = 0; // 重置发光值
+						Subject->RemoveTraitDeferred<FHitGlow>(); // 延迟删除 Trait
 					}
 
-					TemporalDamager.TemporalDmgSegment = Debuff.TemporalDmgParams.TemporalDmgSegment;
-					TemporalDamager.TemporalDmgInterval = Debuff.TemporalDmgParams.TemporalDmgInterval;
-					TemporalDamager.DmgType = Damage.DmgType;
+				}, StageThreadsCount, StageBatchSize);
+		});
 
-					Mechanism->SpawnSubject(TemporalDamager);
-				}
-			}
-		}
-
-		//--------------Debuff--------------
-
-		if (Debuff.LaunchParams.bCanLaunch)
+	// 怪物受击形变 | Jiggle
+	HitStages.AddChainStage(TEXT("AgentJiggle"), AgentJiggleFilter,
+		{ FBattleFrameStageResource::Make<FAgent>(), FBattleFrameStageResource::Make<FRendering>(), FBattleFrameStageResource::Make<FActivated>(), FBattleFrameStageResource::Make<FHit>(), FBattleFrameStageResource::Make<FCurves>(), BATTLEFRAME_STAGE_FIELD(FScaled, Scale) },
+		{ BATTLEFRAME_STAGE_FIELD(FScaled, RenderScale), FBattleFrameStageResource::Make<FJiggle>() },
+		[](auto Chain, float SafeDeltaTime, int32 StageThreadsCount, int32 StageBatchSize)
 		{
-			if (bHasMoving)
-			{
-				auto Moving = Overlapper.GetTrait<FMoving>();
-
-				FVector KnockbackForce = FVector(Debuff.LaunchParams.LaunchSpeed.X, Debuff.LaunchParams.LaunchSpeed.X, 1) * HitDirection + FVector(0, 0, Debuff.LaunchParams.LaunchSpeed.Y);
-				FVector CombinedForce = Moving.LaunchVelSum + KnockbackForce;
-				Moving.LaunchVelSum += KnockbackForce; // 累加击退力
+			TRACE_CPUPROFILER_EVENT_SCOPE_STR("AgentJiggle");
+
+			Chain->OperateConcurrently(
+				[&](FSolidSubjectHandle Subject,
+					FAgent& Agent,
+					FScaled& Scaled,
+					FJiggle& Jiggle,
+					FHit& Hit,
+					FCurves& Curves)
+				{
+					// 远处单位不播受击形变 | far agents skip the jiggle
+					if (Agent.bSimSkipCosmetics)
+					{
+						Scaled.RenderScale = FVector(Scaled.Scale);
+						Subject->RemoveTraitDeferred<FJiggle>();
+						return;
+					}
 
-				Overlapper.SetTrait(Moving);
-			}
-		}
+					// 获取曲线
+					auto Curve = Curves.HitJiggle.GetRichCurve();
 
-		// 减速
-		if (Debuff.SlowParams.bCanSlow && bHasSlowing)
-		{
-			// Record for spawning of Slower
-			FSlower Slower;
+					// 检查曲线是否有关键帧
+					if (!Curve || Curve->GetNumKeys() == 0) return;
 
-			Slower.SlowTarget = Overlapper;
-			Slower.SlowStrength = Debuff.SlowParams.SlowStrength;
-			Slower.SlowTimeout = Debuff.SlowParams.SlowTime;
-			Slower.DmgType = Damage.DmgType;
+					// 获取曲线的最后一个关键帧的时间
+					const auto EndTime = Curve->GetLastKey().Time;
 
-			Mechanism->SpawnSubject(Slower);
-		}
+					// 受击变形
+					Scaled.RenderScale.X = FMath::Lerp(Scaled.Scale, Scaled.Scale * Curve->Eval(Jiggle.JiggleTime), Hit.JiggleStr);
+					Scaled.RenderScale.Y = FMath::Lerp(Scaled.Scale, Scaled.Scale * Curve->Eval(Jiggle.JiggleTime), Hit.JiggleStr);
+					Scaled.RenderScale.Z = FMath::Lerp(Scaled.Scale, Scaled.Scale * (2.f - Curve->Eval(Jiggle.JiggleTime)), Hit.JiggleStr);
 
-		//-----------其它效果------------
+					// 更新形变时间
+					if (Jiggle.JiggleTime < EndTime)
+					{
+						Jiggle.JiggleTime += SafeDeltaTime;
+					}
 
-		if (bHasSleeping)// wake on hit
-		{
-			if (bHasSleep)
-			{
-				auto Sleep = Overlapper.GetTrait<FSleep>();
+					// 计时器完成后删除 Trait
+					if (Jiggle.JiggleTime >= EndTime)
+					{
+						Scaled.RenderScale = FVector(Scaled.Scale); // 恢复原始比例
+						Subject->RemoveTraitDeferred<FJiggle>(); // 延迟删除 Trait
+					}
 
-				if (Sleep.bWakeOnHit)
-				{
-					Sleep.bEnable = false;
-					Overlapper.SetTrait(Sleep);
-					Overlapper.RemoveTrait<FSleeping>();
-				}
-			}
-		}
+				}, StageThreadsCount, StageBatchSize);
+		});
 
-		if (bHasHit)
-		{
-			const auto Hit = Overlapper.GetTrait<FHit>();
 
-			// Glow
-			if (Hit.bCanGlow && !bHasHitGlow)
-			{
-				Overlapper.SetTrait(FHitGlow());
-			}
+	//------------------------死亡 | Death-------------------------
 
-			// Jiggle
-			if (Hit.JiggleStr != 0.f && !bHasJiggle)
-			{
-				Overlapper.SetTrait(FJiggle());
-			}
+	DeathStages.Reset(&StageTuner);
 
-			// Actor
-			for (const FActorSpawnConfig& Config : Hit.SpawnActor)
-			{
-				FActorSpawnConfig_Final NewConfig(Config);
-				NewConfig.OwnerSubject = FSubjectHandle(Overlapper);
-				NewConfig.AttachToSubject = FSubjectHandle(Overlapper);
-				const FTransform WorldTransform(HitDirection.ToOrientationQuat(), Overlapper.GetTrait<FLocated>().Location);
-				NewConfig.SpawnTransform = ABattleFrameBattleControl::LocalOffsetToWorld(Overlapper.GetTrait<FDirected>().Direction.ToOrientationQuat(),WorldTransform.GetLocation(), NewConfig.Transform);
-				NewConfig.InitialRelativeTransform = NewConfig.SpawnTransform.GetRelativeTransform(WorldTransform);
+	// 死亡消融 | Death Dissolve
+	DeathStages.AddChainStage(TEXT("AgentDeathDissolve"), AgentDeathDissolveFilter,
+		TBattleFrameStageTraits<FAgent, FRendering, FActivated, FDying, FDeath, FCurves>::Make(),
+		{ BATTLEFRAME_STAGE_FIELD(FAnimation, Dissolve), FBattleFrameStageResource::Make<FDeathDissolve>() },
+		[](auto Chain, float SafeDeltaTime, int32 StageThreadsCount, int32 StageBatchSize)
+		{
+			TRACE_CPUPROFILER_EVENT_SCOPE_STR("AgentDeathDissolve");
+
+			Chain->OperateConcurrently(
+				[&](FSolidSubjectHandle Subject,
+					FAnimation& Animation,
+					FDeathDissolve& DeathDissolve,
+					FDeath& Death,
+					FCurves& Curves)
+				{
+					// 获取曲线
+					auto Curve = Curves.DissolveOut.GetRichCurve();
+
+					// 检查曲线是否有关键帧
+					if (!Curve || Curve->GetNumKeys() == 0) return;
+					//{
+						// 如果没有关键帧，添加默认关键帧
+						//Curve->Reset();
+						//FKeyHandle Key1 = Curve->AddKey(0.0f, 1.0f); // 初始值
+						//FKeyHandle Key2 = Curve->AddKey(1.0f, 0.0f); // 结束值
+
+						//// 设置自动切线
+						//Curve->SetKeyInterpMode(Key1, RCIM_Cubic);
+						//Curve->SetKeyInterpMode(Key2, RCIM_Cubic);
+
+						//Curve->SetKeyTangentMode(Key1, RCTM_Auto);
+						//Curve->SetKeyTangentMode(Key2, RCTM_Auto);
+					//}
+
+					// 获取曲线的最后一个关键帧的时间
+					const auto EndTime = Curve->GetLastKey().Time;
+
+					// 计算溶解效果
+					if (DeathDissolve.dissolveTime >= Death.FadeOutDelay && (DeathDissolve.dissolveTime - Death.FadeOutDelay) < EndTime)
+					{
+						Animation.Dissolve = 1 - Curve->Eval(DeathDissolve.dissolveTime - Death.FadeOutDelay);
+					}
 
-				Mechanism->SpawnSubject(NewConfig);
-			}
+					// 更新溶解时间
+					DeathDissolve.dissolveTime += SafeDeltaTime;
 
-			// Fx
-			for (const FFxConfig& Config : Hit.SpawnFx)
-			{
-				FFxConfig_Final NewConfig(Config);
-				NewConfig.OwnerSubject = FSubjectHandle(Overlapper);
-				NewConfig.AttachToSubject = FSubjectHandle(Overlapper);
-				const FTransform WorldTransform(HitDirection.ToOrientationQuat(), Overlapper.GetTrait<FLocated>().Location);
-				NewConfig.SpawnTransform = ABattleFrameBattleControl::LocalOffsetToWorld(Overlapper.GetTrait<FDirected>().Direction.ToOrientationQuat(), WorldTransform.GetLocation(), NewConfig.Transform);
-				NewConfig.InitialRelativeTransform = NewConfig.SpawnTransform.GetRelativeTransform(WorldTransform);
+				}, StageThreadsCount, StageBatchSize);
+		});
 
-				Mechanism->SpawnSubject(NewConfig);
-			}
+	// 死亡动画 | Death Anim
+	DeathStages.AddChainStage(TEXT("AgentDeathAnim"), AgentDeathAnimFilter,
+		TBattleFrameStageTraits<FAgent, FRendering, FActivated, FDying>::Make(),
+		{ BATTLEFRAME_STAGE_FIELD(FAnimation, SubjectState), BATTLEFRAME_STAGE_FIELD(FAnimation, PreviousSubjectState), FBattleFrameStageResource::Make<FDeathAnim>() },
+		[](auto Chain, float SafeDeltaTime, int32 StageThreadsCount, int32 StageBatchSize)
+		{
+			TRACE_CPUPROFILER_EVENT_SCOPE_STR("AgentDeathAnim");
 
-			// Sound
-			for (const FSoundConfig& Config : Hit.PlaySound)
-			{
-				FSoundConfig_Final NewConfig(Config);
-				NewConfig.OwnerSubject = FSubjectHandle(Overlapper);
-				NewConfig.AttachToSubject = FSubjectHandle(Overlapper);
-				const FTransform WorldTransform(HitDirection.ToOrientationQuat(), Overlapper.GetTrait<FLocated>().Location);
-				NewConfig.SpawnTransform = ABattleFrameBattleControl::LocalOffsetToWorld(Overlapper.GetTrait<FDirected>().Direction.ToOrientationQuat(), WorldTransform.GetLocation(), NewConfig.Transform);
-				NewConfig.InitialRelativeTransform = NewConfig.SpawnTransform.GetRelativeTransform(WorldTransform);
+			Chain->OperateConcurrently(
+				[&](FSolidSubjectHandle Subject,
+					FAnimation& Animation,
+					FDeathAnim& DeathAnim)
+				{
+					if (DeathAnim.animTime == 0)
+					{
+						Animation.SubjectState = ESubjectState::Dying;
+						Animation.PreviousSubjectState = ESubjectState::Dirty;
+					}
 
-				Mechanism->SpawnSubject(NewConfig);
-			}
-		}
+					DeathAnim.animTime += SafeDeltaTime;
 
-		if (bHasIsSubjective)
-		{
-			FHitData HitData;
-			HitData.SelfSubject = DmgResult.DamagedSubject;
-			HitData.InstigatorSubject = DmgResult.InstigatorSubject;
-			HitData.IsCritical = DmgResult.IsCritical;
-			HitData.IsKill = DmgResult.IsKill;
-			HitData.DmgDealt = DmgResult.DmgDealt;
-			OnHitQueue.Enqueue(HitData);
-		}
+				}, StageThreadsCount, StageBatchSize);
+		});
 
-		DamageResults.Add(DmgResult);
-	}
 }
 
-void ABattleFrameBattleControl::ApplyDamageToSubjects(const FSubjectArray& Subjects, const FSubjectArray& IgnoreSubjects, const FSubjectHandle DmgInstigator, const FVector& HitFromLocation, const FDmgSphere& DmgSphere, const FDebuff& Debuff, TArray<FDmgResult>& DamageResults)
+// 按SortKey稳定排序，三趟11位的基数排序，耗时只与数量成正比 | Stable LSD radix sort on SortKey in three 11 bit passes, cost is linear in the count
+static void RadixSortDamageCommands(TArray<FDamageCommand>& Commands, TArray<FDamageCommand>& Scratch)
 {
-	// 使用TSet存储唯一敌人句柄
-	TSet<FSubjectHandle> UniqueHandles;
+	constexpr int32 NumBits = 11;
+	constexpr int32 NumBuckets = 1 << NumBits;
+	constexpr int32 NumPasses = 3;
 
-	// 将IgnoreSubjects转换为TSet以提高查找效率
-	const TSet<FSubjectHandle> IgnoreSet(IgnoreSubjects.Subjects);
+	const int32 Num = Commands.Num();
+	if (Num < 2) return;
 
-	for (const auto& Overlapper : Subjects.Subjects)
-	{
-		// 使用TSet的Contains替代数组的Contains
-		if (IgnoreSet.Contains(Overlapper)) continue;
+	int32 Offsets[NumPasses][NumBuckets] = {};
 
-		int32 PreviousNum = UniqueHandles.Num();
-		UniqueHandles.Add(Overlapper);
+	for (const FDamageCommand& Command : Commands)
+	{
+		for (int32 Pass = 0; Pass < NumPasses; ++Pass)
+		{
+			++Offsets[Pass][(Command.SortKey >> (Pass * NumBits)) & (NumBuckets - 1)];
+		}
+	}
 
-		if (UniqueHandles.Num() == PreviousNum) continue;
+	Scratch.SetNum(Num);
+	FDamageCommand* Src = Commands.GetData();
+	FDamageCommand* Dst = Scratch.GetData();
 
-		if (!Overlapper.IsValid()) continue;
+	for (int32 Pass = 0; Pass < NumPasses; ++Pass)
+	{
+		int32* PassOffsets = Offsets[Pass];
+		const int32 Shift = Pass * NumBits;
 
-		// Pre-calculate all trait checks
-		const bool bHasHealth = Overlapper.HasTrait<FHealth>();
-		const bool bHasLocated = Overlapper.HasTrait<FLocated>();
-		const bool bHasDirected = Overlapper.HasTrait<FDirected>();
-		const bool bHasScaled = Overlapper.HasTrait<FScaled>();
-		const bool bHasCollider = Overlapper.HasTrait<FCollider>();
-		const bool bHasGridData = Overlapper.HasTrait<FGridData>();
-		const bool bHasDefence = Overlapper.HasTrait<FDefence>();
-		const bool bHasTextPopUp = Overlapper.HasTrait<FTextPopUp>();
-		const bool bHasMoving = Overlapper.HasTrait<FMoving>();
-		const bool bHasSlowing = Overlapper.HasTrait<FSlowing>();
-		const bool bHasAnimation = Overlapper.HasTrait<FAnimation>();
-		const bool bHasSleep = Overlapper.HasTrait<FSleep>();
-		const bool bHasSleeping = Overlapper.HasTrait<FSleeping>();
-		const bool bHasHit = Overlapper.HasTrait<FHit>();
-		const bool bHasHitGlow = Overlapper.HasTrait<FHitGlow>();
-		const bool bHasJiggle = Overlapper.HasTrait<FJiggle>();
-		const bool bHasPatrolling = Overlapper.HasTrait<FPatrolling>();
-		const bool bHasTrace = Overlapper.HasTrait<FTrace>();
-		const bool bHasIsSubjective = Overlapper.HasTrait<FIsSubjective>();
+		// 所有键落在同一个桶时这一趟不改变顺序 | every key in one bucket, the pass would not change the order
+		if (PassOffsets[(Src[0].SortKey >> Shift) & (NumBuckets - 1)] == Num) continue;
 
-		FVector Location = bHasLocated ? Overlapper.GetTrait<FLocated>().Location : FVector::ZeroVector;
-		FVector Direction = bHasDirected ? Overlapper.GetTrait<FDirected>().Direction : FVector::ZeroVector;
-		
-		FDmgResult DmgResult;
-		DmgResult.DamagedSubject = Overlapper;
+		int32 Sum = 0;
 
-		FVector HitDirection = FVector::ZeroVector;
+		for (int32 Bucket = 0; Bucket < NumBuckets; ++Bucket)
+		{
+			const int32 Count = PassOffsets[Bucket];
+			PassOffsets[Bucket] = Sum;
+			Sum += Count;
+		}
 
-		if (bHasLocated)
+		for (int32 Index = 0; Index < Num; ++Index)
 		{
-			HitDirection = (Location - HitFromLocation).GetSafeNormal2D();
+			Dst[PassOffsets[(Src[Index].SortKey >> Shift) & (NumBuckets - 1)]++] = Src[Index];
 		}
 
-		//-------------伤害和抗性------------
+		Swap(Src, Dst);
+	}
 
-		float NormalDmgMult = 1;
-		float FireDmgMult = 1;
-		float IceDmgMult = 1;
-		float PoisonDmgMult = 1;
-		float PercentDmgMult = 1;
+	if (Src != Commands.GetData())
+	{
+		Swap(Commands, Scratch);
+	}
+}
 
-		if (bHasHealth)
+// 相同键的命令连成一组，每组只交给一个线程 | runs of equal keys form the groups, each group goes to one thread
+static void GroupDamageCommands(const TArray<FDamageCommand>& Commands, TArray<int32>& OutGroupStarts)
+{
+	OutGroupStarts.Reset();
+
+	for (int32 Index = 0; Index < Commands.Num(); ++Index)
+	{
+		if (Index == 0 || Commands[Index].SortKey != Commands[Index - 1].SortKey)
 		{
-			auto Health = Overlapper.GetTrait<FHealth>();
+			OutGroupStarts.Add(Index);
+		}
+	}
 
-			// 抗性 如果有的话
-			if (bHasDefence)
-			{
-				const auto Defence = Overlapper.GetTrait<FDefence>();
+	OutGroupStarts.Add(Commands.Num());
+}
 
-				NormalDmgMult = 1 - Defence.NormalDmgImmune;
-				FireDmgMult = 1 - Defence.FireDmgImmune;
-				IceDmgMult = 1 - Defence.IceDmgImmune;
-				PoisonDmgMult = 1 - Defence.PoisonDmgImmune;
-				PercentDmgMult = 1.f - Defence.PercentDmgImmune;
-			}
+// 可回收单位的当前生命周期，不可回收的单位恒为0 | The recyclable agent's current life, always 0 for agents that are never pooled
+static uint32 GetRecycleGeneration(const FSubjectHandle& Agent)
+{
+	const FRecyclable* Recyclable = Agent.GetTraitPtr<FRecyclable, EParadigm::Unsafe>();
+	return Recyclable ? Recyclable->Generation : 0;
+}
 
-			// 基础伤害
-			float BaseDamage = 0;
+void ABattleFrameBattleControl::TickSlowers(const float SafeDeltaTime)
+{
+	TRACE_CPUPROFILER_EVENT_SCOPE_STR("AgentSlowed");
+
+	auto Chain = Mechanism->EnchainSolid(SlowerFilter);
+	FBattleFrameStageTuner::FScope StageTuning(StageTuner, TEXT("AgentSlowed"), Chain->IterableNum(), MaxThreadsAllowed, MinBatchSizeAllowed, ThreadsCount, BatchSize);
 
-			switch (DmgSphere.DmgType)
+	Chain->OperateConcurrently(
+		[&](FSolidSubjectHandle Subject, 
+			FSlower& Slower)
+		{
+			// 减速对象不存在、已进入回收池或已被复用时终止 | stop when the target is gone, pooled, or reused since this ghost was spawned
+			if (!Slower.SlowTarget.IsValid() || Slower.SlowTarget.HasTrait<FPooled>() || GetRecycleGeneration(Slower.SlowTarget) != Slower.TargetGeneration)
 			{
-				case EDmgType::Normal:
-					BaseDamage = DmgSphere.Damage * NormalDmgMult;
-					break;
-				case EDmgType::Fire:
-					BaseDamage = DmgSphere.Damage * FireDmgMult;
-					break;
-				case EDmgType::Ice:
-					BaseDamage = DmgSphere.Damage * IceDmgMult;
-					break;
-				case EDmgType::Poison:
-					BaseDamage = DmgSphere.Damage * PoisonDmgMult;
-					break;
+				Subject.DespawnDeferred();
+				return;
 			}
 
-			// 百分比伤害
-			float PercentageDamage = Health.Maximum * DmgSphere.PercentDmg * PercentDmgMult;
+			// 第一次运行时，登记到agent的减速马甲列表
+			if (Slower.bJustSpawned)
+			{
+				auto& TargetSlowing = Slower.SlowTarget.GetTraitRef<FSlowing, EParadigm::Unsafe>();
 
-			// 总伤害
-			float CombinedDamage = BaseDamage + PercentageDamage;
+				TargetSlowing.Lock();
+				TargetSlowing.Slowers.Add(FSubjectHandle(Subject));
+				TargetSlowing.Unlock();
 
-			// 考虑暴击后伤害
-			auto [bIsCrit, PostCritDamage] = ProcessCritDamage(CombinedDamage, DmgSphere.CritDmgMult, DmgSphere.CritProbability);
+				const bool bHasAnimation = Slower.SlowTarget.HasTrait<FAnimation>();
 
-			// 限制伤害以不大于剩余血量
-			float ClampedDamage = FMath::Min(PostCritDamage, Health.Current);
+				// 开启材质特效
+				if (bHasAnimation)
+				{
+					auto& TargetAnimation = Slower.SlowTarget.GetTraitRef<FAnimation, EParadigm::Unsafe>();
 
-			DmgResult.IsCritical = bIsCrit;
-			DmgResult.DmgDealt = ClampedDamage;
+					TargetAnimation.Lock();
+					switch (Slower.DmgType)
+					{
+						case EDmgType::Fire:
+							TargetAnimation.FireFx = 1;
+							break;
+						case EDmgType::Ice:
+							TargetAnimation.IceFx = 1;
+							break;
+						case EDmgType::Poison:
+							TargetAnimation.PoisonFx = 1;
+							break;
+					}
+					TargetAnimation.Unlock();
+				}
 
-			if (ClampedDamage == Health.Current)
-			{
-				DmgResult.IsKill = true;
-				Overlapper.SetTrait(FMayDie());
+				Slower.bJustSpawned = false;
 			}
 
-			// 应用伤害
-			Overlapper.GetTraitRef<FHealth, EParadigm::Unsafe>().DamageToTake.Enqueue(ClampedDamage);
-
-			// 记录伤害施加者
-			if (DmgInstigator.IsValid())
-			{
-				Overlapper.GetTraitRef<FHealth, EParadigm::Unsafe>().DamageInstigator.Enqueue(DmgInstigator);
-				DmgResult.InstigatorSubject = DmgInstigator;
-			}
-			else
+			// 持续时间结束，解除减速
+			if (Slower.SlowTimeout <= 0)
 			{
-				Overlapper.GetTraitRef<FHealth, EParadigm::Unsafe>().DamageInstigator.Enqueue(FSubjectHandle());
-			}
-
-			Overlapper.GetTraitRef<FHealth, EParadigm::Unsafe>().HitDirection.Enqueue(HitDirection);
+				auto& TargetSlowing = Slower.SlowTarget.GetTraitRef<FSlowing, EParadigm::Unsafe>();
 
-			// ------------生成文字--------------
+				TargetSlowing.Lock();
+				TargetSlowing.Slowers.Remove(FSubjectHandle(Subject));
+				TargetSlowing.Unlock();
 
-			if (bHasTextPopUp && bHasLocated)
-			{
-				const auto TextPopUp = Overlapper.GetTrait<FTextPopUp>();
+				const bool bHasAnimation = Slower.SlowTarget.HasTrait<FAnimation>();
 
-				if (TextPopUp.Enable)
+				// 重置材质特效
+				if (bHasAnimation)
 				{
-					float Style = 0;
+					bool bHasSameDmgType = false;
 
-					if (!bIsCrit)
+					// 是否还存在同伤害类型的减速马甲
+					TargetSlowing.Lock();
+					for (const auto& OtherSlower : TargetSlowing.Slowers)
 					{
-						if (PostCritDamage < TextPopUp.WhiteTextBelowPercent)
-						{
-							Style = 0;
-						}
-						else if (PostCritDamage < TextPopUp.OrangeTextAbovePercent)
-						{
-							Style = 1;
-						}
-						else
+						if (OtherSlower.GetTrait<FSlower>().DmgType == Slower.DmgType)
 						{
-							Style = 2;
+							bHasSameDmgType = true;
+							break;
 						}
 					}
-					else
+					TargetSlowing.Unlock();
+
+					// 是否还存在同伤害类型的延时伤害马甲
+					auto& TargetTemporalDamaging = Slower.SlowTarget.GetTraitRef<FTemporalDamaging, EParadigm::Unsafe>();
+
+					TargetTemporalDamaging.Lock();
+					for (const auto& OtherTemporalDamager : TargetTemporalDamaging.TemporalDamagers)
 					{
-						Style = 3;
+						if (OtherTemporalDamager.GetTrait<FTemporalDamager>().DmgType == Slower.DmgType)
+						{
+							bHasSameDmgType = true;
+							break;
+						}
 					}
+					TargetTemporalDamaging.Unlock();
 
-					float Radius = bHasGridData ? Overlapper.GetTrait<FGridData>().Radius : 0;
-					QueueText(FTextPopConfig(Overlapper, PostCritDamage, Style, TextPopUp.TextScale, Radius * 1.1, Location));
-				}
-			}
-
-			//--------------Debuff--------------
+					// 如果没有同伤害类型的马甲，可以重置材质特效了
+					if (!bHasSameDmgType)
+					{
+						auto& TargetAnimation = Slower.SlowTarget.GetTraitRef<FAnimation, EParadigm::Unsafe>();
 
-			// 持续伤害
-			if (Debuff.TemporalDmgParams.bDealTemporalDmg)
+						TargetAnimation.Lock();
+						switch (Slower.DmgType)
+						{
+							case EDmgType::Fire:
+								TargetAnimation.FireFx = 0;
+								break;
+							case EDmgType::Ice:
+								TargetAnimation.IceFx = 0;
+								break;
+							case EDmgType::Poison:
+								TargetAnimation.PoisonFx = 0;
+								break;
+						}
+						TargetAnimation.Unlock();
+					}
+				}
+
+				Subject.DespawnDeferred();
+				return;
+			}
+
+			// 更新计时器
+			Slower.SlowTimeout -= SafeDeltaTime;
+
+		}, ThreadsCount, BatchSize);
+}
+
+void ABattleFrameBattleControl::TickTemporalDamagers(const float SafeDeltaTime)
+{
+	TRACE_CPUPROFILER_EVENT_SCOPE_STR("AgentTemporalDamaging");
+
+	auto Chain = Mechanism->EnchainSolid(TemporalDamagerFilter);
+	FBattleFrameStageTuner::FScope StageTuning(StageTuner, TEXT("AgentTemporalDamaging"), Chain->IterableNum(), MaxThreadsAllowed, MinBatchSizeAllowed, ThreadsCount, BatchSize);
+
+	Chain->OperateConcurrently(
+		[&](FSolidSubjectHandle Subject, 
+			FTemporalDamager& TemporalDamager)
+		{
+			// 伤害对象不存在、已进入回收池或已被复用时终止 | stop when the target is gone, pooled, or reused since this ghost was spawned
+			if (!TemporalDamager.TemporalDamageTarget.IsValid() || TemporalDamager.TemporalDamageTarget.HasTrait<FPooled>() || GetRecycleGeneration(TemporalDamager.TemporalDamageTarget) != TemporalDamager.TargetGeneration)
 			{
-				// Record for spawning of TemporalDamager
-				FTemporalDamager TemporalDamager;
+				Subject.DespawnDeferred();
+				return;
+			}
 
-				float TotalTemporalDmg = Debuff.TemporalDmgParams.TemporalDmg;
+			// 第一次运行时，登记到agent的持续伤害马甲列表
+			if (TemporalDamager.bJustSpawned)
+			{
+				auto& TargetTemporalDamaging = TemporalDamager.TemporalDamageTarget.GetTraitRef<FTemporalDamaging, EParadigm::Unsafe>();
+
+				TargetTemporalDamaging.Lock();
+				TargetTemporalDamaging.TemporalDamagers.Add(FSubjectHandle(Subject));
+				TargetTemporalDamaging.Unlock();
+
+				const bool bHasAnimation = TemporalDamager.TemporalDamageTarget.HasTrait<FAnimation>();
 
-				switch (DmgSphere.DmgType)
+				if (bHasAnimation)
 				{
-					case EDmgType::Normal:
-						TotalTemporalDmg *= NormalDmgMult;
-						break;
-					case EDmgType::Fire:
-						TotalTemporalDmg *= FireDmgMult;
-						break;
-					case EDmgType::Ice:
-						TotalTemporalDmg *= IceDmgMult;
-						break;
-					case EDmgType::Poison:
-						TotalTemporalDmg *= PoisonDmgMult;
-						break;
+					auto& TargetAnimation = TemporalDamager.TemporalDamageTarget.GetTraitRef<FAnimation, EParadigm::Unsafe>();
+
+					TargetAnimation.Lock();
+					switch (TemporalDamager.DmgType)
+					{
+						case EDmgType::Fire:
+							TargetAnimation.FireFx = 1;
+							break;
+						case EDmgType::Ice:
+							TargetAnimation.IceFx = 1;
+							break;
+						case EDmgType::Poison:
+							TargetAnimation.PoisonFx = 1;
+							break;
+					}
+					TargetAnimation.Unlock();
 				}
 
-				TemporalDamager.TotalTemporalDamage = TotalTemporalDmg;
+				TemporalDamager.bJustSpawned = false;
+			}
+
+			// 持续伤害结束时终止
+			if (TemporalDamager.RemainingTemporalDamage <= 0 || TemporalDamager.CurrentSegment >= TemporalDamager.TemporalDmgSegment)
+			{
+				auto& TargetTemporalDamaging = TemporalDamager.TemporalDamageTarget.GetTraitRef<FTemporalDamaging, EParadigm::Unsafe>();
+
+				// 从马甲列表移除
+				TargetTemporalDamaging.Lock();
+				TargetTemporalDamaging.TemporalDamagers.Remove(FSubjectHandle(Subject));
+				TargetTemporalDamaging.Unlock();
+
+				const bool bHasAnimation = TemporalDamager.TemporalDamageTarget.HasTrait<FAnimation>();
 
-				if (TemporalDamager.TotalTemporalDamage > 0)
+				// 重置材质特效
+				if (bHasAnimation)
 				{
-					TemporalDamager.TemporalDamageTarget = Overlapper;
-					TemporalDamager.RemainingTemporalDamage = TemporalDamager.TotalTemporalDamage;
+					bool bHasSameDmgType = false;
 
-					if (DmgInstigator.IsValid())
+					// 是否还存在同伤害类型的延时伤害马甲
+					TargetTemporalDamaging.Lock();
+					for (const auto& OtherTemporalDamager : TargetTemporalDamaging.TemporalDamagers)
 					{
-						TemporalDamager.TemporalDamageInstigator = DmgInstigator;
+						if (OtherTemporalDamager.GetTrait<FTemporalDamager>().DmgType == TemporalDamager.DmgType)
+						{
+							bHasSameDmgType = true;
+							break;
+						}
 					}
-					else
+					TargetTemporalDamaging.Unlock();
+
+					// 是否还存在同伤害类型的减速马甲
+					auto& TargetSlowing = TemporalDamager.TemporalDamageTarget.GetTraitRef<FSlowing, EParadigm::Unsafe>();
+
+					TargetSlowing.Lock();
+					for (const auto& OtherSlower : TargetSlowing.Slowers)
 					{
-						TemporalDamager.TemporalDamageInstigator = FSubjectHandle();
+						if (OtherSlower.GetTrait<FSlower>().DmgType == TemporalDamager.DmgType)
+						{
+							bHasSameDmgType = true;
+							break;
+						}
 					}
+					TargetSlowing.Unlock();
 
-					TemporalDamager.TemporalDmgSegment = Debuff.TemporalDmgParams.TemporalDmgSegment;
-					TemporalDamager.TemporalDmgInterval = Debuff.TemporalDmgParams.TemporalDmgInterval;
-					TemporalDamager.DmgType = DmgSphere.DmgType;
+					// 如果没有同伤害类型的马甲，可以重置材质特效了
+					if (!bHasSameDmgType)
+					{
+						auto& TargetAnimation = TemporalDamager.TemporalDamageTarget.GetTraitRef<FAnimation, EParadigm::Unsafe>();
 
-					Mechanism->SpawnSubject(TemporalDamager);
+						TargetAnimation.Lock();
+						switch (TemporalDamager.DmgType)
+						{
+							case EDmgType::Fire:
+								TargetAnimation.FireFx = 0;
+								break;
+							case EDmgType::Ice:
+								TargetAnimation.IceFx = 0;
+								break;
+							case EDmgType::Poison:
+								TargetAnimation.PoisonFx = 0;
+								break;
+						}
+						TargetAnimation.Unlock();
+					}
 				}
+
+				Subject.DespawnDeferred();
+				return;
 			}
-		}
 
-		//--------------Debuff--------------
-		
-		// 击退
-		if (Debuff.LaunchParams.bCanLaunch)
-		{
-			if (bHasMoving)
+			TemporalDamager.TemporalDamageTimeout -= SafeDeltaTime;
+
+			// 倒计时结束，造成一次伤害
+			if (TemporalDamager.TemporalDamageTimeout <= 0)
 			{
-				auto Moving = Overlapper.GetTrait<FMoving>();
+				// 计算本次伤害值
+				float ThisSegmentDamage = 0.0f;
 
-				FVector KnockbackForce = FVector(Debuff.LaunchParams.LaunchSpeed.X, Debuff.LaunchParams.LaunchSpeed.X, 1) * HitDirection + FVector(0, 0, Debuff.LaunchParams.LaunchSpeed.Y);
-				FVector CombinedForce = Moving.LaunchVelSum + KnockbackForce;
-				Moving.LaunchVelSum += KnockbackForce; // 累加击退力
+				// 扣除目标生命值
+				if (TemporalDamager.TemporalDamageTarget.HasTrait<FHealth>())
+				{
+					auto& TargetHealth = TemporalDamager.TemporalDamageTarget.GetTraitRef<FHealth, EParadigm::Unsafe>();
 
-				Overlapper.SetTrait(Moving);
-			}
-		}
+					if (TargetHealth.Current > 0)
+					{
+						// 计算本次伤害值
+						float DamagePerSegment = TemporalDamager.TotalTemporalDamage / TemporalDamager.TemporalDmgSegment;
 
-		// 减速
-		if (Debuff.SlowParams.bCanSlow && bHasSlowing)
-		{
-			// Record for spawning of Slower
-			FSlower Slower;
+						// 确保最后一段使用剩余伤害值
+						if (TemporalDamager.CurrentSegment == TemporalDamager.TemporalDmgSegment - 1)
+						{
+							ThisSegmentDamage = TemporalDamager.RemainingTemporalDamage;
+						}
+						else
+						{
+							ThisSegmentDamage = FMath::Min(DamagePerSegment, TemporalDamager.RemainingTemporalDamage);
+						}
 
-			Slower.SlowTarget = Overlapper;
-			Slower.SlowStrength = Debuff.SlowParams.SlowStrength;
-			Slower.SlowTimeout = Debuff.SlowParams.SlowTime;
-			Slower.DmgType = DmgSphere.DmgType;
+						float ClampedDamage = FMath::Min(ThisSegmentDamage, TargetHealth.Current);
 
-			Mechanism->SpawnSubject(Slower);
-		}
+						// 应用伤害，记录伤害施加者
+						DamageCommands.Enqueue(FDamageCommand(TemporalDamager.TemporalDamageTarget, TemporalDamager.TemporalDamageInstigator, FVector(0, 0, 0.0001f), ClampedDamage));
 
-		//-----------其它效果------------
+						//Temporal.TemporalDamageTarget.SetFlag(NeedSettleDmgFlag, true);
 
-		if (bHasSleeping)// wake on hit
-		{
-			if (bHasSleep)
-			{
-				auto Sleep = Overlapper.GetTrait<FSleep>();
+						// 生成伤害数字
+						if (TemporalDamager.TemporalDamageTarget.HasTrait<FTextPopUp>())
+						{
+							const auto& TextPopUp = TemporalDamager.TemporalDamageTarget.GetTraitRef<FTextPopUp, EParadigm::Unsafe>();
 
-				if (Sleep.bWakeOnHit)
+							if (TextPopUp.Enable)
+							{
+								float Style;
+
+								if (ClampedDamage < TextPopUp.WhiteTextBelowPercent)
+								{
+									Style = 0;
+								}
+								else if (ClampedDamage < TextPopUp.OrangeTextAbovePercent)
+								{
+									Style = 1;
+								}
+								else
+								{
+									Style = 2;
+								}
+
+								float Radius = TemporalDamager.TemporalDamageTarget.HasTrait<FGridData>() ? TemporalDamager.TemporalDamageTarget.GetTraitRef<FGridData, EParadigm::Unsafe>().Radius : 0;
+								FVector Location = TemporalDamager.TemporalDamageTarget.HasTrait<FLocated>() ? TemporalDamager.TemporalDamageTarget.GetTraitRef<FLocated, EParadigm::Unsafe>().Location : FVector::ZeroVector;
+
+								QueueText(FTextPopConfig(TemporalDamager.TemporalDamageTarget, ClampedDamage, Style, TextPopUp.TextScale, Radius * 1.1, Location));
+							}
+						}
+					}
+				}
+
+				// 更新伤害状态
+				TemporalDamager.RemainingTemporalDamage -= ThisSegmentDamage;
+				TemporalDamager.CurrentSegment++;
+
+				// 重置倒计时（仅当还有剩余伤害段数时）
+				if (TemporalDamager.CurrentSegment < TemporalDamager.TemporalDmgSegment && TemporalDamager.RemainingTemporalDamage > 0)
 				{
-					Sleep.bEnable = false;
-					Overlapper.SetTrait(Sleep);
-					Overlapper.RemoveTrait<FSleeping>();
+					TemporalDamager.TemporalDamageTimeout = TemporalDamager.TemporalDmgInterval;
 				}
 			}
-		}
 
-		if (bHasHit)
-		{
-			const auto Hit = Overlapper.GetTrait<FHit>();
+		}, ThreadsCount, BatchSize);
+}
 
-			// Glow
-			if (Hit.bCanGlow && !bHasHitGlow)
-			{
-				Overlapper.SetTrait(FHitGlow());
-			}
+void ABattleFrameBattleControl::TickStatusEffects(const float SafeDeltaTime)
+{
+	TRACE_CPUPROFILER_EVENT_SCOPE_STR("AgentStatusEffects");
 
-			// Jiggle
-			if (Hit.JiggleStr != 0.f && !bHasJiggle)
+	auto Chain = Mechanism->EnchainSolid(StatusEffectsFilter);
+	FBattleFrameStageTuner::FScope StageTuning(StageTuner, TEXT("AgentStatusEffects"), Chain->IterableNum(), MaxThreadsAllowed, MinBatchSizeAllowed, ThreadsCount, BatchSize);
+
+	Chain->OperateConcurrently(
+		[&](FSolidSubjectHandle Subject,
+			FStatusEffects& StatusEffects,
+			FSlowing& Slowing)
+		{
+			if (StatusEffects.NumSlots == 0 && StatusEffects.FxMask == 0)
 			{
-				Overlapper.SetTrait(FJiggle());
+				Slowing.InlineSlowMult = 1;
+				return;
 			}
 
-			// Actor
-			for (const FActorSpawnConfig& Config : Hit.SpawnActor)
-			{
-				FActorSpawnConfig_Final NewConfig(Config);
-				NewConfig.OwnerSubject = FSubjectHandle(Overlapper);
-				NewConfig.AttachToSubject = FSubjectHandle(Overlapper);
-				const FTransform WorldTransform(HitDirection.ToOrientationQuat(), Overlapper.GetTrait<FLocated>().Location);
-				NewConfig.SpawnTransform = ABattleFrameBattleControl::LocalOffsetToWorld(Overlapper.GetTrait<FDirected>().Direction.ToOrientationQuat(), WorldTransform.GetLocation(), NewConfig.Transform);
-				NewConfig.InitialRelativeTransform = NewConfig.SpawnTransform.GetRelativeTransform(WorldTransform);
+			uint8 FxMask = 0;
 
-				Mechanism->SpawnSubject(NewConfig);
-			}
+			StatusEffects.Lock();
 
-			// Fx
-			for (const FFxConfig& Config : Hit.SpawnFx)
+			const float SlowMult = StatusEffects.Tick(SafeDeltaTime, [&](const FStatusEffectSlot& Slot, const float ThisSegmentDamage)
 			{
-				FFxConfig_Final NewConfig(Config);
-				NewConfig.OwnerSubject = FSubjectHandle(Overlapper);
-				NewConfig.AttachToSubject = FSubjectHandle(Overlapper);
-				const FTransform WorldTransform(HitDirection.ToOrientationQuat(), Overlapper.GetTrait<FLocated>().Location);
-				NewConfig.SpawnTransform = ABattleFrameBattleControl::LocalOffsetToWorld(Overlapper.GetTrait<FDirected>().Direction.ToOrientationQuat(), WorldTransform.GetLocation(), NewConfig.Transform);
-				NewConfig.InitialRelativeTransform = NewConfig.SpawnTransform.GetRelativeTransform(WorldTransform);
+				const FHealth* Health = Subject.GetTraitPtr<FHealth, EParadigm::Unsafe>();
 
-				Mechanism->SpawnSubject(NewConfig);
-			}
+				if (Health && Health->Current > 0)
+				{
+					const float ClampedDamage = FMath::Min(ThisSegmentDamage, Health->Current);
+					DamageCommands.Enqueue(FDamageCommand(FSubjectHandle(Subject), Slot.Instigator, FVector(0, 0, 0.0001f), ClampedDamage));
 
-			// Sound
-			for (const FSoundConfig& Config : Hit.PlaySound)
+					// 生成伤害数字
+					const FTextPopUp* TextPopUp = Subject.GetTraitPtr<FTextPopUp, EParadigm::Unsafe>();
+
+					if (TextPopUp && TextPopUp->Enable)
+					{
+						const float Style = ClampedDamage < TextPopUp->WhiteTextBelowPercent ? 0 : (ClampedDamage < TextPopUp->OrangeTextAbovePercent ? 1 : 2);
+						const FGridData* GridData = Subject.GetTraitPtr<FGridData, EParadigm::Unsafe>();
+						const FLocated* Located = Subject.GetTraitPtr<FLocated, EParadigm::Unsafe>();
+
+						QueueText(FTextPopConfig(FSubjectHandle(Subject), ClampedDamage, Style, TextPopUp->TextScale, (GridData ? GridData->Radius : 0) * 1.1, Located ? Located->Location : FVector::ZeroVector));
+					}
+				}
+
+			}, FxMask);
+
+			StatusEffects.Unlock();
+
+			Slowing.InlineSlowMult = SlowMult;
+
+			// 材质特效只在状态变化时更新，马甲仍在时不关闭 | touch the material fx only when they change, and leave them on while ghost subjects remain
+			if (FxMask != StatusEffects.FxMask)
 			{
-				FSoundConfig_Final NewConfig(Config);
-				NewConfig.OwnerSubject = FSubjectHandle(Overlapper);
-				NewConfig.AttachToSubject = FSubjectHandle(Overlapper);
-				const FTransform WorldTransform(HitDirection.ToOrientationQuat(), Overlapper.GetTrait<FLocated>().Location);
-				NewConfig.SpawnTransform = ABattleFrameBattleControl::LocalOffsetToWorld(Overlapper.GetTrait<FDirected>().Direction.ToOrientationQuat(), WorldTransform.GetLocation(), NewConfig.Transform);
-				NewConfig.InitialRelativeTransform = NewConfig.SpawnTransform.GetRelativeTransform(WorldTransform);
+				FAnimation* Animation = Subject.GetTraitPtr<FAnimation, EParadigm::Unsafe>();
 
-				Mechanism->SpawnSubject(NewConfig);
+				if (Animation)
+				{
+					const FTemporalDamaging* TemporalDamaging = Subject.GetTraitPtr<FTemporalDamaging, EParadigm::Unsafe>();
+					const bool bHasGhosts = !Slowing.Slowers.IsEmpty() || (TemporalDamaging && !TemporalDamaging->TemporalDamagers.IsEmpty());
+
+					const auto UpdateFx = [&](float& Fx, const EDmgType DmgType)
+					{
+						const uint8 Bit = 1 << static_cast<uint8>(DmgType);
+
+						if (FxMask & Bit)
+						{
+							Fx = 1;
+						}
+						else if ((StatusEffects.FxMask & Bit) && !bHasGhosts)
+						{
+							Fx = 0;
+						}
+					};
+
+					Animation->Lock();
+					UpdateFx(Animation->FireFx, EDmgType::Fire);
+					UpdateFx(Animation->IceFx, EDmgType::Ice);
+					UpdateFx(Animation->PoisonFx, EDmgType::Poison);
+					Animation->Unlock();
+				}
+
+				StatusEffects.FxMask = FxMask;
 			}
+
+		}, ThreadsCount, BatchSize);
+}
+
+void ABattleFrameBattleControl::ResolveDamageCommands()
+{
+	TRACE_CPUPROFILER_EVENT_SCOPE_STR("ResolveDamage");
+
+	PendingDamage.Reset();
+	DamageCommands.Flush(PendingDamage);
+
+	// 已激活目标的停放伤害回到本帧结算，失效或停放过久的丢弃 | parked hits of targets that activated rejoin this settle, those of dead or long inactive targets are dropped
+	for (auto It = ParkedDamage.CreateIterator(); It; ++It)
+	{
+		const FSubjectHandle& Target = It.Key();
+		FParkedDamage& Parked = It.Value();
+
+		if (!Target.IsValid() || Target.HasTrait<FDying>() || ++Parked.Resolves > MaxDamageParkResolves)
+		{
+			It.RemoveCurrent();
 		}
-	
-		if (bHasIsSubjective)
+		else if (Target.HasTrait<FActivated>() && Target.HasTrait<FLocated>())
 		{
-			FHitData HitData;
-			HitData.SelfSubject = DmgResult.DamagedSubject;
-			HitData.InstigatorSubject = DmgResult.InstigatorSubject;
-			HitData.IsCritical = DmgResult.IsCritical;
-			HitData.IsKill = DmgResult.IsKill;
-			HitData.DmgDealt = DmgResult.DmgDealt;
-			OnHitQueue.Enqueue(HitData);
+			PendingDamage.Append(Parked.Commands);
+			It.RemoveCurrent();
 		}
+	}
 
-		DamageResults.Add(DmgResult);
+	if (PendingDamage.IsEmpty()) return;
+
+	// 按目标排序，同一目标的伤害只在一个线程里结算，FHealth无需加锁 | by target, a target's hits all settle on one thread so FHealth needs no lock
+	for (FDamageCommand& Command : PendingDamage)
+	{
+		Command.SortKey = Command.Target.CalcHash();
 	}
-}
 
-// Solid Chain version with better performance and supports multithreading
-void ABattleFrameBattleControl::ApplyDamageToSubjectsDeferred(const FSubjectArray& Subjects, const FSubjectArray& IgnoreSubjects, const FSubjectHandle DmgInstigator, const FVector& HitFromLocation, const FDamage& Damage, const FDebuff& Debuff, TArray<FDmgResult>& DamageResults)
-{
-	// 使用TSet存储唯一敌人句柄
-	TSet<FSubjectHandle> UniqueHandles;
+	RadixSortDamageCommands(PendingDamage, PendingDamageScratch);
+	GroupDamageCommands(PendingDamage, PendingDamageGroups);
 
-	// 将IgnoreSubjects转换为TSet以提高查找效率
-	const TSet<FSubjectHandle> IgnoreSet(IgnoreSubjects.Subjects);
+	const int32 NumTargetGroups = PendingDamageGroups.Num() - 1;
 
-	for (const auto& Overlapper : Subjects.Subjects)
-	{
-		// 使用TSet的Contains替代数组的Contains
-		if (IgnoreSet.Contains(Overlapper)) continue;
+	ParallelFor(NumTargetGroups, [&](int32 GroupIndex)
+		{
+			for (int32 Index = PendingDamageGroups[GroupIndex]; Index < PendingDamageGroups[GroupIndex + 1]; ++Index)
+			{
+				FDamageCommand& Command = PendingDamage[Index];
+				const FSubjectHandle& Target = Command.Target;
 
-		int32 PreviousNum = UniqueHandles.Num();
-		UniqueHandles.Add(Overlapper);
+				if (!Target.IsValid() || Target.HasTrait<FDying>()) continue;
 
-		if (UniqueHandles.Num() == PreviousNum) continue;
+				FHealth* Health = Target.GetTraitPtr<FHealth, EParadigm::Unsafe>();
 
-		if (!Overlapper.IsValid()) continue;
+				// 如果怪物死了，跳过
+				if (!Health || Health->Current <= 0) continue;
 
-		// Pre-calculate all trait checks
-		const bool bHasHealth = Overlapper.HasTrait<FHealth>();
-		const bool bHasLocated = Overlapper.HasTrait<FLocated>();
-		const bool bHasDirected = Overlapper.HasTrait<FDirected>();
-		const bool bHasScaled = Overlapper.HasTrait<FScaled>();
-		const bool bHasCollider = Overlapper.HasTrait<FCollider>();
-		const bool bHasGridData = Overlapper.HasTrait<FGridData>();
-		const bool bHasDefence = Overlapper.HasTrait<FDefence>();
-		const bool bHasTextPopUp = Overlapper.HasTrait<FTextPopUp>();
-		const bool bHasMoving = Overlapper.HasTrait<FMoving>();
-		const bool bHasSlowing = Overlapper.HasTrait<FSlowing>();
-		const bool bHasAnimation = Overlapper.HasTrait<FAnimation>();
-		const bool bHasSleep = Overlapper.HasTrait<FSleep>();
-		const bool bHasSleeping = Overlapper.HasTrait<FSleeping>();
-		const bool bHasHit = Overlapper.HasTrait<FHit>();
-		const bool bHasHitGlow = Overlapper.HasTrait<FHitGlow>();
-		const bool bHasJiggle = Overlapper.HasTrait<FJiggle>();
-		const bool bHasPatrolling = Overlapper.HasTrait<FPatrolling>();
-		const bool bHasTrace = Overlapper.HasTrait<FTrace>();
-		const bool bHasIsSubjective = Overlapper.HasTrait<FIsSubjective>();
+				// 与DecideHealthFilter一致，未激活的目标把伤害停放到之后的帧 | as DecideHealthFilter did, targets not yet activated park their hits for a later frame
+				if (!Target.HasTrait<FActivated>() || !Target.HasTrait<FLocated>())
+				{
+					ParkedDamageQueue.Enqueue(Command);
+					continue;
+				}
 
-		FVector Location = bHasLocated ? Overlapper.GetTraitRef<FLocated, EParadigm::Unsafe>().Location : FVector::ZeroVector;
-		FVector Direction = bHasDirected ? Overlapper.GetTraitRef<FDirected, EParadigm::Unsafe>().Direction : FVector::ZeroVector;
+				if (Health->bLockHealth) continue;
 
-		FDmgResult DmgResult;
-		DmgResult.DamagedSubject = Overlapper;
+				Command.DamageDealt = FMath::Min(Command.Damage, Health->Current);
 
-		FVector HitDirection = FVector::ZeroVector;
+				if (Health->Current - Command.Damage <= 0) // 是致命伤害
+				{
+					Target.SetTraitDeferred(FDying{ 0, 0, Command.Instigator, FVector(Command.HitDirection) });	// 标记为死亡
 
-		if (bHasLocated)
+					if (FMove* Move = Target.GetTraitPtr<FMove, EParadigm::Unsafe>())
+					{
+						Move->Z.bCanFly = false; // 如果在飞行会掉下来
+					}
+
+					const FAgent* Agent = Target.GetTraitPtr<FAgent, EParadigm::Unsafe>();
+					Command.Score = Agent ? Agent->Score : 0;
+					Command.bKill = true;
+				}
+
+				// 扣除血量
+				Health->Current -= Command.DamageDealt;
+			}
+
+		}, NumTargetGroups < MinBatchSizeAllowed);
+
+	ParkedDamageQueue.Drain([&](const FDamageCommand& Command)
+	{
+		ParkedDamage.FindOrAdd(Command.Target).Commands.Add(Command);
+	});
+
+	// 再按施加者排序，伤害、击杀与积分同样无锁累加 | then by instigator, so damage, kills and score are credited without a lock either
+	PendingDamageScratch.Reset();
+
+	for (const FDamageCommand& Command : PendingDamage)
+	{
+		if (Command.DamageDealt > 0.f && Command.Instigator.IsValid())
 		{
-			HitDirection = (Location - HitFromLocation).GetSafeNormal2D();
+			FDamageCommand& Credit = PendingDamageScratch.Add_GetRef(Command);
+			Credit.SortKey = Command.Instigator.CalcHash();
 		}
+	}
 
-		//-------------伤害和抗性------------
+	Swap(PendingDamage, PendingDamageScratch);
 
-		float NormalDmgMult = 1;
-		float FireDmgMult = 1;
-		float IceDmgMult = 1;
-		float PoisonDmgMult = 1;
-		float PercentDmgMult = 1;
+	RadixSortDamageCommands(PendingDamage, PendingDamageScratch);
+	GroupDamageCommands(PendingDamage, PendingDamageGroups);
 
-		if (bHasHealth)
+	const int32 NumInstigatorGroups = PendingDamageGroups.Num() - 1;
+
+	ParallelFor(NumInstigatorGroups, [&](int32 GroupIndex)
 		{
-			auto& Health = Overlapper.GetTraitRef<FHealth, EParadigm::Unsafe>();
+			const int32 GroupEnd = PendingDamageGroups[GroupIndex + 1];
+			int32 Index = PendingDamageGroups[GroupIndex];
 
-			// 抗性 如果有的话
-			if (bHasDefence)
+			// 键冲突时一组里可能有多个施加者，逐段合计 | a key collision can put several instigators in one group, total each run
+			while (Index < GroupEnd)
 			{
-				const auto& Defence = Overlapper.GetTraitRef<FDefence, EParadigm::Unsafe>();
+				const FSubjectHandle Instigator = PendingDamage[Index].Instigator;
+				float TotalDamage = 0.f;
+				int32 TotalKills = 0;
+				int32 TotalScore = 0;
 
-				NormalDmgMult = 1 - Defence.NormalDmgImmune;
-				FireDmgMult = 1 - Defence.FireDmgImmune;
-				IceDmgMult = 1 - Defence.IceDmgImmune;
-				PoisonDmgMult = 1 - Defence.PoisonDmgImmune;
-				PercentDmgMult = 1.f - Defence.PercentDmgImmune;
-			}
+				for (; Index < GroupEnd && PendingDamage[Index].Instigator == Instigator; ++Index)
+				{
+					const FDamageCommand& Command = PendingDamage[Index];
+					TotalDamage += Command.DamageDealt;
+					TotalKills += Command.bKill ? 1 : 0;
+					TotalScore += Command.bKill ? Command.Score : 0;
+				}
 
-			// 基础伤害
-			float BaseDamage = 0;
+				FStatistics* Stats = Instigator.GetTraitPtr<FStatistics, EParadigm::Unsafe>();
 
-			switch (Damage.DmgType)
-			{
-				case EDmgType::Normal:
-					BaseDamage = Damage.Damage * NormalDmgMult;
-					break;
-				case EDmgType::Fire:
-					BaseDamage = Damage.Damage * FireDmgMult;
-					break;
-				case EDmgType::Ice:
-					BaseDamage = Damage.Damage * IceDmgMult;
-					break;
-				case EDmgType::Poison:
-					BaseDamage = Damage.Damage * PoisonDmgMult;
-					break;
+				if (Stats && Stats->bEnable)
+				{
+					Stats->TotalDamage += TotalDamage;
+					Stats->TotalKills += TotalKills;
+					Stats->TotalScore += TotalScore;
+				}
 			}
 
-			// 百分比伤害
-			float PercentageDamage = Health.Maximum * Damage.PercentDmg * PercentDmgMult;
+		}, NumInstigatorGroups < MinBatchSizeAllowed);
+}
 
-			// 总伤害
-			float CombinedDamage = BaseDamage + PercentageDamage;
+void ABattleFrameBattleControl::PoolAgentDeferred(FSolidSubjectHandle Subject)
+{
+	// 去掉所有临时状态，不再参与模拟、网格和渲染注册 | drop every transient state, the agent leaves the simulation, the grids and render registration
+	Subject.RemoveTraitDeferred<FActivated>();
+	Subject.RemoveTraitDeferred<FCorpse>();
+	Subject.RemoveTraitDeferred<FDeathAnim>();
+	Subject.RemoveTraitDeferred<FDeathDissolve>();
+	Subject.RemoveTraitDeferred<FAttacking>();
+	Subject.RemoveTraitDeferred<FHitGlow>();
+	Subject.RemoveTraitDeferred<FJiggle>();
+	Subject.RemoveTraitDeferred<FAppearing>();
+	Subject.RemoveTraitDeferred<FAppearAnim>();
+	Subject.RemoveTraitDeferred<FAppearDissolve>();
+	Subject.RemoveTraitDeferred<FSleeping>();
+	Subject.RemoveTraitDeferred<FPatrolling>();
+	Subject.RemoveTraitDeferred<FMayDie>();
+	Subject.SetTraitDeferred(FPooled());
+
+	// 新的生命周期，此前生成的马甲不会附着到复用后的单位上 | a new life, ghost subjects spawned before this never attach to the reused agent
+	FRecyclable* Recyclable = Subject.GetTraitPtr<FRecyclable, EParadigm::Unsafe>();
+
+	if (Recyclable)
+	{
+		++Recyclable->Generation;
+	}
 
-			// 考虑暴击后伤害
-			auto [bIsCrit, PostCritDamage] = ProcessCritDamage(CombinedDamage, Damage.CritDmgMult, Damage.CritProbability);
+	RecycledAgents.Enqueue(FSubjectHandle(Subject));
+}
 
-			// 限制伤害以不大于剩余血量
-			float ClampedDamage = FMath::Min(PostCritDamage, Health.Current);
+void ABattleFrameBattleControl::CollectPooledAgents()
+{
+	RecycledAgents.Drain([&](const FSubjectHandle& Agent)
+	{
+		if (!Agent.IsValid()) return;
 
-			DmgResult.IsCritical = bIsCrit;
-			DmgResult.DmgDealt = ClampedDamage;
+		const FRecyclable* Recyclable = Agent.GetTraitPtr<FRecyclable, EParadigm::Unsafe>();
 
-			if (ClampedDamage == Health.Current)
-			{
-				DmgResult.IsKill = true;
-				Overlapper.SetTraitDeferred(FMayDie());
-			}
+		if (Recyclable)
+		{
+			AgentPool.FindOrAdd(Recyclable->PoolKey).Add(Agent);
+		}
+	});
+}
 
-			// 应用伤害
-			Health.DamageToTake.Enqueue(ClampedDamage);
+FSubjectHandle ABattleFrameBattleControl::TakePooledAgent(const FAgentPoolKey& Key)
+{
+	TArray<FSubjectHandle>* Pool = AgentPool.Find(Key);
 
-			// 记录伤害施加者
-			if (DmgInstigator.IsValid())
-			{
-				Health.DamageInstigator.Enqueue(DmgInstigator);
-				DmgResult.InstigatorSubject = DmgInstigator;
-			}
-			else
-			{
-				Health.DamageInstigator.Enqueue(FSubjectHandle());
-			}
+	while (Pool && !Pool->IsEmpty())
+	{
+		const FSubjectHandle Agent = Pool->Pop();
 
-			Health.HitDirection.Enqueue(HitDirection);
+		// 池中单位可能已被外部销毁 | a pooled agent may have been despawned from outside
+		if (Agent.IsValid() && Agent.HasTrait<FPooled>())
+		{
+			return Agent;
+		}
+	}
 
-			// ------------生成文字--------------
+	return FSubjectHandle();
+}
 
-			if (bHasTextPopUp && bHasLocated)
-			{
-				const auto& TextPopUp = Overlapper.GetTraitRef<FTextPopUp, EParadigm::Unsafe>();
+UObject* ABattleFrameBattleControl::RequestSoftObject(const FSoftObjectPath& Path)
+{
+	if (Path.IsNull()) return nullptr;
 
-				if (TextPopUp.Enable)
-				{
-					float Style = 0;
+	UObject* Object = Path.ResolveObject();
 
-					if (!bIsCrit)
-					{
-						if (PostCritDamage < TextPopUp.WhiteTextBelowPercent)
-						{
-							Style = 0;
-						}
-						else if (PostCritDamage < TextPopUp.OrangeTextAbovePercent)
-						{
-							Style = 1;
-						}
-						else
-						{
-							Style = 2;
-						}
-					}
-					else
-					{
-						Style = 3;
-					}
+	if (!Object && !AssetLoads.Contains(Path))
+	{
+		AssetLoads.Add(Path, StreamableManager.RequestAsyncLoad(Path, FStreamableDelegate(), FStreamableManager::AsyncLoadHighPriority));
+	}
 
-					float Radius = bHasGridData ? Overlapper.GetTrait<FGridData>().Radius : 0;
-					QueueText(FTextPopConfig(Overlapper, PostCritDamage, Style, TextPopUp.TextScale, Radius * 1.1, Location));
-				}
-			}
+	return Object;
+}
 
-			//--------------Debuff--------------
+bool ABattleFrameBattleControl::HasLoadFailed(const FSoftObjectPath& Path) const
+{
+	const TSharedPtr<FStreamableHandle>* Load = AssetLoads.Find(Path);
 
-			// 持续伤害
-			if (Debuff.TemporalDmgParams.bDealTemporalDmg)
-			{
-				// Record for spawning of TemporalDamager
-				FTemporalDamager TemporalDamager;
+	if (!Load) return false;
 
-				float TotalTemporalDmg = Debuff.TemporalDmgParams.TemporalDmg;
+	return (!Load->IsValid() || (*Load)->HasLoadCompleted() || (*Load)->WasCanceled()) && !Path.ResolveObject();
+}
 
-				switch (Damage.DmgType)
-				{
-				case EDmgType::Normal:
-					TotalTemporalDmg *= NormalDmgMult;
-					break;
-				case EDmgType::Fire:
-					TotalTemporalDmg *= FireDmgMult;
-					break;
-				case EDmgType::Ice:
-					TotalTemporalDmg *= IceDmgMult;
-					break;
-				case EDmgType::Poison:
-					TotalTemporalDmg *= PoisonDmgMult;
-					break;
-				}
+void ABattleFrameBattleControl::PreloadAgentConfigs(const TArray<TSoftObjectPtr<UAgentConfigDataAsset>>& Configs)
+{
+	for (const TSoftObjectPtr<UAgentConfigDataAsset>& Config : Configs)
+	{
+		RequestAgentConfig(Config);
+	}
+}
 
-				TemporalDamager.TotalTemporalDamage = TotalTemporalDmg;
+bool ABattleFrameBattleControl::RequestAgentConfig(const TSoftObjectPtr<UAgentConfigDataAsset>& Config)
+{
+	// 配置加载完后才知道它依赖的资源，下次询问时再请求 | a config's dependencies are only known once it is loaded, they are requested on the next ask
+	const UAgentConfigDataAsset* DataAsset = Cast<UAgentConfigDataAsset>(RequestSoftObject(Config.ToSoftObjectPath()));
 
-				if (TemporalDamager.TotalTemporalDamage > 0)
-				{
-					TemporalDamager.TemporalDamageTarget = Overlapper;
-					TemporalDamager.RemainingTemporalDamage = TemporalDamager.TotalTemporalDamage;
+	if (!DataAsset) return false;
+
+	bool bReady = true;
+
+	const FSoftObjectPath& AnimPath = DataAsset->Animation.AnimToTextureDataAsset.ToSoftObjectPath();
+	bReady &= AnimPath.IsNull() || RequestSoftObject(AnimPath) != nullptr || HasLoadFailed(AnimPath);
 
-					if (DmgInstigator.IsValid())
-					{
-						TemporalDamager.TemporalDamageInstigator = DmgInstigator;
-					}
-					else
-					{
-						TemporalDamager.TemporalDamageInstigator = FSubjectHandle();
-					}
+	const FSoftObjectPath& FlowFieldPath = DataAsset->Navigation.FlowFieldToUse.ToSoftObjectPath();
 
-					TemporalDamager.TemporalDmgSegment = Debuff.TemporalDmgParams.TemporalDmgSegment;
-					TemporalDamager.TemporalDmgInterval = Debuff.TemporalDmgParams.TemporalDmgInterval;
-					TemporalDamager.DmgType = Damage.DmgType;
+	if (!FlowFieldPath.IsNull())
+	{
+		RequestSoftObject(FlowFieldPath);// agents wait in the move stage, not on activation
+	}
 
-					Mechanism->SpawnSubjectDeferred(TemporalDamager);
-				}
-			}
-		}
+	return bReady;
+}
 
-		//--------------Debuff--------------
+void ABattleFrameBattleControl::ResolveFlowFields()
+{
+	const double Now = GetWorld()->GetTimeSeconds();
 
-		// 击退
-		if (Debuff.LaunchParams.bCanLaunch)
+	// 只有仍存活的条目算命中，失败的路径在重试前保持等待 | only live entries count as hits, a failed path keeps its subjects waiting until its retry is due
+	const auto Lookup = [&](const FSoftObjectPath& Path, AFlowField*& OutFlowField)
+	{
+		if (const TWeakObjectPtr<AFlowField>* Found = ResolvedFlowFields.Find(Path))
 		{
-			if (bHasMoving)
+			if (AFlowField* FlowField = Found->Get())
 			{
-				auto& Moving = Overlapper.GetTraitRef<FMoving, EParadigm::Unsafe>();
-
-				FVector KnockbackForce = FVector(Debuff.LaunchParams.LaunchSpeed.X, Debuff.LaunchParams.LaunchSpeed.X, 1) * HitDirection + FVector(0, 0, Debuff.LaunchParams.LaunchSpeed.Y);
-				FVector CombinedForce = Moving.LaunchVelSum + KnockbackForce;
-
-				Moving.Lock();
-				Moving.LaunchVelSum += KnockbackForce; // 累加击退力
-				Moving.Unlock();
+				OutFlowField = FlowField;
+				return true;
 			}
 		}
+		else if (const double* RetryTime = FailedFlowFields.Find(Path))
+		{
+			if (Now < *RetryTime) return false;
+		}
 
-		// 减速
-		if (Debuff.SlowParams.bCanSlow && bHasSlowing)
+		UnresolvedFlowFields.Enqueue(Path);
+		return false;
+	};
+
+	// 并行只查表，没查到的路径交给游戏线程 | workers only look up the table, misses go to the game thread
+	auto Chain = Mechanism->EnchainSolid(NavigationResolveFilter);
+	UBattleFrameFunctionLibraryRT::CalculateThreadsCountAndBatchSize(Chain->IterableNum(), MaxThreadsAllowed, MinBatchSizeAllowed, ThreadsCount, BatchSize);
+
+	Chain->OperateConcurrently([&](FSolidSubjectHandle Subject, FNavigation& Navigation)
+	{
+		if (LIKELY(!Navigation.bIsDirtyData))
 		{
-			// Record for deferred spawning of Slower
-			FSlower Slower;
+			// 已解析的流场被销毁时重新解析 | resolve again when the flow field in use was destroyed
+			if (LIKELY(IsValid(Navigation.FlowField) || Navigation.FlowFieldToUse.IsNull())) return;
 
-			Slower.SlowTarget = Overlapper;
-			Slower.SlowStrength = Debuff.SlowParams.SlowStrength;
-			Slower.SlowTimeout = Debuff.SlowParams.SlowTime;
-			Slower.DmgType = Damage.DmgType;
+			Navigation.bIsDirtyData = true;
+		}
 
-			Mechanism->SpawnSubjectDeferred(Slower);
+		const FSoftObjectPath& Path = Navigation.FlowFieldToUse.ToSoftObjectPath();
+
+		if (Path.IsNull())
+		{
+			Navigation.FlowField = nullptr;
+			Navigation.bIsDirtyData = false;
+		}
+		else if (Lookup(Path, Navigation.FlowField))
+		{
+			Navigation.bIsDirtyData = false;
 		}
 
-		//-----------其它效果------------
+	}, ThreadsCount, BatchSize);
 
-		if (bHasSleeping)// wake on hit
+	// 绑定流场的主体很少，直接在游戏线程处理 | few subjects bind a flow field, they are handled on the game thread
+	Mechanism->Operate<FUnsafeChain>(BindFlowFieldResolveFilter,
+		[&](FUnsafeSubjectHandle Subject, FBindFlowField& BindFlowField)
 		{
-			if (bHasSleep)
+			if (!BindFlowField.bIsDirtyData)
 			{
-				auto& Sleep = Overlapper.GetTraitRef<FSleep, EParadigm::Unsafe>();
+				if (IsValid(BindFlowField.FlowField) || BindFlowField.FlowFieldToBind.IsNull()) return;
 
-				if (Sleep.bWakeOnHit)
-				{
-					Sleep.bEnable = false;
-					Overlapper.RemoveTraitDeferred<FSleeping>();
-				}
+				BindFlowField.bIsDirtyData = true;
 			}
-		}
 
-		if (bHasHit)
-		{
-			const auto& Hit = Overlapper.GetTraitRef<FHit, EParadigm::Unsafe>();
+			const FSoftObjectPath& Path = BindFlowField.FlowFieldToBind.ToSoftObjectPath();
 
-			// Glow
-			if (Hit.bCanGlow && !bHasHitGlow)
+			if (Path.IsNull())
 			{
-				Overlapper.SetTraitDeferred(FHitGlow());
+				BindFlowField.FlowField = nullptr;
+				BindFlowField.bIsDirtyData = false;
 			}
-
-			// Jiggle
-			if (Hit.JiggleStr != 0.f && !bHasJiggle)
+			else if (Lookup(Path, BindFlowField.FlowField))
 			{
-				Overlapper.SetTraitDeferred(FJiggle());
+				BindFlowField.bIsDirtyData = false;
 			}
+		});
 
-			// Actor
-			for (const FActorSpawnConfig& Config : Hit.SpawnActor)
-			{
-				FActorSpawnConfig_Final NewConfig(Config);
-				NewConfig.OwnerSubject = FSubjectHandle(Overlapper);
-				NewConfig.AttachToSubject = FSubjectHandle(Overlapper);
-				const FTransform WorldTransform(HitDirection.ToOrientationQuat(), Overlapper.GetTrait<FLocated>().Location);
-				NewConfig.SpawnTransform = ABattleFrameBattleControl::LocalOffsetToWorld(Overlapper.GetTrait<FDirected>().Direction.ToOrientationQuat(), WorldTransform.GetLocation(), NewConfig.Transform);
-				NewConfig.InitialRelativeTransform = NewConfig.SpawnTransform.GetRelativeTransform(WorldTransform);
-
-				Mechanism->SpawnSubjectDeferred(NewConfig);
-			}
+	UnresolvedFlowFields.Drain([&](const FSoftObjectPath& Path)
+	{
+		if (const TWeakObjectPtr<AFlowField>* Found = ResolvedFlowFields.Find(Path))
+		{
+			if (Found->IsValid()) return;
 
-			// Fx
-			for (const FFxConfig& Config : Hit.SpawnFx)
-			{
-				FFxConfig_Final NewConfig(Config);
-				NewConfig.OwnerSubject = FSubjectHandle(Overlapper);
-				NewConfig.AttachToSubject = FSubjectHandle(Overlapper);
-				const FTransform WorldTransform(HitDirection.ToOrientationQuat(), Overlapper.GetTrait<FLocated>().Location);
-				NewConfig.SpawnTransform = ABattleFrameBattleControl::LocalOffsetToWorld(Overlapper.GetTrait<FDirected>().Direction.ToOrientationQuat(), WorldTransform.GetLocation(), NewConfig.Transform);
-				NewConfig.InitialRelativeTransform = NewConfig.SpawnTransform.GetRelativeTransform(WorldTransform);
+			// 流场已被销毁，丢弃条目与旧的加载句柄 | the flow field was destroyed, drop the entry and its old load handle
+			ResolvedFlowFields.Remove(Path);
+			AssetLoads.Remove(Path);
+		}
+		else if (const double* RetryTime = FailedFlowFields.Find(Path))
+		{
+			if (Now < *RetryTime) return;
 
-				Mechanism->SpawnSubjectDeferred(NewConfig);
-			}
+			// 到了重试时间，重新发起加载 | the retry is due, start a fresh load
+			FailedFlowFields.Remove(Path);
+			AssetLoads.Remove(Path);
+		}
 
-			// Sound
-			for (const FSoundConfig& Config : Hit.PlaySound)
-			{
-				FSoundConfig_Final NewConfig(Config);
-				NewConfig.OwnerSubject = FSubjectHandle(Overlapper);
-				NewConfig.AttachToSubject = FSubjectHandle(Overlapper);
-				const FTransform WorldTransform(HitDirection.ToOrientationQuat(), Overlapper.GetTrait<FLocated>().Location);
-				NewConfig.SpawnTransform = ABattleFrameBattleControl::LocalOffsetToWorld(Overlapper.GetTrait<FDirected>().Direction.ToOrientationQuat(), WorldTransform.GetLocation(), NewConfig.Transform);
-				NewConfig.InitialRelativeTransform = NewConfig.SpawnTransform.GetRelativeTransform(WorldTransform);
+		AFlowField* FlowField = Cast<AFlowField>(RequestSoftObject(Path));
 
-				Mechanism->SpawnSubjectDeferred(NewConfig);
-			}
+		if (FlowField)
+		{
+			ResolvedFlowFields.Add(Path, FlowField);
+			return;
 		}
 
-		if (bHasIsSubjective)
+		// 加载结束仍找不到的，单位原地等待，稍后重试 | a path that still does not resolve after its load finished keeps its agents waiting and is tried again later
+		if (HasLoadFailed(Path))
 		{
-			FHitData HitData;
-			HitData.SelfSubject = DmgResult.DamagedSubject;
-			HitData.InstigatorSubject = DmgResult.InstigatorSubject;
-			HitData.IsCritical = DmgResult.IsCritical;
-			HitData.IsKill = DmgResult.IsKill;
-			HitData.DmgDealt = DmgResult.DmgDealt;
-			OnHitQueue.Enqueue(HitData);
+			UE_LOG(LogBattleFrame, Warning, TEXT("Flow field %s could not be loaded, retrying in %.1fs | 流场加载失败，稍后重试"), *Path.ToString(), FlowFieldRetryInterval);
+			FailedFlowFields.Add(Path, Now + FlowFieldRetryInterval);
 		}
-
-		DamageResults.Add(DmgResult);
-	}
+	});
 }
 
-void ABattleFrameBattleControl::ApplyDamageToSubjectsDeferred(const FSubjectArray& Subjects, const FSubjectArray& IgnoreSubjects, const FSubjectHandle DmgInstigator, const FVector& HitFromLocation, const FDmgSphere& DmgSphere, const FDebuff& Debuff, TArray<FDmgResult>& DamageResults)
+template<bool bDeferred, typename DamageType>
+void ABattleFrameBattleControl::ApplyDamageToSubjectsImpl(const FSubjectArray& Subjects, const FSubjectArray& IgnoreSubjects, const FSubjectHandle DmgInstigator, const FVector& HitFromLocation, const DamageType& Damage, const FDebuff& Debuff, TArray<FDmgResult>& DamageResults)
 {
+	// 延迟版本可在工作线程调用，特征和生成操作都走延迟接口 | the deferred flavor runs on workers, so trait and spawn operations go through the deferred calls
+	const auto SpawnFromTrait = [this](const auto& Trait)
+	{
+		if constexpr (bDeferred)
+		{
+			Mechanism->SpawnSubjectDeferred(Trait);
+		}
+		else
+		{
+			Mechanism->SpawnSubject(Trait);
+		}
+	};
+
+	const auto SetTargetTrait = [](const FSubjectHandle& Target, const auto& Trait)
+	{
+		if constexpr (bDeferred)
+		{
+			Target.SetTraitDeferred(Trait);
+		}
+		else
+		{
+			Target.SetTrait(Trait);
+		}
+	};
+
 	// 使用TSet存储唯一敌人句柄
 	TSet<FSubjectHandle> UniqueHandles;
 
@@ -5067,7 +5079,10 @@ void ABattleFrameBattleControl::ApplyDamageToSubjectsDeferred(const FSubjectArra
 		const bool bHasTrace = Overlapper.HasTrait<FTrace>();
 		const bool bHasIsSubjective = Overlapper.HasTrait<FIsSubjective>();
 
-		FVector Location = bHasLocated ? Overlapper.GetTraitRef<FLocated,EParadigm::Unsafe>().Location : FVector::ZeroVector;
+		// 开启内联状态效果时减益直接写入目标 | with inline status effects on, debuffs are written straight into the target
+		FStatusEffects* StatusEffects = bInlineStatusEffects ? Overlapper.GetTraitPtr<FStatusEffects, EParadigm::Unsafe>() : nullptr;
+
+		FVector Location = bHasLocated ? Overlapper.GetTraitRef<FLocated, EParadigm::Unsafe>().Location : FVector::ZeroVector;
 		FVector Direction = bHasDirected ? Overlapper.GetTraitRef<FDirected, EParadigm::Unsafe>().Direction : FVector::ZeroVector;
 
 		FDmgResult DmgResult;
@@ -5090,7 +5105,7 @@ void ABattleFrameBattleControl::ApplyDamageToSubjectsDeferred(const FSubjectArra
 
 		if (bHasHealth)
 		{
-			auto& Health = Overlapper.GetTraitRef<FHealth, EParadigm::Unsafe>();
+			const FHealth& Health = Overlapper.GetTraitRef<FHealth, EParadigm::Unsafe>();
 
 			// 抗性 如果有的话
 			if (bHasDefence)
@@ -5107,30 +5122,30 @@ void ABattleFrameBattleControl::ApplyDamageToSubjectsDeferred(const FSubjectArra
 			// 基础伤害
 			float BaseDamage = 0;
 
-			switch (DmgSphere.DmgType)
+			switch (Damage.DmgType)
 			{
 				case EDmgType::Normal:
-					BaseDamage = DmgSphere.Damage * NormalDmgMult;
+					BaseDamage = Damage.Damage * NormalDmgMult;
 					break;
 				case EDmgType::Fire:
-					BaseDamage = DmgSphere.Damage * FireDmgMult;
+					BaseDamage = Damage.Damage * FireDmgMult;
 					break;
 				case EDmgType::Ice:
-					BaseDamage = DmgSphere.Damage * IceDmgMult;
+					BaseDamage = Damage.Damage * IceDmgMult;
 					break;
 				case EDmgType::Poison:
-					BaseDamage = DmgSphere.Damage * PoisonDmgMult;
+					BaseDamage = Damage.Damage * PoisonDmgMult;
 					break;
 			}
 
 			// 百分比伤害
-			float PercentageDamage = Health.Maximum * DmgSphere.PercentDmg * PercentDmgMult;
+			float PercentageDamage = Health.Maximum * Damage.PercentDmg * PercentDmgMult;
 
 			// 总伤害
 			float CombinedDamage = BaseDamage + PercentageDamage;
 
 			// 考虑暴击后伤害
-			auto [bIsCrit, PostCritDamage] = ProcessCritDamage(CombinedDamage, DmgSphere.CritDmgMult, DmgSphere.CritProbability);
+			auto [bIsCrit, PostCritDamage] = ProcessCritDamage(CombinedDamage, Damage.CritDmgMult, Damage.CritProbability);
 
 			// 限制伤害以不大于剩余血量
 			float ClampedDamage = FMath::Min(PostCritDamage, Health.Current);
@@ -5141,24 +5156,17 @@ void ABattleFrameBattleControl::ApplyDamageToSubjectsDeferred(const FSubjectArra
 			if (ClampedDamage == Health.Current)
 			{
 				DmgResult.IsKill = true;
-				Overlapper.SetTraitDeferred(FMayDie());
+				SetTargetTrait(Overlapper, FMayDie());
 			}
 
-			// 应用伤害
-			Health.DamageToTake.Enqueue(ClampedDamage);
-
 			// 记录伤害施加者
 			if (DmgInstigator.IsValid())
 			{
-				Health.DamageInstigator.Enqueue(DmgInstigator);
 				DmgResult.InstigatorSubject = DmgInstigator;
 			}
-			else
-			{
-				Health.DamageInstigator.Enqueue(FSubjectHandle());
-			}
 
-			Health.HitDirection.Enqueue(HitDirection);
+			// 应用伤害，在DecideHealth中按目标统一结算 | settled per target in DecideHealth
+			DamageCommands.Enqueue(FDamageCommand(Overlapper, DmgResult.InstigatorSubject, HitDirection, ClampedDamage));
 
 			// ------------生成文字--------------
 
@@ -5205,27 +5213,44 @@ void ABattleFrameBattleControl::ApplyDamageToSubjectsDeferred(const FSubjectArra
 
 				float TotalTemporalDmg = Debuff.TemporalDmgParams.TemporalDmg;
 
-				switch (DmgSphere.DmgType)
+				switch (Damage.DmgType)
 				{
-					case EDmgType::Normal:
-						TotalTemporalDmg *= NormalDmgMult;
-						break;
-					case EDmgType::Fire:
-						TotalTemporalDmg *= FireDmgMult;
-						break;
-					case EDmgType::Ice:
-						TotalTemporalDmg *= IceDmgMult;
-						break;
-					case EDmgType::Poison:
-						TotalTemporalDmg *= PoisonDmgMult;
-						break;
+				case EDmgType::Normal:
+					TotalTemporalDmg *= NormalDmgMult;
+					break;
+				case EDmgType::Fire:
+					TotalTemporalDmg *= FireDmgMult;
+					break;
+				case EDmgType::Ice:
+					TotalTemporalDmg *= IceDmgMult;
+					break;
+				case EDmgType::Poison:
+					TotalTemporalDmg *= PoisonDmgMult;
+					break;
 				}
 
 				TemporalDamager.TotalTemporalDamage = TotalTemporalDmg;
 
-				if (TemporalDamager.TotalTemporalDamage > 0)
+				if (TemporalDamager.TotalTemporalDamage > 0 && StatusEffects)
+				{
+					// 写入目标的内联槽位，不生成马甲 | a slot write on the target instead of a ghost subject
+					FStatusEffectSlot Effect;
+					Effect.Kind = EStatusEffectKind::TemporalDmg;
+					Effect.DmgType = Damage.DmgType;
+					Effect.Instigator = DmgInstigator.IsValid() ? DmgInstigator : FSubjectHandle();
+					Effect.Strength = TotalTemporalDmg;
+					Effect.SegmentsLeft = Debuff.TemporalDmgParams.TemporalDmgSegment;
+					Effect.Interval = Debuff.TemporalDmgParams.TemporalDmgInterval;
+					Effect.TimeLeft = Effect.Interval;
+
+					StatusEffects->Lock();
+					StatusEffects->Apply(Effect, Debuff.TemporalDmgParams.Stacking);
+					StatusEffects->Unlock();
+				}
+				else if (TemporalDamager.TotalTemporalDamage > 0)
 				{
 					TemporalDamager.TemporalDamageTarget = Overlapper;
+					TemporalDamager.TargetGeneration = GetRecycleGeneration(Overlapper);
 					TemporalDamager.RemainingTemporalDamage = TemporalDamager.TotalTemporalDamage;
 
 					if (DmgInstigator.IsValid())
@@ -5239,9 +5264,9 @@ void ABattleFrameBattleControl::ApplyDamageToSubjectsDeferred(const FSubjectArra
 
 					TemporalDamager.TemporalDmgSegment = Debuff.TemporalDmgParams.TemporalDmgSegment;
 					TemporalDamager.TemporalDmgInterval = Debuff.TemporalDmgParams.TemporalDmgInterval;
-					TemporalDamager.DmgType = DmgSphere.DmgType;
+					TemporalDamager.DmgType = Damage.DmgType;
 
-					Mechanism->SpawnSubjectDeferred(TemporalDamager);
+					SpawnFromTrait(TemporalDamager);
 				}
 			}
 		}
@@ -5265,17 +5290,31 @@ void ABattleFrameBattleControl::ApplyDamageToSubjectsDeferred(const FSubjectArra
 		}
 
 		// 减速
-		if (Debuff.SlowParams.bCanSlow && bHasSlowing)
+		if (Debuff.SlowParams.bCanSlow && bHasSlowing && StatusEffects)
+		{
+			FStatusEffectSlot Effect;
+			Effect.Kind = EStatusEffectKind::Slow;
+			Effect.DmgType = Damage.DmgType;
+			Effect.Instigator = DmgInstigator.IsValid() ? DmgInstigator : FSubjectHandle();
+			Effect.Strength = Debuff.SlowParams.SlowStrength;
+			Effect.TimeLeft = Debuff.SlowParams.SlowTime;
+
+			StatusEffects->Lock();
+			StatusEffects->Apply(Effect, Debuff.SlowParams.Stacking);
+			StatusEffects->Unlock();
+		}
+		else if (Debuff.SlowParams.bCanSlow && bHasSlowing)
 		{
-			// Record for deferred spawning of Slower
+			// Record for spawning of Slower
 			FSlower Slower;
 
 			Slower.SlowTarget = Overlapper;
+			Slower.TargetGeneration = GetRecycleGeneration(Overlapper);
 			Slower.SlowStrength = Debuff.SlowParams.SlowStrength;
 			Slower.SlowTimeout = Debuff.SlowParams.SlowTime;
-			Slower.DmgType = DmgSphere.DmgType;
+			Slower.DmgType = Damage.DmgType;
 
-			Mechanism->SpawnSubjectDeferred(Slower);
+			SpawnFromTrait(Slower);
 		}
 
 		//-----------其它效果------------
@@ -5289,25 +5328,33 @@ void ABattleFrameBattleControl::ApplyDamageToSubjectsDeferred(const FSubjectArra
 				if (Sleep.bWakeOnHit)
 				{
 					Sleep.bEnable = false;
-					Overlapper.RemoveTraitDeferred<FSleeping>();
+
+					if constexpr (bDeferred)
+					{
+						Overlapper.RemoveTraitDeferred<FSleeping>();
+					}
+					else
+					{
+						Overlapper.RemoveTrait<FSleeping>();
+					}
 				}
 			}
 		}
 
 		if (bHasHit)
 		{
-			const auto& Hit = Overlapper.GetTraitRef<FHit,EParadigm::Unsafe>();
+			const auto& Hit = Overlapper.GetTraitRef<FHit, EParadigm::Unsafe>();
 
 			// Glow
 			if (Hit.bCanGlow && !bHasHitGlow)
 			{
-				Overlapper.SetTraitDeferred(FHitGlow());
+				SetTargetTrait(Overlapper, FHitGlow());
 			}
 
 			// Jiggle
 			if (Hit.JiggleStr != 0.f && !bHasJiggle)
 			{
-				Overlapper.SetTraitDeferred(FJiggle());
+				SetTargetTrait(Overlapper, FJiggle());
 			}
 
 			// Actor
@@ -5320,7 +5367,7 @@ void ABattleFrameBattleControl::ApplyDamageToSubjectsDeferred(const FSubjectArra
 				NewConfig.SpawnTransform = ABattleFrameBattleControl::LocalOffsetToWorld(Overlapper.GetTrait<FDirected>().Direction.ToOrientationQuat(), WorldTransform.GetLocation(), NewConfig.Transform);
 				NewConfig.InitialRelativeTransform = NewConfig.SpawnTransform.GetRelativeTransform(WorldTransform);
 
-				Mechanism->SpawnSubjectDeferred(NewConfig);
+				SpawnFromTrait(NewConfig);
 			}
 
 			// Fx
@@ -5333,7 +5380,7 @@ void ABattleFrameBattleControl::ApplyDamageToSubjectsDeferred(const FSubjectArra
 				NewConfig.SpawnTransform = ABattleFrameBattleControl::LocalOffsetToWorld(Overlapper.GetTrait<FDirected>().Direction.ToOrientationQuat(), WorldTransform.GetLocation(), NewConfig.Transform);
 				NewConfig.InitialRelativeTransform = NewConfig.SpawnTransform.GetRelativeTransform(WorldTransform);
 
-				Mechanism->SpawnSubjectDeferred(NewConfig);
+				SpawnFromTrait(NewConfig);
 			}
 
 			// Sound
@@ -5346,7 +5393,7 @@ void ABattleFrameBattleControl::ApplyDamageToSubjectsDeferred(const FSubjectArra
 				NewConfig.SpawnTransform = ABattleFrameBattleControl::LocalOffsetToWorld(Overlapper.GetTrait<FDirected>().Direction.ToOrientationQuat(), WorldTransform.GetLocation(), NewConfig.Transform);
 				NewConfig.InitialRelativeTransform = NewConfig.SpawnTransform.GetRelativeTransform(WorldTransform);
 
-				Mechanism->SpawnSubjectDeferred(NewConfig);
+				SpawnFromTrait(NewConfig);
 			}
 		}
 
@@ -5362,9 +5409,30 @@ void ABattleFrameBattleControl::ApplyDamageToSubjectsDeferred(const FSubjectArra
 		}
 
 		DamageResults.Add(DmgResult);
+		FBattleFrameCounters::Add(EBattleFrameCounter::DamageEvents, 1);
 	}
 }
 
+// Blueprint callable version that don't use get ref and defers
+void ABattleFrameBattleControl::ApplyDamageToSubjects(const FSubjectArray& Subjects, const FSubjectArray& IgnoreSubjects, const FSubjectHandle DmgInstigator, const FVector& HitFromLocation, const FDamage& Damage, const FDebuff& Debuff, TArray<FDmgResult>& DamageResults)
+{
+	ApplyDamageToSubjectsImpl<false>(Subjects, IgnoreSubjects, DmgInstigator, HitFromLocation, Damage, Debuff, DamageResults);
+}
+
+void ABattleFrameBattleControl::ApplyDamageToSubjects(const FSubjectArray& Subjects, const FSubjectArray& IgnoreSubjects, const FSubjectHandle DmgInstigator, const FVector& HitFromLocation, const FDmgSphere& DmgSphere, const FDebuff& Debuff, TArray<FDmgResult>& DamageResults)
+{
+	ApplyDamageToSubjectsImpl<false>(Subjects, IgnoreSubjects, DmgInstigator, HitFromLocation, DmgSphere, Debuff, DamageResults);
+}
+
+void ABattleFrameBattleControl::ApplyDamageToSubjectsDeferred(const FSubjectArray& Subjects, const FSubjectArray& IgnoreSubjects, const FSubjectHandle DmgInstigator, const FVector& HitFromLocation, const FDamage& Damage, const FDebuff& Debuff, TArray<FDmgResult>& DamageResults)
+{
+	ApplyDamageToSubjectsImpl<true>(Subjects, IgnoreSubjects, DmgInstigator, HitFromLocation, Damage, Debuff, DamageResults);
+}
+
+void ABattleFrameBattleControl::ApplyDamageToSubjectsDeferred(const FSubjectArray& Subjects, const FSubjectArray& IgnoreSubjects, const FSubjectHandle DmgInstigator, const FVector& HitFromLocation, const FDmgSphere& DmgSphere, const FDebuff& Debuff, TArray<FDmgResult>& DamageResults)
+{
+	ApplyDamageToSubjectsImpl<true>(Subjects, IgnoreSubjects, DmgInstigator, HitFromLocation, DmgSphere, Debuff, DamageResults);
+}
 
 FVector ABattleFrameBattleControl::FindNewPatrolGoalLocation(const FPatrol Patrol, const FCollider Collider, const FTrace Trace, const FTracing Tracing, const FLocated Located, const FScaled Scaled, int32 MaxAttempts)
 {
@@ -5418,200 +5486,33 @@ FVector ABattleFrameBattleControl::FindNewPatrolGoalLocation(const FPatrol Patro
 	return BestCandidate;
 }
 
-void ABattleFrameBattleControl::DrawDebugSector(UWorld* World, const FVector& Center, const FVector& Direction, float Radius, float AngleDegrees, float Height, const FColor& Color, bool bPersistentLines, float LifeTime, uint8 DepthPriority, float Thickness)
-{
-	if (!World || AngleDegrees <= 0.f || Radius <= 0.f || Height <= 0.f) return;
-
-	// 确保角度在合理范围
-	AngleDegrees = FMath::Clamp(AngleDegrees, 1.f, 360.f);
-	const float HalfAngle = FMath::DegreesToRadians(AngleDegrees) * 0.5f;
-
-	// 计算方向向量
-	FVector Forward = Direction.GetSafeNormal2D();
-	if (Forward.IsNearlyZero()) Forward = FVector::ForwardVector;
-
-	// 计算顶面和底面中心位置（以Center为中心对称）
-	const float HalfHeight = Height * 0.5f;
-	const FVector TopCenter = Center + FVector(0, 0, HalfHeight);
-	const FVector BottomCenter = Center - FVector(0, 0, HalfHeight);
-
-	// 计算起始和结束方向
-	const FQuat StartQuat = FQuat(FVector::UpVector, -HalfAngle);
-	const FQuat EndQuat = FQuat(FVector::UpVector, HalfAngle);
-
-	FVector StartDir = StartQuat.RotateVector(Forward);
-	FVector EndDir = EndQuat.RotateVector(Forward);
-
-	// 计算关键点
-	const FVector BottomStart = BottomCenter + StartDir * Radius;
-	const FVector BottomEnd = BottomCenter + EndDir * Radius;
-	const FVector TopStart = TopCenter + StartDir * Radius;
-	const FVector TopEnd = TopCenter + EndDir * Radius;
-
-	// ========== 绘制底面扇形 ==========
-	// 绘制底面弧线
-	const int32 NumSegments = FMath::CeilToInt(AngleDegrees / 5.f) + 1;
-	const float AngleStep = 2 * HalfAngle / (NumSegments - 1);
-
-	FVector LastBottomPoint = BottomStart;
-
-	for (int32 i = 1; i < NumSegments; ++i)
-	{
-		const float CurrentAngle = -HalfAngle + AngleStep * i;
-		const FQuat RotQuat = FQuat(FVector::UpVector, CurrentAngle);
-		FVector CurrentDir = RotQuat.RotateVector(Forward);
-		FVector CurrentPoint = BottomCenter + CurrentDir * Radius;
-
-		DrawDebugLine(
-			World,
-			LastBottomPoint,
-			CurrentPoint,
-			Color,
-			bPersistentLines,
-			LifeTime,
-			DepthPriority,
-			Thickness
-		);
-
-		LastBottomPoint = CurrentPoint;
-	}
-
-	// ========== 绘制顶面扇形 ==========
-	FVector LastTopPoint = TopStart;
-
-	// 绘制顶面弧线
-	for (int32 i = 1; i < NumSegments; ++i)
-	{
-		const float CurrentAngle = -HalfAngle + AngleStep * i;
-		const FQuat RotQuat = FQuat(FVector::UpVector, CurrentAngle);
-		FVector CurrentDir = RotQuat.RotateVector(Forward);
-		FVector CurrentPoint = TopCenter + CurrentDir * Radius;
-
-		DrawDebugLine(
-			World,
-			LastTopPoint,
-			CurrentPoint,
-			Color,
-			bPersistentLines,
-			LifeTime,
-			DepthPriority,
-			Thickness
-		);
-
-		LastTopPoint = CurrentPoint;
-	}
-
-	// ========== 连接三个关键位置 ==========
-
-	if (AngleDegrees != 360)
-	{
-		// 连接两个圆心（底面圆心 <-> 顶面圆心）
-		//DrawDebugLine(
-		//	World,
-		//	BottomCenter,
-		//	TopCenter,
-		//	Color,
-		//	bPersistentLines,
-		//	LifeTime,
-		//	DepthPriority,
-		//	Thickness
-		//);
-
-		// 绘制顶面两条半径线
-		DrawDebugLine(
-			World,
-			TopCenter,
-			TopStart,
-			Color,
-			bPersistentLines,
-			LifeTime,
-			DepthPriority,
-			Thickness
-		);
-
-		DrawDebugLine(
-			World,
-			TopCenter,
-			TopEnd,
-			Color,
-			bPersistentLines,
-			LifeTime,
-			DepthPriority,
-			Thickness
-		);
-
-		// 绘制底面两条半径线
-		DrawDebugLine(
-			World,
-			BottomCenter,
-			BottomStart,
-			Color,
-			bPersistentLines,
-			LifeTime,
-			DepthPriority,
-			Thickness
-		);
-
-		DrawDebugLine(
-			World,
-			BottomCenter,
-			BottomEnd,
-			Color,
-			bPersistentLines,
-			LifeTime,
-			DepthPriority,
-			Thickness
-		);
-
-		// 连接起点（底面起点 <-> 顶面起点）
-		DrawDebugLine(
-			World,
-			BottomStart,
-			TopStart,
-			Color,
-			bPersistentLines,
-			LifeTime,
-			DepthPriority,
-			Thickness
-		);
-
-		// 连接终点（底面终点 <-> 顶面终点）
-		DrawDebugLine(
-			World,
-			BottomEnd,
-			TopEnd,
-			Color,
-			bPersistentLines,
-			LifeTime,
-			DepthPriority,
-			Thickness
-		);
-	}
-}
-
-
 //-------------------------------RVO2D Copyright 2023, EastFoxStudio. All Rights Reserved-------------------------------
 
-void ABattleFrameBattleControl::ComputeAvoidingVelocity(FAvoidance& Avoidance, FAvoiding& Avoiding, const TArray<FGridData>& SubjectNeighbors, const TArray<FGridData>& ObstacleNeighbors, float TimeStep)
+void ABattleFrameBattleControl::ComputeAvoidingVelocity(FAvoidance& Avoidance, FAvoiding& Avoiding, TArrayView<const FGridData> SubjectNeighbors, TArrayView<const FObstacleSegment> ObstacleSegments, float TimeStep)
 {
-	FAvoiding SelfAvoiding = Avoiding;
-	FAvoidance SelfAvoidance = Avoidance;
+	const FAvoiding& SelfAvoiding = Avoiding;
 
-	int32 Reserve = FMath::Clamp(SubjectNeighbors.Num() + ObstacleNeighbors.Num(), 1, FLT_MAX);
-	SelfAvoidance.OrcaLines.reserve(Reserve);
+	// ORCA线写入栈上的定长缓冲，超出容量才回退到堆 | lines live in an inline stack buffer, heap only past its capacity
+	RVO::FOrcaLineBuffer OrcaLines;
 
 	/* Create obstacle ORCA lines. */
-	if (!ObstacleNeighbors.IsEmpty())
+	if (!ObstacleSegments.IsEmpty())
 	{
-		const float invTimeHorizonObst = 1.0f / SelfAvoidance.RVO_TimeHorizon_Obstacle;
+		const float invTimeHorizonObst = 1.0f / Avoidance.RVO_TimeHorizon_Obstacle;
 
-		for (const auto& Data : ObstacleNeighbors)
+		for (const FObstacleSegment& Segment : ObstacleSegments)
 		{
-			FBoxObstacle* obstacle1 = Data.SubjectHandle.GetTraitPtr<FBoxObstacle, EParadigm::Unsafe>();
-			FBoxObstacle* obstacle2 = obstacle1->nextObstacle_.GetTraitPtr<FBoxObstacle, EParadigm::Unsafe>();
-
-			const RVO::Vector2 relativePosition1 = obstacle1->point_ - SelfAvoiding.Position;
-			const RVO::Vector2 relativePosition2 = obstacle2->point_ - SelfAvoiding.Position;
+			// 两端顶点的数据已打包在线段中，斜视时以同一顶点替代另一端 | both vertices come packed, oblique views collapse one onto the other
+			RVO::Vector2 point1 = Segment.Point1;
+			RVO::Vector2 point2 = Segment.Point2;
+			RVO::Vector2 unitDir1 = Segment.UnitDir1;
+			RVO::Vector2 unitDir2 = Segment.UnitDir2;
+			bool isConvex1 = Segment.bConvex1;
+			bool isConvex2 = Segment.bConvex2;
+			bool isSameVertex = false;
+
+			const RVO::Vector2 relativePosition1 = point1 - SelfAvoiding.Position;
+			const RVO::Vector2 relativePosition2 = point2 - SelfAvoiding.Position;
 
 			/*
 			 * Check if velocity obstacle of obstacle is already taken care of by
@@ -5619,8 +5520,8 @@ void ABattleFrameBattleControl::ComputeAvoidingVelocity(FAvoidance& Avoidance, F
 			 */
 			bool alreadyCovered = false;
 
-			for (size_t j = 0; j < SelfAvoidance.OrcaLines.size(); ++j) {
-				if (RVO::det(invTimeHorizonObst * relativePosition1 - SelfAvoidance.OrcaLines[j].point, SelfAvoidance.OrcaLines[j].direction) - invTimeHorizonObst * SelfAvoiding.Radius >= -RVO_EPSILON && det(invTimeHorizonObst * relativePosition2 - SelfAvoidance.OrcaLines[j].point, SelfAvoidance.OrcaLines[j].direction) - invTimeHorizonObst * SelfAvoiding.Radius >= -RVO_EPSILON) {
+			for (int32 j = 0; j < OrcaLines.Num(); ++j) {
+				if (RVO::det(invTimeHorizonObst * relativePosition1 - OrcaLines[j].point, OrcaLines[j].direction) - invTimeHorizonObst * SelfAvoiding.Radius >= -RVO_EPSILON && det(invTimeHorizonObst * relativePosition2 - OrcaLines[j].point, OrcaLines[j].direction) - invTimeHorizonObst * SelfAvoiding.Radius >= -RVO_EPSILON) {
 					alreadyCovered = true;
 					break;
 				}
@@ -5637,7 +5538,7 @@ void ABattleFrameBattleControl::ComputeAvoidingVelocity(FAvoidance& Avoidance, F
 
 			const float radiusSq = RVO::sqr(SelfAvoiding.Radius);
 
-			const RVO::Vector2 obstacleVector = obstacle2->point_ - obstacle1->point_;
+			const RVO::Vector2 obstacleVector = point2 - point1;
 			const float s = (-relativePosition1 * obstacleVector) / absSq(obstacleVector);
 			const float distSqLine = absSq(-relativePosition1 - s * obstacleVector);
 
@@ -5645,28 +5546,28 @@ void ABattleFrameBattleControl::ComputeAvoidingVelocity(FAvoidance& Avoidance, F
 
 			if (s < 0.0f && distSq1 <= radiusSq) {
 				/* Collision with left vertex. Ignore if non-convex. */
-				if (obstacle1->isConvex_) {
+				if (isConvex1) {
 					line.point = RVO::Vector2(0.0f, 0.0f);
 					line.direction = normalize(RVO::Vector2(-relativePosition1.y(), relativePosition1.x()));
-					SelfAvoidance.OrcaLines.push_back(line);
+					OrcaLines.Add(line);
 				}
 				continue;
 			}
 			else if (s > 1.0f && distSq2 <= radiusSq) {
 				/* Collision with right vertex. Ignore if non-convex
 				 * or if it will be taken care of by neighoring obstace */
-				if (obstacle2->isConvex_ && det(relativePosition2, obstacle2->unitDir_) >= 0.0f) {
+				if (isConvex2 && det(relativePosition2, unitDir2) >= 0.0f) {
 					line.point = RVO::Vector2(0.0f, 0.0f);
 					line.direction = normalize(RVO::Vector2(-relativePosition2.y(), relativePosition2.x()));
-					SelfAvoidance.OrcaLines.push_back(line);
+					OrcaLines.Add(line);
 				}
 				continue;
 			}
 			else if (s >= 0.0f && s < 1.0f && distSqLine <= radiusSq) {
 				/* Collision with obstacle segment. */
 				line.point = RVO::Vector2(0.0f, 0.0f);
-				line.direction = -obstacle1->unitDir_;
-				SelfAvoidance.OrcaLines.push_back(line);
+				line.direction = -unitDir1;
+				OrcaLines.Add(line);
 				continue;
 			}
 
@@ -5683,12 +5584,15 @@ void ABattleFrameBattleControl::ComputeAvoidingVelocity(FAvoidance& Avoidance, F
 				 * Obstacle viewed obliquely so that left vertex
 				 * defines velocity obstacle.
 				 */
-				if (!obstacle1->isConvex_) {
+				if (!isConvex1) {
 					/* Ignore obstacle. */
 					continue;
 				}
 
-				obstacle2 = obstacle1;
+				point2 = point1;
+				unitDir2 = unitDir1;
+				isConvex2 = isConvex1;
+				isSameVertex = true;
 
 				const float leg1 = std::sqrt(distSq1 - radiusSq);
 				leftLegDirection = RVO::Vector2(relativePosition1.x() * leg1 - relativePosition1.y() * SelfAvoiding.Radius, relativePosition1.x() * SelfAvoiding.Radius + relativePosition1.y() * leg1) / distSq1;
@@ -5699,12 +5603,15 @@ void ABattleFrameBattleControl::ComputeAvoidingVelocity(FAvoidance& Avoidance, F
 				 * Obstacle viewed obliquely so that
 				 * right vertex defines velocity obstacle.
 				 */
-				if (!obstacle2->isConvex_) {
+				if (!isConvex2) {
 					/* Ignore obstacle. */
 					continue;
 				}
 
-				obstacle1 = obstacle2;
+				point1 = point2;
+				unitDir1 = unitDir2;
+				isConvex1 = isConvex2;
+				isSameVertex = true;
 
 				const float leg2 = std::sqrt(distSq2 - radiusSq);
 				leftLegDirection = RVO::Vector2(relativePosition2.x() * leg2 - relativePosition2.y() * SelfAvoiding.Radius, relativePosition2.x() * SelfAvoiding.Radius + relativePosition2.y() * leg2) / distSq2;
@@ -5712,22 +5619,22 @@ void ABattleFrameBattleControl::ComputeAvoidingVelocity(FAvoidance& Avoidance, F
 			}
 			else {
 				/* Usual situation. */
-				if (obstacle1->isConvex_) {
+				if (isConvex1) {
 					const float leg1 = std::sqrt(distSq1 - radiusSq);
 					leftLegDirection = RVO::Vector2(relativePosition1.x() * leg1 - relativePosition1.y() * SelfAvoiding.Radius, relativePosition1.x() * SelfAvoiding.Radius + relativePosition1.y() * leg1) / distSq1;
 				}
 				else {
 					/* Left vertex non-convex; left leg extends cut-off line. */
-					leftLegDirection = -obstacle1->unitDir_;
+					leftLegDirection = -unitDir1;
 				}
 
-				if (obstacle2->isConvex_) {
+				if (isConvex2) {
 					const float leg2 = std::sqrt(distSq2 - radiusSq);
 					rightLegDirection = RVO::Vector2(relativePosition2.x() * leg2 + relativePosition2.y() * SelfAvoiding.Radius, -relativePosition2.x() * SelfAvoiding.Radius + relativePosition2.y() * leg2) / distSq2;
 				}
 				else {
 					/* Right vertex non-convex; right leg extends cut-off line. */
-					rightLegDirection = obstacle1->unitDir_;
+					rightLegDirection = unitDir1;
 				}
 			}
 
@@ -5737,42 +5644,40 @@ void ABattleFrameBattleControl::ComputeAvoidingVelocity(FAvoidance& Avoidance, F
 			 * "foreign" leg, no constraint is added.
 			 */
 
-			const FSubjectHandle leftNeighbor = obstacle1->prevObstacle_;
-
 			bool isLeftLegForeign = false;
 			bool isRightLegForeign = false;
 
-			if (obstacle1->isConvex_ && det(leftLegDirection, -obstacle1->unitDir_) >= 0.0f) {
+			if (isConvex1 && det(leftLegDirection, -unitDir1) >= 0.0f) {
 				/* Left leg points into obstacle. */
-				leftLegDirection = -obstacle1->unitDir_;
+				leftLegDirection = -unitDir1;
 				isLeftLegForeign = true;
 			}
 
-			if (obstacle2->isConvex_ && det(rightLegDirection, obstacle2->unitDir_) <= 0.0f) {
+			if (isConvex2 && det(rightLegDirection, unitDir2) <= 0.0f) {
 				/* Right leg points into obstacle. */
-				rightLegDirection = obstacle2->unitDir_;
+				rightLegDirection = unitDir2;
 				isRightLegForeign = true;
 			}
 
 			/* Compute cut-off centers. */
-			const RVO::Vector2 leftCutoff = invTimeHorizonObst * (obstacle1->point_ - SelfAvoiding.Position);
-			const RVO::Vector2 rightCutoff = invTimeHorizonObst * (obstacle2->point_ - SelfAvoiding.Position);
+			const RVO::Vector2 leftCutoff = invTimeHorizonObst * (point1 - SelfAvoiding.Position);
+			const RVO::Vector2 rightCutoff = invTimeHorizonObst * (point2 - SelfAvoiding.Position);
 			const RVO::Vector2 cutoffVec = rightCutoff - leftCutoff;
 
 			/* Project current velocity on velocity obstacle. */
 
 			/* Check if current velocity is projected on cutoff circles. */
-			const float t = (obstacle1 == obstacle2 ? 0.5f : ((SelfAvoiding.CurrentVelocity - leftCutoff) * cutoffVec) / absSq(cutoffVec));
+			const float t = (isSameVertex ? 0.5f : ((SelfAvoiding.CurrentVelocity - leftCutoff) * cutoffVec) / absSq(cutoffVec));
 			const float tLeft = ((SelfAvoiding.CurrentVelocity - leftCutoff) * leftLegDirection);
 			const float tRight = ((SelfAvoiding.CurrentVelocity - rightCutoff) * rightLegDirection);
 
-			if ((t < 0.0f && tLeft < 0.0f) || (obstacle1 == obstacle2 && tLeft < 0.0f && tRight < 0.0f)) {
+			if ((t < 0.0f && tLeft < 0.0f) || (isSameVertex && tLeft < 0.0f && tRight < 0.0f)) {
 				/* Project on left cut-off circle. */
 				const RVO::Vector2 unitW = normalize(SelfAvoiding.CurrentVelocity - leftCutoff);
 
 				line.direction = RVO::Vector2(unitW.y(), -unitW.x());
 				line.point = leftCutoff + SelfAvoiding.Radius * invTimeHorizonObst * unitW;
-				SelfAvoidance.OrcaLines.push_back(line);
+				OrcaLines.Add(line);
 				continue;
 			}
 			else if (t > 1.0f && tRight < 0.0f) {
@@ -5781,7 +5686,7 @@ void ABattleFrameBattleControl::ComputeAvoidingVelocity(FAvoidance& Avoidance, F
 
 				line.direction = RVO::Vector2(unitW.y(), -unitW.x());
 				line.point = rightCutoff + SelfAvoiding.Radius * invTimeHorizonObst * unitW;
-				SelfAvoidance.OrcaLines.push_back(line);
+				OrcaLines.Add(line);
 				continue;
 			}
 
@@ -5789,15 +5694,15 @@ void ABattleFrameBattleControl::ComputeAvoidingVelocity(FAvoidance& Avoidance, F
 			 * Project on left leg, right leg, or cut-off line, whichever is closest
 			 * to velocity.
 			 */
-			const float distSqCutoff = ((t < 0.0f || t > 1.0f || obstacle1 == obstacle2) ? std::numeric_limits<float>::infinity() : absSq(SelfAvoiding.CurrentVelocity - (leftCutoff + t * cutoffVec)));
+			const float distSqCutoff = ((t < 0.0f || t > 1.0f || isSameVertex) ? std::numeric_limits<float>::infinity() : absSq(SelfAvoiding.CurrentVelocity - (leftCutoff + t * cutoffVec)));
 			const float distSqLeft = ((tLeft < 0.0f) ? std::numeric_limits<float>::infinity() : absSq(SelfAvoiding.CurrentVelocity - (leftCutoff + tLeft * leftLegDirection)));
 			const float distSqRight = ((tRight < 0.0f) ? std::numeric_limits<float>::infinity() : absSq(SelfAvoiding.CurrentVelocity - (rightCutoff + tRight * rightLegDirection)));
 
 			if (distSqCutoff <= distSqLeft && distSqCutoff <= distSqRight) {
 				/* Project on cut-off line. */
-				line.direction = -obstacle1->unitDir_;
+				line.direction = -unitDir1;
 				line.point = leftCutoff + SelfAvoiding.Radius * invTimeHorizonObst * RVO::Vector2(-line.direction.y(), line.direction.x());
-				SelfAvoidance.OrcaLines.push_back(line);
+				OrcaLines.Add(line);
 				continue;
 			}
 			else if (distSqLeft <= distSqRight) {
@@ -5808,7 +5713,7 @@ void ABattleFrameBattleControl::ComputeAvoidingVelocity(FAvoidance& Avoidance, F
 
 				line.direction = leftLegDirection;
 				line.point = leftCutoff + SelfAvoiding.Radius * invTimeHorizonObst * RVO::Vector2(-line.direction.y(), line.direction.x());
-				SelfAvoidance.OrcaLines.push_back(line);
+				OrcaLines.Add(line);
 				continue;
 			}
 			else {
@@ -5819,97 +5724,133 @@ void ABattleFrameBattleControl::ComputeAvoidingVelocity(FAvoidance& Avoidance, F
 
 				line.direction = -rightLegDirection;
 				line.point = rightCutoff + SelfAvoiding.Radius * invTimeHorizonObst * RVO::Vector2(-line.direction.y(), line.direction.x());
-				SelfAvoidance.OrcaLines.push_back(line);
+				OrcaLines.Add(line);
 				continue;
 			}
 		}
 	}
 
-	const size_t numObstLines = SelfAvoidance.OrcaLines.size();
+	const int32 numObstLines = OrcaLines.Num();
 
 	/* Create agent ORCA lines. */
 	if (LIKELY(!SubjectNeighbors.IsEmpty()))
 	{
-		const float invTimeHorizon = 1.0f / SelfAvoidance.RVO_TimeHorizon_Agent;
+		const float invTimeHorizon = 1.0f / Avoidance.RVO_TimeHorizon_Agent;
+
+		// 先按批收集邻居数据，再用SIMD批量构建 | gather neighbors into packed lanes, then build the whole batch at once
+		RVO::FAgentLineBatch Batch;
+
+		auto FlushBatch = [&]()
+		{
+			const int32 FirstLine = OrcaLines.AddUninitialized(Batch.Num);
+			RVO::BuildAgentLines(Batch, SelfAvoiding.CurrentVelocity, invTimeHorizon, TimeStep, OrcaLines.GetData() + FirstLine);
+			Batch.Num = 0;
+		};
 
 		for (const auto& Data : SubjectNeighbors)
 		{
 			const auto& OtherAvoiding = Data.SubjectHandle.GetTraitRef<FAvoiding,EParadigm::Unsafe>();
-			const RVO::Vector2 relativePosition = OtherAvoiding.Position - SelfAvoiding.Position;
-			const RVO::Vector2 relativeVelocity = SelfAvoiding.CurrentVelocity - OtherAvoiding.CurrentVelocity;
-			const float distSq = absSq(relativePosition);
-			const float combinedRadius = SelfAvoiding.Radius + OtherAvoiding.Radius;
-			const float combinedRadiusSq = RVO::sqr(combinedRadius);
+			Batch.Add(SelfAvoiding.Position, SelfAvoiding.CurrentVelocity, SelfAvoiding.Radius, OtherAvoiding.Position, OtherAvoiding.CurrentVelocity, OtherAvoiding.Radius, OtherAvoiding.bCanAvoid);
 
-			RVO::Line line;
-			RVO::Vector2 u;
+			if (UNLIKELY(Batch.IsFull()))
+			{
+				FlushBatch();
+			}
+		}
 
-			if (distSq > combinedRadiusSq) {
-				/* No collision. */
-				const RVO::Vector2 w = relativeVelocity - invTimeHorizon * relativePosition;
-				/* Vector from cutoff center to relative velocity. */
-				const float wLengthSq = RVO::absSq(w);
+		if (Batch.Num > 0)
+		{
+			FlushBatch();
+		}
+	}
 
-				const float dotProduct1 = w * relativePosition;
+	RVO::Vector2 AvoidingVelocity;
+	const int32 lineFail = LinearProgram2(OrcaLines, Avoidance.MaxSpeed, Avoidance.DesiredVelocity, false, AvoidingVelocity);
 
-				if (dotProduct1 < 0.0f && RVO::sqr(dotProduct1) > combinedRadiusSq * wLengthSq) {
-					/* Project on cut-off circle. */
-					const float wLength = std::sqrt(wLengthSq);
-					const RVO::Vector2 unitW = w / wLength;
+	if (lineFail < OrcaLines.Num()) 
+	{
+		LinearProgram3(OrcaLines, numObstLines, lineFail, Avoidance.MaxSpeed, AvoidingVelocity);
+	}
 
-					line.direction = RVO::Vector2(unitW.y(), -unitW.x());
-					u = (combinedRadius * invTimeHorizon - wLength) * unitW;
-				}
-				else {
-					/* Project on legs. */
-					const float leg = std::sqrt(distSq - combinedRadiusSq);
+	if (UNLIKELY(OrcaLines.Num() > RVO::ORCA_INLINE_LINES))
+	{
+		GAvoidHeapAllocations.fetch_add(1, std::memory_order_relaxed);
+	}
 
-					if (det(relativePosition, w) > 0.0f) {
-						/* Project on left leg. */
-						line.direction = RVO::Vector2(relativePosition.x() * leg - relativePosition.y() * combinedRadius, relativePosition.x() * combinedRadius + relativePosition.y() * leg) / distSq;
-					}
-					else {
-						/* Project on right leg. */
-						line.direction = -RVO::Vector2(relativePosition.x() * leg + relativePosition.y() * combinedRadius, -relativePosition.x() * combinedRadius + relativePosition.y() * leg) / distSq;
-					}
+	FBattleFrameCounters::Add(EBattleFrameCounter::OrcaLinesBuilt, OrcaLines.Num());
 
-					const float dotProduct2 = relativeVelocity * line.direction;
+	Avoidance.AvoidingVelocity = AvoidingVelocity;
+}
 
-					u = dotProduct2 * line.direction - relativeVelocity;
-				}
-			}
-			else {
-				/* Collision. Project on cut-off circle of time timeStep. */
-				const float invTimeStep = 1.0f / TimeStep;
+void ABattleFrameBattleControl::SortAgentsSpatially()
+{
+	TRACE_CPUPROFILER_EVENT_SCOPE_STR("SortAgentsSpatially");
 
-				/* Vector from cutoff center to relative velocity. */
-				const RVO::Vector2 w = relativeVelocity - invTimeStep * relativePosition;
+	FramesSinceSpatialSort = 0;
+	bSpatialOrderDirty = false;
+	SpatialOrderVersion = AgentActivationVersion.load(std::memory_order_relaxed);
 
-				const float wLength = abs(w);
-				const RVO::Vector2 unitW = w / wLength;
+	auto Chain = Mechanism->EnchainSolid(AgentMoveFilter);
+	const int32 Num = Chain->IterableNum();
 
-				line.direction = RVO::Vector2(unitW.y(), -unitW.x());
-				u = (combinedRadius * invTimeStep - wLength) * unitW;
-			}
+	struct FSpatialEntry
+	{
+		uint32 Key;
+		FVector2f Location;
+		FSubjectHandle Agent;
+	};
+
+	TArray<FSpatialEntry> Entries;
+	Entries.SetNumUninitialized(Num);
+	std::atomic<int32> Cursor{ 0 };
+
+	UBattleFrameFunctionLibraryRT::CalculateThreadsCountAndBatchSize(Num, MaxThreadsAllowed, MinBatchSizeAllowed, ThreadsCount, BatchSize);
+
+	Chain->OperateConcurrently([&](FSolidSubjectHandle Subject, FLocated& Located)
+	{
+		const int32 Slot = Cursor.fetch_add(1, std::memory_order_relaxed);
 
-			float Ratio = OtherAvoiding.bCanAvoid ? 0.5f : 1.f;
-			line.point = SelfAvoiding.CurrentVelocity + Ratio * u;
-			SelfAvoidance.OrcaLines.push_back(line);
+		if (LIKELY(Slot < Num))
+		{
+			Entries[Slot] = { 0, FVector2f(Located.Location.X, Located.Location.Y), FSubjectHandle(Subject) };
 		}
+	}, ThreadsCount, BatchSize);
+
+	Entries.SetNum(FMath::Min(Cursor.load(), Num));
+
+	if (Entries.IsEmpty())
+	{
+		SpatialOrder.Reset();
+		return;
+	}
+
+	// 以全体单位的包围盒量化到16位 | quantize to 16 bits over the bounding box of all agents
+	FBox2f Bounds(ForceInit);
+
+	for (const FSpatialEntry& Entry : Entries)
+	{
+		Bounds += Entry.Location;
 	}
 
-	size_t lineFail = LinearProgram2(SelfAvoidance.OrcaLines, SelfAvoidance.MaxSpeed, SelfAvoidance.DesiredVelocity, false, SelfAvoidance.AvoidingVelocity);
+	const FVector2f Scale = FVector2f(65535.f) / FVector2f::Max(Bounds.GetSize(), FVector2f(1.f));
 
-	if (lineFail < SelfAvoidance.OrcaLines.size()) 
+	for (FSpatialEntry& Entry : Entries)
 	{
-		LinearProgram3(SelfAvoidance.OrcaLines, numObstLines, lineFail, SelfAvoidance.MaxSpeed, SelfAvoidance.AvoidingVelocity);
+		const FVector2f Quantized = (Entry.Location - Bounds.Min) * Scale;
+		Entry.Key = UBattleFrameFunctionLibraryRT::MortonCode2D(static_cast<uint32>(Quantized.X), static_cast<uint32>(Quantized.Y));
 	}
 
-	//SelfAvoidance.OrcaLines.clear();
-	Avoidance.AvoidingVelocity = SelfAvoidance.AvoidingVelocity;
+	Algo::SortBy(Entries, &FSpatialEntry::Key);
+
+	SpatialOrder.SetNum(Entries.Num());
+
+	for (int32 i = 0; i < Entries.Num(); ++i)
+	{
+		SpatialOrder[i] = Entries[i].Agent;
+	}
 }
 
-bool ABattleFrameBattleControl::LinearProgram1(const std::vector<RVO::Line>& lines, size_t lineNo, float radius, const RVO::Vector2& optVelocity, bool directionOpt, RVO::Vector2& result)
+bool ABattleFrameBattleControl::LinearProgram1(TArrayView<const RVO::Line> lines, int32 lineNo, float radius, const RVO::Vector2& optVelocity, bool directionOpt, RVO::Vector2& result)
 {
 	//TRACE_CPUPROFILER_EVENT_SCOPE_STR("linearProgram1");
 	const float dotProduct = lines[lineNo].point * lines[lineNo].direction;
@@ -5924,7 +5865,7 @@ bool ABattleFrameBattleControl::LinearProgram1(const std::vector<RVO::Line>& lin
 	float tLeft = -dotProduct - sqrtDiscriminant;
 	float tRight = -dotProduct + sqrtDiscriminant;
 
-	for (size_t i = 0; i < lineNo; ++i) {
+	for (int32 i = 0; i < lineNo; ++i) {
 		const float denominator = det(lines[lineNo].direction, lines[i].direction);
 		const float numerator = det(lines[i].direction, lines[lineNo].point - lines[i].point);
 
@@ -5983,7 +5924,7 @@ bool ABattleFrameBattleControl::LinearProgram1(const std::vector<RVO::Line>& lin
 	return true;
 }
 
-size_t ABattleFrameBattleControl::LinearProgram2(const std::vector<RVO::Line>& lines, float radius, const RVO::Vector2& optVelocity, bool directionOpt, RVO::Vector2& result)
+int32 ABattleFrameBattleControl::LinearProgram2(TArrayView<const RVO::Line> lines, float radius, const RVO::Vector2& optVelocity, bool directionOpt, RVO::Vector2& result)
 {
 	//TRACE_CPUPROFILER_EVENT_SCOPE_STR("linearProgram2");
 	if (directionOpt) {
@@ -6002,7 +5943,7 @@ size_t ABattleFrameBattleControl::LinearProgram2(const std::vector<RVO::Line>& l
 		result = optVelocity;
 	}
 
-	for (size_t i = 0; i < lines.size(); ++i) {
+	for (int32 i = 0; i < lines.Num(); ++i) {
 		if (det(lines[i].direction, lines[i].point - result) > 0.0f) {
 			/* Result does not satisfy constraint i. Compute new optimal result. */
 			const RVO::Vector2 tempResult = result;
@@ -6014,20 +5955,20 @@ size_t ABattleFrameBattleControl::LinearProgram2(const std::vector<RVO::Line>& l
 		}
 	}
 
-	return lines.size();
+	return lines.Num();
 }
 
-void ABattleFrameBattleControl::LinearProgram3(const std::vector<RVO::Line>& lines, size_t numObstLines, size_t beginLine, float radius, RVO::Vector2& result)
+void ABattleFrameBattleControl::LinearProgram3(TArrayView<const RVO::Line> lines, int32 numObstLines, int32 beginLine, float radius, RVO::Vector2& result)
 {
 	//TRACE_CPUPROFILER_EVENT_SCOPE_STR("linearProgram3");
 	float distance = 0.0f;
 
-	for (size_t i = beginLine; i < lines.size(); ++i) {
+	for (int32 i = beginLine; i < lines.Num(); ++i) {
 		if (det(lines[i].direction, lines[i].point - result) > distance) {
 			/* Result does not satisfy constraint of line i. */
-			std::vector<RVO::Line> projLines(lines.begin(), lines.begin() + static_cast<ptrdiff_t>(numObstLines));
+			RVO::FOrcaLineBuffer projLines(lines.GetData(), numObstLines);
 
-			for (size_t j = numObstLines; j < i; ++j) {
+			for (int32 j = numObstLines; j < i; ++j) {
 				RVO::Line line;
 
 				float determinant = det(lines[i].direction, lines[j].direction);
@@ -6048,12 +5989,17 @@ void ABattleFrameBattleControl::LinearProgram3(const std::vector<RVO::Line>& lin
 				}
 
 				line.direction = normalize(lines[j].direction - lines[i].direction);
-				projLines.push_back(line);
+				projLines.Add(line);
+			}
+
+			if (UNLIKELY(projLines.Num() > RVO::ORCA_INLINE_LINES))
+			{
+				GAvoidHeapAllocations.fetch_add(1, std::memory_order_relaxed);
 			}
 
 			const RVO::Vector2 tempResult = result;
 
-			if (LinearProgram2(projLines, radius, RVO::Vector2(-lines[i].direction.y(), lines[i].direction.x()), true, result) < projLines.size()) {
+			if (LinearProgram2(projLines, radius, RVO::Vector2(-lines[i].direction.y(), lines[i].direction.x()), true, result) < projLines.Num()) {
 				/* This should in principle not happen.  The result is by definition
 				 * already in the feasible region of this linear program. If it fails,
 				 * it is due to small floating point error, and the current result is
@@ -0,0 +1,817 @@
+/*
+* BattleFrame
+* Created: 2025
+* Author: Leroy Works, All Rights Reserved.
+*/
+
+// 开发期性能基准，控制台命令触发，不进入发行版 | Development micro-benchmarks, triggered from the console, stripped from shipping builds
+
+#include "CoreMinimal.h"
+#include "HAL/IConsoleManager.h"
+#include "Math/RandomStream.h"
+#include "NeighborGridComponent.h"
+#include "BattleFrameFunctionLibraryRT.h"
+#include "BattleFrameStageGraph.h"
+#include "BattleFrameBattleControl.h"
+#include "RVOAgentLines.h"
+#include "Traits/StatusEffects.h"
+#include "Traits/Activated.h"
+#include "Traits/Animation.h"
+#include "Traits/AppearAnim.h"
+#include "Traits/AppearDissolve.h"
+#include "Traits/DeathAnim.h"
+#include "Traits/DeathDissolve.h"
+#include "Traits/HealthBar.h"
+#include "Traits/HitGlow.h"
+#include "Traits/Jiggle.h"
+#include "Traits/Scaled.h"
+#include "Traits/Health.h"
+#include "Traits/Slower.h"
+#include "Traits/Slowing.h"
+#include "Traits/TemporalDamager.h"
+#include "Traits/TemporalDamaging.h"
+
+#if !UE_BUILD_SHIPPING
+
+namespace BattleFrameBenchmarks
+{
+	// 用随机分布的假单位填充一个CSR网格 | Fill a transient grid with uniformly scattered fake agents through the CountingSort path
+	static UNeighborGridComponent* MakeSyntheticGrid(const int32 AgentCount, const FIntVector& GridSize, const FVector& CellSize, const int32 Seed, const ENeighborGridStorage Storage = ENeighborGridStorage::Dense)
+	{
+		UNeighborGridComponent* Grid = NewObject<UNeighborGridComponent>(GetTransientPackage());
+		Grid->GridSize = GridSize;
+		Grid->CellSize = CellSize;
+		Grid->Storage = Storage;
+		Grid->DoInitializeCells();
+		Grid->GetBounds();
+		Grid->ReserveSparseCells(AgentCount, true);
+
+		FRandomStream Random(Seed);
+
+		Grid->EntryData.SetNum(AgentCount);
+		Grid->EntryCellIndices.SetNum(AgentCount);
+
+		for (int32 i = 0; i < AgentCount; ++i)
+		{
+			const FVector Location = Random.RandPointInBox(Grid->Bounds);
+			const int32 CellIndex = Grid->FindOrAddCellIndex(Grid->LocationToCoord(Location));
+
+			FGridData& Data = Grid->EntryData[i];
+			Data.SubjectHash = static_cast<uint32>(i + 1);
+			Data.Location = FVector3f(Location);
+			Data.Radius = Random.FRandRange(30.f, 60.f);
+
+			Grid->EntryCellIndices[i] = CellIndex;
+			Grid->CellCounts[CellIndex]++;
+		}
+
+		Grid->ActiveBuildMode = EGridBuildMode::CountingSort;
+		Grid->BuildSortedSubjects(AgentCount);
+
+		return Grid;
+	}
+
+	static void NeighborScan(const TArray<FString>& Args)
+	{
+		const int32 Iterations = Args.Num() > 0 ? FMath::Max(1, FCString::Atoi(*Args[0])) : 5;
+		const FIntVector GridSize(200, 200, 1);
+		const FVector CellSize(300.f, 300.f, 300.f);
+		const float Range = 150.f + 50.f;// TraceDist + avoidance radius, as in AgentAvoid
+
+		for (const int32 AgentCount : { 10000, 30000, 60000 })
+		{
+			UNeighborGridComponent* Grid = MakeSyntheticGrid(AgentCount, GridSize, CellSize, 1337);
+			const FVector3f RangeVec(Range);
+
+			int64 AoSAccepted = 0;
+			int64 SoAAccepted = 0;
+			int64 Candidates = 0;
+			double AoSSeconds = 0.0;
+			double SoASeconds = 0.0;
+
+			for (int32 Iteration = 0; Iteration < Iterations; ++Iteration)
+			{
+				// AoS：逐个FGridData读取位置 | AoS scan drags every full entry through the cache
+				double Start = FPlatformTime::Seconds();
+
+				for (const FGridData& Self : Grid->EntryData)
+				{
+					const FIntVector Min = Grid->LocationToCoord(FVector(Self.Location - RangeVec));
+					const FIntVector Max = Grid->LocationToCoord(FVector(Self.Location + RangeVec));
+
+					for (int32 y = Min.Y; y <= Max.Y; ++y)
+					{
+						for (int32 x = Min.X; x <= Max.X; ++x)
+						{
+							const FIntVector Coord(x, y, 0);
+							if (!Grid->IsInside(Coord)) continue;
+
+							for (const FGridData& Data : Grid->GetSubjectsAt(Coord))
+							{
+								++Candidates;
+
+								if (Data.SubjectHash == Self.SubjectHash) continue;
+								if (FVector3f::DistSquared(Self.Location, Data.Location) > Range * Range) continue;
+
+								++AoSAccepted;
+							}
+						}
+					}
+				}
+
+				AoSSeconds += FPlatformTime::Seconds() - Start;
+
+				// SoA：SIMD距离测试，只在通过时读取FGridData | SoA scan only reads the entry once a lane passes
+				Start = FPlatformTime::Seconds();
+
+				for (const FGridData& Self : Grid->EntryData)
+				{
+					const FIntVector Min = Grid->LocationToCoord(FVector(Self.Location - RangeVec));
+					const FIntVector Max = Grid->LocationToCoord(FVector(Self.Location + RangeVec));
+
+					for (int32 y = Min.Y; y <= Max.Y; ++y)
+					{
+						for (int32 x = Min.X; x <= Max.X; ++x)
+						{
+							const FIntVector Coord(x, y, 0);
+							if (!Grid->IsInside(Coord)) continue;
+
+							Grid->ForEachSubjectInRange<false>(Coord, Self.Location, Range, Self.SubjectHash, [&](const FGridData& Data, float DistSqr)
+							{
+								++SoAAccepted;
+							});
+						}
+					}
+				}
+
+				SoASeconds += FPlatformTime::Seconds() - Start;
+			}
+
+			const double CandidatesPerIteration = static_cast<double>(Candidates) / Iterations;
+
+			UE_LOG(LogTemp, Log, TEXT("NeighborScan Agents=%d Candidates/iter=%.0f AoS=%.3fms (%.1f M/s) SoA=%.3fms (%.1f M/s) Speedup=%.2fx Accepted(AoS/SoA)=%lld/%lld"),
+				AgentCount,
+				CandidatesPerIteration,
+				AoSSeconds * 1000.0 / Iterations,
+				CandidatesPerIteration / FMath::Max(AoSSeconds / Iterations, 1e-9) * 1e-6,
+				SoASeconds * 1000.0 / Iterations,
+				CandidatesPerIteration / FMath::Max(SoASeconds / Iterations, 1e-9) * 1e-6,
+				AoSSeconds / FMath::Max(SoASeconds, 1e-9),
+				AoSAccepted,
+				SoAAccepted);
+
+			Grid->MarkAsGarbage();
+		}
+	}
+
+	// 同样数量的单位放在20倍面积的地图上，对比稠密与稀疏存储 | Same agent count on a map of 20x the area, dense storage against the sparse hash
+	static void SparseGrid(const TArray<FString>& Args)
+	{
+		const int32 Iterations = Args.Num() > 0 ? FMath::Max(1, FCString::Atoi(*Args[0])) : 5;
+		const int32 AgentCount = 30000;
+		const FVector CellSize(300.f, 300.f, 300.f);
+		const float Range = 150.f + 50.f;// TraceDist + avoidance radius, as in AgentAvoid
+		const int32 BaseSide = 200;
+		const int32 LargeSide = FMath::RoundToInt(BaseSide * FMath::Sqrt(20.f));
+
+		struct FCase
+		{
+			const TCHAR* Name;
+			int32 Side;
+			ENeighborGridStorage Storage;
+		};
+
+		const FCase Cases[] =
+		{
+			{ TEXT("Dense 1x"), BaseSide, ENeighborGridStorage::Dense },
+			{ TEXT("Dense 20x"), LargeSide, ENeighborGridStorage::Dense },
+			{ TEXT("Sparse 20x"), LargeSide, ENeighborGridStorage::SparseHash }
+		};
+
+		for (const FCase& Case : Cases)
+		{
+			double Start = FPlatformTime::Seconds();
+			UNeighborGridComponent* Grid = MakeSyntheticGrid(AgentCount, FIntVector(Case.Side, Case.Side, 1), CellSize, 1337, Case.Storage);
+			const double BuildSeconds = FPlatformTime::Seconds() - Start;
+
+			const int32 NumCells = Case.Storage == ENeighborGridStorage::SparseHash ? Grid->SparseCells.GetNumCells() : Case.Side * Case.Side;
+
+			int64 Accepted = 0;
+			Start = FPlatformTime::Seconds();
+
+			for (int32 Iteration = 0; Iteration < Iterations; ++Iteration)
+			{
+				for (const FGridData& Self : Grid->EntryData)
+				{
+					Grid->ForEachCellInBox(FVector(Self.Location), FVector(Range), [&](int32 CellIndex, const FIntVector& Coord)
+					{
+						Grid->ForEachSubjectInRange<false>(CellIndex, Self.Location, Range, Self.SubjectHash, [&](const FGridData& Data, float DistSqr)
+						{
+							++Accepted;
+						});
+					});
+				}
+			}
+
+			const double QuerySeconds = FPlatformTime::Seconds() - Start;
+
+			UE_LOG(LogTemp, Log, TEXT("SparseGrid %s Agents=%d Grid=%dx%d Cells=%d Memory=%.2fMB Init+Build=%.3fms Query=%.3fms Accepted/iter=%lld"),
+				Case.Name,
+				AgentCount,
+				Case.Side,
+				Case.Side,
+				NumCells,
+				Grid->GetCellMemorySize() / (1024.0 * 1024.0),
+				BuildSeconds * 1000.0,
+				QuerySeconds * 1000.0 / Iterations,
+				Accepted / Iterations);
+
+			Grid->MarkAsGarbage();
+		}
+	}
+
+	/*
+	 * 30k个单位按生成顺序(空间随机)存放，对比按存储顺序与按Z序遍历的邻居查询 | 30k agents stored in spawn order, which is random in space.
+	 * Chunk order reads agent state sequentially but scatters grid reads, Z-order does the opposite, as the avoidance pass would.
+	 * Wall time stands in for cache misses, use a hardware profiler for the raw counts.
+	 */
+	static void SpatialOrder(const TArray<FString>& Args)
+	{
+		const int32 Iterations = Args.Num() > 0 ? FMath::Max(1, FCString::Atoi(*Args[0])) : 5;
+		const int32 AgentCount = 30000;
+		const float Range = 150.f + 50.f;// TraceDist + avoidance radius, as in AgentAvoid
+
+		UNeighborGridComponent* Grid = MakeSyntheticGrid(AgentCount, FIntVector(200, 200, 1), FVector(300.f, 300.f, 300.f), 1337);
+
+		// 模拟特征数据：每个单位一块与邻居结果无关的状态 | stand-in for the per agent traits the pass reads and writes
+		struct FAgentState
+		{
+			FGridData Data;
+			FVector3f Velocity = FVector3f::ZeroVector;
+			float Padding[16] = {};
+		};
+
+		TArray<FAgentState> States;
+		States.SetNum(AgentCount);
+
+		for (int32 i = 0; i < AgentCount; ++i)
+		{
+			States[i].Data = Grid->EntryData[i];
+		}
+
+		const FVector2f Min(Grid->Bounds.Min.X, Grid->Bounds.Min.Y);
+		const FVector2f Scale = FVector2f(65535.f) / FVector2f(Grid->Bounds.GetSize().X, Grid->Bounds.GetSize().Y);
+
+		TArray<TPair<uint32, int32>> Keys;
+		Keys.SetNum(AgentCount);
+
+		for (int32 i = 0; i < AgentCount; ++i)
+		{
+			const FVector2f Quantized = (FVector2f(States[i].Data.Location.X, States[i].Data.Location.Y) - Min) * Scale;
+			Keys[i] = { UBattleFrameFunctionLibraryRT::MortonCode2D(static_cast<uint32>(Quantized.X), static_cast<uint32>(Quantized.Y)), i };
+		}
+
+		Algo::SortBy(Keys, &TPair<uint32, int32>::Key);
+
+		auto RunPass = [&](auto&& GetAgentIndex, int64& OutAccepted)
+		{
+			const double Start = FPlatformTime::Seconds();
+
+			for (int32 Iteration = 0; Iteration < Iterations; ++Iteration)
+			{
+				for (int32 i = 0; i < AgentCount; ++i)
+				{
+					FAgentState& State = States[GetAgentIndex(i)];
+					FVector3f Sum = FVector3f::ZeroVector;
+
+					Grid->ForEachCellInBox(FVector(State.Data.Location), FVector(Range), [&](int32 CellIndex, const FIntVector& Coord)
+					{
+						Grid->ForEachSubjectInRange<false>(CellIndex, State.Data.Location, Range, State.Data.SubjectHash, [&](const FGridData& Data, float DistSqr)
+						{
+							Sum += Data.Location - State.Data.Location;
+							++OutAccepted;
+						});
+					});
+
+					State.Velocity = Sum;
+				}
+			}
+
+			return (FPlatformTime::Seconds() - Start) * 1000.0 / Iterations;
+		};
+
+		int64 ChunkAccepted = 0;
+		int64 SortedAccepted = 0;
+
+		const double ChunkMs = RunPass([](int32 i) { return i; }, ChunkAccepted);
+		const double SortedMs = RunPass([&](int32 i) { return Keys[i].Value; }, SortedAccepted);
+
+		UE_LOG(LogTemp, Log, TEXT("SpatialOrder Agents=%d ChunkOrder=%.3fms ZOrder=%.3fms Speedup=%.2fx Accepted(Chunk/ZOrder)=%lld/%lld"),
+			AgentCount,
+			ChunkMs,
+			SortedMs,
+			ChunkMs / FMath::Max(SortedMs, 1e-6),
+			ChunkAccepted / Iterations,
+			SortedAccepted / Iterations);
+
+		Grid->MarkAsGarbage();
+	}
+
+	// 阶段图会写入的全部特征的一份拷贝，缺失的特征记为未设置 | A copy of every trait the stage graphs write, a missing trait is left unset
+	struct FStageSnapshot
+	{
+		FSubjectHandle Subject;
+		TOptional<FAnimation> Animation;
+		TOptional<FHealthBar> HealthBar;
+		TOptional<FScaled> Scaled;
+		TOptional<FHitGlow> HitGlow;
+		TOptional<FJiggle> Jiggle;
+		TOptional<FAppearAnim> AppearAnim;
+		TOptional<FAppearDissolve> AppearDissolve;
+		TOptional<FDeathAnim> DeathAnim;
+		TOptional<FDeathDissolve> DeathDissolve;
+
+		template<typename TraitType>
+		static void CaptureTrait(FSubjectHandle Subject, TOptional<TraitType>& Out)
+		{
+			const TraitType* Trait = Subject.GetTraitPtr<TraitType, EParadigm::Unsafe>();
+			Out = Trait ? TOptional<TraitType>(*Trait) : TOptional<TraitType>();
+		}
+
+		template<typename TraitType>
+		static void RestoreTrait(FSubjectHandle Subject, const TOptional<TraitType>& In)
+		{
+			if (In.IsSet())
+			{
+				Subject.SetTrait(In.GetValue());
+			}
+			else if (Subject.HasTrait<TraitType>())
+			{
+				Subject.RemoveTrait<TraitType>();
+			}
+		}
+
+		template<typename TraitType, typename PredicateType>
+		static bool IsSameTrait(const TOptional<TraitType>& A, const TOptional<TraitType>& B, PredicateType&& Predicate)
+		{
+			if (A.IsSet() != B.IsSet()) return false;
+			return !A.IsSet() || Predicate(A.GetValue(), B.GetValue());
+		}
+
+		void Capture()
+		{
+			CaptureTrait(Subject, Animation);
+			CaptureTrait(Subject, HealthBar);
+			CaptureTrait(Subject, Scaled);
+			CaptureTrait(Subject, HitGlow);
+			CaptureTrait(Subject, Jiggle);
+			CaptureTrait(Subject, AppearAnim);
+			CaptureTrait(Subject, AppearDissolve);
+			CaptureTrait(Subject, DeathAnim);
+			CaptureTrait(Subject, DeathDissolve);
+		}
+
+		void Restore() const
+		{
+			if (!Subject.IsValid()) return;
+
+			RestoreTrait(Subject, Animation);
+			RestoreTrait(Subject, HealthBar);
+			RestoreTrait(Subject, Scaled);
+			RestoreTrait(Subject, HitGlow);
+			RestoreTrait(Subject, Jiggle);
+			RestoreTrait(Subject, AppearAnim);
+			RestoreTrait(Subject, AppearDissolve);
+			RestoreTrait(Subject, DeathAnim);
+			RestoreTrait(Subject, DeathDissolve);
+		}
+
+		// 只比较阶段会写的字段 | compares the fields the stages write only
+		bool IsSame(const FStageSnapshot& Other) const
+		{
+			return IsSameTrait(Animation, Other.Animation, [](const FAnimation& A, const FAnimation& B) { return A.HitGlow == B.HitGlow && A.Dissolve == B.Dissolve && A.SubjectState == B.SubjectState && A.PreviousSubjectState == B.PreviousSubjectState; })
+				&& IsSameTrait(HealthBar, Other.HealthBar, [](const FHealthBar& A, const FHealthBar& B) { return A.TargetRatio == B.TargetRatio && A.CurrentRatio == B.CurrentRatio && A.Opacity == B.Opacity; })
+				&& IsSameTrait(Scaled, Other.Scaled, [](const FScaled& A, const FScaled& B) { return A.RenderScale == B.RenderScale; })
+				&& IsSameTrait(HitGlow, Other.HitGlow, [](const FHitGlow& A, const FHitGlow& B) { return A.GlowTime == B.GlowTime; })
+				&& IsSameTrait(Jiggle, Other.Jiggle, [](const FJiggle& A, const FJiggle& B) { return A.JiggleTime == B.JiggleTime; })
+				&& IsSameTrait(AppearAnim, Other.AppearAnim, [](const FAppearAnim& A, const FAppearAnim& B) { return A.animTime == B.animTime; })
+				&& IsSameTrait(AppearDissolve, Other.AppearDissolve, [](const FAppearDissolve& A, const FAppearDissolve& B) { return A.dissolveTime == B.dissolveTime; })
+				&& IsSameTrait(DeathAnim, Other.DeathAnim, [](const FDeathAnim& A, const FDeathAnim& B) { return A.animTime == B.animTime; })
+				&& IsSameTrait(DeathDissolve, Other.DeathDissolve, [](const FDeathDissolve& A, const FDeathDissolve& B) { return A.dissolveTime == B.dissolveTime; });
+		}
+	};
+
+	/*
+	 * 在当前关卡的单位上，把战斗控制器的真实阶段图按声明顺序与按波次各跑一遍，要求结果一致 | Runs the battle control's real stage graphs on the live agents,
+	 * once in declaration order and once in waves, from the same starting state, and checks every written trait matches. The world is restored afterwards.
+	 */
+	static void StageGraph(const TArray<FString>& Args)
+	{
+		const int32 Repeats = Args.Num() > 0 ? FMath::Max(1, FCString::Atoi(*Args[0])) : 10;
+		const float DeltaTime = 1.f / 60.f;
+
+		ABattleFrameBattleControl* Control = ABattleFrameBattleControl::GetInstance();
+
+		if (!Control || !Control->Mechanism || Control->AppearStages.NumStages() == 0)
+		{
+			UE_LOG(LogTemp, Warning, TEXT("StageGraph needs a level with a ticking BattleFrameBattleControl"));
+			return;
+		}
+
+		AMechanism* Mechanism = Control->Mechanism;
+		const FBattleFrameStageContext Context{ Mechanism, DeltaTime, Control->MaxThreadsAllowed, Control->MinBatchSizeAllowed };
+
+		// 所有阶段过滤器都要求已激活 | every stage filter requires FActivated
+		TArray<FStageSnapshot> Initial;
+		{
+			auto Chain = Mechanism->EnchainSolid(FFilter::Make<FActivated>());
+			Initial.Reserve(Chain->IterableNum());
+
+			Chain->Operate([&](FSolidSubjectHandle Subject)
+			{
+				Initial.AddDefaulted_GetRef().Subject = FSubjectHandle(Subject);
+			});
+		}
+
+		for (FStageSnapshot& Snapshot : Initial)
+		{
+			Snapshot.Capture();
+		}
+
+		auto RunAndCapture = [&](FBattleFrameStageGraph& Graph, const bool bParallel, TArray<FStageSnapshot>& Out)
+		{
+			Graph.Run(Context, bParallel);
+			Mechanism->ApplyDeferreds();
+
+			Out = Initial;
+
+			for (FStageSnapshot& Snapshot : Out)
+			{
+				Snapshot.Capture();
+			}
+
+			for (const FStageSnapshot& Snapshot : Initial)
+			{
+				Snapshot.Restore();
+			}
+		};
+
+		const TPair<const TCHAR*, FBattleFrameStageGraph*> Graphs[] =
+		{
+			{ TEXT("Appear"), &Control->AppearStages },
+			{ TEXT("Hit"), &Control->HitStages },
+			{ TEXT("Death"), &Control->DeathStages },
+		};
+
+		bool bAllPassed = true;
+		TArray<FStageSnapshot> Serial;
+		TArray<FStageSnapshot> Parallel;
+
+		for (const TPair<const TCHAR*, FBattleFrameStageGraph*>& Graph : Graphs)
+		{
+			int32 NumMismatches = 0;
+
+			for (int32 Repeat = 0; Repeat < Repeats; ++Repeat)
+			{
+				RunAndCapture(*Graph.Value, false, Serial);
+				RunAndCapture(*Graph.Value, true, Parallel);
+
+				for (int32 Index = 0; Index < Serial.Num(); ++Index)
+				{
+					NumMismatches += Serial[Index].IsSame(Parallel[Index]) ? 0 : 1;
+				}
+			}
+
+			// 同一波内的阶段不得冲突 | no wave may hold two conflicting stages
+			bool bWavesOk = true;
+			const TArray<FBattleFrameStage>& Stages = Graph.Value->GetStages();
+
+			for (int32 i = 0; i < Stages.Num(); ++i)
+			{
+				for (int32 j = i + 1; j < Stages.Num(); ++j)
+				{
+					bWavesOk &= Stages[i].Wave != Stages[j].Wave || !FBattleFrameStageGraph::IsConflicting(Stages[i], Stages[j]);
+				}
+			}
+
+			const bool bPassed = NumMismatches == 0 && bWavesOk;
+			bAllPassed &= bPassed;
+
+			UE_LOG(LogTemp, Log, TEXT("StageGraph %s: %s, %d stages in %d waves, %d agents x %d repeats, %d mismatches"),
+				Graph.Key, bPassed ? TEXT("identical") : TEXT("DIFFERS"), Graph.Value->NumStages(), Graph.Value->NumWaves(), Initial.Num(), Repeats, NumMismatches);
+		}
+
+		if (bAllPassed)
+		{
+			UE_LOG(LogTemp, Log, TEXT("StageGraph PASSED"));
+		}
+		else
+		{
+			UE_LOG(LogTemp, Error, TEXT("StageGraph FAILED"));
+		}
+	}
+
+	// 随机邻居集合上逐位比较SIMD与标量ORCA线 | Bitwise comparison of the batched agent ORCA kernel against the scalar reference
+	static void AgentOrcaLines(const TArray<FString>& Args)
+	{
+		const int32 Iterations = Args.Num() > 0 ? FMath::Max(1, FCString::Atoi(*Args[0])) : 10000;
+
+		FRandomStream Random(4242);
+
+		int32 Mismatches = 0;
+		int64 LinesChecked = 0;
+
+		auto IsSameBits = [](const RVO::Line& A, const RVO::Line& B)
+		{
+			const float ValuesA[4] = { A.point.x(), A.point.y(), A.direction.x(), A.direction.y() };
+			const float ValuesB[4] = { B.point.x(), B.point.y(), B.direction.x(), B.direction.y() };
+			return FMemory::Memcmp(ValuesA, ValuesB, sizeof(ValuesA)) == 0;
+		};
+
+		for (int32 Iteration = 0; Iteration < Iterations; ++Iteration)
+		{
+			const RVO::Vector2 SelfPosition(Random.FRandRange(-5000.f, 5000.f), Random.FRandRange(-5000.f, 5000.f));
+			const RVO::Vector2 SelfVelocity(Random.FRandRange(-600.f, 600.f), Random.FRandRange(-600.f, 600.f));
+			const float SelfRadius = Random.FRandRange(20.f, 80.f);
+			const float TimeHorizon = Random.FRandRange(0.25f, 2.f);
+			const float TimeStep = Random.FRandRange(1.f / 120.f, 1.f / 30.f);
+
+			RVO::FAgentLineBatch Batch;
+			const int32 NeighborCount = Random.RandRange(1, RVO::FAgentLineBatch::Capacity);
+
+			for (int32 i = 0; i < NeighborCount; ++i)
+			{
+				// 混合重叠与非重叠的邻居，覆盖三种分支 | mix overlapping and separated neighbors so every branch is hit
+				const float Distance = Random.FRandRange(1.f, SelfRadius * 6.f);
+				const RVO::Vector2 Offset = RVO::normalize(RVO::Vector2(Random.FRandRange(-1.f, 1.f), Random.FRandRange(-1.f, 1.f) + 0.001f)) * Distance;
+				const RVO::Vector2 OtherVelocity(Random.FRandRange(-600.f, 600.f), Random.FRandRange(-600.f, 600.f));
+
+				Batch.Add(SelfPosition, SelfVelocity, SelfRadius, SelfPosition + Offset, OtherVelocity, Random.FRandRange(20.f, 80.f), Random.RandBool());
+			}
+
+			RVO::Line ScalarLines[RVO::FAgentLineBatch::Capacity];
+			RVO::Line BatchedLines[RVO::FAgentLineBatch::Capacity];
+			RVO::Line Lanes4Lines[RVO::FAgentLineBatch::Capacity];
+
+			RVO::BuildAgentLinesScalar(Batch, SelfVelocity, 1.f / TimeHorizon, TimeStep, ScalarLines);
+			RVO::BuildAgentLines(Batch, SelfVelocity, 1.f / TimeHorizon, TimeStep, BatchedLines);
+			RVO::BuildAgentLinesLanes<RVO::FLanes4>(Batch, SelfVelocity, 1.f / TimeHorizon, TimeStep, Lanes4Lines);
+
+			for (int32 i = 0; i < NeighborCount; ++i)
+			{
+				++LinesChecked;
+
+				if (!IsSameBits(ScalarLines[i], BatchedLines[i]) || !IsSameBits(ScalarLines[i], Lanes4Lines[i]))
+				{
+					if (Mismatches < 10)
+					{
+						UE_LOG(LogTemp, Warning, TEXT("AgentOrcaLines mismatch: scalar p(%.9g, %.9g) d(%.9g, %.9g) batched p(%.9g, %.9g) d(%.9g, %.9g)"),
+							ScalarLines[i].point.x(), ScalarLines[i].point.y(), ScalarLines[i].direction.x(), ScalarLines[i].direction.y(),
+							BatchedLines[i].point.x(), BatchedLines[i].point.y(), BatchedLines[i].direction.x(), BatchedLines[i].direction.y());
+					}
+
+					++Mismatches;
+				}
+			}
+		}
+
+		if (Mismatches == 0)
+		{
+			UE_LOG(LogTemp, Log, TEXT("AgentOrcaLines PASSED: %lld lines bit-identical (AVX2=%d)"), LinesChecked, RVO_AGENT_LINES_AVX2);
+		}
+		else
+		{
+			UE_LOG(LogTemp, Error, TEXT("AgentOrcaLines FAILED: %d of %lld lines differ (AVX2=%d)"), Mismatches, LinesChecked, RVO_AGENT_LINES_AVX2);
+		}
+	}
+
+	/*
+	 * 反复全体冰冻与全体中毒，比较内联槽位与真实马甲 | Repeated mass freeze and mass poison on inline slots against real ghost subjects.
+	 * Both sides run the battle control's own tick functions on the live mechanism: TickStatusEffects for the slots, TickSlowers and
+	 * TickTemporalDamagers for one FSlower / FTemporalDamager subject per application. Damage settling is left out of the timings.
+	 */
+	static void StatusEffects(const TArray<FString>& Args)
+	{
+		const int32 Iterations = Args.Num() > 0 ? FMath::Max(1, FCString::Atoi(*Args[0])) : 20;
+		const int32 TicksPerWave = 30;
+		const float DeltaTime = 1.f / 60.f;
+
+		ABattleFrameBattleControl* Control = ABattleFrameBattleControl::GetInstance();
+
+		if (!Control || !Control->Mechanism || Control->AppearStages.NumStages() == 0)
+		{
+			UE_LOG(LogTemp, Warning, TEXT("StatusEffects needs a level with a ticking BattleFrameBattleControl"));
+			return;
+		}
+
+		AMechanism* Mechanism = Control->Mechanism;
+		const bool bWasInline = Control->bInlineStatusEffects;
+
+		// 足够厚的血量，整个基准中目标不会死亡 | enough health that no target dies during the run
+		FSubjectRecord TargetRecord;
+		{
+			FHealth Health;
+			Health.Current = 1e9f;
+			Health.Maximum = 1e9f;
+
+			TargetRecord.SetTrait(Health);
+			TargetRecord.SetTrait(FAnimation());
+			TargetRecord.SetTrait(FSlowing());
+			TargetRecord.SetTrait(FTemporalDamaging());
+			TargetRecord.SetTrait(FStatusEffects());
+			TargetRecord.SetTrait(FActivated());
+		}
+
+		auto MakeEffect = [](const int32 Iteration)
+		{
+			// 交替施加冰冻与中毒，强度随波次变化 | alternate freeze and poison waves with strengths that vary per wave
+			FStatusEffectSlot Effect;
+			Effect.Kind = Iteration % 2 == 0 ? EStatusEffectKind::Slow : EStatusEffectKind::TemporalDmg;
+			Effect.DmgType = Effect.Kind == EStatusEffectKind::Slow ? EDmgType::Ice : EDmgType::Poison;
+			Effect.Strength = Effect.Kind == EStatusEffectKind::Slow ? 0.3f + 0.1f * (Iteration % 5) : 50.f;
+			Effect.Interval = 0.1f;
+			Effect.SegmentsLeft = 10;
+			Effect.TimeLeft = Effect.Kind == EStatusEffectKind::Slow ? 2.f : Effect.Interval;
+			return Effect;
+		};
+
+		auto SpawnTargets = [&](const int32 Agents, TArray<FSubjectHandle>& Targets)
+		{
+			Targets.Reset(Agents);
+
+			for (int32 i = 0; i < Agents; ++i)
+			{
+				Targets.Add(Mechanism->SpawnSubject(TargetRecord));
+			}
+		};
+
+		// 结算伤害并返回目标损失的总血量，随后回收目标，遗留马甲在下一次推进时自行销毁 | settle damage, sum the health lost, then despawn the targets and let the orphaned ghosts despawn themselves
+		auto Teardown = [&](TArray<FSubjectHandle>& Targets)
+		{
+			Control->ResolveDamageCommands();
+
+			double DamageDealt = 0;
+
+			for (FSubjectHandle& Target : Targets)
+			{
+				const FHealth& Health = Target.GetTraitRef<FHealth, EParadigm::Unsafe>();
+				DamageDealt += Health.Maximum - Health.Current;
+				Target.Despawn();
+			}
+
+			Targets.Reset();
+
+			Control->TickSlowers(0.f);
+			Control->TickTemporalDamagers(0.f);
+			Mechanism->ApplyDeferreds();
+			Control->ResolveDamageCommands();
+
+			return DamageDealt;
+		};
+
+		for (const int32 Agents : { 5000, 20000 })
+		{
+			TArray<FSubjectHandle> Targets;
+
+			// 马甲路径：每次施加生成一个真实马甲，叠加方式固定为各自独立 | ghost path: one real subject per application, which always stacks independently
+			double GhostApply = 0, GhostTick = 0;
+			int32 PeakGhosts = 0;
+			double GhostDamage = 0;
+			{
+				Control->bInlineStatusEffects = false;
+				SpawnTargets(Agents, Targets);
+
+				for (int32 Iteration = 0; Iteration < Iterations; ++Iteration)
+				{
+					const FStatusEffectSlot Effect = MakeEffect(Iteration);
+
+					double Start = FPlatformTime::Seconds();
+
+					for (const FSubjectHandle& Target : Targets)
+					{
+						if (Effect.Kind == EStatusEffectKind::Slow)
+						{
+							FSlower Slower;
+							Slower.SlowTarget = Target;
+							Slower.SlowStrength = Effect.Strength;
+							Slower.SlowTimeout = Effect.TimeLeft;
+							Slower.DmgType = Effect.DmgType;
+							Mechanism->SpawnSubject(Slower);
+						}
+						else
+						{
+							FTemporalDamager TemporalDamager;
+							TemporalDamager.TemporalDamageTarget = Target;
+							TemporalDamager.TotalTemporalDamage = Effect.Strength;
+							TemporalDamager.RemainingTemporalDamage = Effect.Strength;
+							TemporalDamager.TemporalDmgSegment = Effect.SegmentsLeft;
+							TemporalDamager.TemporalDmgInterval = Effect.Interval;
+							TemporalDamager.TemporalDamageTimeout = Effect.Interval;
+							TemporalDamager.DmgType = Effect.DmgType;
+							Mechanism->SpawnSubject(TemporalDamager);
+						}
+					}
+
+					GhostApply += FPlatformTime::Seconds() - Start;
+					PeakGhosts = FMath::Max(PeakGhosts, Mechanism->EnchainSolid(FFilter::Make<FSlower>())->IterableNum() + Mechanism->EnchainSolid(FFilter::Make<FTemporalDamager>())->IterableNum());
+
+					for (int32 Tick = 0; Tick < TicksPerWave; ++Tick)
+					{
+						Start = FPlatformTime::Seconds();
+
+						Control->TickSlowers(DeltaTime);
+						Control->TickTemporalDamagers(DeltaTime);
+						Mechanism->ApplyDeferreds();
+
+						GhostTick += FPlatformTime::Seconds() - Start;
+
+						Control->ResolveDamageCommands();
+					}
+				}
+
+				GhostDamage = Teardown(Targets);
+			}
+
+			for (const EStatusEffectStacking Stacking : { EStatusEffectStacking::Refresh, EStatusEffectStacking::Stack, EStatusEffectStacking::StrongestWins })
+			{
+				double InlineApply = 0, InlineTick = 0;
+
+				Control->bInlineStatusEffects = true;
+				SpawnTargets(Agents, Targets);
+
+				for (int32 Iteration = 0; Iteration < Iterations; ++Iteration)
+				{
+					const FStatusEffectSlot Effect = MakeEffect(Iteration);
+
+					double Start = FPlatformTime::Seconds();
+
+					ParallelFor(Targets.Num(), [&](int32 i)
+					{
+						FStatusEffects& Store = Targets[i].GetTraitRef<FStatusEffects, EParadigm::Unsafe>();
+						Store.Lock();
+						Store.Apply(Effect, Stacking);
+						Store.Unlock();
+					});
+
+					InlineApply += FPlatformTime::Seconds() - Start;
+
+					for (int32 Tick = 0; Tick < TicksPerWave; ++Tick)
+					{
+						Start = FPlatformTime::Seconds();
+
+						Control->TickStatusEffects(DeltaTime);
+
+						InlineTick += FPlatformTime::Seconds() - Start;
+
+						Control->ResolveDamageCommands();
+					}
+				}
+
+				const double InlineDamage = Teardown(Targets);
+
+				const TCHAR* StackingName = Stacking == EStatusEffectStacking::Refresh ? TEXT("Refresh") : (Stacking == EStatusEffectStacking::Stack ? TEXT("Stack") : TEXT("StrongestWins"));
+				const double Ticks = double(Iterations) * TicksPerWave;
+
+				UE_LOG(LogTemp, Log, TEXT("StatusEffects Agents=%d Stacking=%s Waves=%d Inline(apply/wave=%.3fms tick=%.3fms damage=%.0f) Ghost(apply/wave=%.3fms tick=%.3fms peak=%d damage=%.0f) TickSpeedup=%.2fx"),
+					Agents, StackingName, Iterations,
+					InlineApply * 1000.0 / Iterations, InlineTick * 1000.0 / Ticks, InlineDamage,
+					GhostApply * 1000.0 / Iterations, GhostTick * 1000.0 / Ticks, PeakGhosts, GhostDamage,
+					InlineTick > 0 ? GhostTick / InlineTick : 0.0);
+			}
+		}
+
+		Control->bInlineStatusEffects = bWasInline;
+	}
+
+	static FAutoConsoleCommand AgentOrcaLinesCommand(
+		TEXT("BattleFrame.Verify.AgentOrcaLines"),
+		TEXT("Check that the batched agent ORCA kernel is bit-identical to the scalar reference over randomized neighbor sets. Usage: BattleFrame.Verify.AgentOrcaLines [Iterations]"),
+		FConsoleCommandWithArgsDelegate::CreateStatic(&AgentOrcaLines));
+
+	static FAutoConsoleCommand StageGraphCommand(
+		TEXT("BattleFrame.Verify.StageGraph"),
+		TEXT("Run the battle control's stage graphs on the live agents serially and in waves from the same state and check every written trait matches. Usage: BattleFrame.Verify.StageGraph [Repeats]"),
+		FConsoleCommandWithArgsDelegate::CreateStatic(&StageGraph));
+
+	static FAutoConsoleCommand NeighborScanCommand(
+		TEXT("BattleFrame.Bench.NeighborScan"),
+		TEXT("Compare AoS and SoA neighbor cell scan throughput at 10k/30k/60k agents. Usage: BattleFrame.Bench.NeighborScan [Iterations]"),
+		FConsoleCommandWithArgsDelegate::CreateStatic(&NeighborScan));
+
+	static FAutoConsoleCommand SparseGridCommand(
+		TEXT("BattleFrame.Bench.SparseGrid"),
+		TEXT("Compare dense and sparse hashed grid storage for 30k agents on a map of 20x the area: memory, build and query time. Usage: BattleFrame.Bench.SparseGrid [Iterations]"),
+		FConsoleCommandWithArgsDelegate::CreateStatic(&SparseGrid));
+
+	static FAutoConsoleCommand SpatialOrderCommand(
+		TEXT("BattleFrame.Bench.SpatialOrder"),
+		TEXT("Compare neighbor queries for 30k agents iterated in storage order against Z-order. Usage: BattleFrame.Bench.SpatialOrder [Iterations]"),
+		FConsoleCommandWithArgsDelegate::CreateStatic(&SpatialOrder));
+
+	static FAutoConsoleCommand StatusEffectsCommand(
+		TEXT("BattleFrame.Bench.StatusEffects"),
+		TEXT("Repeated mass freeze and mass poison on 5k/20k spawned targets: the inline status effect tick against real slower and temporal damager ghosts, for every stacking mode. Run in a level without agents for clean numbers. Usage: BattleFrame.Bench.StatusEffects [Waves]"),
+		FConsoleCommandWithArgsDelegate::CreateStatic(&StatusEffects));
+}
+
+#endif
@@ -0,0 +1,187 @@
+/*
+ * BattleFrame
+ * Created: 2025
+ * Author: Leroy Works, All Rights Reserved.
+ */
+
+#include "BattleFrameDebugDraw.h"
+#include "Engine/World.h"
+#include "DrawDebugHelpers.h"
+#include "Misc/EngineVersionComparison.h"
+
+int32 FBattleFrameDebugDraw::CalcSegments(const FVector& Center, float Radius, float Fraction) const
+{
+	// 按屏幕上的大小细分，远处的图形只用几段 | tessellate by size on screen, far shapes take a few segments
+	const float Distance = FMath::Max(FVector::Dist(ViewLocation, Center), 1.f);
+	const int32 Lower = FMath::Max(2, FMath::CeilToInt(MinSegments * Fraction));
+	const int32 Upper = FMath::Max(Lower, FMath::CeilToInt(MaxSegments * Fraction));
+
+	return FMath::Clamp(FMath::CeilToInt(SegmentScale * Radius / Distance * Fraction), Lower, Upper);
+}
+
+bool FBattleFrameDebugDraw::Reserve(int32 NumLines)
+{
+	if (MaxLines > 0 && Num() + NumLines > MaxLines)
+	{
+		++NumDropped;
+		return false;
+	}
+
+	return true;
+}
+
+void FBattleFrameDebugDraw::AddLine(const FVector& Start, const FVector& End, const FColor& Color, float Duration, float Thickness, uint8 DepthPriority)
+{
+	if (!Reserve(1)) return;
+
+	TArray<FBatchedLine>& Target = Duration > 0.f ? PersistentLines : Lines;
+	Target.Emplace(Start, End, FLinearColor(Color), Duration, Thickness, DepthPriority);
+}
+
+void FBattleFrameDebugDraw::AddArc(const FVector& Center, float Radius, const FVector& XAxis, const FVector& YAxis, float StartAngle, float EndAngle, int32 Segments, const FColor& Color, float Duration, float Thickness, uint8 DepthPriority)
+{
+	TArray<FBatchedLine>& Target = Duration > 0.f ? PersistentLines : Lines;
+	const FLinearColor LineColor(Color);
+	const float AngleStep = (EndAngle - StartAngle) / Segments;
+
+	float Sin, Cos;
+	FMath::SinCos(&Sin, &Cos, StartAngle);
+	FVector LastPoint = Center + (XAxis * Cos + YAxis * Sin) * Radius;
+
+	for (int32 i = 1; i <= Segments; ++i)
+	{
+		FMath::SinCos(&Sin, &Cos, StartAngle + AngleStep * i);
+		const FVector Point = Center + (XAxis * Cos + YAxis * Sin) * Radius;
+
+		Target.Emplace(LastPoint, Point, LineColor, Duration, Thickness, DepthPriority);
+		LastPoint = Point;
+	}
+}
+
+void FBattleFrameDebugDraw::AddCircle(const FVector& Center, float Radius, const FColor& Color, float Duration, float Thickness, const FVector& XAxis, const FVector& YAxis, uint8 DepthPriority)
+{
+	const int32 Segments = CalcSegments(Center, Radius);
+	if (!Reserve(Segments)) return;
+
+	AddArc(Center, Radius, XAxis, YAxis, 0.f, UE_TWO_PI, Segments, Color, Duration, Thickness, DepthPriority);
+}
+
+void FBattleFrameDebugDraw::AddSphere(const FVector& Center, float Radius, const FColor& Color, float Duration, float Thickness, uint8 DepthPriority)
+{
+	const int32 Segments = CalcSegments(Center, Radius);
+	if (!Reserve(Segments * 3)) return;
+
+	AddArc(Center, Radius, FVector::XAxisVector, FVector::YAxisVector, 0.f, UE_TWO_PI, Segments, Color, Duration, Thickness, DepthPriority);
+	AddArc(Center, Radius, FVector::XAxisVector, FVector::ZAxisVector, 0.f, UE_TWO_PI, Segments, Color, Duration, Thickness, DepthPriority);
+	AddArc(Center, Radius, FVector::YAxisVector, FVector::ZAxisVector, 0.f, UE_TWO_PI, Segments, Color, Duration, Thickness, DepthPriority);
+}
+
+void FBattleFrameDebugDraw::AddCapsule(const FVector& Center, float HalfHeight, float Radius, const FQuat& Rotation, const FColor& Color, float Duration, float Thickness, uint8 DepthPriority)
+{
+	// HalfHeight含半球，与DrawDebugCapsule一致 | HalfHeight includes the hemispheres, as in DrawDebugCapsule
+	const int32 Segments = CalcSegments(Center, FMath::Max(Radius, HalfHeight));
+	const int32 HalfSegments = FMath::Max(2, Segments / 2);
+	if (!Reserve(Segments * 2 + HalfSegments * 4 + 4)) return;
+
+	const FVector AxisX = Rotation.GetAxisX();
+	const FVector AxisY = Rotation.GetAxisY();
+	const FVector AxisZ = Rotation.GetAxisZ();
+	const float CylinderHalfHeight = FMath::Max(0.f, HalfHeight - Radius);
+	const FVector Top = Center + AxisZ * CylinderHalfHeight;
+	const FVector Bottom = Center - AxisZ * CylinderHalfHeight;
+
+	AddArc(Top, Radius, AxisX, AxisY, 0.f, UE_TWO_PI, Segments, Color, Duration, Thickness, DepthPriority);
+	AddArc(Bottom, Radius, AxisX, AxisY, 0.f, UE_TWO_PI, Segments, Color, Duration, Thickness, DepthPriority);
+
+	AddArc(Top, Radius, AxisX, AxisZ, 0.f, UE_PI, HalfSegments, Color, Duration, Thickness, DepthPriority);
+	AddArc(Top, Radius, AxisY, AxisZ, 0.f, UE_PI, HalfSegments, Color, Duration, Thickness, DepthPriority);
+	AddArc(Bottom, Radius, AxisX, -AxisZ, 0.f, UE_PI, HalfSegments, Color, Duration, Thickness, DepthPriority);
+	AddArc(Bottom, Radius, AxisY, -AxisZ, 0.f, UE_PI, HalfSegments, Color, Duration, Thickness, DepthPriority);
+
+	TArray<FBatchedLine>& Target = Duration > 0.f ? PersistentLines : Lines;
+	const FLinearColor LineColor(Color);
+
+	Target.Emplace(Top + AxisX * Radius, Bottom + AxisX * Radius, LineColor, Duration, Thickness, DepthPriority);
+	Target.Emplace(Top - AxisX * Radius, Bottom - AxisX * Radius, LineColor, Duration, Thickness, DepthPriority);
+	Target.Emplace(Top + AxisY * Radius, Bottom + AxisY * Radius, LineColor, Duration, Thickness, DepthPriority);
+	Target.Emplace(Top - AxisY * Radius, Bottom - AxisY * Radius, LineColor, Duration, Thickness, DepthPriority);
+}
+
+void FBattleFrameDebugDraw::AddSector(const FVector& Center, const FVector& Direction, float Radius, float AngleDegrees, float Height, const FColor& Color, float Duration, float Thickness, uint8 DepthPriority)
+{
+	if (AngleDegrees <= 0.f || Radius <= 0.f || Height <= 0.f) return;
+
+	// 确保角度在合理范围
+	AngleDegrees = FMath::Clamp(AngleDegrees, 1.f, 360.f);
+	const float HalfAngle = FMath::DegreesToRadians(AngleDegrees) * 0.5f;
+	const bool bFullCircle = AngleDegrees >= 360.f;
+
+	const int32 Segments = CalcSegments(Center, Radius, AngleDegrees / 360.f);
+	if (!Reserve(Segments * 2 + (bFullCircle ? 0 : 6))) return;
+
+	// 计算方向向量
+	FVector Forward = Direction.GetSafeNormal2D();
+	if (Forward.IsNearlyZero()) Forward = FVector::ForwardVector;
+	const FVector Right = FVector::CrossProduct(FVector::UpVector, Forward);
+
+	// 顶面和底面以Center为中心对称
+	const FVector HalfHeight(0, 0, Height * 0.5f);
+	const FVector TopCenter = Center + HalfHeight;
+	const FVector BottomCenter = Center - HalfHeight;
+
+	AddArc(BottomCenter, Radius, Forward, Right, -HalfAngle, HalfAngle, Segments, Color, Duration, Thickness, DepthPriority);
+	AddArc(TopCenter, Radius, Forward, Right, -HalfAngle, HalfAngle, Segments, Color, Duration, Thickness, DepthPriority);
+
+	if (bFullCircle) return;
+
+	// 两条半径线和两条竖边 | radius lines of both faces and the two vertical edges
+	float Sin, Cos;
+	FMath::SinCos(&Sin, &Cos, HalfAngle);
+	const FVector StartOffset = (Forward * Cos - Right * Sin) * Radius;
+	const FVector EndOffset = (Forward * Cos + Right * Sin) * Radius;
+
+	TArray<FBatchedLine>& Target = Duration > 0.f ? PersistentLines : Lines;
+	const FLinearColor LineColor(Color);
+
+	Target.Emplace(TopCenter, TopCenter + StartOffset, LineColor, Duration, Thickness, DepthPriority);
+	Target.Emplace(TopCenter, TopCenter + EndOffset, LineColor, Duration, Thickness, DepthPriority);
+	Target.Emplace(BottomCenter, BottomCenter + StartOffset, LineColor, Duration, Thickness, DepthPriority);
+	Target.Emplace(BottomCenter, BottomCenter + EndOffset, LineColor, Duration, Thickness, DepthPriority);
+	Target.Emplace(BottomCenter + StartOffset, TopCenter + StartOffset, LineColor, Duration, Thickness, DepthPriority);
+	Target.Emplace(BottomCenter + EndOffset, TopCenter + EndOffset, LineColor, Duration, Thickness, DepthPriority);
+}
+
+void FBattleFrameDebugDraw::Flush(UWorld* World)
+{
+#if ENABLE_DRAW_DEBUG
+	if (World)
+	{
+	#if UE_VERSION_OLDER_THAN(5, 5, 0)
+		ULineBatchComponent* LineBatcher = World->LineBatcher;
+		ULineBatchComponent* PersistentLineBatcher = World->PersistentLineBatcher;
+	#else
+		ULineBatchComponent* LineBatcher = World->GetLineBatcher(UWorld::ELineBatcherType::World);
+		ULineBatchComponent* PersistentLineBatcher = World->GetLineBatcher(UWorld::ELineBatcherType::WorldPersistent);
+	#endif
+
+		if (LineBatcher && !Lines.IsEmpty())
+		{
+			// 与DrawDebugLine一致，单帧的线用批处理器的默认寿命 | single frame lines take the batcher's default life, as DrawDebugLine does
+			for (FBatchedLine& Line : Lines)
+			{
+				Line.RemainingLifeTime = LineBatcher->DefaultLifeTime;
+			}
+
+			LineBatcher->DrawLines(Lines);
+		}
+
+		if (PersistentLineBatcher && !PersistentLines.IsEmpty())
+		{
+			PersistentLineBatcher->DrawLines(PersistentLines);
+		}
+	}
+#endif
+
+	Lines.Reset();
+	PersistentLines.Reset();
+}
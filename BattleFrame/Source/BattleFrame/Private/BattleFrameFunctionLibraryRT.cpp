@@ -375,12 +375,17 @@ void USphereSweepForSubjectsAsyncAction::Activate()
 	{
 		AsyncTask(ENamedThreads::GameThread, [this]()
 		{
-			TArray<FIntVector> CellCoords = NeighborGrid->SphereSweepForCells(Start, End, Radius);
+			NeighborGrid->ForEachCellAlongSweep(Start, End, Radius, [&](int32 CellIndex, const FIntVector& CellCoord)
+			{
+				ValidCells.AddDefaulted_GetRef().Subjects.Append(NeighborGrid->GetSubjectsAt(CellIndex));
+			});
 
-			for (const FIntVector& CellCoord : CellCoords)
+			// 粗层的大体型单位收进单独一组 | large subjects from the coarse levels go into one extra group
+			FNeighborGridCell& CoarseSubjects = ValidCells.AddDefaulted_GetRef();
+			NeighborGrid->ForEachCoarseSubjectInBox((Start + End) * 0.5f, (End - Start).GetAbs() * 0.5f + FVector(Radius), [&](const FGridData& Data)
 			{
-				ValidCells.Add(NeighborGrid->GetCellAt(NeighborGrid->SubjectCells, CellCoord));
-			}
+				CoarseSubjects.Subjects.Add(Data);
+			});
 
 			AsyncTask(ENamedThreads::AnyBackgroundThreadNormalTask, [this]()
 			{
@@ -16,12 +16,39 @@
 #include "NeighborGridComponent.h"
 #include "Runtime/Core/Public/Async/ParallelFor.h"
 #include "ProfilingDebugging/CpuProfilerTrace.h"
+#include "ProfilingDebugging/CountersTrace.h"
 #include "BitMask.h"
 #include "GenericPlatform/GenericPlatformMisc.h"
 #include "BattleFrameFunctionLibraryRT.h"
 #include "BattleFrameBattleControl.h"
 #include "Kismet/BlueprintAsyncActionBase.h"
 
+// 追踪候选格子，缓存到排序原点的距离 | Candidate cell of a trace, with its distance to the sort origin cached for sorting and early-out
+struct FTraceCandidateCell
+{
+	float SortDistSq;
+	int32 CellIndex;
+	const UNeighborGridComponent* Grid;// the cell may belong to a neighboring grid
+};
+
+using FTraceCandidateCells = TArray<FTraceCandidateCell, TInlineAllocator<64>>;
+
+TRACE_DECLARE_INT_COUNTER(BattleFrame_GridMovedSubjects, TEXT("BattleFrame/GridMovedSubjects"));
+TRACE_DECLARE_INT_COUNTER(BattleFrame_GridStationarySubjects, TEXT("BattleFrame/GridStationarySubjects"));
+
+static void SortTraceCandidateCells(FTraceCandidateCells& CandidateCells, const ESortMode SortMode)
+{
+	if (SortMode == ESortMode::None) return;
+
+	CandidateCells.Sort([SortMode](const FTraceCandidateCell& A, const FTraceCandidateCell& B)
+		{
+			return SortMode == ESortMode::NearToFar ? A.SortDistSq < B.SortDistSq : A.SortDistSq > B.SortDistSq;
+		});
+}
+
+uint32 UNeighborGridComponent::GridListVersion = 0;
+TArray<TPair<int32, FSubjectHandle>> UNeighborGridComponent::AssignedSubjects;
+
 UNeighborGridComponent::UNeighborGridComponent()
 {
 	bWantsInitializeComponent = true;
@@ -31,6 +58,13 @@ void UNeighborGridComponent::BeginPlay()
 {
 	Super::BeginPlay();
 	DefineFilters();
+	++GridListVersion;
+}
+
+void UNeighborGridComponent::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	++GridListVersion;
+	Super::EndPlay(EndPlayReason);
 }
 
 void UNeighborGridComponent::InitializeComponent()
@@ -91,9 +125,6 @@ void UNeighborGridComponent::SphereTraceForSubjects
 	const float ExpandedRadius = Radius + MaxCellRadius * FMath::Sqrt(2.0f);
 	const FVector Range(ExpandedRadius);
 
-	const FIntVector CoordMin = LocationToCoord(Origin - Range);
-	const FIntVector CoordMax = LocationToCoord(Origin + Range);
-
 	// 跟踪最佳结果（用于KeepCount=1的情况）
 	FTraceResult BestResult;
 	float BestDistSq = (SortMode == ESortMode::NearToFar) ? FLT_MAX : -FLT_MAX;
@@ -102,36 +133,23 @@ void UNeighborGridComponent::SphereTraceForSubjects
 	TArray<FTraceResult> TempResults;
 
 	// 预收集候选格子并按距离排序
-	TArray<FIntVector> CandidateCells;
+	FTraceCandidateCells CandidateCells;
 
-	for (int32 z = CoordMin.Z; z <= CoordMax.Z; ++z)
+	ForEachGridInBox(Origin, Range, [&](const UNeighborGridComponent* Grid)
 	{
-		for (int32 y = CoordMin.Y; y <= CoordMax.Y; ++y)
+		Grid->ForEachCellInBox(Origin, Range, [&](int32 CellIndex, const FIntVector& Coord)
 		{
-			for (int32 x = CoordMin.X; x <= CoordMax.X; ++x)
-			{
-				const FIntVector Coord(x, y, z);
-				if (!IsInside(Coord)) continue;
+			const FVector CellCenter = Grid->CoordToLocation(Coord);
+			const float DistSq = FVector::DistSquared(CellCenter, Origin);
 
-				const FVector CellCenter = CoordToLocation(Coord);
-				const float DistSq = FVector::DistSquared(CellCenter, Origin);
+			if (DistSq > FMath::Square(ExpandedRadius)) return;
 
-				if (DistSq > FMath::Square(ExpandedRadius)) continue;
-
-				CandidateCells.Add(Coord);
-			}
-		}
-	}
+			CandidateCells.Add({ static_cast<float>(FVector::DistSquared(CellCenter, SortOrigin)), CellIndex, Grid });
+		});
+	});
 
 	// 根据SortMode对格子进行排序
-	if (SortMode != ESortMode::None)
-	{
-		CandidateCells.Sort([this, SortOrigin, SortMode](const FIntVector& A, const FIntVector& B) {
-			const float DistSqA = FVector::DistSquared(CoordToLocation(A), SortOrigin);
-			const float DistSqB = FVector::DistSquared(CoordToLocation(B), SortOrigin);
-			return SortMode == ESortMode::NearToFar ? DistSqA < DistSqB : DistSqA > DistSqB;
-			});
-	}
+	SortTraceCandidateCells(CandidateCells, SortMode);
 
 	// 计算提前终止阈值
 	float ThresholdDistanceSq = FLT_MAX;
@@ -143,109 +161,111 @@ void UNeighborGridComponent::SphereTraceForSubjects
 		ThresholdDistanceSq = FMath::Square(ThresholdDistance);
 	}
 
-	// 遍历检测
-	for (const FIntVector& Coord : CandidateCells)
+	// 单个候选的处理，基础层与粗层共用 | per candidate handling, shared by the base and coarse levels
+	auto ProcessSubject = [&](const FGridData& SubjectData, float DistSqr)
 	{
-		// 提前终止检查
-		if (!bNoCountLimit && KeepCount > 0 && SortMode != ESortMode::None)
-		{
-			const float CellDistSq = FVector::DistSquared(CoordToLocation(Coord), SortOrigin);
-			if ((SortMode == ESortMode::NearToFar && CellDistSq > ThresholdDistanceSq) || (SortMode == ESortMode::FarToNear && CellDistSq < ThresholdDistanceSq)) break;
-		}
+		const FSubjectHandle Subject = SubjectData.SubjectHandle;
+		if (IgnoreSet.Contains(Subject)) return;
+		if (!Subject.Matches(Filter)) return;
 
-		const auto& CellData = GetCellAt(SubjectCells, Coord);
+		const FVector SubjectPos = FVector(SubjectData.Location);
+		const float SubjectRadius = SubjectData.Radius;
 
-		for (const FGridData& SubjectData : CellData.Subjects)
+		if (bCheckVisibility)
 		{
-			const FSubjectHandle Subject = SubjectData.SubjectHandle;
-			if (IgnoreSet.Contains(Subject)) continue;
-			if (!Subject.Matches(Filter)) continue;
-
-			const FVector SubjectPos = FVector(SubjectData.Location);
-			const float SubjectRadius = SubjectData.Radius;
+			bool bVisibilityHit = false;
+			FTraceResult VisibilityResult;
 
-			// 距离检查
-			const FVector Delta = SubjectPos - Origin;
-			const float DistSq = Delta.SizeSquared();
-			const float CombinedRadius = Radius + SubjectRadius;
-			if (DistSq > FMath::Square(CombinedRadius)) continue;
+			const FVector ToSubjectDir = (SubjectPos - CheckOrigin).GetSafeNormal();
+			const FVector SubjectSurfacePoint = SubjectPos - (ToSubjectDir * SubjectRadius);
+			FTraceDrawDebugConfig CheckObstacleDrawDebugConfig;
+			SphereSweepForObstacle(CheckOrigin, SubjectSurfacePoint, CheckRadius, CheckObstacleDrawDebugConfig, bVisibilityHit, VisibilityResult);
 
-			if (bCheckVisibility)
-			{
-				bool bVisibilityHit = false;
-				FTraceResult VisibilityResult;
+			if (bVisibilityHit) return;
+		}
 
-				const FVector ToSubjectDir = (SubjectPos - CheckOrigin).GetSafeNormal();
-				const FVector SubjectSurfacePoint = SubjectPos - (ToSubjectDir * SubjectRadius);
-				FTraceDrawDebugConfig CheckObstacleDrawDebugConfig;
-				SphereSweepForObstacle(CheckOrigin, SubjectSurfacePoint, CheckRadius, CheckObstacleDrawDebugConfig, bVisibilityHit, VisibilityResult);
+		const float CurrentDistSq = FVector::DistSquared(SortOrigin, SubjectPos);
 
-				if (bVisibilityHit) continue;
+		if (bSingleResult)
+		{
+			bool bIsBetter = false;
+			if (SortMode == ESortMode::NearToFar)
+			{
+				bIsBetter = (CurrentDistSq < BestDistSq);
+			}
+			else if (SortMode == ESortMode::FarToNear)
+			{
+				bIsBetter = (CurrentDistSq > BestDistSq);
+			}
+			else // ESortMode::None
+			{
+				bIsBetter = true;
 			}
 
-			const float CurrentDistSq = FVector::DistSquared(SortOrigin, SubjectPos);
-
-			if (bSingleResult)
+			if (bIsBetter)
 			{
-				bool bIsBetter = false;
-				if (SortMode == ESortMode::NearToFar)
+				BestResult.Subject = Subject;
+				BestResult.Location = SubjectPos;
+				BestResult.CachedDistSq = CurrentDistSq;
+				BestDistSq = CurrentDistSq;
+
+				// 更新阈值
+				if (!bNoCountLimit && KeepCount > 0)
 				{
-					bIsBetter = (CurrentDistSq < BestDistSq);
+					const float MaxCellSize = CellSize.GetMax();
+					const float ThresholdDistance = FMath::Sqrt(BestDistSq) + 2.0f * MaxCellSize * FMath::Sqrt(2.0f);
+					ThresholdDistanceSq = FMath::Square(ThresholdDistance);
 				}
-				else if (SortMode == ESortMode::FarToNear)
+			}
+		}
+		else
+		{
+			FTraceResult Result;
+			Result.Subject = Subject;
+			Result.Location = SubjectPos;
+			Result.CachedDistSq = CurrentDistSq;
+			TempResults.Add(Result);
+
+			// 当收集到足够结果时更新阈值
+			if (!bNoCountLimit && KeepCount > 0 && SortMode != ESortMode::None && TempResults.Num() >= KeepCount)
+			{
+				// 找到当前第KeepCount个最佳结果的距离
+				float CurrentThresholdDistSq = 0.0f;
+				if (SortMode == ESortMode::NearToFar)
 				{
-					bIsBetter = (CurrentDistSq > BestDistSq);
+					CurrentThresholdDistSq = TempResults[KeepCount - 1].CachedDistSq;
 				}
-				else // ESortMode::None
+				else // FarToNear
 				{
-					bIsBetter = true;
+					CurrentThresholdDistSq = TempResults.Last().CachedDistSq;
 				}
 
-				if (bIsBetter)
-				{
-					BestResult.Subject = Subject;
-					BestResult.Location = SubjectPos;
-					BestResult.CachedDistSq = CurrentDistSq;
-					BestDistSq = CurrentDistSq;
-
-					// 更新阈值
-					if (!bNoCountLimit && KeepCount > 0)
-					{
-						const float MaxCellSize = CellSize.GetMax();
-						const float ThresholdDistance = FMath::Sqrt(BestDistSq) + 2.0f * MaxCellSize * FMath::Sqrt(2.0f);
-						ThresholdDistanceSq = FMath::Square(ThresholdDistance);
-					}
-				}
+				// 更新阈值
+				const float MaxCellSize = CellSize.GetMax();
+				const float ThresholdDistance = FMath::Sqrt(CurrentThresholdDistSq) + 2.0f * MaxCellSize * FMath::Sqrt(2.0f);
+				ThresholdDistanceSq = FMath::Square(ThresholdDistance);
 			}
-			else
-			{
-				FTraceResult Result;
-				Result.Subject = Subject;
-				Result.Location = SubjectPos;
-				Result.CachedDistSq = CurrentDistSq;
-				TempResults.Add(Result);
-
-				// 当收集到足够结果时更新阈值
-				if (!bNoCountLimit && KeepCount > 0 && SortMode != ESortMode::None && TempResults.Num() >= KeepCount)
-				{
-					// 找到当前第KeepCount个最佳结果的距离
-					float CurrentThresholdDistSq = 0.0f;
-					if (SortMode == ESortMode::NearToFar)
-					{
-						CurrentThresholdDistSq = TempResults[KeepCount - 1].CachedDistSq;
-					}
-					else // FarToNear
-					{
-						CurrentThresholdDistSq = TempResults.Last().CachedDistSq;
-					}
+		}
+	};
 
-					// 更新阈值
-					const float MaxCellSize = CellSize.GetMax();
-					const float ThresholdDistance = FMath::Sqrt(CurrentThresholdDistSq) + 2.0f * MaxCellSize * FMath::Sqrt(2.0f);
-					ThresholdDistanceSq = FMath::Square(ThresholdDistance);
-				}
-			}
+	// 粗层的大体型单位各只出现一次，先处理以尽早收紧阈值 | large subjects on coarse levels appear once each, visit them first to tighten the threshold early
+	ForEachGridInBox(Origin, FVector(Radius), [&](const UNeighborGridComponent* Grid)
+	{
+		Grid->ForEachCoarseSubjectInRange<true>(FVector3f(Origin), Radius, MAX_uint32, ProcessSubject);
+	});
+
+	// 遍历检测
+	for (const FTraceCandidateCell& Cell : CandidateCells)
+	{
+		// 提前终止检查
+		if (!bNoCountLimit && KeepCount > 0 && SortMode != ESortMode::None)
+		{
+			const float CellDistSq = Cell.SortDistSq;
+			if ((SortMode == ESortMode::NearToFar && CellDistSq > ThresholdDistanceSq) || (SortMode == ESortMode::FarToNear && CellDistSq < ThresholdDistanceSq)) break;
 		}
+
+		// 距离检查在格子内按SIMD批量完成，通过后才读取句柄 | the distance test runs batched over the cell before the handle is read
+		Cell.Grid->ForEachSubjectInRange<true>(Cell.CellIndex, FVector3f(Origin), Radius, MAX_uint32, ProcessSubject);
 	}
 
 	// 处理结果
@@ -341,74 +361,83 @@ void UNeighborGridComponent::SphereSweepForSubjects
 	// Convert ignore list to set for fast lookup
 	const TSet<FSubjectHandle> IgnoreSet(IgnoreSubjects.Subjects);
 
-	// Get cells along the sweep path (already handles FVector CellSize)
-	TArray<FIntVector> GridCells = SphereSweepForCells(Start, End, Radius);
-
 	const FVector TraceDir = (End - Start).GetSafeNormal();
 	const float TraceLength = FVector::Distance(Start, End);
 
 	// Temporary array to store unsorted results
 	TArray<FTraceResult> TempResults;
 
-	// Check subjects in each cell
-	for (const FIntVector& CellIndex : GridCells)
+	// Shared per subject test, used by the base level cells and the coarse levels
+	auto ProcessSubject = [&](const FGridData& Data)
 	{
-		if (!IsInside(CellIndex)) continue;
+		const FSubjectHandle Subject = Data.SubjectHandle;
 
-		const auto& CageCell = GetCellAt(SubjectCells, CellIndex);
+		// Check if in ignore list
+		if (IgnoreSet.Contains(Subject)) return;
 
-		for (const FGridData& Data : CageCell.Subjects)
-		{
-			const FSubjectHandle Subject = Data.SubjectHandle;
+		// Validity checks
+		if (!Subject.IsValid() || !Subject.Matches(Filter)) return;
+
+		const FVector SubjectPos = FVector(Data.Location);
+		float SubjectRadius = Data.Radius;
 
-			// Check if in ignore list
-			if (IgnoreSet.Contains(Subject)) continue;
+		// Distance calculations
+		const FVector ToSubject = SubjectPos - Start;
+		const float ProjOnTrace = FVector::DotProduct(ToSubject, TraceDir);
 
-			// Validity checks
-			if (!Subject.IsValid() || !Subject.Matches(Filter)) continue;
+		// Initial filtering
+		const float ProjThreshold = SubjectRadius + Radius;
+		if (ProjOnTrace < -ProjThreshold || ProjOnTrace > TraceLength + ProjThreshold) return;
 
-			const FVector SubjectPos = FVector(Data.Location);
-			float SubjectRadius = Data.Radius;
+		// Precise distance check (still spherical)
+		const float ClampedProj = FMath::Clamp(ProjOnTrace, 0.0f, TraceLength);
+		const FVector NearestPoint = Start + ClampedProj * TraceDir;
+		const float CombinedRadSq = FMath::Square(Radius + SubjectRadius);
 
-			// Distance calculations
-			const FVector ToSubject = SubjectPos - Start;
-			const float ProjOnTrace = FVector::DotProduct(ToSubject, TraceDir);
+		if (FVector::DistSquared(NearestPoint, SubjectPos) < CombinedRadSq)
+		{
+			if (bCheckVisibility)
+			{
+				// Perform visibility check
+				bool bHit = false;
+				FTraceResult VisibilityResult;
 
-			// Initial filtering
-			const float ProjThreshold = SubjectRadius + Radius;
-			if (ProjOnTrace < -ProjThreshold || ProjOnTrace > TraceLength + ProjThreshold) continue;
+				// Calculate the surface point on the subject's sphere
+				const FVector ToSubjectDir = (SubjectPos - CheckOrigin).GetSafeNormal();
+				const FVector SubjectSurfacePoint = SubjectPos - (ToSubjectDir * SubjectRadius);
+				FTraceDrawDebugConfig CheckObstacleDrawDebugConfig;
+				SphereSweepForObstacle(CheckOrigin, SubjectSurfacePoint, CheckRadius, CheckObstacleDrawDebugConfig, bHit, VisibilityResult);
 
-			// Precise distance check (still spherical)
-			const float ClampedProj = FMath::Clamp(ProjOnTrace, 0.0f, TraceLength);
-			const FVector NearestPoint = Start + ClampedProj * TraceDir;
-			const float CombinedRadSq = FMath::Square(Radius + SubjectRadius);
+				if (bHit) return; // Path is blocked, skip this subject
+			}
 
-			if (FVector::DistSquared(NearestPoint, SubjectPos) < CombinedRadSq)
-			{
-				if (bCheckVisibility)
-				{
-					// Perform visibility check
-					bool bHit = false;
-					FTraceResult VisibilityResult;
+			// Create FTraceResult and add to temp results array
+			FTraceResult Result;
+			Result.Subject = Subject;
+			Result.Location = SubjectPos;
+			Result.CachedDistSq = FVector::DistSquared(SortOrigin, SubjectPos);
+			TempResults.Add(Result);
+		}
+	};
 
-					// Calculate the surface point on the subject's sphere
-					const FVector ToSubjectDir = (SubjectPos - CheckOrigin).GetSafeNormal();
-					const FVector SubjectSurfacePoint = SubjectPos - (ToSubjectDir * SubjectRadius);
-					FTraceDrawDebugConfig CheckObstacleDrawDebugConfig;
-					SphereSweepForObstacle(CheckOrigin, SubjectSurfacePoint, CheckRadius, CheckObstacleDrawDebugConfig, bHit, VisibilityResult);
+	const FVector SweepCenter = (Start + End) * 0.5f;
+	const FVector SweepExtent = (End - Start).GetAbs() * 0.5f + FVector(Radius);
 
-					if (bHit) continue; // Path is blocked, skip this subject
-				}
+	// The sweep may cross into neighboring grids, which own the subjects on their side
+	ForEachGridInBox(SweepCenter, SweepExtent, [&](const UNeighborGridComponent* Grid)
+	{
+		// Large subjects on coarse levels, each registered once
+		Grid->ForEachCoarseSubjectInBox(SweepCenter, SweepExtent, ProcessSubject);
 
-				// Create FTraceResult and add to temp results array
-				FTraceResult Result;
-				Result.Subject = Subject;
-				Result.Location = SubjectPos;
-				Result.CachedDistSq = FVector::DistSquared(SortOrigin, SubjectPos);
-				TempResults.Add(Result);
+		// Check subjects in each cell along the sweep path, nearest to Start first
+		Grid->ForEachCellAlongSweep(Start, End, Radius, [&](int32 CellIndex, const FIntVector& Coord)
+		{
+			for (const FGridData& Data : Grid->GetSubjectsAt(CellIndex))
+			{
+				ProcessSubject(Data);
 			}
-		}
-	}
+		});
+	});
 
 	// Sorting logic
 	if (SortMode != ESortMode::None)
@@ -542,9 +571,6 @@ void UNeighborGridComponent::SectorTraceForSubjects
 	const float ExpandedHeight = Height / 2.0f + CellRadius.Z;
 	const FVector Range(ExpandedRadiusXY, ExpandedRadiusXY, ExpandedHeight);
 
-	const FIntVector CoordMin = LocationToCoord(Origin - Range);
-	const FIntVector CoordMax = LocationToCoord(Origin + Range);
-
 	// 跟踪最佳结果（用于KeepCount=1的情况）
 	FTraceResult BestResult;
 	float BestDistSq = (SortMode == ESortMode::NearToFar) ? FLT_MAX : -FLT_MAX;
@@ -553,65 +579,53 @@ void UNeighborGridComponent::SectorTraceForSubjects
 	TArray<FTraceResult> TempResults;
 
 	// 预收集候选格子并按距离排序
-	TArray<FIntVector> CandidateCells;
+	FTraceCandidateCells CandidateCells;
 
-	for (int32 z = CoordMin.Z; z <= CoordMax.Z; ++z)
+	ForEachGridInBox(Origin, Range, [&](const UNeighborGridComponent* Grid)
 	{
-		for (int32 x = CoordMin.X; x <= CoordMax.X; ++x)
+		Grid->ForEachCellInBox(Origin, Range, [&](int32 CellIndex, const FIntVector& Coord)
 		{
-			for (int32 y = CoordMin.Y; y <= CoordMax.Y; ++y)
-			{
-				const FIntVector Coord(x, y, z);
-				if (!IsInside(Coord)) continue;
+			const FVector CellCenter = Grid->CoordToLocation(Coord);
+			const FVector DeltaXY = (CellCenter - Origin) * FVector(1, 1, 0);
+			const float DistSqXY = DeltaXY.SizeSquared();
 
-				const FVector CellCenter = CoordToLocation(Coord);
-				const FVector DeltaXY = (CellCenter - Origin) * FVector(1, 1, 0);
-				const float DistSqXY = DeltaXY.SizeSquared();
+			if (DistSqXY > FMath::Square(ExpandedRadiusXY)) return;
 
-				if (DistSqXY > FMath::Square(ExpandedRadiusXY)) continue;
+			const float VerticalDist = FMath::Abs(CellCenter.Z - Origin.Z);
+			if (VerticalDist > ExpandedHeight) return;
 
-				const float VerticalDist = FMath::Abs(CellCenter.Z - Origin.Z);
-				if (VerticalDist > ExpandedHeight) continue;
+			if (!bFullCircle && DistSqXY > SMALL_NUMBER)
+			{
+				const FVector ToCellDirXY = DeltaXY.GetSafeNormal();
+				const float DotProduct = FVector::DotProduct(NormalizedDir, ToCellDirXY);
 
-				if (!bFullCircle && DistSqXY > SMALL_NUMBER)
+				if (DotProduct < CosHalfAngle)
 				{
-					const FVector ToCellDirXY = DeltaXY.GetSafeNormal();
-					const float DotProduct = FVector::DotProduct(NormalizedDir, ToCellDirXY);
-
-					if (DotProduct < CosHalfAngle)
+					FVector ClosestPoint;
+					float DistToLeftBound = FMath::PointDistToLine(CellCenter, Origin, LeftBoundDir, ClosestPoint);
+					if (DistToLeftBound >= FMath::Max(CellRadius.X, CellRadius.Y))
 					{
-						FVector ClosestPoint;
-						float DistToLeftBound = FMath::PointDistToLine(CellCenter, Origin, LeftBoundDir, ClosestPoint);
-						if (DistToLeftBound >= FMath::Max(CellRadius.X, CellRadius.Y))
+						float DistToRightBound = FMath::PointDistToLine(CellCenter, Origin, RightBoundDir, ClosestPoint);
+						if (DistToRightBound >= FMath::Max(CellRadius.X, CellRadius.Y))
 						{
-							float DistToRightBound = FMath::PointDistToLine(CellCenter, Origin, RightBoundDir, ClosestPoint);
-							if (DistToRightBound >= FMath::Max(CellRadius.X, CellRadius.Y))
+							const FVector CellMin = CellCenter - CellRadius;
+							const FVector CellMax = CellCenter + CellRadius;
+							if (!(CellMin.X <= Origin.X && Origin.X <= CellMax.X &&
+								CellMin.Y <= Origin.Y && Origin.Y <= CellMax.Y))
 							{
-								const FVector CellMin = CoordToLocation(Coord) - CellRadius;
-								const FVector CellMax = CoordToLocation(Coord) + CellRadius;
-								if (!(CellMin.X <= Origin.X && Origin.X <= CellMax.X &&
-									CellMin.Y <= Origin.Y && Origin.Y <= CellMax.Y))
-								{
-									continue;
-								}
+								return;
 							}
 						}
 					}
 				}
-				CandidateCells.Add(Coord);
 			}
-		}
-	}
+
+			CandidateCells.Add({ static_cast<float>(FVector::DistSquared(CellCenter, SortOrigin)), CellIndex, Grid });
+		});
+	});
 
 	// 根据SortMode对格子进行排序
-	if (SortMode != ESortMode::None)
-	{
-		CandidateCells.Sort([this, SortOrigin, SortMode](const FIntVector& A, const FIntVector& B) {
-			const float DistSqA = FVector::DistSquared(CoordToLocation(A), SortOrigin);
-			const float DistSqB = FVector::DistSquared(CoordToLocation(B), SortOrigin);
-			return SortMode == ESortMode::NearToFar ? DistSqA < DistSqB : DistSqA > DistSqB;
-			});
-	}
+	SortTraceCandidateCells(CandidateCells, SortMode);
 
 	// 计算提前终止阈值
 	float ThresholdDistanceSq = FLT_MAX;
@@ -623,125 +637,135 @@ void UNeighborGridComponent::SectorTraceForSubjects
 		ThresholdDistanceSq = FMath::Square(ThresholdDistance);
 	}
 
-	// 遍历检测
-	for (const FIntVector& Coord : CandidateCells)
+	// 单个候选的处理，基础层与粗层共用 | per candidate handling, shared by the base and coarse levels
+	auto ProcessSubject = [&](const FGridData& SubjectData)
 	{
-		// 提前终止检查
-		if (!bNoCountLimit && KeepCount > 0 && SortMode != ESortMode::None)
-		{
-			const float CellDistSq = FVector::DistSquared(CoordToLocation(Coord), SortOrigin);
-			if ((SortMode == ESortMode::NearToFar && CellDistSq > ThresholdDistanceSq) ||
-				(SortMode == ESortMode::FarToNear && CellDistSq < ThresholdDistanceSq))
-			{
-				break;
-			}
-		}
+	const FSubjectHandle Subject = SubjectData.SubjectHandle;
+	if (IgnoreSet.Contains(Subject)) return;
+	if (!Subject.Matches(Filter)) return;
 
-		const auto& CellData = GetCellAt(SubjectCells, Coord);
+	const FVector SubjectPos = FVector(SubjectData.Location);
+	const float SubjectRadius = SubjectData.Radius;
 
-		for (const FGridData& SubjectData : CellData.Subjects)
-		{
-			const FSubjectHandle Subject = SubjectData.SubjectHandle;
-			if (IgnoreSet.Contains(Subject)) continue;
-			if (!Subject.Matches(Filter)) continue;
+	// 高度检查
+	const float VerticalDist = FMath::Abs(SubjectPos.Z - Origin.Z);
+	if (VerticalDist > (Height / 2.0f + SubjectRadius)) return;
 
-			const FVector SubjectPos = FVector(SubjectData.Location);
-			const float SubjectRadius = SubjectData.Radius;
+	// 距离检查
+	const FVector DeltaXY = (SubjectPos - Origin) * FVector(1, 1, 0);
+	const float DistSqXY = DeltaXY.SizeSquared();
+	const float CombinedRadius = Radius + SubjectRadius;
+	if (DistSqXY > FMath::Square(CombinedRadius)) return;
 
-			// 高度检查
-			const float VerticalDist = FMath::Abs(SubjectPos.Z - Origin.Z);
-			if (VerticalDist > (Height / 2.0f + SubjectRadius)) continue;
+	// 角度检查
+	if (!bFullCircle && DistSqXY > SMALL_NUMBER)
+	{
+		const FVector ToSubjectDirXY = DeltaXY.GetSafeNormal();
+		const float DotProduct = FVector::DotProduct(NormalizedDir, ToSubjectDirXY);
+		if (DotProduct < CosHalfAngle) return;
+	}
 
-			// 距离检查
-			const FVector DeltaXY = (SubjectPos - Origin) * FVector(1, 1, 0);
-			const float DistSqXY = DeltaXY.SizeSquared();
-			const float CombinedRadius = Radius + SubjectRadius;
-			if (DistSqXY > FMath::Square(CombinedRadius)) continue;
+	if (bCheckVisibility)
+	{
+		bool bVisibilityHit = false;
+		FTraceResult VisibilityResult;
 
-			// 角度检查
-			if (!bFullCircle && DistSqXY > SMALL_NUMBER)
-			{
-				const FVector ToSubjectDirXY = DeltaXY.GetSafeNormal();
-				const float DotProduct = FVector::DotProduct(NormalizedDir, ToSubjectDirXY);
-				if (DotProduct < CosHalfAngle) continue;
-			}
+		const FVector ToSubjectDir = (SubjectPos - CheckOrigin).GetSafeNormal();
+		const FVector SubjectSurfacePoint = SubjectPos - (ToSubjectDir * SubjectRadius);
+		FTraceDrawDebugConfig CheckObstacleDrawDebugConfig;
+		SphereSweepForObstacle(CheckOrigin, SubjectSurfacePoint, CheckRadius, CheckObstacleDrawDebugConfig, bVisibilityHit, VisibilityResult);
 
-			if (bCheckVisibility)
-			{
-				bool bVisibilityHit = false;
-				FTraceResult VisibilityResult;
+		if (bVisibilityHit) return;
+	}
 
-				const FVector ToSubjectDir = (SubjectPos - CheckOrigin).GetSafeNormal();
-				const FVector SubjectSurfacePoint = SubjectPos - (ToSubjectDir * SubjectRadius);
-				FTraceDrawDebugConfig CheckObstacleDrawDebugConfig;
-				SphereSweepForObstacle(CheckOrigin, SubjectSurfacePoint, CheckRadius, CheckObstacleDrawDebugConfig, bVisibilityHit, VisibilityResult);
+	const float CurrentDistSq = FVector::DistSquared(SortOrigin, SubjectPos);
 
-				if (bVisibilityHit) continue;
-			}
+	if (bSingleResult)
+	{
+		bool bIsBetter = false;
+		if (SortMode == ESortMode::NearToFar)
+		{
+			bIsBetter = (CurrentDistSq < BestDistSq);
+		}
+		else if (SortMode == ESortMode::FarToNear)
+		{
+			bIsBetter = (CurrentDistSq > BestDistSq);
+		}
+		else // ESortMode::None
+		{
+			bIsBetter = true;
+		}
 
-			const float CurrentDistSq = FVector::DistSquared(SortOrigin, SubjectPos);
+		if (bIsBetter)
+		{
+			BestResult.Subject = Subject;
+			BestResult.Location = SubjectPos;
+			BestResult.CachedDistSq = CurrentDistSq;
+			BestDistSq = CurrentDistSq;
 
-			if (bSingleResult)
+			// 更新阈值
+			if (!bNoCountLimit && KeepCount > 0)
 			{
-				bool bIsBetter = false;
-				if (SortMode == ESortMode::NearToFar)
-				{
-					bIsBetter = (CurrentDistSq < BestDistSq);
-				}
-				else if (SortMode == ESortMode::FarToNear)
-				{
-					bIsBetter = (CurrentDistSq > BestDistSq);
-				}
-				else // ESortMode::None
-				{
-					bIsBetter = true;
-				}
-
-				if (bIsBetter)
-				{
-					BestResult.Subject = Subject;
-					BestResult.Location = SubjectPos;
-					BestResult.CachedDistSq = CurrentDistSq;
-					BestDistSq = CurrentDistSq;
-
-					// 更新阈值
-					if (!bNoCountLimit && KeepCount > 0)
-					{
-						const float MaxCellSize = CellSize.GetMax();
-						const float ThresholdDistance = FMath::Sqrt(BestDistSq) + 2.0f * MaxCellSize * FMath::Sqrt(2.0f);
-						ThresholdDistanceSq = FMath::Square(ThresholdDistance);
-					}
-				}
+				const float MaxCellSize = CellSize.GetMax();
+				const float ThresholdDistance = FMath::Sqrt(BestDistSq) + 2.0f * MaxCellSize * FMath::Sqrt(2.0f);
+				ThresholdDistanceSq = FMath::Square(ThresholdDistance);
 			}
-			else
+		}
+	}
+	else
+	{
+		FTraceResult Result;
+		Result.Subject = Subject;
+		Result.Location = SubjectPos;
+		Result.CachedDistSq = CurrentDistSq;
+		TempResults.Add(Result);
+
+		// 当收集到足够结果时更新阈值
+		if (!bNoCountLimit && KeepCount > 0 && SortMode != ESortMode::None && TempResults.Num() >= KeepCount)
+		{
+			// 找到当前第KeepCount个最佳结果的距离
+			float CurrentThresholdDistSq = 0.0f;
+			if (SortMode == ESortMode::NearToFar)
 			{
-				FTraceResult Result;
-				Result.Subject = Subject;
-				Result.Location = SubjectPos;
-				Result.CachedDistSq = CurrentDistSq;
-				TempResults.Add(Result);
-
-				// 当收集到足够结果时更新阈值
-				if (!bNoCountLimit && KeepCount > 0 && SortMode != ESortMode::None && TempResults.Num() >= KeepCount)
-				{
-					// 找到当前第KeepCount个最佳结果的距离
-					float CurrentThresholdDistSq = 0.0f;
-					if (SortMode == ESortMode::NearToFar)
-					{
-						CurrentThresholdDistSq = TempResults[KeepCount - 1].CachedDistSq;
-					}
-					else // FarToNear
-					{
-						CurrentThresholdDistSq = TempResults.Last().CachedDistSq;
-					}
+				CurrentThresholdDistSq = TempResults[KeepCount - 1].CachedDistSq;
+			}
+			else // FarToNear
+			{
+				CurrentThresholdDistSq = TempResults.Last().CachedDistSq;
+			}
 
-					// 更新阈值
-					const float MaxCellSize = CellSize.GetMax();
-					const float ThresholdDistance = FMath::Sqrt(CurrentThresholdDistSq) + 2.0f * MaxCellSize * FMath::Sqrt(2.0f);
-					ThresholdDistanceSq = FMath::Square(ThresholdDistance);
-				}
+			// 更新阈值
+			const float MaxCellSize = CellSize.GetMax();
+			const float ThresholdDistance = FMath::Sqrt(CurrentThresholdDistSq) + 2.0f * MaxCellSize * FMath::Sqrt(2.0f);
+			ThresholdDistanceSq = FMath::Square(ThresholdDistance);
+		}
+	}
+	};
+
+	// 粗层的大体型单位各只出现一次，先处理以尽早收紧阈值 | large subjects on coarse levels appear once each, visit them first to tighten the threshold early
+	ForEachGridInBox(Origin, Range, [&](const UNeighborGridComponent* Grid)
+	{
+		Grid->ForEachCoarseSubjectInBox(Origin, Range, ProcessSubject);
+	});
+
+	// 遍历检测
+	for (const FTraceCandidateCell& Cell : CandidateCells)
+	{
+		// 提前终止检查
+		if (!bNoCountLimit && KeepCount > 0 && SortMode != ESortMode::None)
+		{
+			const float CellDistSq = Cell.SortDistSq;
+			if ((SortMode == ESortMode::NearToFar && CellDistSq > ThresholdDistanceSq) ||
+				(SortMode == ESortMode::FarToNear && CellDistSq < ThresholdDistanceSq))
+			{
+				break;
 			}
 		}
+
+		for (const FGridData& SubjectData : Cell.Grid->GetSubjectsAt(Cell.CellIndex))
+		{
+			ProcessSubject(SubjectData);
+		}
 	}
 
 	// 处理结果
@@ -832,7 +856,6 @@ void UNeighborGridComponent::SphereSweepForObstacle
 	Result = FTraceResult();
 	float ClosestHitDistSq = FLT_MAX;
 
-	TArray<FIntVector> PathCells = SphereSweepForCells(Start, End, Radius);
 	const FVector CellExtent = CellSize * 0.5f;
 	const float CellMaxRadius = CellExtent.GetMax(); // 最长半轴作为单元包围球半径
 
@@ -848,10 +871,11 @@ void UNeighborGridComponent::SphereSweepForObstacle
 			}
 		};
 
-	for (const FIntVector& Coord : PathCells)
+	// 沿扫掠路径由近到远访问格子，返回false提前结束 | visit cells nearest first, returning false stops the walk
+	ForEachCellAlongSweep(Start, End, Radius, [&](int32 CellIndex, const FIntVector& Coord) -> bool
 	{
-		const auto& ObstacleCell = GetCellAt(ObstacleCells, Coord);
-		const auto& StaticObstacleCell = GetCellAt(StaticObstacleCells, Coord);
+		const auto& ObstacleCell = ObstacleCells[CellIndex];
+		const auto& StaticObstacleCell = StaticObstacleCells[CellIndex];
 
 		// 检查球形障碍物
 		auto CheckSphereCollision = [&](const FGridData& GridData)
@@ -1035,10 +1059,12 @@ void UNeighborGridComponent::SphereSweepForObstacle
 
 			if (MinPossibleDist > 0 && (MinPossibleDist * MinPossibleDist) > ClosestHitDistSq)
 			{
-				break; // 后续单元不可能更近，提前退出循环
+				return false; // 后续单元不可能更近，提前退出循环
 			}
 		}
-	}
+
+		return true;
+	});
 
 	if (DrawDebugConfig.bDrawDebugShape)
 	{
@@ -1083,39 +1109,114 @@ void UNeighborGridComponent::SphereSweepForObstacle
 
 //--------------------------------------------Avoidance---------------------------------------------------------------
 
-void UNeighborGridComponent::Update()
+template<typename ForEachSubjectType>
+void UNeighborGridComponent::UpdateSubjects(const int32 NumSubjects, ForEachSubjectType&& ForEachSubject)
 {
-	TRACE_CPUPROFILER_EVENT_SCOPE_STR("RVO2 Update");
+	// 增量模式下单位格子跨帧保留，只重置障碍物格子 | incremental mode keeps subject cells, only obstacle cells are reset
+	const bool bIncremental = bIncrementalUpdate && BuildMode == EGridBuildMode::SpinLock && ActiveStorage == ENeighborGridStorage::Dense && CoarseLevels.IsEmpty();
 
 	{
 		TRACE_CPUPROFILER_EVENT_SCOPE_STR("ResetCells");
 
+		const bool bKeepSubjectCells = bIncrementalActive;
+
 		ParallelFor(OccupiedCellsQueues.Num(), [&](int32 Index)
 		{
 			int32 CellIndex;
 
 			while (OccupiedCellsQueues[Index].Dequeue(CellIndex))                            
 			{
-				auto& SubjectCell = SubjectCells[CellIndex];
-				SubjectCell.Empty();
+				if (!bKeepSubjectCells)
+				{
+					auto& SubjectCell = SubjectCells[CellIndex];
+					SubjectCell.Empty();
+				}
 
 				auto& ObstacleCell = ObstacleCells[CellIndex];
 				ObstacleCell.Empty();
 			}			
 		});
-	}
 
-	AMechanism* Mechanism = GetMechanism();
+		// 粗层格子很少，直接整体扫描 | coarse levels are tiny, sweep them whole
+		for (FNeighborGridLevel& Level : CoarseLevels)
+		{
+			if (Level.MaxRadiusBits == 0) continue;
+
+			for (FNeighborGridCell& Cell : Level.Cells)
+			{
+				if (Cell.bRegistered)
+				{
+					Cell.Empty();
+				}
+			}
+
+			Level.MaxRadiusBits = 0;
+		}
+
+		if (bIncrementalActive && !bIncremental)
+		{
+			for (const int32 CellIndex : IncrementalSubjectCells)
+			{
+				SubjectCells[CellIndex].Empty();
+			}
+
+			IncrementalSubjectCells.Reset();
+			MultiRegisteredCells.Reset();
+			IncrementalEntryCount = 0;
+		}
+		else if (bIncrementalActive && !MultiRegisteredCells.IsEmpty())
+		{
+			// 多格注册的单位每帧重新插入，先清掉上一帧的条目 | multi cell subjects are reinserted every frame, drop last frame's entries first
+			SweepStaleSubjects(MultiRegisteredCells, false, true);
+			MultiRegisteredCells.Reset();
+		}
+
+		bIncrementalActive = bIncremental;
+		++IncrementalStamp;
+	}
 
 	{
 		TRACE_CPUPROFILER_EVENT_SCOPE_STR("RegisterSubject");
 
-		auto Chain = Mechanism->EnchainSolid(RegisterSubjectFilter);
-		UBattleFrameFunctionLibraryRT::CalculateThreadsCountAndBatchSize(Chain->IterableNum(), MaxThreadsAllowed, MinBatchSizeAllowed, ThreadsCount, BatchSize);
+		UBattleFrameFunctionLibraryRT::CalculateThreadsCountAndBatchSize(NumSubjects, MaxThreadsAllowed, MinBatchSizeAllowed, ThreadsCount, BatchSize);
+
+		ReserveSparseCells(NumSubjects, true);
+
+		ActiveBuildMode = BuildMode;
+		const bool bCountingSort = (ActiveBuildMode == EGridBuildMode::CountingSort);
+
+		// 计数排序模式：先收集(格子,数据)条目并统计直方图，之后再前缀和+分散写入 | Counting sort mode gathers entries and the histogram first
+		std::atomic<int32> EntryCursor{ 0 };
+		TQueue<TPair<int32, FGridData>, EQueueMode::Mpsc> OverflowEntries;// entries beyond last frame's capacity, rare
+
+		if (bCountingSort)
+		{
+			const int32 Capacity = FMath::Max(NumSubjects, EntryData.Num());
+			EntryData.SetNum(Capacity);
+			EntryCellIndices.SetNum(Capacity);
+		}
 
 		// 定义注册单元格的lambda函数
 		auto RegisterCell = [&](int32 CellIndex, const FGridData& GridData) 
 		{
+			if (bCountingSort)
+			{
+				FPlatformAtomics::InterlockedIncrement(&CellCounts[CellIndex]);
+
+				const int32 Slot = EntryCursor.fetch_add(1, std::memory_order_relaxed);
+
+				if (LIKELY(Slot < EntryData.Num()))
+				{
+					EntryData[Slot] = GridData;
+					EntryCellIndices[Slot] = CellIndex;
+				}
+				else
+				{
+					OverflowEntries.Enqueue(TPair<int32, FGridData>(CellIndex, GridData));
+				}
+				return;
+			}
+
 			bool bShouldRegister = false;
 			auto& Cell = SubjectCells[CellIndex];
 
@@ -1130,75 +1231,200 @@ void UNeighborGridComponent::Update()
 
 			if (bShouldRegister) 
 			{
-				OccupiedCellsQueues[CellIndex % MaxThreadsAllowed].Enqueue(CellIndex);
+				if (bIncremental)
+				{
+					NewIncrementalCells.Enqueue(CellIndex);
+				}
+				else
+				{
+					OccupiedCellsQueues[CellIndex % MaxThreadsAllowed].Enqueue(CellIndex);
+				}
 			}
 		};
 
-		Chain->OperateConcurrently([&](
-			FSolidSubjectHandle Subject,
-			FLocated& Located,
-			FScaled& Scaled,
-			FCollider& Collider,
-			FGridData& GridData)
+		std::atomic<int32> NumMoved{ 0 };
+		std::atomic<int32> NumStationary{ 0 };
+		std::atomic<int32> NumOutside{ 0 };// moved out of the grid, no entry expected
+		std::atomic<int32> EntryDelta{ 0 };
+
+		// 未换格的单位原地刷新，换格的单位从旧格移除再插入新格 | subjects that stayed refresh their entry in place, the rest move between cells
+		auto UpdateIncrementalCell = [&](int32 CellIndex, const FGridData& GridData, FGridOwner& GridOwner)
 		{
-			if (Subject.HasTrait<FTracing>()) 
+			const int32 PreviousCellIndex = GridOwner.CellIndex;
+
+			if (LIKELY(CellIndex != INDEX_NONE && CellIndex == PreviousCellIndex))
 			{
-				auto& Tracing = Subject.GetTraitRef<FTracing>();
-				Tracing.Lock();
-				Tracing.NeighborGrid = this;
-				Tracing.Unlock();
-			}
+				auto& Cell = SubjectCells[CellIndex];
+
+				Cell.Lock();
+				FGridData* Entry = Cell.Subjects.FindByKey(GridData.SubjectHash);
+				if (LIKELY(Entry))
+				{
+					*Entry = GridData;
+				}
+				Cell.Unlock();
+
+				if (UNLIKELY(!Entry))// swept while the subject was out of the filter
+				{
+					RegisterCell(CellIndex, GridData);
+					EntryDelta.fetch_add(1, std::memory_order_relaxed);
+				}
+
+				NumStationary.fetch_add(1, std::memory_order_relaxed);
+				return;
+			}
+
+			if (PreviousCellIndex >= 0 && PreviousCellIndex < SubjectCells.Num())
+			{
+				auto& PreviousCell = SubjectCells[PreviousCellIndex];
+
+				PreviousCell.Lock();
+				const int32 NumRemoved = PreviousCell.Subjects.RemoveAllSwap([&](const FGridData& Data) { return Data.SubjectHash == GridData.SubjectHash; });
+				PreviousCell.Unlock();
+
+				EntryDelta.fetch_sub(NumRemoved, std::memory_order_relaxed);
+			}
+
+			GridOwner.CellIndex = CellIndex;
+
+			if (CellIndex != INDEX_NONE)
+			{
+				RegisterCell(CellIndex, GridData);
+				EntryDelta.fetch_add(1, std::memory_order_relaxed);
+			}
+			else
+			{
+				NumOutside.fetch_add(1, std::memory_order_relaxed);
+			}
+
+			NumMoved.fetch_add(1, std::memory_order_relaxed);
+		};
+
+		const bool bHierarchical = !CoarseLevels.IsEmpty();
+
+		auto RegisterCoarse = [&](int32 LevelIndex, const FVector& Location, const FGridData& GridData)
+		{
+			FNeighborGridLevel& Level = CoarseLevels[LevelIndex];
+			auto& Cell = Level.Cells[LevelLocationToIndex(Level, Location)];
+
+			Cell.Lock();
+			Cell.Subjects.Add(GridData);
+			Cell.bRegistered = true;
+			Cell.Unlock();
+
+			Level.NoteRadius(GridData.Radius);
+		};
+
+		auto RegisterSubject = [&](
+			const FSubjectHandle& Subject,
+			FLocated& Located,
+			FScaled& Scaled,
+			FCollider& Collider,
+			FGridData& GridData,
+			FGridOwner* GridOwnerPtr)
+		{
+			// 还没有FGridOwner的单位本帧按临时条目注册，并延迟补上特征 | a subject without FGridOwner yet is registered as a transient entry this frame and gets the trait deferred
+			FGridOwner TransientOwner;
+			const bool bTransient = !GridOwnerPtr;
+
+			if (UNLIKELY(bTransient))
+			{
+				TransientOwner.NeighborGrid = this;
+				GridOwnerPtr = &TransientOwner;
+			}
+
+			FGridOwner& GridOwner = *GridOwnerPtr;
+
+			// 多网格时只注册归属本网格的单位 | with several grids, only the subjects owned by this grid are registered here
+			if (UNLIKELY(GridOwner.NeighborGrid != this))
+			{
+				if (bPartitioned) return;
+
+				GridOwner.NeighborGrid = this;
+				GridOwner.CellIndex = INDEX_NONE;
+			}
+
+			if (Subject.HasTrait<FTracing>()) 
+			{
+				auto& Tracing = Subject.GetTraitRef<FTracing, EParadigm::Unsafe>();
+				Tracing.Lock();
+				Tracing.NeighborGrid = this;
+				Tracing.Unlock();
+			}
 
 			const FVector& Location = Located.Location;
 			GridData.Location = FVector3f(Location);
 			GridData.Radius = Collider.Radius * Scaled.Scale;
+			GridOwner.GridStamp = IncrementalStamp;
 
 			// 处理Avoidance逻辑
 			if (Subject.HasTrait<FAvoidance>() && Subject.HasTrait<FAvoiding>()) 
 			{
-				auto& Avoidance = Subject.GetTraitRef<FAvoidance>();
-				auto& Avoiding = Subject.GetTraitRef<FAvoiding>();
+				auto& Avoidance = Subject.GetTraitRef<FAvoidance, EParadigm::Unsafe>();
+				auto& Avoiding = Subject.GetTraitRef<FAvoiding, EParadigm::Unsafe>();
 
 				Avoiding.Position = RVO::Vector2(Location.X, Location.Y);
 				Avoiding.Radius = GridData.Radius * Avoidance.AvoidDistMult;
 
 				if (Subject.HasTrait<FMoving>()) 
 				{
-					auto& Moving = Subject.GetTraitRef<FMoving>();
+					auto& Moving = Subject.GetTraitRef<FMoving, EParadigm::Unsafe>();
 					Avoiding.bCanAvoid = !Moving.bLaunching && !Moving.bPushedBack;
 				}
 			}
 
-			// 使用统一的单元格注册逻辑
-			if (!Subject.HasFlag(RegisterMultipleFlag)) 
+			// 多层网格：按半径选层，每个单位只注册一次 | hierarchical grid: one insert at the level matching the radius
+			const int32 CoarseLevel = bHierarchical ? PickCoarseLevel(GridData.Radius) : INDEX_NONE;
+
+			if (CoarseLevel != INDEX_NONE)
 			{
-				if (IsInside(Location)) 
+				if (IsInside(Location))
 				{
-					RegisterCell(LocationToIndex(Location), GridData);
+					RegisterCoarse(CoarseLevel, Location, GridData);
 				}
 			}
-			else 
+			else if (bHierarchical || !Subject.HasFlag(RegisterMultipleFlag)) 
 			{
-				const FVector Range = FVector(GridData.Radius);
-				const FIntVector CoordMin = LocationToCoord(Location - Range);
-				const FIntVector CoordMax = LocationToCoord(Location + Range);
+				const int32 CellIndex = FindOrAddCellIndex(LocationToCoord(Location));
 
-				for (int32 z = CoordMin.Z; z <= CoordMax.Z; ++z) 
+				if (bIncremental && !bTransient)
 				{
-					for (int32 y = CoordMin.Y; y <= CoordMax.Y; ++y) 
-					{
-						for (int32 x = CoordMin.X; x <= CoordMax.X; ++x) 
-						{
-							const FIntVector CurrentCoord(x, y, z);
+					UpdateIncrementalCell(CellIndex, GridData, GridOwner);
+				}
+				else if (CellIndex != INDEX_NONE) 
+				{
+					GridOwner.CellIndex = INDEX_NONE;
+					RegisterCell(CellIndex, GridData);
 
-							if (IsInside(CurrentCoord)) 
-							{
-								RegisterCell(CoordToIndex(CurrentCoord), GridData);
-							}
-						}
+					// 临时条目与多格条目一样在下一帧注册前清除 | transient entries are dropped before the next registration, like multi cell ones
+					if (bIncremental)
+					{
+						MultiRegisteredCellsQueue.Enqueue(CellIndex);
 					}
 				}
 			}
+			else 
+			{
+				// 多格注册的单位每帧重新插入，旧条目在下一帧注册前清除 | multi cell subjects are reinserted every frame, their old entries are dropped before the next registration
+				GridOwner.CellIndex = FGridOwner::MultiCellIndex;
+
+				ForEachCellInBox<true>(Location, FVector(GridData.Radius), [&](int32 CellIndex, const FIntVector& Coord)
+				{
+					RegisterCell(CellIndex, GridData);
+
+					if (bIncremental)
+					{
+						MultiRegisteredCellsQueue.Enqueue(CellIndex);
+					}
+				});
+			}
+
+			if (UNLIKELY(bTransient))
+			{
+				// 下一帧清理临时条目时按多格单位处理，之后走正常的增量注册 | next frame's sweep drops the transient entry as a multi cell one, registration is incremental from then on
+				TransientOwner.CellIndex = FGridOwner::MultiCellIndex;
+				Subject.SetTraitDeferred(TransientOwner);
+			}
 
 			if (Collider.bDrawDebugShape)
 			{
@@ -1209,10 +1435,79 @@ void UNeighborGridComponent::Update()
 				Config.LineThickness = 0.f;
 				ABattleFrameBattleControl::GetInstance()->DebugSphereQueue.Enqueue(Config);
 			}
+		};
 
-		}, ThreadsCount, BatchSize);
+		ForEachSubject(RegisterSubject);
+
+		if (bIncremental)
+		{
+			TRACE_CPUPROFILER_EVENT_SCOPE_STR("SweepStaleSubjects");
+
+			int32 CellIndex;
+
+			while (NewIncrementalCells.Dequeue(CellIndex))
+			{
+				IncrementalSubjectCells.Add(CellIndex);
+			}
+
+			// 条目数对不上说明有单位离开了过滤器(死亡、移除)，整体清理一次 | a count mismatch means subjects left the filter, sweep every cell once
+			IncrementalEntryCount += EntryDelta.load();
+			const int32 ExpectedEntries = NumStationary.load() + NumMoved.load() - NumOutside.load();
+
+			if (IncrementalEntryCount != ExpectedEntries)
+			{
+				SweepStaleSubjects(IncrementalSubjectCells, true);
+				IncrementalEntryCount = ExpectedEntries;
+			}
+
+			while (MultiRegisteredCellsQueue.Dequeue(CellIndex))
+			{
+				MultiRegisteredCells.Add(CellIndex);
+			}
+
+			// 去重，每个格子只由一个线程清理 | unique, so every cell is swept by exactly one worker
+			Algo::Sort(MultiRegisteredCells);
+
+			int32 NumUniqueCells = 0;
+
+			for (int32 i = 0; i < MultiRegisteredCells.Num(); ++i)
+			{
+				if (i == 0 || MultiRegisteredCells[i] != MultiRegisteredCells[NumUniqueCells - 1])
+				{
+					MultiRegisteredCells[NumUniqueCells++] = MultiRegisteredCells[i];
+				}
+			}
+
+			MultiRegisteredCells.SetNum(NumUniqueCells);
+		}
+
+		MovedSubjectsCount = bIncremental ? NumMoved.load() : NumSubjects;
+		StationarySubjectsCount = NumStationary.load();
+
+		TRACE_COUNTER_SET(BattleFrame_GridMovedSubjects, MovedSubjectsCount);
+		TRACE_COUNTER_SET(BattleFrame_GridStationarySubjects, StationarySubjectsCount);
+
+		if (bCountingSort)
+		{
+			int32 NumEntries = FMath::Min(EntryCursor.load(), EntryData.Num());
+
+			TPair<int32, FGridData> Overflow;
+
+			while (OverflowEntries.Dequeue(Overflow))
+			{
+				EntryCellIndices.Add(Overflow.Key);
+				EntryData.Add(Overflow.Value);
+				NumEntries++;
+			}
+
+			BuildSortedSubjects(NumEntries);
+		}
 	}
+}
 
+void UNeighborGridComponent::UpdateObstacles()
+{
+	AMechanism* Mechanism = GetMechanism();
 
 	{
 		TRACE_CPUPROFILER_EVENT_SCOPE_STR("RegisterSphereObstacles");
@@ -1220,15 +1515,23 @@ void UNeighborGridComponent::Update()
 		auto Chain = Mechanism->EnchainSolid(RegisterSphereObstaclesFilter);
 		UBattleFrameFunctionLibraryRT::CalculateThreadsCountAndBatchSize(Chain->IterableNum(), MaxThreadsAllowed, MinBatchSizeAllowed, ThreadsCount, BatchSize);
 
+		ReserveSparseCells(Chain->IterableNum() * 4, false);
+
 		Chain->OperateConcurrently([&](FSolidSubjectHandle Subject, FSphereObstacle& SphereObstacle, FLocated& Located, FCollider& Collider, FAvoidance& Avoidance, FAvoiding& Avoiding, FGridData& GridData)
 		{
-			if (SphereObstacle.bStatic && SphereObstacle.bRegistered) return; // if static, we only register once
+			if (SphereObstacle.bStatic && (bPartitioned ? StaticObstacleFootprints.Contains(GridData.SubjectHash) : SphereObstacle.bRegistered)) return; // if static, we only register once
 
 			const auto& Location = Located.Location;
 
-			SphereObstacle.Lock();
-			SphereObstacle.NeighborGrid = this;// when sphere obstacle override speed limit, it uses this neighbor grid instance.
-			SphereObstacle.Unlock();
+			// 多网格时障碍物注册进它覆盖的每个网格，由中心所在的网格负责限速 | with several grids the obstacle goes into every grid it reaches, the one holding its center serves speed limits
+			if (bPartitioned && Bounds.ComputeSquaredDistanceToPoint(Location) > FMath::Square(Collider.Radius)) return;
+
+			if (!bPartitioned || !SphereObstacle.NeighborGrid || Bounds.IsInsideOrOn(Location))
+			{
+				SphereObstacle.Lock();
+				SphereObstacle.NeighborGrid = this;// when sphere obstacle override speed limit, it uses this neighbor grid instance.
+				SphereObstacle.Unlock();
+			}
 
 			GridData.Location = FVector3f(Location);
 			GridData.Radius = Collider.Radius;
@@ -1242,6 +1545,8 @@ void UNeighborGridComponent::Update()
 			const FIntVector CoordMin = LocationToCoord(Location - Range);
 			const FIntVector CoordMax = LocationToCoord(Location + Range);
 
+			bool bDroppedCell = false;// sparse table ran out of cells, a static obstacle retries next frame
+
 			for (int32 i = CoordMin.Z; i <= CoordMax.Z; ++i)
 			{
 				for (int32 j = CoordMin.Y; j <= CoordMax.Y; ++j)
@@ -1254,7 +1559,13 @@ void UNeighborGridComponent::Update()
 
 						bool bShouldRegister = false;
 
-						int32 CellIndex = CoordToIndex(CurrentCoord);
+						const int32 CellIndex = FindOrAddCellIndex(CurrentCoord);
+
+						if (UNLIKELY(CellIndex == INDEX_NONE))
+						{
+							bDroppedCell = true;
+							continue;
+						}
 
 						if (!SphereObstacle.bStatic)
 						{
@@ -1272,15 +1583,25 @@ void UNeighborGridComponent::Update()
 						else
 						{
 							auto& StaticObstacleCell = StaticObstacleCells[CellIndex];
+							bool bAdded = false;
 
 							StaticObstacleCell.Lock();
-							StaticObstacleCell.Subjects.Add(GridData);
+							if (!StaticObstacleCell.Subjects.ContainsByPredicate([&](const FGridData& Data) { return Data.SubjectHash == GridData.SubjectHash; }))
+							{
+								StaticObstacleCell.Subjects.Add(GridData);
+								bAdded = true;
+							}
 							if (!StaticObstacleCell.bRegistered)
 							{
 								bShouldRegister = true;
 								StaticObstacleCell.bRegistered = true;
 							}
 							StaticObstacleCell.Unlock();
+
+							if (bAdded)
+							{
+								StaticObstacleRegistrations.Enqueue(TPair<uint32, int32>(GridData.SubjectHash, CellIndex));
+							}
 						}
 
 						if (bShouldRegister && !SphereObstacle.bStatic)
@@ -1291,7 +1612,7 @@ void UNeighborGridComponent::Update()
 				}
 			}
 
-			SphereObstacle.bRegistered = true;
+			SphereObstacle.bRegistered = !bDroppedCell;
 
 		}, ThreadsCount, BatchSize);
 	}
@@ -1302,9 +1623,11 @@ void UNeighborGridComponent::Update()
 		auto Chain = Mechanism->EnchainSolid(RegisterBoxObstaclesFilter);
 		UBattleFrameFunctionLibraryRT::CalculateThreadsCountAndBatchSize(Chain->IterableNum(), MaxThreadsAllowed, 1, ThreadsCount, BatchSize);
 
+		ReserveSparseCells(Chain->IterableNum() * 16, false);
+
 		Chain->OperateConcurrently([&](FSolidSubjectHandle Subject, FBoxObstacle& BoxObstacle, FGridData& GridData)
 		{
-			if (BoxObstacle.bStatic && BoxObstacle.bRegistered) return; // if static, we only register once
+			if (BoxObstacle.bStatic && (bPartitioned ? StaticObstacleFootprints.Contains(GridData.SubjectHash) : BoxObstacle.bRegistered)) return; // if static, we only register once
 
 			const auto& Location = FVector(BoxObstacle.point_.x(), BoxObstacle.point_.y(), BoxObstacle.pointZ_);
 			GridData.Location = FVector3f(Location);
@@ -1315,8 +1638,18 @@ void UNeighborGridComponent::Update()
 			const float StartZ = Location.Z;
 			const float EndZ = StartZ + ObstacleHeight;
 
-			TSet<FIntVector> AllGridCells;
-			TArray<FIntVector> AllGridCellsArray;
+			if (bPartitioned)
+			{
+				FBox ObstacleBox(ForceInit);
+				ObstacleBox += Location;
+				ObstacleBox += FVector(NextLocation.x(), NextLocation.y(), EndZ);
+
+				if (!ObstacleBox.ExpandBy(CellSize.GetMax() * 2.0f).Intersect(Bounds)) return;
+			}
+
+			// 以格子索引收集，排序去重代替TSet | gather plain cell indices, sort and unique instead of hashing coords
+			TArray<int32, TInlineAllocator<256>> AllCellIndices;
+			bool bDroppedCell = false;// sparse table ran out of cells, a static obstacle retries next frame
 
 			float CurrentLayerZ = StartZ;
 
@@ -1328,27 +1661,43 @@ void UNeighborGridComponent::Update()
 
 				// 使用最大轴尺寸的2倍作为扫描半径
 				const float SweepRadius = CellSize.GetMax() * 2.0f;
-				auto LayerCells = SphereSweepForCells(LayerCurrentPoint, LayerNextPoint, SweepRadius);
-
-				for (const auto& Coord : LayerCells)
+				VisitSweepStamps(LayerCurrentPoint, LayerNextPoint, SweepRadius, [&](const FIntVector& Coord)
 				{
-					AllGridCells.Add(Coord);
-				}
+					if (LIKELY(IsInside(Coord)))
+					{
+						const int32 CellIndex = FindOrAddCellIndex(Coord);
+
+						if (LIKELY(CellIndex != INDEX_NONE))
+						{
+							AllCellIndices.Add(CellIndex);
+						}
+						else
+						{
+							bDroppedCell = true;
+						}
+					}
+				});
 
 				CurrentLayerZ += CellSize.Z; // 使用Z轴尺寸作为步长
 			}
 
-			AllGridCellsArray = AllGridCells.Array();
+			Algo::Sort(AllCellIndices);
 
-			ParallelFor(AllGridCellsArray.Num(), [&](int32 Index)
-				{
-					const FIntVector& CurrentCoord = AllGridCellsArray[Index];
+			int32 NumUniqueCells = 0;
 
-					if (UNLIKELY(!IsInside(CurrentCoord))) return;
+			for (int32 i = 0; i < AllCellIndices.Num(); ++i)
+			{
+				if (i == 0 || AllCellIndices[i] != AllCellIndices[NumUniqueCells - 1])
+				{
+					AllCellIndices[NumUniqueCells++] = AllCellIndices[i];
+				}
+			}
 
+			ParallelFor(NumUniqueCells, [&](int32 Index)
+				{
 					bool bShouldRegister = false;
 
-					int32 CellIndex = CoordToIndex(CurrentCoord);
+					int32 CellIndex = AllCellIndices[Index];
 
 					if (!BoxObstacle.bStatic)
 					{
@@ -1366,15 +1715,25 @@ void UNeighborGridComponent::Update()
 					else
 					{
 						auto& StaticObstacleCell = StaticObstacleCells[CellIndex];
+						bool bAdded = false;
 
 						StaticObstacleCell.Lock();
-						StaticObstacleCell.Subjects.Add(GridData);
+						if (!StaticObstacleCell.Subjects.ContainsByPredicate([&](const FGridData& Data) { return Data.SubjectHash == GridData.SubjectHash; }))
+						{
+							StaticObstacleCell.Subjects.Add(GridData);
+							bAdded = true;
+						}
 						if (!StaticObstacleCell.bRegistered)
 						{
 							bShouldRegister = true;
 							StaticObstacleCell.bRegistered = true;
 						}
 						StaticObstacleCell.Unlock();
+
+						if (bAdded)
+						{
+							StaticObstacleRegistrations.Enqueue(TPair<uint32, int32>(GridData.SubjectHash, CellIndex));
+						}
 					}
 
 					if (bShouldRegister && !BoxObstacle.bStatic)
@@ -1384,9 +1743,567 @@ void UNeighborGridComponent::Update()
 
 				});
 
-			BoxObstacle.bRegistered = true;
+			BoxObstacle.bRegistered = !bDroppedCell;
+
+		}, ThreadsCount, BatchSize);
+	}
+
+	RebuildStaticObstacleCaches();
+}
+
+void UNeighborGridComponent::Update()
+{
+	TRACE_CPUPROFILER_EVENT_SCOPE_STR("RVO2 Update");
+
+	auto Chain = GetMechanism()->EnchainSolid(RegisterSubjectFilter);
 
+	UpdateSubjects(Chain->IterableNum(), [&](const auto& RegisterSubject)
+	{
+		Chain->OperateConcurrently([&](FSolidSubjectHandle Subject, FLocated& Located, FScaled& Scaled, FCollider& Collider, FGridData& GridData)
+		{
+			RegisterSubject(FSubjectHandle(Subject), Located, Scaled, Collider, GridData, Subject.GetTraitPtr<FGridOwner, EParadigm::Unsafe>());
 		}, ThreadsCount, BatchSize);
+	});
+
+	UpdateObstacles();
+}
+
+void UNeighborGridComponent::UpdateOwnedSubjects()
+{
+	UpdateSubjects(OwnedSubjects.Num(), [&](const auto& RegisterSubject)
+	{
+		ParallelFor(ThreadsCount, [&](int32 ThreadIndex)
+		{
+			const int32 Begin = ThreadIndex * BatchSize;
+			const int32 End = FMath::Min(Begin + BatchSize, OwnedSubjects.Num());
+
+			for (int32 i = Begin; i < End; ++i)
+			{
+				const FSubjectHandle& Subject = OwnedSubjects[i];
+
+				RegisterSubject(Subject,
+					*Subject.GetTraitPtr<FLocated, EParadigm::Unsafe>(),
+					*Subject.GetTraitPtr<FScaled, EParadigm::Unsafe>(),
+					*Subject.GetTraitPtr<FCollider, EParadigm::Unsafe>(),
+					*Subject.GetTraitPtr<FGridData, EParadigm::Unsafe>(),
+					Subject.GetTraitPtr<FGridOwner, EParadigm::Unsafe>());
+			}
+		});
+	});
+}
+
+void UNeighborGridComponent::UpdateGrids(const TArray<UNeighborGridComponent*>& Grids)
+{
+	TArray<UNeighborGridComponent*, TInlineAllocator<16>> ValidGrids;
+
+	for (UNeighborGridComponent* Grid : Grids)
+	{
+		if (IsValid(Grid))
+		{
+			ValidGrids.Add(Grid);
+		}
 	}
+
+	if (UNLIKELY(ValidGrids.IsEmpty())) return;
+
+	const bool bSeveralGrids = ValidGrids.Num() > 1;
+
+	for (UNeighborGridComponent* Grid : ValidGrids)
+	{
+		Grid->GetBounds();// refreshed here on the game thread, read by the concurrent stages below
+		Grid->bPartitioned = bSeveralGrids;
+		Grid->OtherGrids.Reset();
+
+		for (UNeighborGridComponent* Other : ValidGrids)
+		{
+			if (Other != Grid)
+			{
+				Grid->OtherGrids.Add(Other);
+			}
+		}
+	}
+
+	if (!bSeveralGrids)
+	{
+		ValidGrids[0]->Update();
+		return;
+	}
+
+	TRACE_CPUPROFILER_EVENT_SCOPE_STR("RVO2 Update Partitioned");
+
+	// 链在注册结束前保持，期间单位结构不变，各网格的单位列表一直有效 | the chain is held until registration ends, so the per grid subject lists stay valid
+	UNeighborGridComponent* FirstGrid = ValidGrids[0];
+	auto Chain = FirstGrid->GetMechanism()->EnchainSolid(FirstGrid->RegisterSubjectFilter);
+
+	AssignSubjects(ValidGrids, Chain);
+
+	// 每个单位只归一个网格，各网格写入的数据互不相交，可以并行注册 | every subject belongs to one grid, the grids write disjoint data and register concurrently
+	ParallelFor(ValidGrids.Num(), [&](int32 Index)
+	{
+		ValidGrids[Index]->UpdateOwnedSubjects();
+	});
+
+	// 障碍物注册进它覆盖的每个网格，逐个网格进行 | obstacles go into every grid they reach, so grids take turns
+	for (UNeighborGridComponent* Grid : ValidGrids)
+	{
+		Grid->UpdateObstacles();
+	}
+}
+
+template<typename ChainType>
+void UNeighborGridComponent::AssignSubjects(const TArray<UNeighborGridComponent*, TInlineAllocator<16>>& Grids, ChainType& Chain)
+{
+	TRACE_CPUPROFILER_EVENT_SCOPE_STR("AssignSubjects");
+
+	UNeighborGridComponent* FirstGrid = Grids[0];
+
+	int32 AssignThreadsCount = 1;
+	int32 AssignBatchSize = 1;
+	UBattleFrameFunctionLibraryRT::CalculateThreadsCountAndBatchSize(Chain->IterableNum(), FirstGrid->MaxThreadsAllowed, FirstGrid->MinBatchSizeAllowed, AssignThreadsCount, AssignBatchSize);
+
+	// 先记下每个单位的归属，之后按网格分发，每个网格只遍历自己的单位 | record every subject's grid first, then split them so each grid walks only its own subjects
+	AssignedSubjects.SetNum(Chain->IterableNum());
+	std::atomic<int32> AssignCursor{ 0 };
+
+	TArray<int32, TInlineAllocator<16>> GridCounts;
+	GridCounts.SetNumZeroed(Grids.Num());
+
+	auto Assign = [&](const FSolidSubjectHandle& Subject, int32 GridIndex)
+	{
+		const int32 Slot = AssignCursor.fetch_add(1, std::memory_order_relaxed);
+
+		if (LIKELY(Slot < AssignedSubjects.Num()))
+		{
+			AssignedSubjects[Slot] = TPair<int32, FSubjectHandle>(GridIndex, FSubjectHandle(Subject));
+			FPlatformAtomics::InterlockedIncrement(&GridCounts[GridIndex]);
+		}
+	};
+
+	Chain->OperateConcurrently([&](FSolidSubjectHandle Subject, FLocated& Located, FGridData& GridData)
+	{
+		const FVector& Location = Located.Location;
+
+		// 没有FGridOwner的单位当作新单位，注册时补上 | a subject without FGridOwner counts as new, registration attaches it
+		FGridOwner* GridOwner = Subject.GetTraitPtr<FGridOwner, EParadigm::Unsafe>();
+		const int32 Current = GridOwner ? Grids.IndexOfByKey(GridOwner->NeighborGrid) : INDEX_NONE;
+
+		// 在所属网格内就保持不变，网格重叠处因此不会来回切换 | stay while inside the owning grid, which is what keeps subjects from flipping where grids overlap
+		if (LIKELY(Current != INDEX_NONE) && Grids[Current]->Bounds.IsInsideOrOn(Location))
+		{
+			Assign(Subject, Current);
+			return;
+		}
+
+		int32 Next = INDEX_NONE;
+
+		for (int32 i = 0; i < Grids.Num(); ++i)
+		{
+			if (Grids[i]->Bounds.IsInsideOrOn(Location))
+			{
+				Next = i;
+				break;
+			}
+		}
+
+		if (Next == INDEX_NONE)
+		{
+			// 不在任何网格内：保留原网格，新单位交给最近的网格 | outside every grid: keep the current one, new subjects take the nearest
+			if (Current != INDEX_NONE)
+			{
+				Assign(Subject, Current);
+				return;
+			}
+
+			float NearestDistSq = FLT_MAX;
+
+			for (int32 i = 0; i < Grids.Num(); ++i)
+			{
+				const float DistSq = Grids[i]->Bounds.ComputeSquaredDistanceToPoint(Location);
+
+				if (DistSq < NearestDistSq)
+				{
+					NearestDistSq = DistSq;
+					Next = i;
+				}
+			}
+		}
+
+		if (Current != INDEX_NONE)
+		{
+			Grids[Current]->ReleaseSubject(GridData, *GridOwner);
+		}
+
+		if (GridOwner)
+		{
+			GridOwner->NeighborGrid = Grids[Next];
+			GridOwner->CellIndex = INDEX_NONE;
+		}
+
+		Assign(Subject, Next);
+
+	}, AssignThreadsCount, AssignBatchSize);
+
+	for (int32 i = 0; i < Grids.Num(); ++i)
+	{
+		Grids[i]->OwnedSubjects.Reset(GridCounts[i]);
+	}
+
+	const int32 NumAssigned = FMath::Min(AssignCursor.load(), AssignedSubjects.Num());
+
+	for (int32 Slot = 0; Slot < NumAssigned; ++Slot)
+	{
+		const TPair<int32, FSubjectHandle>& Assigned = AssignedSubjects[Slot];
+		Grids[Assigned.Key]->OwnedSubjects.Add(Assigned.Value);
+	}
+}
+
+void UNeighborGridComponent::ReleaseSubject(const FGridData& GridData, const FGridOwner& GridOwner)
+{
+	const int32 CellIndex = GridOwner.CellIndex;
+
+	// 只有增量模式的格子跨帧保留条目，其余模式每帧重建；多格条目由注册前的清理移除 | only incremental cells keep entries across frames, other modes rebuild every frame. Multi cell entries go in the sweep before registration
+	if (!bIncrementalActive || CellIndex < 0 || CellIndex >= SubjectCells.Num()) return;
+
+	auto& Cell = SubjectCells[CellIndex];
+
+	Cell.Lock();
+	const int32 NumRemoved = Cell.Subjects.RemoveAllSwap([&](const FGridData& Data) { return Data.SubjectHash == GridData.SubjectHash; });
+	Cell.Unlock();
+
+	if (NumRemoved > 0)
+	{
+		FPlatformAtomics::InterlockedAdd(&IncrementalEntryCount, -NumRemoved);
+	}
+}
+
+void UNeighborGridComponent::BuildSortedSubjects(int32 NumEntries)
+{
+	const int32 NumCells = CellCounts.Num();
+
+	if (UNLIKELY(NumCells == 0)) return;
+
+	{
+		TRACE_CPUPROFILER_EVENT_SCOPE_STR("CountingSortPrefixSum");
+
+		// 分块并行前缀和：先求每块总数，再串行扫描块总数，最后并行写回各格起点 | Blocked parallel exclusive scan
+		constexpr int32 ScanBlockSize = 4096;
+		const int32 NumBlocks = FMath::DivideAndRoundUp(NumCells, ScanBlockSize);
+
+		TArray<int32, TInlineAllocator<64>> BlockOffsets;
+		BlockOffsets.SetNumZeroed(NumBlocks + 1);
+
+		ParallelFor(NumBlocks, [&](int32 Block)
+		{
+			const int32 Begin = Block * ScanBlockSize;
+			const int32 End = FMath::Min(Begin + ScanBlockSize, NumCells);
+
+			int32 Sum = 0;
+
+			for (int32 i = Begin; i < End; ++i)
+			{
+				Sum += CellCounts[i];
+			}
+
+			BlockOffsets[Block + 1] = Sum;
+		});
+
+		for (int32 Block = 0; Block < NumBlocks; ++Block)
+		{
+			BlockOffsets[Block + 1] += BlockOffsets[Block];
+		}
+
+		ParallelFor(NumBlocks, [&](int32 Block)
+		{
+			const int32 Begin = Block * ScanBlockSize;
+			const int32 End = FMath::Min(Begin + ScanBlockSize, NumCells);
+
+			int32 Running = BlockOffsets[Block];
+
+			for (int32 i = Begin; i < End; ++i)
+			{
+				CellOffsets[i] = Running;
+				Running += CellCounts[i];
+			}
+		});
+
+		CellOffsets[NumCells] = BlockOffsets[NumBlocks];
+	}
+
+	{
+		TRACE_CPUPROFILER_EVENT_SCOPE_STR("CountingSortScatter");
+
+		const int32 NumSorted = CellOffsets[NumCells];
+		SortedSubjects.SetNum(NumSorted);
+		SortedX.SetNumUninitialized(NumSorted);
+		SortedY.SetNumUninitialized(NumSorted);
+		SortedZ.SetNumUninitialized(NumSorted);
+		SortedRadius.SetNumUninitialized(NumSorted);
+		SortedHash.SetNumUninitialized(NumSorted);
+
+		int32 ScatterThreadsCount = 1;
+		int32 ScatterBatchSize = 1;
+		UBattleFrameFunctionLibraryRT::CalculateThreadsCountAndBatchSize(NumEntries, MaxThreadsAllowed, MinBatchSizeAllowed, ScatterThreadsCount, ScatterBatchSize);
+
+		// 每个条目原子地从所在格子的计数上取一个槽位，计数在此过程中归零，下一帧无需清空 | Counts drain back to zero here
+		ParallelFor(ScatterThreadsCount, [&](int32 ThreadIndex)
+		{
+			const int32 Begin = ThreadIndex * ScatterBatchSize;
+			const int32 End = FMath::Min(Begin + ScatterBatchSize, NumEntries);
+
+			for (int32 i = Begin; i < End; ++i)
+			{
+				const int32 CellIndex = EntryCellIndices[i];
+				const int32 Slot = CellOffsets[CellIndex] + FPlatformAtomics::InterlockedDecrement(&CellCounts[CellIndex]);
+				const FGridData& Data = EntryData[i];
+
+				SortedSubjects[Slot] = Data;
+				SortedX[Slot] = Data.Location.X;
+				SortedY[Slot] = Data.Location.Y;
+				SortedZ[Slot] = Data.Location.Z;
+				SortedRadius[Slot] = Data.Radius;
+				SortedHash[Slot] = Data.SubjectHash;
+			}
+		});
+	}
+}
+
+void UNeighborGridComponent::SweepStaleSubjects(TArray<int32>& Cells, bool bPrune, bool bMultiOnly)
+{
+	const uint32 Stamp = IncrementalStamp;
+
+	ParallelFor(Cells.Num(), [&](int32 Index)
+	{
+		const int32 CellIndex = Cells[Index];
+		FNeighborGridCell& Cell = SubjectCells[CellIndex];
+
+		// 归属先于格子检查：别的网格可能正在并发改写移交出去的单位的格子 | ownership is checked first, another grid may be writing the cell of a subject handed off to it
+		Cell.Subjects.RemoveAllSwap([&](const FGridData& Data)
+		{
+			if (UNLIKELY(!Data.SubjectHandle.IsValid())) return true;
+
+			const FGridOwner* GridOwner = Data.SubjectHandle.GetTraitPtr<FGridOwner, EParadigm::Unsafe>();
+
+			// 尚未补上FGridOwner的是临时条目，只由多格清理移除 | no FGridOwner yet marks a transient entry, only the multi cell sweep removes it
+			if (UNLIKELY(!GridOwner)) return bMultiOnly;
+
+			if (UNLIKELY(GridOwner->NeighborGrid != this)) return true;
+
+			if (bMultiOnly) return GridOwner->CellIndex == FGridOwner::MultiCellIndex;
+
+			return GridOwner->GridStamp != Stamp || (GridOwner->CellIndex != CellIndex && GridOwner->CellIndex != FGridOwner::MultiCellIndex);
+		});
+
+		if (bPrune && Cell.Subjects.IsEmpty())
+		{
+			Cell.bRegistered = false;
+			Cells[Index] = INDEX_NONE;
+		}
+	});
+
+	if (bPrune)
+	{
+		Cells.Remove(INDEX_NONE);
+	}
+}
+
+void UNeighborGridComponent::RebuildStaticObstacleCaches()
+{
+	TPair<uint32, int32> Registration;
+
+	while (StaticObstacleRegistrations.Dequeue(Registration))
+	{
+		StaticObstacleFootprints.FindOrAdd(Registration.Key).AddUnique(Registration.Value);
+		DirtyStaticObstacleCells.Add(Registration.Value);
+	}
+
+	if (LIKELY(DirtyStaticObstacleCells.IsEmpty())) return;
+
+	TRACE_CPUPROFILER_EVENT_SCOPE_STR("RebuildStaticObstacleCaches");
+
+	Algo::Sort(DirtyStaticObstacleCells);
+
+	int32 NumDirtyCells = 0;
+
+	for (int32 i = 0; i < DirtyStaticObstacleCells.Num(); ++i)
+	{
+		if (i == 0 || DirtyStaticObstacleCells[i] != DirtyStaticObstacleCells[NumDirtyCells - 1])
+		{
+			DirtyStaticObstacleCells[NumDirtyCells++] = DirtyStaticObstacleCells[i];
+		}
+	}
+
+	// 每个脏格子只由一个线程重建 | every dirty cell is rebuilt by exactly one worker
+	ParallelFor(NumDirtyCells, [&](int32 Index)
+	{
+		const int32 CellIndex = DirtyStaticObstacleCells[Index];
+		FStaticObstacleCache& Cache = StaticObstacleCaches[CellIndex];
+
+		Cache.Segments.Reset();
+		Cache.Spheres.Reset();
+
+		for (const FGridData& Obstacle : StaticObstacleCells[CellIndex].Subjects)
+		{
+			if (UNLIKELY(!Obstacle.SubjectHandle.IsValid())) continue;
+
+			if (Obstacle.SubjectHandle.HasTrait<FSphereObstacle>())
+			{
+				Cache.Spheres.Add(Obstacle);
+			}
+			else
+			{
+				FObstacleSegment Segment;
+
+				if (MakeObstacleSegment(Obstacle, Segment))
+				{
+					Cache.Segments.Add(Segment);
+				}
+			}
+		}
+	});
+
+	DirtyStaticObstacleCells.Reset();
+}
+
+void UNeighborGridComponent::UnregisterStaticObstacle(const FSubjectHandle& Obstacle)
+{
+	// 先收取尚未处理的注册，确保足迹完整 | pick up pending registrations first so the footprint is complete
+	TPair<uint32, int32> Registration;
+
+	while (StaticObstacleRegistrations.Dequeue(Registration))
+	{
+		StaticObstacleFootprints.FindOrAdd(Registration.Key).AddUnique(Registration.Value);
+		DirtyStaticObstacleCells.Add(Registration.Value);
+	}
+
+	TArray<int32> Footprint;
+
+	if (!StaticObstacleFootprints.RemoveAndCopyValue(Obstacle.CalcHash(), Footprint)) return;
+
+	for (const int32 CellIndex : Footprint)
+	{
+		StaticObstacleCells[CellIndex].Subjects.RemoveAll([&](const FGridData& Data) { return Data.SubjectHandle == Obstacle; });
+		DirtyStaticObstacleCells.Add(CellIndex);
+	}
+}
+
+void UNeighborGridComponent::ReserveSparseCells(int32 ExpectedNewCells, bool bCompact)
+{
+	if (ActiveStorage != ENeighborGridStorage::SparseHash) return;
+
+	const int32 Headroom = FMath::Max(ExpectedNewCells, 1024);
+
+	if (!SparseCells.HasOverflowed() && SparseCells.NumCells + Headroom <= SparseCells.MaxCells) return;
+
+	TRACE_CPUPROFILER_EVENT_SCOPE_STR("ReserveSparseCells");
+
+	if (bCompact)
+	{
+		// 只保留仍有静态障碍物的格子，单位本帧会重新申请 | only cells holding static obstacles survive, subjects add theirs again this frame
+		const int32 NumOldCells = SparseCells.GetNumCells();
+		TArray<int32> Remap;
+
+		SparseCells.Compact([&](int32 CellIndex) { return !StaticObstacleCells[CellIndex].Subjects.IsEmpty(); }, Remap);
+
+		// 新编号不大于旧编号，顺序搬移不会覆盖未处理的格子 | new ids never exceed old ones, so an ascending in-place move is safe
+		for (int32 OldIndex = 0; OldIndex < NumOldCells; ++OldIndex)
+		{
+			const int32 NewIndex = Remap[OldIndex];
+			if (NewIndex == INDEX_NONE || NewIndex == OldIndex) continue;
+
+			StaticObstacleCells[NewIndex] = StaticObstacleCells[OldIndex];
+			StaticObstacleCaches[NewIndex] = MoveTemp(StaticObstacleCaches[OldIndex]);
+		}
+
+		for (int32 CellIndex = SparseCells.NumCells; CellIndex < NumOldCells; ++CellIndex)
+		{
+			StaticObstacleCells[CellIndex].Empty();
+			StaticObstacleCaches[CellIndex] = FStaticObstacleCache();
+		}
+
+		for (auto& Footprint : StaticObstacleFootprints)
+		{
+			for (int32& CellIndex : Footprint.Value)
+			{
+				CellIndex = Remap[CellIndex];
+			}
+
+			Footprint.Value.Remove(INDEX_NONE);
+		}
+
+		for (int32& CellIndex : DirtyStaticObstacleCells)
+		{
+			CellIndex = Remap[CellIndex];
+		}
+
+		DirtyStaticObstacleCells.Remove(INDEX_NONE);
+	}
+
+	// 容量保持在需求的2到4倍之间，内存随占用格子数伸缩 | keep capacity within 2x to 4x of demand, so memory follows occupancy both ways
+	const int32 Required = SparseCells.GetNumCells() + Headroom;
+
+	if (SparseCells.HasOverflowed() || Required > SparseCells.MaxCells || (bCompact && Required * 4 < SparseCells.MaxCells))
+	{
+		SparseCells.Rehash(Required * 2);
+	}
+
+	const int32 NumCells = SparseCells.MaxCells;
+
+	if (SubjectCells.Num() == NumCells) return;
+
+	SubjectCells.SetNum(NumCells);
+	ObstacleCells.SetNum(NumCells);
+	StaticObstacleCells.SetNum(NumCells);
+	StaticObstacleCaches.SetNum(NumCells);
+	CellCounts.SetNumZeroed(NumCells);
+
+	// 新格子的偏移取当前总数，保证本帧已建好的CSR区间仍然有效 | new cells start at the current total, so this frame's CSR ranges stay valid
+	const int32 NumOldOffsets = CellOffsets.Num();
+	const int32 TotalEntries = NumOldOffsets > 0 ? CellOffsets.Last() : 0;
+
+	CellOffsets.SetNumUninitialized(NumCells + 1);
+
+	for (int32 i = NumOldOffsets; i < CellOffsets.Num(); ++i)
+	{
+		CellOffsets[i] = TotalEntries;
+	}
+}
+
+SIZE_T UNeighborGridComponent::GetCellMemorySize() const
+{
+	SIZE_T Size = SubjectCells.GetAllocatedSize() + ObstacleCells.GetAllocatedSize() + StaticObstacleCells.GetAllocatedSize();
+	Size += StaticObstacleCaches.GetAllocatedSize() + CellCounts.GetAllocatedSize() + CellOffsets.GetAllocatedSize();
+	Size += SparseCells.GetAllocatedSize();
+
+	for (const FNeighborGridLevel& Level : CoarseLevels)
+	{
+		Size += Level.Cells.GetAllocatedSize();
+	}
+
+	return Size;
+}
+
+bool UNeighborGridComponent::MakeObstacleSegment(const FGridData& Obstacle, FObstacleSegment& OutSegment)
+{
+	if (UNLIKELY(!Obstacle.SubjectHandle.IsValid())) return false;
+
+	const FBoxObstacle* Obstacle1 = Obstacle.SubjectHandle.GetTraitPtr<FBoxObstacle, EParadigm::Unsafe>();
+	if (UNLIKELY(!Obstacle1 || !Obstacle1->nextObstacle_.IsValid())) return false;
+
+	const FBoxObstacle* Obstacle2 = Obstacle1->nextObstacle_.GetTraitPtr<FBoxObstacle, EParadigm::Unsafe>();
+	if (UNLIKELY(!Obstacle2)) return false;
+
+	const float HalfHeight = Obstacle1->height_ * 0.5f;
+
+	OutSegment.SubjectHash = Obstacle.SubjectHash;
+	OutSegment.Point1 = Obstacle1->point_;
+	OutSegment.Point2 = Obstacle2->point_;
+	OutSegment.UnitDir1 = Obstacle1->unitDir_;
+	OutSegment.UnitDir2 = Obstacle2->unitDir_;
+	OutSegment.ZMin = Obstacle1->pointZ_ - HalfHeight;
+	OutSegment.ZMax = Obstacle1->pointZ_ + HalfHeight;
+	OutSegment.bConvex1 = Obstacle1->isConvex_;
+	OutSegment.bConvex2 = Obstacle2->isConvex_;
+
+	return true;
 }
 
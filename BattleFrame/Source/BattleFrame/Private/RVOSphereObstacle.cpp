@@ -6,6 +6,7 @@
 
 #include "RVOSphereObstacle.h"
 #include "BattleFrameBattleControl.h"
+#include "NeighborGridComponent.h"
 // Sets default values
 ARVOSphereObstacle::ARVOSphereObstacle()
 {
@@ -54,6 +55,20 @@ void ARVOSphereObstacle::EndPlay(const EEndPlayReason::Type EndPlayReason)
 	// Check if the SubjectHandle is valid
 	if (SubjectHandle.IsValid())
 	{
+		// 静态障碍物只失效它覆盖的格子缓存 | static obstacles invalidate only the cached cells they covered
+		ABattleFrameBattleControl* BattleControl = ABattleFrameBattleControl::GetInstance();
+
+		if (!bIsDynamicObstacle && IsValid(BattleControl))
+		{
+			for (UNeighborGridComponent* Grid : BattleControl->NeighborGrids)
+			{
+				if (IsValid(Grid))
+				{
+					Grid->UnregisterStaticObstacle(SubjectHandle);
+				}
+			}
+		}
+
 		SubjectHandle->DespawnDeferred();
 	}
 }
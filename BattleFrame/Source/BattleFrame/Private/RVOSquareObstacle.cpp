@@ -6,6 +6,7 @@
 
 #include "RVOSquareObstacle.h"
 #include "BattleFrameBattleControl.h"
+#include "NeighborGridComponent.h"
 
 // Sets default values 
 ARVOSquareObstacle::ARVOSquareObstacle()
@@ -170,6 +171,25 @@ void ARVOSquareObstacle::EndPlay(const EEndPlayReason::Type EndPlayReason)
 {
     Super::EndPlay(EndPlayReason);
 
+    // 静态障碍物只失效它覆盖的格子缓存 | static obstacles invalidate only the cached cells they covered
+    ABattleFrameBattleControl* BattleControl = ABattleFrameBattleControl::GetInstance();
+
+    if (!bIsDynamicObstacle && IsValid(BattleControl))
+    {
+        for (UNeighborGridComponent* Grid : BattleControl->NeighborGrids)
+        {
+            if (!IsValid(Grid)) continue;
+
+            for (const FSubjectHandle& Obstacle : { Obstacle1, Obstacle2, Obstacle3, Obstacle4 })
+            {
+                if (Obstacle.IsValid())
+                {
+                    Grid->UnregisterStaticObstacle(Obstacle);
+                }
+            }
+        }
+    }
+
     if (Obstacle1.IsValid())
     {
         Obstacle1->DespawnDeferred();
@@ -13,10 +13,56 @@
 #include "Math/Vector2D.h"
 #include "AgentConfigDataAsset.h"
 #include "BattleFrameStructs.h"
+#include "Traits/Recyclable.h"
 #include "AgentSpawner.generated.h"
 
 class ABattleFrameBattleControl;
 
+// 预先算好的逐单位出生字段 | Per agent spawn fields, worked out before the subjects exist
+struct FAgentSpawnPoint
+{
+	FVector Location;
+	FVector Direction;
+	float FlyingHeight;
+};
+
+// 尚未生成完的一波单位 | A bulk wave that has not been fully spawned yet
+USTRUCT()
+struct BATTLEFRAME_API FPendingAgentWave
+{
+	GENERATED_BODY()
+
+	UPROPERTY()
+	FSubjectRecord Prototype;
+
+	UPROPERTY()
+	TSoftObjectPtr<UAgentConfigDataAsset> ConfigAsset;
+
+	UPROPERTY()
+	TObjectPtr<UAgentConfigDataAsset> DataAsset = nullptr;// keeps the config loaded while the wave is pending
+
+	// 生成参数，配置加载完后才据此准备原型与出生点 | Spawn parameters, the prototype and points are prepared from them once the config is loaded
+	int32 Quantity = 0;
+	int32 Team = 0;
+	FVector Origin = FVector::ZeroVector;
+	FVector2D Region = FVector2D::ZeroVector;
+	FVector2D LaunchVelocity = FVector2D::ZeroVector;
+	EInitialDirection InitialDirection = EInitialDirection::FacePlayer;
+	FVector2D CustomDirection = FVector2D(1, 0);
+	FSpawnerMult Multipliers;
+
+	TArray<FAgentSpawnPoint> Points;
+	bool bPrepared = false;
+	bool bAutoActivate = true;
+	bool bRecycle = false;// take agents from the battle control's recycling pool first
+	FAgentPoolKey PoolKey;
+	int32 NextIndex = 0;
+	int32 WaveId = 0;// reported with OnWaveSpawned
+};
+
+// 队列中的波次在后续帧生成的一批单位 | A slice of a queued wave spawned on a later frame
+DECLARE_DYNAMIC_MULTICAST_DELEGATE_ThreeParams(FAgentWaveSpawned, int32, WaveId, const TArray<FSubjectHandle>&, Agents, bool, bWaveComplete);
+
 UCLASS()
 class BATTLEFRAME_API AAgentSpawner : public AActor
 {
@@ -30,6 +76,8 @@ public:
 
 	AAgentSpawner();
 
+	void Tick(float DeltaTime) override;
+
 	UPROPERTY(BlueprintReadWrite, EditAnywhere)
 	TArray<TSoftObjectPtr<UAgentConfigDataAsset>> AgentConfigAssets;
 
@@ -39,6 +87,30 @@ public:
 
 	EFlagmarkBit RegisterMultipleFlag = EFlagmarkBit::M;
 
+	/* Per frame time for time sliced bulk waves. */
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "BattleFrame | AgentSpawner", meta = (ClampMin = "0.1"))
+	float TimeSlicedSpawnBudgetMs = 2.f;
+
+	/* Agents spawned between two budget checks. */
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "BattleFrame | AgentSpawner", meta = (ClampMin = "1"))
+	int32 TimeSlicedSpawnBatch = 128;
+
+	UPROPERTY(Transient)
+	TArray<FPendingAgentWave> PendingWaves;
+
+	int32 LastWaveId = 0;
+
+	/* Agents of queued waves spawned in Tick, once per wave and frame. Agents SpawnAgentsBulk returned are not reported again. */
+	UPROPERTY(BlueprintAssignable, Category = "BattleFrame | AgentSpawner")
+	FAgentWaveSpawned OnWaveSpawned;
+
+	TSet<FSubjectHandle> HeldAgents;// spawned, waiting for their VAT data before activation
+
+	/*
+	 * Spawn Quantity agents of the config in a rectangle around Origin. The config is loaded synchronously, its VAT data is not:
+	 * with bAutoActivate on, agents whose VAT data is still loading are returned inactive and activated on a later tick.
+	 * Call PreloadAgentConfigs ahead of the wave to have them active on return.
+	 */
 	UFUNCTION(BlueprintCallable, Category = "BattleFrame | AgentSpawner", meta = (DisplayName = "Spawn Agents By Config Index"))
 	TArray<FSubjectHandle> SpawnAgentsRectangular
 	(
@@ -54,6 +126,7 @@ public:
 		FSpawnerMult Multipliers = FSpawnerMult()
 	);
 
+	/* SpawnAgentsRectangular by config asset, with the same activation caveat. */
 	TArray<FSubjectHandle> SpawnAgentsByConfigRectangular
 	(
 		const bool bAutoActivate = true,
@@ -68,6 +141,37 @@ public:
 		const FSpawnerMult& Multipliers = FSpawnerMult()
 	);
 
+	/*
+	 * Same placement as SpawnAgentsRectangular, but the record is built once and cloned, and the per agent
+	 * fields are filled in parallel. Time sliced waves spawn what fits in TimeSlicedSpawnBudgetMs now and the
+	 * rest over the following frames, only the agents spawned in this call are returned, the rest come through OnWaveSpawned
+	 * under the id GetLastWaveId gives right after the call. With the battle control's
+	 * bRecycleAgents on, agents of the same config and team that finished dying are reused before new ones are spawned.
+	 * Nothing is loaded synchronously: while the config or its VAT data is loading the wave is queued and nothing is returned.
+	 */
+	UFUNCTION(BlueprintCallable, Category = "BattleFrame | AgentSpawner", meta = (DisplayName = "Spawn Agents Bulk"))
+	TArray<FSubjectHandle> SpawnAgentsBulk
+	(
+		bool bAutoActivate = true,
+		int32 ConfigIndex = 0,
+		int32 Quantity = 1,
+		int32 Team = 0,
+		FVector Origin = FVector::ZeroVector,
+		FVector2D Region = FVector2D::ZeroVector,
+		FVector2D LaunchVelocity = FVector2D::ZeroVector,
+		EInitialDirection InitialDirection = EInitialDirection::FacePlayer,
+		FVector2D CustomDirection = FVector2D(1, 0),
+		FSpawnerMult Multipliers = FSpawnerMult(),
+		bool bTimeSliced = false
+	);
+
+	UFUNCTION(BlueprintPure, Category = "BattleFrame | AgentSpawner", meta = (DisplayName = "Get Pending Spawn Count"))
+	int32 GetPendingSpawnCount() const;
+
+	/* Id of the wave the latest SpawnAgentsBulk call queued, matched against OnWaveSpawned. */
+	UFUNCTION(BlueprintPure, Category = "BattleFrame | AgentSpawner", meta = (DisplayName = "Get Last Wave Id"))
+	int32 GetLastWaveId() const;
+
 	UFUNCTION(BlueprintCallable, Category = "BattleFrame | AgentSpawner", meta = (DisplayName = "Initialize Agent"))
 	void ActivateAgent(FSubjectHandle Agent);
 
@@ -77,4 +181,16 @@ public:
 	UFUNCTION(BlueprintCallable, Category = "BattleFrame | AgentSpawner", meta = (DisplayName = "KillAgentsBySubtype"))
 	void KillAgentsBySubtype(int32 Index);
 
+private:
+
+	void MakeAgentPrototype(const UAgentConfigDataAsset* DataAsset, const int32 Team, const FSpawnerMult& Multipliers, FSubjectRecord& OutRecord) const;
+
+	/* Bring a pooled agent back to the prototype's state, keeping its render slot. */
+	void ResetPooledAgent(FSubjectHandle Agent, FSubjectRecord& Prototype);
+
+	/* Build the prototype and spawn points of a wave whose config is loaded. */
+	bool PrepareWave(FPendingAgentWave& Wave);
+
+	int32 SpawnWaveSlice(FPendingAgentWave& Wave, const int32 MaxCount, TArray<FSubjectHandle>& OutAgents);
+
 };
\ No newline at end of file
@@ -8,6 +8,8 @@
 #include "CoreMinimal.h"
 #include "Modules/ModuleManager.h"
 
+BATTLEFRAME_API DECLARE_LOG_CATEGORY_EXTERN(LogBattleFrame, Log, All);
+
 class FBattleFrameModule : public IModuleInterface
 {
 public:
@@ -8,6 +8,7 @@
 
 // C++
 #include <utility>
+#include <atomic>
 
 // Unreal
 #include "CoreMinimal.h"
@@ -26,6 +27,11 @@
 #include "BattleFrameFunctionLibraryRT.h"
 #include "BattleFrameStructs.h"
 #include "BattleFrameEnums.h"
+#include "NeighborGridCell.h"
+#include "BattleFrameStageTuner.h"
+#include "BattleFrameStageGraph.h"
+#include "BattleFrameEventBuffer.h"
+#include "BattleFrameDebugDraw.h"
 
 #include "Traits/Debuff.h"
 #include "Traits/DmgSphere.h"
@@ -77,6 +83,7 @@
 #include "Traits/Sleeping.h"
 #include "Traits/Patrolling.h"
 #include "Traits/TemporalDamaging.h"
+#include "Traits/StatusEffects.h"
 #include "Traits/ActorSpawnConfig.h"
 #include "Traits/SoundConfig.h"
 #include "Traits/FxConfig.h"
@@ -87,12 +94,49 @@
 #include "Traits/Patrol.h"
 #include "Traits/TextPopConfig.h"
 #include "Traits/MayDie.h"
+#include "Traits/Pooled.h"
+#include "Traits/Recyclable.h"
 #include "Traits/Tracing.h"
 
 #include "BattleFrameBattleControl.generated.h"
 
 // Forward Declearation
 class UNeighborGridComponent;
+class UAgentConfigDataAsset;
+
+// 一个等待执行的索敌请求 | One agent waiting for its trace
+struct FTraceRequest
+{
+	FSubjectHandle Subject;
+	float CoolDown = 0.f;// cooldown to restart once served
+	float Waited = 0.f;// seconds already carried over
+	uint8 Priority = 0;// lower is served first
+	float Score = 0.f;// priority aged by waiting, lower is served first
+};
+
+// 一次待结算的伤害，按目标排序后并行结算 | One hit waiting to be settled, sorted by target and resolved in parallel
+struct FDamageCommand
+{
+	FSubjectHandle Target;
+	FSubjectHandle Instigator;
+	FVector3f HitDirection = FVector3f::ZeroVector;
+	float Damage = 0.f;
+
+	// 结算时填写 | filled while resolving
+	uint32 SortKey = 0;
+	float DamageDealt = 0.f;
+	int32 Score = 0;
+	bool bKill = false;
+
+	FDamageCommand() = default;
+
+	FDamageCommand(const FSubjectHandle& InTarget, const FSubjectHandle& InInstigator, const FVector& InHitDirection, const float InDamage)
+		: Target(InTarget)
+		, Instigator(InInstigator)
+		, HitDirection(InHitDirection)
+		, Damage(InDamage)
+	{}
+};
 
 UCLASS()
 class BATTLEFRAME_API ABattleFrameBattleControl : public AActor
@@ -110,17 +154,119 @@ public:
 	int32 ThreadsCount = 1;
 	int32 BatchSize = 1;
 
+	// 按各阶段实测的单个成本选取线程数，默认关闭，使用上面的固定最小批次 | Pick threads from each stage's measured cost. Off by default, which uses the fixed minimum batch above
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = BattleFrame)
+	bool bAdaptiveBatching = false;
+
+	FBattleFrameStageTuner StageTuner;
+
+	FBattleFrameStageGraph AppearStages;// appear anim and dissolve, built once in DefineStageGraphs
+	FBattleFrameStageGraph HitStages;// health bars, hit glow and jiggle
+	FBattleFrameStageGraph DeathStages;// death dissolve and anim
+
+	// 上一帧的各阶段耗时与计数，发布版本中同样可读 | Last frame's stage timings and counters, readable in shipping builds too
+	UPROPERTY(BlueprintReadOnly, VisibleAnywhere, Category = BattleFrame)
+	FBattleFrameFrameStats FrameStats;
+
 	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = BattleFrame)
 	bool bGamePaused = false;
 
 	UPROPERTY(BlueprintReadOnly, VisibleAnywhere, Category = BattleFrame)
 	int32 AgentCount = 0;
 
+	// 以固定频率推进模拟，渲染在最近两次模拟状态之间插值 | Advance the simulation at a fixed rate, rendering blends between the last two sim states
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = BattleFrame)
+	bool bFixedTimeStep = false;
+
+	// 每秒模拟步数 | Simulation steps per second
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = BattleFrame, meta = (EditCondition = "bFixedTimeStep", ClampMin = "1"))
+	float FixedStepRate = 30.f;
+
+	// 单帧最多追赶的步数，超出的时间被丢弃 | Most steps run in one frame, time beyond that is dropped
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = BattleFrame, meta = (EditCondition = "bFixedTimeStep", ClampMin = "1"))
+	int32 MaxStepsPerFrame = 4;
+
+	float SimAccumulator = 0.f;
+	float RenderAlpha = 1.f;// 0 renders the state before the latest step, 1 the latest step
+	uint32 SimStepCount = 0;
+
+	// 按与玩家的距离降低远处单位的移动与避障频率 | Update movement and avoidance of far agents less often, by distance to the player
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = BattleFrame)
+	bool bSimLOD = false;
+
+	// 单位使用MinDistance不超过其距离的最远一级，顺序任意，比所有级都近的单位全速更新 | Agents use the level with the largest MinDistance they reach, in any order, agents closer than every level run at full rate
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = BattleFrame, meta = (EditCondition = "bSimLOD"))
+	TArray<FSimLODLevel> SimLODLevels = { FSimLODLevel(5000.f, 2, true), FSimLODLevel(10000.f, 4, true) };
+
+	bool bSimLODActive = false;
+	std::atomic<uint32> SimLODPhaseCounter{ 0 };
+
+	// 读写不冲突的阶段并行执行，关闭时按原顺序逐个执行 | Run stages with disjoint read/write sets concurrently, off keeps the serial order
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = BattleFrame)
+	bool bParallelStages = false;
+
+	// 每隔多少帧按Z序重排一次避障的遍历顺序，0为关闭 | Re-sort the avoidance iteration order by Z-order every N frames, 0 disables
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = BattleFrame, meta = (ClampMin = "0"))
+	int32 SpatialSortInterval = 0;
+
+	TArray<FSubjectHandle> SpatialOrder;// agents of the avoidance filter, spatially coherent
+	uint32 SpatialOrderVersion = MAX_uint32;// AgentActivationVersion SpatialOrder was sorted at
+	bool bTraceOutsideSpatialOrder = false;// some tracing agent is not in the avoidance filter, the trace gather keeps storage order
+	int32 FramesSinceSpatialSort = 0;
+	bool bSpatialOrderDirty = true;
+
+	// 每有单位获得FActivated时递增，避障据此判断Z序是否漏掉了新单位 | Bumped whenever an agent gains FActivated, the avoidance pass re-sorts when it moved so no new agent is left out of SpatialOrder
+	static std::atomic<uint32> AgentActivationVersion;
+
+	// 每帧最多执行的索敌数，0为不限，超出的请求优先追逐中和等待最久的单位，其余顺延到下一帧 | Most agent traces run per frame, 0 is unlimited. Over budget, chasing and longest waiting agents go first, the rest carry over to the next frame
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = BattleFrame, meta = (ClampMin = "0"))
+	int32 TraceBudget = 0;
+
+	// 顺延的请求每等待这么多秒提升一个优先级，低优先级的单位不会一直排不上 | Each this many seconds a deferred request waits lifts it one priority class, so low priority agents are not starved
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = BattleFrame, meta = (ClampMin = "0.01", EditCondition = "TraceBudget > 0"))
+	float TraceAgingTime = 0.5f;
+
+	// 把每个单位的首次索敌错开到一个冷却内，避免同批生成的单位同帧索敌，默认关闭以保持首帧即索敌 | Spread each agent's first trace over one cooldown, so agents spawned together do not trace on the same frame. Off by default, so agents still trace on their first frame
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = BattleFrame)
+	bool bStaggerTracePhase = false;
+
+	TArray<FTraceRequest> TraceRequests;// agents due for a trace this frame, capacity kept across frames
+
+	// 每帧调试线的上限，超出的调试图形整体丢弃，0为不限 | Most debug lines drawn per frame, shapes past it are dropped whole, 0 is unlimited
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = BattleFrame, meta = (ClampMin = "0"))
+	int32 MaxDebugLines = 100000;
+
+	// 调试圆形的细分程度，按到相机的距离降低 | Tessellation of round debug shapes, lowered with distance to the camera
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = BattleFrame, meta = (ClampMin = "1"))
+	float DebugSegmentScale = 64.f;
+
+	FBattleFrameDebugDraw DebugDraw;
+
+	// 减速与延时伤害写入目标身上的定长槽位，不再生成马甲实体 | Keep slows and temporal damage in fixed slots on the target instead of spawning ghost subjects
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = BattleFrame)
+	bool bInlineStatusEffects = false;
+
+	// 带FRecyclable的单位死亡结束后进入回收池，由生成器复用，不再销毁重建 | Agents with FRecyclable go to a pool when their death ends and are reused by the spawner instead of despawned and spawned again
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = BattleFrame)
+	bool bRecycleAgents = false;
+
+	TMap<FAgentPoolKey, TArray<FSubjectHandle>> AgentPool;
+
+	// Soft references, resolved on the game thread only. Loads in flight or finished stay referenced by their handle
+	TMap<FSoftObjectPath, TSharedPtr<FStreamableHandle>> AssetLoads;
+	TMap<FSoftObjectPath, TWeakObjectPtr<AFlowField>> ResolvedFlowFields;
+
+	// Paths whose load finished without a flow field, with the world time of the next load attempt
+	TMap<FSoftObjectPath, double> FailedFlowFields;
+	static constexpr double FlowFieldRetryInterval = 2.0;
+	TBattleFrameEventBuffer<FSoftObjectPath> UnresolvedFlowFields;
+
 	static ABattleFrameBattleControl* Instance;
 	FStreamableManager StreamableManager;
 	UWorld* CurrentWorld = nullptr;
 	AMechanism* Mechanism = nullptr;
 	TArray<UNeighborGridComponent*> NeighborGrids;
+	uint32 NeighborGridsVersion = MAX_uint32;// grid list version NeighborGrids was gathered at
 	TSet<int32> ExistingRenderers;
 
 	// Agent Status Flags
@@ -131,21 +277,41 @@ public:
 	EFlagmarkBit ChasingFlag = EFlagmarkBit::C;
 	EFlagmarkBit AttackingFlag = EFlagmarkBit::A;
 
-	// Event Callbacks
-	TQueue<FAppearData, EQueueMode::Mpsc> OnAppearQueue;
-	TQueue<FTraceData, EQueueMode::Mpsc> OnTraceQueue;
-	TQueue<FMoveData, EQueueMode::Mpsc> OnMoveQueue;
-	TQueue<FAttackData, EQueueMode::Mpsc> OnAttackQueue;
-	TQueue<FHitData, EQueueMode::Mpsc> OnHitQueue;
-	TQueue<FDeathData, EQueueMode::Mpsc> OnDeathQueue;
+	// Event Callbacks, per worker buffers flushed on the game thread
+	TBattleFrameEventBuffer<FAppearData> OnAppearQueue;
+	TBattleFrameEventBuffer<FTraceData> OnTraceQueue;
+	TBattleFrameEventBuffer<FMoveData> OnMoveQueue;
+	TBattleFrameEventBuffer<FAttackData> OnAttackQueue;
+	TBattleFrameEventBuffer<FHitData> OnHitQueue;
+	TBattleFrameEventBuffer<FDeathData> OnDeathQueue;
+
+	// Damage, per worker buffers settled per target in DecideHealth
+	TBattleFrameEventBuffer<FDamageCommand> DamageCommands;
+	TArray<FDamageCommand> PendingDamage;
+	TArray<FDamageCommand> PendingDamageScratch;
+	TArray<int32> PendingDamageGroups;
+
+	// Hits on targets not activated yet, parked per target outside the sort until it activates or MaxDamageParkResolves pass
+	struct FParkedDamage
+	{
+		TArray<FDamageCommand> Commands;
+		int32 Resolves = 0;
+	};
+
+	TBattleFrameEventBuffer<FDamageCommand> ParkedDamageQueue;
+	TMap<FSubjectHandle, FParkedDamage> ParkedDamage;
+	static constexpr int32 MaxDamageParkResolves = 300;
+
+	// Recycling, agents whose death ended this step, moved into AgentPool on the game thread
+	TBattleFrameEventBuffer<FSubjectHandle> RecycledAgents;
 
 	// Draw Debug Queue
-	TQueue<FDebugPointConfig, EQueueMode::Mpsc> DebugPointQueue;
-	TQueue<FDebugLineConfig, EQueueMode::Mpsc> DebugLineQueue;
-	TQueue<FDebugSphereConfig, EQueueMode::Mpsc> DebugSphereQueue;
-	TQueue<FDebugCapsuleConfig, EQueueMode::Mpsc> DebugCapsuleQueue;
-	TQueue<FDebugSectorConfig, EQueueMode::Mpsc> DebugSectorQueue;
-	TQueue<FDebugCircleConfig, EQueueMode::Mpsc> DebugCircleQueue;
+	TBattleFrameEventBuffer<FDebugPointConfig> DebugPointQueue;
+	TBattleFrameEventBuffer<FDebugLineConfig> DebugLineQueue;
+	TBattleFrameEventBuffer<FDebugSphereConfig> DebugSphereQueue;
+	TBattleFrameEventBuffer<FDebugCapsuleConfig> DebugCapsuleQueue;
+	TBattleFrameEventBuffer<FDebugSectorConfig> DebugSectorQueue;
+	TBattleFrameEventBuffer<FDebugCircleConfig> DebugCircleQueue;
 
 
 
@@ -166,6 +332,10 @@ private:
 	FFilter AgentJiggleFilter;
 	FFilter TemporalDamagerFilter;
 	FFilter SlowerFilter;
+	FFilter StatusEffectsFilter;
+	FFilter PooledRenderFilter;
+	FFilter NavigationResolveFilter;
+	FFilter BindFlowFieldResolveFilter;
 	FFilter DecideHealthFilter;
 	FFilter AgentHealthBarFilter;
 	FFilter AgentDeathFilter;
@@ -174,6 +344,7 @@ private:
 	FFilter SpeedLimitOverrideFilter;
 	FFilter AgentSleepFilter;
 	FFilter AgentPatrolFilter;
+	FFilter AgentSimLODFilter;
 	FFilter AgentMoveFilter;
 	FFilter IdleToMoveAnimFilter;
 	FFilter AgentStateMachineFilter;
@@ -215,6 +386,56 @@ public:
 
 	void DefineFilters();
 
+	/* Declare the stages of the stage graphs with their read and write sets, once after the filters. */
+	void DefineStageGraphs();
+
+	/* One simulation step, everything up to rendering. SafeDeltaTime is what the stages integrate with. */
+	void SimulateStep(float DeltaTime, float SafeDeltaTime);
+
+	/* Collect the frame counters and stage timings into FrameStats, stat BattleFrame and csvprofile. */
+	void PublishFrameStats();
+
+	/* Rendering and game thread work, runs once per frame after the simulation steps. */
+	void RenderFrame(float SafeDeltaTime);
+
+	/* Copy each rendered agent's location and direction before a fixed step, so AgentRender can interpolate. */
+	void SnapshotRenderState();
+
+	/* Rebuild SpatialOrder from the avoidance filter, sorted by the Z-order key of each agent's location. */
+	void SortAgentsSpatially();
+
+	/*
+	 * Call Func on every agent of SpatialOrder still matching Filter, split into InThreadsCount contiguous, spatially coherent runs.
+	 * Returns how many agents were visited.
+	 */
+	template<typename FuncType>
+	int32 ForEachInSpatialOrder(const FFilter& Filter, const int32 InThreadsCount, FuncType&& Func)
+	{
+		const int32 Num = SpatialOrder.Num();
+		const int32 NumRuns = FMath::Clamp(InThreadsCount, 1, FMath::Max(Num, 1));
+		std::atomic<int32> NumVisited{ 0 };
+
+		ParallelFor(NumRuns, [&](int32 RunIndex)
+		{
+			const int32 Begin = static_cast<int32>(static_cast<int64>(Num) * RunIndex / NumRuns);
+			const int32 End = static_cast<int32>(static_cast<int64>(Num) * (RunIndex + 1) / NumRuns);
+			int32 NumRunVisited = 0;
+
+			for (int32 i = Begin; i < End; ++i)
+			{
+				const FSubjectHandle& Agent = SpatialOrder[i];
+				if (UNLIKELY(!Agent.IsValid() || !Agent.Matches(Filter))) continue;
+
+				Func(Agent);
+				++NumRunVisited;
+			}
+
+			NumVisited.fetch_add(NumRunVisited, std::memory_order_relaxed);
+		});
+
+		return NumVisited.load();
+	}
+
 	void ApplyDamageToSubjects(const FSubjectArray& Subjects, const FSubjectArray& IgnoreSubjects, const FSubjectHandle DmgInstigator, const FVector& HitFromLocation, const FDamage& FDamage, const FDebuff& Debuff, TArray<FDmgResult>& DamageResults);
 
 	void ApplyDamageToSubjects(const FSubjectArray& Subjects, const FSubjectArray& IgnoreSubjects, const FSubjectHandle DmgInstigator, const FVector& HitFromLocation, const FDmgSphere& DmgSphere, const FDebuff& Debuff, TArray<FDmgResult>& DamageResults);
@@ -223,6 +444,50 @@ public:
 
 	void ApplyDamageToSubjectsDeferred(const FSubjectArray& Subjects, const FSubjectArray& IgnoreSubjects, const FSubjectHandle DmgInstigator, const FVector& HitFromLocation, const FDmgSphere& DmgSphere, const FDebuff& Debuff, TArray<FDmgResult>& DamageResults);
 
+	/* Shared body of the overloads above. Deferred uses deferred trait and spawn calls so it can run on workers, the hits themselves always go to DamageCommands. */
+	template<bool bDeferred, typename DamageType>
+	void ApplyDamageToSubjectsImpl(const FSubjectArray& Subjects, const FSubjectArray& IgnoreSubjects, const FSubjectHandle DmgInstigator, const FVector& HitFromLocation, const DamageType& Damage, const FDebuff& Debuff, TArray<FDmgResult>& DamageResults);
+
+	/* Advance the slower ghost subjects, registering new ones with their target and despawning the expired ones. */
+	void TickSlowers(const float SafeDeltaTime);
+
+	/* Advance the temporal damager ghost subjects, their due segments go to DamageCommands. */
+	void TickTemporalDamagers(const float SafeDeltaTime);
+
+	/* Advance the inline status effect slots through FStatusEffects::Tick, their due segments go to DamageCommands. */
+	void TickStatusEffects(const float SafeDeltaTime);
+
+	/* Settle the frame's damage commands: sort by target, apply per target in parallel, then credit instigators the same way. */
+	void ResolveDamageCommands();
+
+	/* Retire an agent whose death ended into the recycling pool: transient state traits go, FDying stays and FPooled is added. Deferred, safe on workers. */
+	void PoolAgentDeferred(FSolidSubjectHandle Subject);
+
+	/* Move this step's retired agents into AgentPool. Game thread. */
+	void CollectPooledAgents();
+
+	/* A pooled agent of the key, or an invalid handle when the pool is dry. The caller resets and reactivates it. Game thread. */
+	FSubjectHandle TakePooledAgent(const FAgentPoolKey& Key);
+
+	/* The object if it is in memory, otherwise nullptr and an async load is started once. Game thread. */
+	UObject* RequestSoftObject(const FSoftObjectPath& Path);
+
+	/* True when the load of Path has finished and the object is still not there. */
+	bool HasLoadFailed(const FSoftObjectPath& Path) const;
+
+	/* Start loading configs and what their agents need on activation ahead of a wave. */
+	UFUNCTION(BlueprintCallable, Category = "BattleFrame | Assets")
+	void PreloadAgentConfigs(const TArray<TSoftObjectPtr<UAgentConfigDataAsset>>& Configs);
+
+	/* True once the config and its agents' VAT data are in memory, requests whatever is missing otherwise. Game thread. */
+	bool RequestAgentConfig(const TSoftObjectPtr<UAgentConfigDataAsset>& Config);
+
+	/*
+	 * Give dirty navigation and bound flow fields their resolved actor so the move stage never resolves soft pointers.
+	 * Entries whose actor went away are evicted and resolved again, failed paths are loaded again every FlowFieldRetryInterval.
+	 */
+	void ResolveFlowFields();
+
 	//---------------------------------------------Helpers------------------------------------------------------------------
 
 	FORCEINLINE std::pair<bool, float> ProcessCritDamage(float BaseDamage, float damageMult, float Probability)
@@ -303,17 +568,15 @@ public:
 
 	static FVector FindNewPatrolGoalLocation(const FPatrol Patrol, const FCollider Collider, const FTrace Trace, const FTracing Tracing, const FLocated Located, const FScaled Scaled, int32 MaxAttempts);
 
-	void DrawDebugSector(UWorld* World, const FVector& Center, const FVector& Direction, float Radius, float AngleDegrees, float Height, const FColor& Color, bool bPersistentLines, float LifeTime, uint8 DepthPriority, float Thickness);
-
 
 	//---------------------------------------------RVO2------------------------------------------------------------------
 
-	static void ComputeAvoidingVelocity(FAvoidance& Avoidance, FAvoiding& Avoiding, const TArray<FGridData>& SubjectNeighbors, const TArray<FGridData>& ObstacleNeighbors, float TimeStep);
+	static void ComputeAvoidingVelocity(FAvoidance& Avoidance, FAvoiding& Avoiding, TArrayView<const FGridData> SubjectNeighbors, TArrayView<const FObstacleSegment> ObstacleSegments, float TimeStep);
 
-	static bool LinearProgram1(const std::vector<RVO::Line>& lines, size_t lineNo, float radius, const RVO::Vector2& optVelocity, bool directionOpt, RVO::Vector2& result);
+	static bool LinearProgram1(TArrayView<const RVO::Line> lines, int32 lineNo, float radius, const RVO::Vector2& optVelocity, bool directionOpt, RVO::Vector2& result);
 
-	static size_t LinearProgram2(const std::vector<RVO::Line>& lines, float radius, const RVO::Vector2& optVelocity, bool directionOpt, RVO::Vector2& result);
+	static int32 LinearProgram2(TArrayView<const RVO::Line> lines, float radius, const RVO::Vector2& optVelocity, bool directionOpt, RVO::Vector2& result);
 
-	static void LinearProgram3(const std::vector<RVO::Line>& lines, size_t numObstLines, size_t beginLine, float radius, RVO::Vector2& result);
+	static void LinearProgram3(TArrayView<const RVO::Line> lines, int32 numObstLines, int32 beginLine, float radius, RVO::Vector2& result);
 
 };
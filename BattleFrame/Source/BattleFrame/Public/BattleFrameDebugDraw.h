@@ -0,0 +1,67 @@
+/*
+ * BattleFrame
+ * Created: 2025
+ * Author: Leroy Works, All Rights Reserved.
+ */
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Components/LineBatchComponent.h"
+
+class UWorld;
+
+/**
+ * Collects a frame of debug shapes as plain lines and hands them to the world's line batchers
+ * in one call each, instead of one DrawDebug call per line. Round shapes are tessellated by
+ * their size on screen, so far shapes cost a handful of lines, and past MaxLines whole shapes
+ * are dropped. Game thread only.
+ */
+class BATTLEFRAME_API FBattleFrameDebugDraw
+{
+public:
+
+	int32 MaxLines = 0;// 0 is unlimited
+	float SegmentScale = 64.f;// segments of a full circle whose radius equals its distance to the view
+	int32 MinSegments = 4;
+	int32 MaxSegments = 36;
+
+	void BeginFrame(const FVector& InViewLocation)
+	{
+		ViewLocation = InViewLocation;
+		NumDropped = 0;
+	}
+
+	void AddLine(const FVector& Start, const FVector& End, const FColor& Color, float Duration, float Thickness, uint8 DepthPriority = 0);
+
+	/* Circle in the plane spanned by XAxis and YAxis. */
+	void AddCircle(const FVector& Center, float Radius, const FColor& Color, float Duration, float Thickness, const FVector& XAxis = FVector::XAxisVector, const FVector& YAxis = FVector::YAxisVector, uint8 DepthPriority = 0);
+
+	/* Three great circles instead of a full latitude / longitude wire. */
+	void AddSphere(const FVector& Center, float Radius, const FColor& Color, float Duration, float Thickness, uint8 DepthPriority = 0);
+
+	void AddCapsule(const FVector& Center, float HalfHeight, float Radius, const FQuat& Rotation, const FColor& Color, float Duration, float Thickness, uint8 DepthPriority = 0);
+
+	/* Vertical slice of a cylinder, Height is centered on Center. */
+	void AddSector(const FVector& Center, const FVector& Direction, float Radius, float AngleDegrees, float Height, const FColor& Color, float Duration, float Thickness, uint8 DepthPriority = 0);
+
+	/* Submit every collected line to the world and clear, keeping the memory. */
+	void Flush(UWorld* World);
+
+	int32 Num() const { return Lines.Num() + PersistentLines.Num(); }
+	int32 GetNumDropped() const { return NumDropped; }
+
+private:
+
+	TArray<FBatchedLine> Lines;// last one frame
+	TArray<FBatchedLine> PersistentLines;// have a duration
+	FVector ViewLocation = FVector::ZeroVector;
+	int32 NumDropped = 0;
+
+	int32 CalcSegments(const FVector& Center, float Radius, float Fraction = 1.f) const;
+
+	/* Whole shapes only, so a capped frame never shows half a sphere. */
+	bool Reserve(int32 NumLines);
+
+	void AddArc(const FVector& Center, float Radius, const FVector& XAxis, const FVector& YAxis, float StartAngle, float EndAngle, int32 Segments, const FColor& Color, float Duration, float Thickness, uint8 DepthPriority);
+};
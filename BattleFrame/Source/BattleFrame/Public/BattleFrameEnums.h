@@ -125,4 +125,26 @@ enum class EDeathEventState : uint8
 	OutOfLifeSpan UMETA(DisplayName = "OutOfLifeSpan", ToolTip = "寿命归零"),
 	SuicideAttack UMETA(DisplayName = "SuicideAttack", ToolTip = "自杀攻击"),
 	KillZ UMETA(DisplayName = "KillZ", ToolTip = "低于强制移除高度")
-};
\ No newline at end of file
+};
+
+UENUM(BlueprintType)
+enum class EGridBuildMode : uint8
+{
+	SpinLock UMETA(DisplayName = "SpinLock", ToolTip = "逐格加锁插入，每个格子单独分配内存"),
+	CountingSort UMETA(DisplayName = "CountingSort", ToolTip = "计数排序构建连续数组(CSR)，无锁且无逐格分配，适合大量密集单位")
+};
+
+UENUM(BlueprintType)
+enum class ENeighborGridStorage : uint8
+{
+	Dense UMETA(DisplayName = "Dense", ToolTip = "按GridSize预分配全部格子，查询最快，内存随地图面积增长"),
+	SparseHash UMETA(DisplayName = "SparseHash", ToolTip = "按格子坐标开放寻址哈希，只为有单位或障碍物的格子分配内存，地图不设边界")
+};
+
+UENUM(BlueprintType)
+enum class EStatusEffectStacking : uint8
+{
+	Refresh UMETA(DisplayName = "Refresh", ToolTip = "同类型效果只保留一个，新效果覆盖旧效果"),
+	Stack UMETA(DisplayName = "Stack", ToolTip = "每次施加占用一个新槽位，槽位满时替换剩余时间最短的"),
+	StrongestWins UMETA(DisplayName = "StrongestWins", ToolTip = "同类型效果只保留一个，保留强度更高的")
+};
@@ -0,0 +1,110 @@
+/*
+ * BattleFrame
+ * Created: 2025
+ * Author: Leroy Works, All Rights Reserved.
+ */
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "HAL/CriticalSection.h"
+#include "BattleFrameWorkerSlot.h"
+
+/**
+ * Append only event buffer written from worker threads and flushed on the game thread.
+ * Every thread appends to its own cache line aligned array, so an event is a plain TArray add
+ * with no shared atomic and, once the arrays have grown to a frame's worth, no allocation.
+ * Enqueue mirrors TQueue so producers read the same, the order across threads is unspecified.
+ */
+template<typename T>
+class TBattleFrameEventBuffer
+{
+public:
+
+	FORCEINLINE bool Enqueue(const T& Item)
+	{
+		Emplace(Item);
+		return true;
+	}
+
+	FORCEINLINE bool Enqueue(T&& Item)
+	{
+		Emplace(MoveTemp(Item));
+		return true;
+	}
+
+	/* Append every buffered event to OutEvents and clear the buffer, keeping its memory. Game thread, no producer in flight. */
+	void Flush(TArray<T>& OutEvents)
+	{
+		const int32 NumSlots = FBattleFrameWorkerSlot::Num();
+
+		for (int32 i = 0; i < NumSlots; ++i)
+		{
+			OutEvents.Append(Slots[i].Items);
+			Slots[i].Items.Reset();
+		}
+	}
+
+	/* Visit every buffered event then clear the buffer. Func must not enqueue into this buffer. */
+	template<typename FunctionType>
+	void Drain(FunctionType&& Func)
+	{
+		const int32 NumSlots = FBattleFrameWorkerSlot::Num();
+
+		for (int32 i = 0; i < NumSlots; ++i)
+		{
+			for (const T& Item : Slots[i].Items)
+			{
+				Func(Item);
+			}
+
+			Slots[i].Items.Reset();
+		}
+	}
+
+	bool IsEmpty() const
+	{
+		const int32 NumSlots = FBattleFrameWorkerSlot::Num();
+
+		for (int32 i = 0; i < NumSlots; ++i)
+		{
+			if (!Slots[i].Items.IsEmpty()) return false;
+		}
+
+		return true;
+	}
+
+	void Empty()
+	{
+		for (FSlot& Slot : Slots)
+		{
+			Slot.Items.Empty();
+		}
+	}
+
+private:
+
+	struct alignas(PLATFORM_CACHE_LINE_SIZE) FSlot
+	{
+		TArray<T> Items;
+	};
+
+	FSlot Slots[FBattleFrameWorkerSlot::MaxSlots];
+	FCriticalSection SharedSlotLock;
+
+	template<typename ItemType>
+	FORCEINLINE void Emplace(ItemType&& Item)
+	{
+		const int32 Slot = FBattleFrameWorkerSlot::Get();
+
+		if (LIKELY(Slot < FBattleFrameWorkerSlot::MaxSlots - 1))
+		{
+			Slots[Slot].Items.Emplace(Forward<ItemType>(Item));
+		}
+		else
+		{
+			FScopeLock ScopeLock(&SharedSlotLock);
+			Slots[Slot].Items.Emplace(Forward<ItemType>(Item));
+		}
+	}
+};
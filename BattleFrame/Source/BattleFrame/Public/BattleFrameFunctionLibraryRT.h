@@ -170,6 +170,22 @@ public:
     static FSubjectArray ConvertSubjectHandlesToSubjectArray(const TArray<FSubjectHandle>& SubjectHandles);
 
     static void CalculateThreadsCountAndBatchSize(int32 IterableNum, int32 MaxThreadsAllowed, int32 MinBatchSizeAllowed, int32& ThreadsCount, int32& BatchSize);
+
+    // 16位X、Y交错为32位Z序码，空间上相邻的点码值也相近 | Interleave two 16 bit coordinates into a 32 bit Z-order key, nearby points get nearby keys
+    FORCEINLINE static uint32 MortonCode2D(uint32 X, uint32 Y)
+    {
+        auto Spread = [](uint32 Value)
+        {
+            Value &= 0x0000FFFF;
+            Value = (Value | (Value << 8)) & 0x00FF00FF;
+            Value = (Value | (Value << 4)) & 0x0F0F0F0F;
+            Value = (Value | (Value << 2)) & 0x33333333;
+            Value = (Value | (Value << 1)) & 0x55555555;
+            return Value;
+        };
+
+        return Spread(X) | (Spread(Y) << 1);
+    }
     static void SetRecordSubTypeTraitByIndex(int32 Index, FSubjectRecord& SubjectRecord);
     static void SetRecordSubTypeTraitByEnum(EESubType SubType, FSubjectRecord& SubjectRecord);
     static void SetSubjectSubTypeTraitByIndex(int32 Index, FSubjectHandle SubjectHandle);
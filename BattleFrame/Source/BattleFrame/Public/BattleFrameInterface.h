@@ -36,4 +36,40 @@ public:
 
     UFUNCTION(BlueprintCallable, BlueprintNativeEvent)
     void OnDeath(const FDeathData& Data);
+};
+
+UINTERFACE(MinimalAPI)
+class UBattleFrameBatchInterface : public UInterface
+{
+    GENERATED_BODY()
+};
+
+/**
+ * 批量事件：实现此接口的Actor每帧每种事件只收到一次调用，参数为该帧发给它的全部事件
+ * Batched events: an actor implementing this gets one call per event type per frame, carrying every event sent to it that frame.
+ * Actors that only implement IBattleFrameInterface keep receiving one call per event.
+ */
+class BATTLEFRAME_API IBattleFrameBatchInterface
+{
+    GENERATED_BODY()
+
+public:
+
+    UFUNCTION(BlueprintCallable, BlueprintNativeEvent)
+    void OnAppearBatch(const TArray<FAppearData>& Data);
+
+    UFUNCTION(BlueprintCallable, BlueprintNativeEvent)
+    void OnTraceBatch(const TArray<FTraceData>& Data);
+
+    UFUNCTION(BlueprintCallable, BlueprintNativeEvent)
+    void OnMoveBatch(const TArray<FMoveData>& Data);
+
+    UFUNCTION(BlueprintCallable, BlueprintNativeEvent)
+    void OnAttackBatch(const TArray<FAttackData>& Data);
+
+    UFUNCTION(BlueprintCallable, BlueprintNativeEvent)
+    void OnHitBatch(const TArray<FHitData>& Data);
+
+    UFUNCTION(BlueprintCallable, BlueprintNativeEvent)
+    void OnDeathBatch(const TArray<FDeathData>& Data);
 };
\ No newline at end of file
@@ -0,0 +1,267 @@
+/*
+ * BattleFrame
+ * Created: 2025
+ * Author: Leroy Works, All Rights Reserved.
+ */
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Async/ParallelFor.h"
+#include "Machine.h"
+#include "BattleFrameFunctionLibraryRT.h"
+#include "BattleFrameStageTuner.h"
+
+/**
+ * One resource a stage touches, a whole trait or one field of it.
+ * Made from the trait type, so a renamed trait or field fails to compile instead of silently never conflicting.
+ */
+struct FBattleFrameStageResource
+{
+	const UScriptStruct* Trait = nullptr;
+	FName Field;// None is the whole trait
+
+	template<typename TraitType>
+	static FBattleFrameStageResource Make(const FName Field = NAME_None)
+	{
+		return FBattleFrameStageResource{ TraitType::StaticStruct(), Field };
+	}
+
+	bool Overlaps(const FBattleFrameStageResource& Other) const
+	{
+		// 整个特征与其字段冲突，不同字段之间不冲突 | a whole trait overlaps each of its fields, distinct fields do not overlap
+		return Trait == Other.Trait && (Field.IsNone() || Other.Field.IsNone() || Field == Other.Field);
+	}
+};
+
+// 特征的一个字段，字段名在编译期检查 | One field of a trait, the field name is checked at compile time
+#define BATTLEFRAME_STAGE_FIELD(TraitType, FieldName) FBattleFrameStageResource::Make<TraitType>(GET_MEMBER_NAME_CHECKED(TraitType, FieldName))
+
+// 整个特征的列表 | A list of whole traits
+template<typename... TraitTypes>
+struct TBattleFrameStageTraits
+{
+	static TArray<FBattleFrameStageResource> Make()
+	{
+		return { FBattleFrameStageResource::Make<TraitTypes>()... };
+	}
+};
+
+/**
+ * What a stage graph run needs from the frame. Stages are built once, everything that changes
+ * between frames reaches them through here.
+ */
+struct FBattleFrameStageContext
+{
+	AMechanism* Mechanism = nullptr;
+	float DeltaTime = 0.f;
+	int32 MaxThreadsAllowed = 1;
+	int32 MinBatchSizeAllowed = 1;
+};
+
+/**
+ * One tick stage with the data it touches. Removing or adding a trait counts as writing it.
+ * Prepare and Release always run on the game thread, Execute may share a wave with other stages.
+ */
+struct FBattleFrameStage
+{
+	FName Name;
+	TArray<FBattleFrameStageResource> Reads;
+	TArray<FBattleFrameStageResource> Writes;
+	TFunction<void(const FBattleFrameStageContext&)> Prepare;
+	TFunction<void(const FBattleFrameStageContext&)> Execute;
+	TFunction<void()> Release;
+	int32 Wave = 0;
+};
+
+/**
+ * Runs declared stages either strictly in declaration order, or as a DAG.
+ * A stage depends on every earlier stage it conflicts with, stages in the
+ * same wave share no conflicting resource and run concurrently, so the
+ * number of barriers drops from one per stage to one per wave.
+ * The graph is meant to be built once and run every frame, the waves are
+ * only worked out again when a stage is added.
+ */
+class FBattleFrameStageGraph
+{
+public:
+
+	// 传入调优器时，链阶段按实测成本选取线程数与批次 | with a tuner, chain stages size their threads and batches from measured cost
+	explicit FBattleFrameStageGraph(FBattleFrameStageTuner* InTuner = nullptr)
+		: Tuner(InTuner)
+	{
+	}
+
+	void Reset(FBattleFrameStageTuner* InTuner = nullptr)
+	{
+		Tuner = InTuner;
+		Stages.Reset();
+		Waves.Reset();
+		bWavesDirty = true;
+	}
+
+	void Add(const FName Name, TArray<FBattleFrameStageResource> Reads, TArray<FBattleFrameStageResource> Writes, TFunction<void(const FBattleFrameStageContext&)> Prepare, TFunction<void(const FBattleFrameStageContext&)> Execute, TFunction<void()> Release = nullptr)
+	{
+		FBattleFrameStage& Stage = Stages.AddDefaulted_GetRef();
+		Stage.Name = Name;
+		Stage.Reads = MoveTemp(Reads);
+		Stage.Writes = MoveTemp(Writes);
+		Stage.Prepare = MoveTemp(Prepare);
+		Stage.Execute = MoveTemp(Execute);
+		Stage.Release = MoveTemp(Release);
+		bWavesDirty = true;
+	}
+
+	/*
+	 * Add a stage iterating a solid chain. The chain is enchained in Prepare and let go in Release on the game thread,
+	 * Body(Chain, DeltaTime, ThreadsCount, BatchSize) operates on it from wherever the wave runs it.
+	 */
+	template<typename BodyType>
+	void AddChainStage(const FName Name, const FFilter& Filter, TArray<FBattleFrameStageResource> Reads, TArray<FBattleFrameStageResource> Writes, BodyType&& Body)
+	{
+		using FChainPtr = decltype(DeclVal<AMechanism*>()->EnchainSolid(Filter));
+
+		TSharedRef<FChainPtr> Chain = MakeShared<FChainPtr>(nullptr);
+
+		Add(Name, MoveTemp(Reads), MoveTemp(Writes),
+			[Chain, Filter](const FBattleFrameStageContext& Context)
+			{
+				*Chain = Context.Mechanism->EnchainSolid(Filter);
+			},
+			[Chain, Name, StageTuner = Tuner, Body = Forward<BodyType>(Body)](const FBattleFrameStageContext& Context) mutable
+			{
+				int32 ThreadsCount = 1;
+				int32 BatchSize = 1;
+
+				if (StageTuner)
+				{
+					FBattleFrameStageTuner::FScope StageTuning(*StageTuner, Name, (*Chain)->IterableNum(), Context.MaxThreadsAllowed, Context.MinBatchSizeAllowed, ThreadsCount, BatchSize);
+					Body(*Chain, Context.DeltaTime, ThreadsCount, BatchSize);
+				}
+				else
+				{
+					UBattleFrameFunctionLibraryRT::CalculateThreadsCountAndBatchSize((*Chain)->IterableNum(), Context.MaxThreadsAllowed, Context.MinBatchSizeAllowed, ThreadsCount, BatchSize);
+					Body(*Chain, Context.DeltaTime, ThreadsCount, BatchSize);
+				}
+			},
+			[Chain]()
+			{
+				*Chain = nullptr;
+			});
+	}
+
+	void Run(const FBattleFrameStageContext& Context, const bool bParallel)
+	{
+		if (!bParallel)
+		{
+			for (FBattleFrameStage& Stage : Stages)
+			{
+				Stage.Prepare(Context);
+				Stage.Execute(Context);
+				if (Stage.Release) Stage.Release();
+			}
+
+			return;
+		}
+
+		BuildWaves();
+
+		for (const TArray<int32>& Wave : Waves)
+		{
+			for (const int32 StageIndex : Wave)
+			{
+				Stages[StageIndex].Prepare(Context);
+			}
+
+			if (Wave.Num() == 1)
+			{
+				Stages[Wave[0]].Execute(Context);
+			}
+			else
+			{
+				ParallelFor(Wave.Num(), [&](int32 Index)
+				{
+					Stages[Wave[Index]].Execute(Context);
+				});
+			}
+
+			for (const int32 StageIndex : Wave)
+			{
+				if (Stages[StageIndex].Release) Stages[StageIndex].Release();
+			}
+		}
+	}
+
+	int32 NumStages() const
+	{
+		return Stages.Num();
+	}
+
+	int32 NumWaves()
+	{
+		BuildWaves();
+		return Waves.Num();
+	}
+
+	const TArray<FBattleFrameStage>& GetStages()
+	{
+		BuildWaves();
+		return Stages;
+	}
+
+	static bool IsConflicting(const FBattleFrameStage& A, const FBattleFrameStage& B)
+	{
+		auto Overlaps = [](const TArray<FBattleFrameStageResource>& Lhs, const TArray<FBattleFrameStageResource>& Rhs)
+		{
+			for (const FBattleFrameStageResource& L : Lhs)
+			{
+				for (const FBattleFrameStageResource& R : Rhs)
+				{
+					if (L.Overlaps(R)) return true;
+				}
+			}
+
+			return false;
+		};
+
+		return Overlaps(A.Writes, B.Writes) || Overlaps(A.Writes, B.Reads) || Overlaps(A.Reads, B.Writes);
+	}
+
+private:
+
+	FBattleFrameStageTuner* Tuner = nullptr;
+	TArray<FBattleFrameStage> Stages;
+	TArray<TArray<int32>> Waves;
+	bool bWavesDirty = true;
+
+	void BuildWaves()
+	{
+		if (!bWavesDirty) return;
+		bWavesDirty = false;
+
+		Waves.Reset();
+
+		// 每个阶段排在与它冲突的所有前序阶段之后 | every stage goes one wave after the latest earlier stage it conflicts with
+		for (int32 i = 0; i < Stages.Num(); ++i)
+		{
+			int32 Wave = 0;
+
+			for (int32 j = 0; j < i; ++j)
+			{
+				if (IsConflicting(Stages[j], Stages[i]))
+				{
+					Wave = FMath::Max(Wave, Stages[j].Wave + 1);
+				}
+			}
+
+			Stages[i].Wave = Wave;
+
+			if (Waves.Num() <= Wave)
+			{
+				Waves.SetNum(Wave + 1);
+			}
+
+			Waves[Wave].Add(i);
+		}
+	}
+};
@@ -0,0 +1,283 @@
+/*
+ * BattleFrame
+ * Created: 2025
+ * Author: Leroy Works, All Rights Reserved.
+ */
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "HAL/CriticalSection.h"
+#include "Async/TaskGraphInterfaces.h"
+#include "Templates/UniquePtr.h"
+#include <algorithm>
+#include "BattleFrameFunctionLibraryRT.h"
+#include "BattleFrameStats.h"
+
+/**
+ * What the tuner knows about one stage. SecondsPerItem is single thread time,
+ * smoothed over frames, WallSecondsPerItem is the measured wall time by threads
+ * count, the rest is what was picked for the current frame.
+ */
+struct FBattleFrameStageTuning
+{
+	static constexpr int32 MaxTunedThreads = 64;
+
+	FName Name;
+	double SecondsPerItem = 0.0;
+	double LastSeconds = 0.0;// wall time of the last run
+	double TotalSeconds = 0.0;// wall time of every run so far, differences give the time spent between two reads
+	uint32 NumRuns = 0;// runs so far, unchanged when the stage was skipped
+	int32 ItemsCount = 0;
+	int32 ThreadsCount = 1;
+	int32 BatchSize = 1;
+	int32 BaselineThreadsCount = 1;// what CalculateThreadsCountAndBatchSize would have picked
+	int32 RunsSinceBaseline = 0;
+	bool bMeasured = false;
+
+	// 按线程数记录的每单位墙钟时间，用来验证模型的选择 | smoothed wall time per item by threads count, checks what the model picks
+	float WallSecondsPerItem[MaxTunedThreads + 1] = {};
+
+	// 统计名只在创建时拼一次 | stat names, built once
+	FName ThreadsStatName;
+	FName BatchStatName;
+	FName CostStatName;
+
+#if STATS
+	TStatId MeanStatId;
+	TStatId P95StatId;
+	TStatId MaxStatId;
+	TStatId ItemsStatId;
+	TStatId ThreadsStatId;
+#endif
+
+	// 最近若干次运行的墙钟时间环形缓冲 | ring of recent wall times
+	static constexpr int32 HistorySize = 120;
+	float History[HistorySize] = {};
+	int32 HistoryNum = 0;
+	int32 HistoryHead = 0;
+
+	void AddHistory(const float Seconds)
+	{
+		History[HistoryHead] = Seconds;
+		HistoryHead = (HistoryHead + 1) % HistorySize;
+		HistoryNum = FMath::Min(HistoryNum + 1, HistorySize);
+	}
+
+	/* Mean, 95th percentile and max of the recent wall times, in milliseconds. */
+	void GetRecentTimes(float& OutMeanMs, float& OutP95Ms, float& OutMaxMs) const
+	{
+		OutMeanMs = OutP95Ms = OutMaxMs = 0.f;
+		if (HistoryNum == 0) return;
+
+		float Sorted[HistorySize];
+		float Sum = 0.f;
+
+		for (int32 i = 0; i < HistoryNum; ++i)
+		{
+			Sorted[i] = History[i];
+			Sum += History[i];
+		}
+
+		const int32 P95Index = FMath::Min(HistoryNum - 1, (HistoryNum * 95) / 100);
+		std::nth_element(Sorted, Sorted + P95Index, Sorted + HistoryNum);
+
+		OutMeanMs = Sum / HistoryNum * 1000.f;
+		OutP95Ms = Sorted[P95Index] * 1000.f;
+		OutMaxMs = *std::max_element(Sorted + P95Index, Sorted + HistoryNum) * 1000.f;
+	}
+};
+
+/**
+ * Picks the threads count per stage from the measured cost per item instead of a fixed
+ * minimum batch. OperateConcurrently hands each thread one batch, so the batch size just
+ * splits the items evenly over the picked threads. The threads count minimizes
+ * Work / Threads + ThreadOverheadSeconds * Threads, stages whose whole frame of work is
+ * cheaper than a fork/join run on the calling thread. Every ValidateInterval runs the
+ * stage goes back to the CalculateThreadsCountAndBatchSize choice, and whenever that
+ * measured faster in wall time than the model's choice, it is kept instead. Until a
+ * stage has been measured, or while disabled, it uses CalculateThreadsCountAndBatchSize.
+ */
+class FBattleFrameStageTuner
+{
+public:
+
+	bool bEnabled = false;
+	double ThreadOverheadSeconds = 10e-6;// cost of waking and joining one more worker
+	double MinParallelSeconds = 30e-6;// total work below this runs single threaded
+	double Smoothing = 0.25;
+	int32 MinSampleItems = 16;// smaller runs are too noisy to learn from
+	int32 ValidateInterval = 60;// runs between re-measuring the baseline threads count
+
+	/*
+	 * Calculates on construction and measures until Stop, or until destruction when Stop is not called.
+	 * Construct it right before the concurrent call, and Stop it right after when more work follows in the same scope.
+	 */
+	class FScope
+	{
+	public:
+
+		FScope(FBattleFrameStageTuner& InTuner, const FName Name, const int32 IterableNum, const int32 MaxThreadsAllowed, const int32 MinBatchSizeAllowed, int32& ThreadsCount, int32& BatchSize)
+			: Tuner(InTuner)
+			, Tuning(InTuner.FindOrAdd(Name))
+		{
+			Tuner.Calculate(Tuning, IterableNum, MaxThreadsAllowed, MinBatchSizeAllowed, ThreadsCount, BatchSize);
+			StartTime = FPlatformTime::Seconds();
+		}
+
+		/* Timing only, for stages that are not split across threads. */
+		FScope(FBattleFrameStageTuner& InTuner, const FName Name)
+			: Tuner(InTuner)
+			, Tuning(InTuner.FindOrAdd(Name))
+		{
+			Tuning.ItemsCount = 0;
+			Tuning.ThreadsCount = 1;
+			Tuning.BatchSize = 1;
+			StartTime = FPlatformTime::Seconds();
+		}
+
+		~FScope()
+		{
+			Stop();
+		}
+
+		void Stop()
+		{
+			if (bStopped) return;
+
+			bStopped = true;
+			Tuner.Measure(Tuning, FPlatformTime::Seconds() - StartTime);
+		}
+
+	private:
+
+		FBattleFrameStageTuner& Tuner;
+		FBattleFrameStageTuning& Tuning;
+		double StartTime = 0.0;
+		bool bStopped = false;
+	};
+
+	/* Entries are never removed, so the returned reference stays valid. Safe to call from concurrent stages. */
+	FBattleFrameStageTuning& FindOrAdd(const FName Name)
+	{
+		FScopeLock ScopeLock(&Lock);
+
+		TUniquePtr<FBattleFrameStageTuning>& Entry = Stages.FindOrAdd(Name);
+
+		if (!Entry.IsValid())
+		{
+			Entry = MakeUnique<FBattleFrameStageTuning>();
+			Entry->Name = Name;
+
+			const FString NameString = Name.ToString();
+			Entry->ThreadsStatName = FName(*(NameString + TEXT("_Threads")));
+			Entry->BatchStatName = FName(*(NameString + TEXT("_Batch")));
+			Entry->CostStatName = FName(*(NameString + TEXT("_NsPerItem")));
+
+#if STATS
+			Entry->MeanStatId = FDynamicStats::CreateStatIdDouble<FStatGroup_STATGROUP_BattleFrame>(NameString + TEXT(" Mean (ms)"));
+			Entry->P95StatId = FDynamicStats::CreateStatIdDouble<FStatGroup_STATGROUP_BattleFrame>(NameString + TEXT(" P95 (ms)"));
+			Entry->MaxStatId = FDynamicStats::CreateStatIdDouble<FStatGroup_STATGROUP_BattleFrame>(NameString + TEXT(" Max (ms)"));
+			Entry->ItemsStatId = FDynamicStats::CreateStatIdInt64<FStatGroup_STATGROUP_BattleFrame>(NameString + TEXT(" Items"));
+			Entry->ThreadsStatId = FDynamicStats::CreateStatIdInt64<FStatGroup_STATGROUP_BattleFrame>(NameString + TEXT(" Threads"));
+#endif
+		}
+
+		return *Entry;
+	}
+
+	void Calculate(FBattleFrameStageTuning& Tuning, const int32 IterableNum, const int32 MaxThreadsAllowed, const int32 MinBatchSizeAllowed, int32& ThreadsCount, int32& BatchSize) const
+	{
+		Tuning.ItemsCount = IterableNum;
+
+		// 固定最小批次的选择，既是回退值也是验证模型的基准 | the fixed minimum batch choice, both the fallback and the baseline the model is checked against
+		UBattleFrameFunctionLibraryRT::CalculateThreadsCountAndBatchSize(IterableNum, MaxThreadsAllowed, MinBatchSizeAllowed, ThreadsCount, BatchSize);
+
+		const int32 MaxThreads = FMath::Clamp(MaxThreadsAllowed, 1, FBattleFrameStageTuning::MaxTunedThreads);
+		const int32 BaselineThreads = FMath::Clamp(ThreadsCount, 1, MaxThreads);
+		Tuning.BaselineThreadsCount = BaselineThreads;
+
+		if (bEnabled && Tuning.bMeasured && IterableNum > 0)
+		{
+			const double WorkSeconds = Tuning.SecondsPerItem * IterableNum;
+			int32 NewThreads = 1;
+
+			// 整帧的活还不如一次派发贵，直接在当前线程跑 | the whole frame of work costs less than a fork/join
+			if (WorkSeconds >= MinParallelSeconds)
+			{
+				// Work / n + Overhead * n 在 n = sqrt(Work / Overhead) 时最小 | Work / n + Overhead * n is smallest at n = sqrt(Work / Overhead)
+				NewThreads = FMath::Clamp(FMath::RoundToInt(FMath::Sqrt(WorkSeconds / FMath::Max(ThreadOverheadSeconds, 1e-9))), 1, MaxThreads);
+			}
+
+			const float PickedWall = Tuning.WallSecondsPerItem[NewThreads];
+			const float BaselineWall = Tuning.WallSecondsPerItem[BaselineThreads];
+
+			if (++Tuning.RunsSinceBaseline >= ValidateInterval || BaselineWall <= 0.f)
+			{
+				// 定期重测基准，验证数据不会过时 | re-measure the baseline now and then so the check does not go stale
+				NewThreads = BaselineThreads;
+			}
+			else if (PickedWall > 0.f && PickedWall > BaselineWall)
+			{
+				// 实测比基准慢，模型不可信 | measured slower than the baseline, the model is off for this stage
+				NewThreads = BaselineThreads;
+			}
+
+			if (NewThreads == BaselineThreads)
+			{
+				Tuning.RunsSinceBaseline = 0;
+			}
+
+			ThreadsCount = NewThreads;
+			BatchSize = FMath::DivideAndRoundUp(IterableNum, NewThreads);
+		}
+
+		Tuning.ThreadsCount = ThreadsCount;
+		Tuning.BatchSize = BatchSize;
+	}
+
+	void Measure(FBattleFrameStageTuning& Tuning, const double Seconds) const
+	{
+		Tuning.LastSeconds = Seconds;
+		Tuning.TotalSeconds += Seconds;
+		++Tuning.NumRuns;
+		Tuning.AddHistory(static_cast<float>(Seconds));
+
+		if (Tuning.ItemsCount < MinSampleItems) return;
+
+		// 按模型去掉派发开销，再乘以实际参与的线程数，折算成单线程成本 | strip the modelled fork/join overhead, then times the threads that actually had work, as single thread cost
+		const int32 NumTasks = FMath::DivideAndRoundUp(Tuning.ItemsCount, FMath::Max(1, Tuning.BatchSize));
+		const int32 UsedThreads = FMath::Clamp(FMath::Min(Tuning.ThreadsCount, NumTasks), 1, FTaskGraphInterface::Get().GetNumWorkerThreads() + 1);
+		const double WorkSeconds = UsedThreads > 1 ? FMath::Max(Seconds - ThreadOverheadSeconds * UsedThreads, Seconds * 0.1) : Seconds;
+		const double Sample = WorkSeconds * UsedThreads / Tuning.ItemsCount;
+
+		Tuning.SecondsPerItem = Tuning.bMeasured ? FMath::Lerp(Tuning.SecondsPerItem, Sample, Smoothing) : Sample;
+		Tuning.bMeasured = true;
+
+		float& Wall = Tuning.WallSecondsPerItem[FMath::Clamp(Tuning.ThreadsCount, 1, FBattleFrameStageTuning::MaxTunedThreads)];
+		const float WallSample = static_cast<float>(Seconds / Tuning.ItemsCount);
+		Wall = Wall > 0.f ? FMath::Lerp(Wall, WallSample, static_cast<float>(Smoothing)) : WallSample;
+	}
+
+	template<typename FunctionType>
+	void ForEachStage(FunctionType&& Function) const
+	{
+		FScopeLock ScopeLock(&Lock);
+
+		for (const auto& Pair : Stages)
+		{
+			Function(*Pair.Value);
+		}
+	}
+
+	void Reset()
+	{
+		FScopeLock ScopeLock(&Lock);
+		Stages.Reset();
+	}
+
+private:
+
+	TMap<FName, TUniquePtr<FBattleFrameStageTuning>> Stages;
+	mutable FCriticalSection Lock;
+};
@@ -0,0 +1,84 @@
+/*
+ * BattleFrame
+ * Created: 2025
+ * Author: Leroy Works, All Rights Reserved.
+ */
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Stats/Stats.h"
+#include "BattleFrameWorkerSlot.h"
+
+DECLARE_STATS_GROUP(TEXT("BattleFrame"), STATGROUP_BattleFrame, STATCAT_Advanced);
+
+enum class EBattleFrameCounter : uint8
+{
+	NeighborsExamined,
+	OrcaLinesBuilt,
+	TracesIssued,
+	DamageEvents,
+	Num
+};
+
+/**
+ * Frame counters bumped from worker threads. Each thread owns a cache line sized slot,
+ * so adding is a plain increment, and the game thread sums and clears all slots once
+ * per frame while no stage is running. Slots come from FBattleFrameWorkerSlot, threads past its
+ * MaxSlots share the last slot atomically.
+ */
+class FBattleFrameCounters
+{
+public:
+
+	static constexpr int32 NumCounters = static_cast<int32>(EBattleFrameCounter::Num);
+	static constexpr int32 MaxSlots = FBattleFrameWorkerSlot::MaxSlots;
+
+	static FORCEINLINE void Add(const EBattleFrameCounter Counter, const int64 Value)
+	{
+		FBattleFrameCounters& Counters = Get();
+		const int32 Slot = FBattleFrameWorkerSlot::Get();
+
+		if (LIKELY(Slot < MaxSlots - 1))
+		{
+			Counters.Slots[Slot].Values[static_cast<int32>(Counter)] += Value;
+		}
+		else
+		{
+			FPlatformAtomics::InterlockedAdd(&Counters.Slots[Slot].Values[static_cast<int32>(Counter)], Value);
+		}
+	}
+
+	/* Sum every slot into OutValues and clear them. Game thread only, with no stage in flight. */
+	static void Collect(int64 (&OutValues)[NumCounters])
+	{
+		FBattleFrameCounters& Counters = Get();
+		const int32 NumSlots = FBattleFrameWorkerSlot::Num();
+
+		FMemory::Memzero(OutValues);
+
+		for (int32 Slot = 0; Slot < NumSlots; ++Slot)
+		{
+			for (int32 i = 0; i < NumCounters; ++i)
+			{
+				OutValues[i] += Counters.Slots[Slot].Values[i];
+				Counters.Slots[Slot].Values[i] = 0;
+			}
+		}
+	}
+
+private:
+
+	struct alignas(PLATFORM_CACHE_LINE_SIZE) FSlot
+	{
+		int64 Values[NumCounters] = {};
+	};
+
+	FSlot Slots[MaxSlots];
+
+	static FBattleFrameCounters& Get()
+	{
+		static FBattleFrameCounters Counters;
+		return Counters;
+	}
+};
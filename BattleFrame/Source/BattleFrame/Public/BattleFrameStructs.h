@@ -586,3 +586,86 @@ public:
 
 };
 
+USTRUCT(BlueprintType)
+struct BATTLEFRAME_API FSimLODLevel
+{
+	GENERATED_BODY()
+
+public:
+
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, meta = (Tooltip = "与玩家的距离达到此值时进入本级"))
+	float MinDistance = 5000.f;
+
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, meta = (Tooltip = "每N帧更新一次移动与避障", ClampMin = "1"))
+	int32 UpdateInterval = 2;
+
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, meta = (Tooltip = "跳过受击发光、形变与血条渐变"))
+	bool bSkipCosmetics = true;
+
+	FSimLODLevel() = default;
+
+	FSimLODLevel(float InMinDistance, int32 InUpdateInterval, bool bInSkipCosmetics)
+		: MinDistance(InMinDistance)
+		, UpdateInterval(InUpdateInterval)
+		, bSkipCosmetics(bInSkipCosmetics)
+	{
+	}
+
+};
+
+USTRUCT(BlueprintType)
+struct BATTLEFRAME_API FBattleFrameStageStats
+{
+	GENERATED_BODY()
+
+public:
+
+	UPROPERTY(BlueprintReadOnly, VisibleAnywhere, meta = (Tooltip = "阶段名"))
+	FName Stage = NAME_None;
+
+	UPROPERTY(BlueprintReadOnly, VisibleAnywhere, meta = (Tooltip = "最近120次的平均耗时（毫秒）"))
+	float MeanMs = 0.f;
+
+	UPROPERTY(BlueprintReadOnly, VisibleAnywhere, meta = (Tooltip = "最近120次的P95耗时（毫秒）"))
+	float P95Ms = 0.f;
+
+	UPROPERTY(BlueprintReadOnly, VisibleAnywhere, meta = (Tooltip = "最近120次的最大耗时（毫秒）"))
+	float MaxMs = 0.f;
+
+	UPROPERTY(BlueprintReadOnly, VisibleAnywhere, meta = (Tooltip = "处理的数量"))
+	int32 Items = 0;
+
+	UPROPERTY(BlueprintReadOnly, VisibleAnywhere, meta = (Tooltip = "使用的线程数"))
+	int32 Threads = 0;
+
+	UPROPERTY(BlueprintReadOnly, VisibleAnywhere, meta = (Tooltip = "批次大小"))
+	int32 BatchSize = 0;
+
+};
+
+USTRUCT(BlueprintType)
+struct BATTLEFRAME_API FBattleFrameFrameStats
+{
+	GENERATED_BODY()
+
+public:
+
+	UPROPERTY(BlueprintReadOnly, VisibleAnywhere, meta = (Tooltip = "各阶段耗时"))
+	TArray<FBattleFrameStageStats> Stages;
+
+	UPROPERTY(BlueprintReadOnly, VisibleAnywhere, meta = (Tooltip = "Agent数量"))
+	int32 AgentCount = 0;
+
+	UPROPERTY(BlueprintReadOnly, VisibleAnywhere, meta = (Tooltip = "避障检查过的邻居数"))
+	int64 NeighborsExamined = 0;
+
+	UPROPERTY(BlueprintReadOnly, VisibleAnywhere, meta = (Tooltip = "构建的ORCA线数"))
+	int64 OrcaLinesBuilt = 0;
+
+	UPROPERTY(BlueprintReadOnly, VisibleAnywhere, meta = (Tooltip = "发起的索敌数"))
+	int64 TracesIssued = 0;
+
+	UPROPERTY(BlueprintReadOnly, VisibleAnywhere, meta = (Tooltip = "伤害事件数"))
+	int64 DamageEvents = 0;
+
+};
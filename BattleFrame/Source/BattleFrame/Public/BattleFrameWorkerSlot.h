@@ -0,0 +1,44 @@
+/*
+ * BattleFrame
+ * Created: 2025
+ * Author: Leroy Works, All Rights Reserved.
+ */
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include <atomic>
+
+/**
+ * Slot index of the calling thread, shared by the event buffers and the frame counters. The first MaxSlots - 1
+ * threads to ask get a slot of their own, later threads all land on the last slot, which users lock or update atomically.
+ */
+struct FBattleFrameWorkerSlot
+{
+	static constexpr int32 MaxSlots = 64;
+
+	static FORCEINLINE int32 Get()
+	{
+		static thread_local int32 Slot = INDEX_NONE;
+
+		if (UNLIKELY(Slot == INDEX_NONE))
+		{
+			Slot = FMath::Min(NumUsed().fetch_add(1, std::memory_order_acq_rel), MaxSlots - 1);
+		}
+
+		return Slot;
+	}
+
+	static FORCEINLINE int32 Num()
+	{
+		return FMath::Min(NumUsed().load(std::memory_order_acquire), MaxSlots);
+	}
+
+private:
+
+	static std::atomic<int32>& NumUsed()
+	{
+		static std::atomic<int32> Count{ 0 };
+		return Count;
+	}
+};
@@ -17,6 +17,7 @@
 
 #include "CoreMinimal.h"
 #include "Traits/GridData.h"
+#include "RVOVector2.h"
 #include "NeighborGridCell.generated.h"
     
  /**
@@ -68,3 +69,81 @@ public:
 		bRegistered = false;
 	}
 };
+
+/**
+ * Read-only structure-of-arrays view over the subjects of one cell.
+ * Only available in CountingSort build mode. Data holds the full entries
+ * and is meant to be touched only for candidates that pass the range test.
+ */
+struct FNeighborGridSoAView
+{
+	const float* X = nullptr;
+	const float* Y = nullptr;
+	const float* Z = nullptr;
+	const float* Radius = nullptr;
+	const uint32* Hash = nullptr;
+	const FGridData* Data = nullptr;
+	int32 Num = 0;
+};
+
+/**
+ * One box obstacle edge packed for ORCA: this vertex, the next vertex and
+ * everything the line builder reads from both, copied out of the traits once.
+ */
+struct FObstacleSegment
+{
+	uint32 SubjectHash = 0;
+	RVO::Vector2 Point1;
+	RVO::Vector2 Point2;
+	RVO::Vector2 UnitDir1;
+	RVO::Vector2 UnitDir2;
+	float ZMin = 0.f;
+	float ZMax = 0.f;
+	bool bConvex1 = true;
+	bool bConvex2 = true;
+};
+
+/**
+ * Per cell cache of the static obstacles overlapping it.
+ * Rebuilt only for cells touched when a static obstacle is added or removed.
+ */
+struct FStaticObstacleCache
+{
+	TArray<FObstacleSegment> Segments;
+	TArray<FGridData> Spheres;
+};
+
+/**
+ * A coarser level of the hierarchical neighbor grid. Subjects too large for
+ * the finer levels are registered once, into the cell holding their center.
+ * Queries widen their box by MaxRadiusBits, the largest radius registered
+ * this frame, so a single insert is always found and never seen twice.
+ */
+struct FNeighborGridLevel
+{
+	FVector CellSize = FVector::OneVector;
+	FVector InvCellSize = FVector::OneVector;
+	FIntVector GridSize = FIntVector::ZeroValue;
+	float MaxSubjectRadius = 0.f;// radius bound for picking this level
+	int32 MaxRadiusBits = 0;// float bits of the largest registered radius, positive floats order like ints
+	TArray<FNeighborGridCell> Cells;
+
+	FORCEINLINE float GetMaxRegisteredRadius() const
+	{
+		const int32 Bits = MaxRadiusBits;
+		return *reinterpret_cast<const float*>(&Bits);
+	}
+
+	FORCEINLINE void NoteRadius(const float Radius)
+	{
+		const int32 Bits = *reinterpret_cast<const int32*>(&Radius);
+		int32 Current = MaxRadiusBits;
+
+		while (Bits > Current)
+		{
+			const int32 Previous = FPlatformAtomics::InterlockedCompareExchange(&MaxRadiusBits, Bits, Current);
+			if (Previous == Current) break;
+			Current = Previous;
+		}
+	}
+};
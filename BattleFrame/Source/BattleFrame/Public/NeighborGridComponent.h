@@ -16,10 +16,12 @@
 #pragma once
 
 #include "CoreMinimal.h"
+#include "BattleFrame.h"
 #include "GameFramework/Actor.h"
 #include "MechanicalActorComponent.h"
 #include "Machine.h"
 #include "NeighborGridCell.h"
+#include "NeighborGridHash.h"
 #include "BattleFrameEnums.h"
 #include "BattleFrameStructs.h"
 #include "RVOSimulator.h"
@@ -36,6 +38,7 @@
 #include "Traits/Move.h"
 #include "Traits/Trace.h"
 #include "Traits/GridData.h"
+#include "Traits/GridOwner.h"
 #include "Traits/Avoiding.h"
 #include "Traits/Corpse.h"
 #include "Traits/Dying.h"
@@ -44,6 +47,7 @@
 #include "Traits/Patrol.h"
 #include "Traits/Directed.h"
 #include "Math/UnrealMathUtility.h"
+#include "Algo/Sort.h"
 #include "NeighborGridComponent.generated.h"
 
 #define BUBBLE_DEBUG 0
@@ -64,6 +68,22 @@ public:
 	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = Performance)
 	int32 MinBatchSizeAllowed = 100;
 
+	// 格子构建方式，CountingSort 以计数排序把所有单位写入一个连续数组 | How subject cells are rebuilt every frame
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = Performance)
+	EGridBuildMode BuildMode = EGridBuildMode::SpinLock;
+
+	// 格子存储方式，SparseHash 只为被占用的格子分配内存，不支持多层网格 | Dense preallocates GridSize cells, SparseHash allocates occupied cells only, is unbounded and runs with a single level
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = Performance)
+	ENeighborGridStorage Storage = ENeighborGridStorage::Dense;
+
+	// 稀疏模式的初始格子容量，不够时自动扩容 | Initial cell capacity of the sparse table, grown on demand
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = Performance, meta = (ClampMin = "64", EditCondition = "Storage == ENeighborGridStorage::SparseHash"))
+	int32 SparseInitialCells = 4096;
+
+	// 增量更新：单位不换格时原地刷新，只有换格的单位才移出移入，仅适用于 SpinLock + Dense 且单层网格 | Keep subject cells across frames and only move subjects that changed cell. SpinLock, Dense, single level only
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = Performance)
+	bool bIncrementalUpdate = false;
+
 	int32 ThreadsCount = 1;
 	int32 BatchSize = 1;
 
@@ -78,16 +98,70 @@ public:
 	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "Grid")
 	FIntVector GridSize = FIntVector(20, 20, 1);
 
+	// 网格层数，大于1时大体型单位按半径只注册到一个粗层格子，不再多格注册，仅限 Dense | With more than one level, large subjects are registered once into the coarse level matching their radius. Dense storage only
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "Grid", meta = (ClampMin = "1", ClampMax = "3", EditCondition = "Storage == ENeighborGridStorage::Dense"))
+	int32 GridLevels = 1;
+
+	// 相邻两层的格子尺寸倍数 | Cell size ratio between neighboring levels
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "Grid", meta = (ClampMin = "2", ClampMax = "8"))
+	int32 LevelScale = 4;
+
 	UPROPERTY(BlueprintReadOnly, VisibleAnywhere, Category = "Grid")
 	mutable FBox Bounds;
 
 	TArray<FNeighborGridCell> SubjectCells;
 	TArray<FNeighborGridCell> ObstacleCells;
 	TArray<FNeighborGridCell> StaticObstacleCells;
+	TArray<FNeighborGridLevel> CoarseLevels;// levels 1..GridLevels-1, subjects only
+
+	// SparseHash storage: per cell arrays are indexed by the table's cell id instead of the dense index
+	ENeighborGridStorage ActiveStorage = ENeighborGridStorage::Dense;
+	FSparseCellTable SparseCells;
 
 	FVector InvCellSizeCache = FVector(1 / 300.f, 1 / 300.f, 1 / 300.f);
 	TArray<TQueue<int32,EQueueMode::Mpsc>> OccupiedCellsQueues;
 
+	// CSR layout, only used when BuildMode == CountingSort. Subjects of cell i live in SortedSubjects[CellOffsets[i], CellOffsets[i + 1])
+	EGridBuildMode ActiveBuildMode = EGridBuildMode::SpinLock;
+	TArray<FGridData> SortedSubjects;
+	TArray<float> SortedX;// SoA mirror of SortedSubjects for SIMD range tests
+	TArray<float> SortedY;
+	TArray<float> SortedZ;
+	TArray<float> SortedRadius;
+	TArray<uint32> SortedHash;
+	TArray<int32> CellOffsets;
+	TArray<int32> CellCounts;// histogram, drained back to zero by the scatter pass
+	TArray<FGridData> EntryData;
+	TArray<int32> EntryCellIndices;
+
+	// Incremental update state. Subject cells persist, each subject's FGridOwner records the cell and frame it was last registered in
+	bool bIncrementalActive = false;// mode the current subject cells were built with
+	uint32 IncrementalStamp = 0;
+	int32 IncrementalEntryCount = 0;// single cell entries currently in the grid
+	TArray<int32> IncrementalSubjectCells;// every subject cell flagged bRegistered
+	TQueue<int32, EQueueMode::Mpsc> NewIncrementalCells;
+	TArray<int32> MultiRegisteredCells;// cells that received multi cell entries last frame
+	TQueue<int32, EQueueMode::Mpsc> MultiRegisteredCellsQueue;
+
+	// 上一帧换格与未换格的单位数 | Subjects that changed cell and that stayed put during the last update
+	int32 MovedSubjectsCount = 0;
+	int32 StationarySubjectsCount = 0;
+
+	// 静态障碍物按格缓存的紧凑数据，避障时无需查询特征 | Packed static obstacle data per cell, read by avoidance without trait lookups
+	TArray<FStaticObstacleCache> StaticObstacleCaches;
+	TMap<uint32, TArray<int32>> StaticObstacleFootprints;// obstacle hash -> cells it was registered into
+	TQueue<TPair<uint32, int32>, EQueueMode::Mpsc> StaticObstacleRegistrations;
+	TArray<int32> DirtyStaticObstacleCells;
+
+	// 多网格状态，每帧由 UpdateGrids 设置 | Multi grid state, set by UpdateGrids every frame
+	bool bPartitioned = false;// several grids, each registers only the subjects it owns
+	TArray<UNeighborGridComponent*> OtherGrids;// queries reaching past this grid's bounds look into these
+	TArray<FSubjectHandle> OwnedSubjects;// subjects assigned to this grid this frame, partitioned mode only
+	static TArray<TPair<int32, FSubjectHandle>> AssignedSubjects;// grid index per subject, scratch of AssignSubjects kept for its capacity
+
+	// 网格增删时递增，战斗控制据此刷新缓存的网格列表 | Bumped whenever a grid begins or ends play, the battle control refreshes its cached grid list on change
+	static uint32 GridListVersion;
+
 	EFlagmarkBit RegisterMultipleFlag = EFlagmarkBit::M;
 
 	FFilter RegisterNeighborGrid_Trace_Filter;
@@ -109,21 +183,87 @@ public:
 
 	void InitializeComponent() override;
 
+	void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
 	void DoInitializeCells()
 	{
+		ActiveStorage = Storage;
+
+		int32 NumCells = GridSize.X * GridSize.Y * GridSize.Z;
+
+		if (ActiveStorage == ENeighborGridStorage::SparseHash)
+		{
+			SparseCells.Init(SparseInitialCells);
+			NumCells = SparseCells.MaxCells;
+		}
+		else
+		{
+			SparseCells = FSparseCellTable();
+		}
+
 		SubjectCells.Empty();
 		ObstacleCells.Empty();
 		StaticObstacleCells.Empty();
 
 		OccupiedCellsQueues.Empty();
 
-		SubjectCells.AddDefaulted(GridSize.X * GridSize.Y * GridSize.Z);
-		ObstacleCells.AddDefaulted(GridSize.X * GridSize.Y * GridSize.Z);
-		StaticObstacleCells.AddDefaulted(GridSize.X * GridSize.Y * GridSize.Z);
+		SubjectCells.AddDefaulted(NumCells);
+		ObstacleCells.AddDefaulted(NumCells);
+		StaticObstacleCells.AddDefaulted(NumCells);
 
 		OccupiedCellsQueues.SetNum(MaxThreadsAllowed);
 
+		bIncrementalActive = false;
+		IncrementalEntryCount = 0;
+		IncrementalSubjectCells.Empty();
+		NewIncrementalCells.Empty();
+		MultiRegisteredCells.Empty();
+		MultiRegisteredCellsQueue.Empty();
+
+		SortedSubjects.Empty();
+		SortedX.Empty();
+		SortedY.Empty();
+		SortedZ.Empty();
+		SortedRadius.Empty();
+		SortedHash.Empty();
+		EntryData.Empty();
+		EntryCellIndices.Empty();
+		CellCounts.Empty();
+		CellOffsets.Empty();
+
+		CellCounts.AddZeroed(NumCells);
+		CellOffsets.AddZeroed(NumCells + 1);
+
+		StaticObstacleCaches.Empty();
+		StaticObstacleCaches.AddDefaulted(NumCells);
+		StaticObstacleFootprints.Empty();
+		StaticObstacleRegistrations.Empty();
+		DirtyStaticObstacleCells.Empty();
+
 		InvCellSizeCache = FVector(1 / CellSize.X, 1 / CellSize.Y, 1 / CellSize.Z);
+
+		CoarseLevels.Empty();
+
+		// 粗层是定长数组，会把稀疏网格界外的大体型单位夹进边缘格子，所以稀疏存储只用单层 | coarse levels are fixed arrays that would clamp far out subjects of an unbounded sparse grid into their edge cells, so sparse storage runs single level
+		int32 NumLevels = FMath::Clamp(GridLevels, 1, 3);
+
+		if (ActiveStorage == ENeighborGridStorage::SparseHash && NumLevels > 1)
+		{
+			UE_LOG(LogBattleFrame, Warning, TEXT("NeighborGrid %s: GridLevels > 1 is not supported with SparseHash storage, using a single level"), *GetNameSafe(GetOwner()));
+			NumLevels = 1;
+		}
+
+		for (int32 Level = 1; Level < NumLevels; ++Level)
+		{
+			const int32 Scale = FMath::RoundToInt(FMath::Pow(static_cast<float>(FMath::Max(LevelScale, 2)), static_cast<float>(Level)));
+
+			FNeighborGridLevel& CoarseLevel = CoarseLevels.AddDefaulted_GetRef();
+			CoarseLevel.CellSize = CellSize * Scale;
+			CoarseLevel.InvCellSize = FVector(1 / CoarseLevel.CellSize.X, 1 / CoarseLevel.CellSize.Y, 1 / CoarseLevel.CellSize.Z);
+			CoarseLevel.GridSize = FIntVector(FMath::DivideAndRoundUp(GridSize.X, Scale), FMath::DivideAndRoundUp(GridSize.Y, Scale), FMath::DivideAndRoundUp(GridSize.Z, Scale));
+			CoarseLevel.MaxSubjectRadius = CoarseLevel.CellSize.GetMin() * 0.5f;
+			CoarseLevel.Cells.AddDefaulted(CoarseLevel.GridSize.X * CoarseLevel.GridSize.Y * CoarseLevel.GridSize.Z);
+		}
 	}
 
 	void BeginPlay() override;
@@ -197,38 +337,239 @@ public:
 
 	void Update();
 
+	/*
+	 * Update every grid of the world. A single grid updates as it always did. With several grids each subject
+	 * is assigned to the grid whose bounds contain it, the grids register their own subjects concurrently,
+	 * then obstacles are registered into every grid they reach.
+	 */
+	static void UpdateGrids(const TArray<UNeighborGridComponent*>& Grids);
+
+	/*
+	 * Hand subjects to the grid containing them, as soon as they leave the bounds of their current grid.
+	 * Where grids overlap a subject keeps its current grid, so overlapping neighbors give hysteresis at the border.
+	 * Fills every grid's OwnedSubjects from the chain, which must stay alive until the grids have registered them.
+	 */
+	template<typename ChainType>
+	static void AssignSubjects(const TArray<UNeighborGridComponent*, TInlineAllocator<16>>& Grids, ChainType& Chain);
+
+	/* Drop a subject that moved to another grid from its incremental cell. Safe to call concurrently. */
+	void ReleaseSubject(const FGridData& GridData, const FGridOwner& GridOwner);
+
+	/* Register NumSubjects subjects. ForEachSubject(RegisterSubject) feeds RegisterSubject every subject concurrently, in ThreadsCount batches of BatchSize. */
+	template<typename ForEachSubjectType>
+	void UpdateSubjects(int32 NumSubjects, ForEachSubjectType&& ForEachSubject);
+
+	/* Register only the subjects AssignSubjects gave to this grid. */
+	void UpdateOwnedSubjects();
+
+	void UpdateObstacles();
+
+	void BuildSortedSubjects(int32 NumEntries);
+
+	/*
+	 * Drop subject entries from the given cells whose FGridOwner no longer places them there this frame.
+	 * With bMultiOnly, which runs before registration, only last frame's multi cell entries are dropped.
+	 * Cells left empty are unflagged when bPrune is set.
+	 */
+	void SweepStaleSubjects(TArray<int32>& Cells, bool bPrune, bool bMultiOnly = false);
+
+	void RebuildStaticObstacleCaches();
+
+	/*
+	 * SparseHash only: make room for ExpectedNewCells more cells before a registration stage.
+	 * With bCompact, which is only valid while subject and dynamic obstacle cells are empty, cells left
+	 * without static obstacles are dropped first so the table tracks what is occupied now.
+	 */
+	void ReserveSparseCells(int32 ExpectedNewCells, bool bCompact);
+
+	/* Bytes held by the per cell arrays and the sparse table, for comparing storage modes. */
+	SIZE_T GetCellMemorySize() const;
+
+	/* Drop a static obstacle from every cell it was registered into and invalidate just those cells. */
+	void UnregisterStaticObstacle(const FSubjectHandle& Obstacle);
+
+	/* Pack a box obstacle edge from its traits. Returns false if the obstacle or its next vertex is gone. */
+	static bool MakeObstacleSegment(const FGridData& Obstacle, FObstacleSegment& OutSegment);
+
 	void DefineFilters();
 
 
 	//---------------------------------------------Helpers------------------------------------------------------------------
 
-	FORCEINLINE TArray<FIntVector> GetNeighborCells(const FVector& Center, const FVector& Range3D) const
+	/*
+	 * Invoke Func(const UNeighborGridComponent* Grid) for this grid and for every other grid the box Center +- Extent overlaps.
+	 * Subjects live only in the grid that owns them, so queries near a border use this to look across it.
+	 */
+	template<typename FunctionType>
+	FORCEINLINE void ForEachGridInBox(const FVector& Center, const FVector& Extent, FunctionType&& Func) const
+	{
+		Func(this);
+
+		if (LIKELY(OtherGrids.IsEmpty())) return;
+
+		const FBox Box(Center - Extent, Center + Extent);
+
+		for (const UNeighborGridComponent* Grid : OtherGrids)
+		{
+			if (Grid->Bounds.Intersect(Box))
+			{
+				Func(Grid);
+			}
+		}
+	}
+
+	/*
+	 * Invoke Func(int32 CellIndex, const FIntVector& Coord) for every in-grid cell overlapped by the box Center +- Range3D.
+	 * The box is clamped to the grid once up front and cell indices are stepped directly, nothing is allocated.
+	 * With SparseHash storage only existing cells are visited, unless bCreateCells asks for missing ones to be added.
+	 */
+	template<bool bCreateCells = false, typename FunctionType>
+	FORCEINLINE void ForEachCellInBox(const FVector& Center, const FVector& Range3D, FunctionType&& Func) const
 	{
 		const FIntVector Min = LocationToCoord(Center - Range3D);
 		const FIntVector Max = LocationToCoord(Center + Range3D);
 
-		TArray<FIntVector> ValidCells;
-		const int32 ExpectedCells = (Max.X - Min.X + 1) * (Max.Y - Min.Y + 1) * (Max.Z - Min.Z + 1);
-		ValidCells.Reserve(ExpectedCells); // 根据场景规模调整
-
-		for (int32 z = Min.Z; z <= Max.Z; ++z) 
+		if (ActiveStorage == ENeighborGridStorage::SparseHash)
 		{
-			for (int32 y = Min.Y; y <= Max.Y; ++y) 
+			for (int32 z = Min.Z; z <= Max.Z; ++z)
 			{
-				for (int32 x = Min.X; x <= Max.X; ++x) 
+				for (int32 y = Min.Y; y <= Max.Y; ++y)
 				{
-					const FIntVector Coord(x, y, z);
-					if (LIKELY(IsInside(Coord))) 
-					{ // 分支预测优化
-						ValidCells.Emplace(Coord);
+					for (int32 x = Min.X; x <= Max.X; ++x)
+					{
+						const FIntVector Coord(x, y, z);
+						int32 CellIndex;
+
+						if constexpr (bCreateCells)
+						{
+							CellIndex = const_cast<UNeighborGridComponent*>(this)->FindOrAddCellIndex(Coord);
+						}
+						else
+						{
+							CellIndex = SparseCells.Find(Coord);
+						}
+
+						if (CellIndex != INDEX_NONE)
+						{
+							Func(CellIndex, Coord);
+						}
 					}
 				}
 			}
+
+			return;
+		}
+
+		const int32 MinX = FMath::Max(Min.X, 0), MaxX = FMath::Min(Max.X, GridSize.X - 1);
+		const int32 MinY = FMath::Max(Min.Y, 0), MaxY = FMath::Min(Max.Y, GridSize.Y - 1);
+		const int32 MinZ = FMath::Max(Min.Z, 0), MaxZ = FMath::Min(Max.Z, GridSize.Z - 1);
+
+		for (int32 z = MinZ; z <= MaxZ; ++z)
+		{
+			for (int32 y = MinY; y <= MaxY; ++y)
+			{
+				int32 CellIndex = MinX + GridSize.X * (y + GridSize.Y * z);
+
+				for (int32 x = MinX; x <= MaxX; ++x, ++CellIndex)
+				{
+					Func(CellIndex, FIntVector(x, y, z));
+				}
+			}
+		}
+	}
+
+	/*
+	 * Invoke Func(int32 CellIndex, const FIntVector& Coord) once for every in-grid cell touched by a sphere swept from Start to End,
+	 * nearest to Start first. Cells are deduplicated as plain indices in an inline buffer, so typical sweeps stay off the heap.
+	 * Func may return bool, false stops the walk early.
+	 */
+	template<typename FunctionType>
+	FORCEINLINE void ForEachCellAlongSweep(const FVector& Start, const FVector& End, float Radius, FunctionType&& Func) const
+	{
+		struct FSweepCell
+		{
+			float DistSq;
+			int32 CellIndex;
+			FIntVector Coord;
+		};
+
+		TArray<int32, TInlineAllocator<256>> CellIndices;
+
+		VisitSweepStamps(Start, End, Radius, [&](const FIntVector& Coord)
+		{
+			const int32 CellIndex = FindCellIndex(Coord);
+
+			if (CellIndex != INDEX_NONE)
+			{
+				CellIndices.Add(CellIndex);
+			}
+		});
+
+		Algo::Sort(CellIndices);
+
+		// 去重后按距离Start点的平方距离排序（避免开根号）| unique, then order by squared distance to Start
+		TArray<FSweepCell, TInlineAllocator<128>> SweepCells;
+		int32 PrevIndex = INDEX_NONE;
+
+		for (const int32 CellIndex : CellIndices)
+		{
+			if (CellIndex == PrevIndex) continue;
+			PrevIndex = CellIndex;
+
+			const FIntVector Coord = CellIndexToCoord(CellIndex);
+
+			SweepCells.Add({ static_cast<float>((CoordToLocation(Coord) - Start).SizeSquared()), CellIndex, Coord });
+		}
+
+		Algo::Sort(SweepCells, [](const FSweepCell& A, const FSweepCell& B)
+		{
+			return A.DistSq < B.DistSq || (A.DistSq == B.DistSq && A.CellIndex < B.CellIndex);
+		});
+
+		for (const FSweepCell& Cell : SweepCells)
+		{
+			if constexpr (std::is_same_v<decltype(Func(Cell.CellIndex, Cell.Coord)), bool>)
+			{
+				if (!Func(Cell.CellIndex, Cell.Coord)) return;
+			}
+			else
+			{
+				Func(Cell.CellIndex, Cell.Coord);
+			}
 		}
+	}
+
+	FORCEINLINE TArray<FIntVector> GetNeighborCells(const FVector& Center, const FVector& Range3D) const
+	{
+		TArray<FIntVector> ValidCells;
+		GetNeighborCells(Center, Range3D, ValidCells);
 		return ValidCells;
 	}
 
+	/* Same as above but fills a caller owned array, so scratch buffers can be reused without allocating. */
+	template<typename AllocatorType>
+	FORCEINLINE void GetNeighborCells(const FVector& Center, const FVector& Range3D, TArray<FIntVector, AllocatorType>& ValidCells) const
+	{
+		ValidCells.Reset();
+		ForEachCellInBox(Center, Range3D, [&](int32 CellIndex, const FIntVector& Coord)
+		{
+			ValidCells.Emplace(Coord);
+		});
+	}
+
 	FORCEINLINE TArray<FIntVector> SphereSweepForCells(const FVector& Start, const FVector& End, float Radius) const
+	{
+		TArray<FIntVector> ResultArray;
+		ForEachCellAlongSweep(Start, End, Radius, [&](int32 CellIndex, const FIntVector& Coord)
+		{
+			ResultArray.Add(Coord);
+		});
+		return ResultArray;
+	}
+
+	/* Walk the Bresenham line from Start to End and stamp a sphere of cells at every step. Coords may repeat and may lie outside the grid. */
+	template<typename FunctionType>
+	FORCEINLINE void VisitSweepStamps(const FVector& Start, const FVector& End, float Radius, FunctionType&& Func) const
 	{
 		// 预计算关键参数 - 现在每个轴有自己的半径值
 		const FVector RadiusInCellsValue(Radius / CellSize.X, Radius / CellSize.Y, Radius / CellSize.Z);
@@ -236,14 +577,6 @@ public:
 			FMath::CeilToInt(RadiusInCellsValue.X),
 			FMath::CeilToInt(RadiusInCellsValue.Y),
 			FMath::CeilToInt(RadiusInCellsValue.Z));
-		const FVector RadiusSq(
-			FMath::Square(RadiusInCellsValue.X),
-			FMath::Square(RadiusInCellsValue.Y),
-			FMath::Square(RadiusInCellsValue.Z));
-
-		// 改用TArray+BitArray加速去重
-		TArray<FIntVector> GridCells;
-		TSet<FIntVector> GridCellsSet; // 保持TSet或根据性能测试调整
 
 		FIntVector StartCell = LocationToCoord(Start);
 		FIntVector EndCell = LocationToCoord(End);
@@ -265,7 +598,7 @@ public:
 
 			for (int32 i = 0; i < AbsDelta.X; ++i)
 			{
-				AddSphereCells(CurrentCell, RadiusInCells, RadiusSq, GridCellsSet);
+				VisitSphereCells(CurrentCell, RadiusInCells, Func);
 				if (P1 >= 0) { CurrentCell.Y += YStep; P1 -= 2 * AbsDelta.X; }
 				if (P2 >= 0) { CurrentCell.Z += ZStep; P2 -= 2 * AbsDelta.X; }
 				P1 += 2 * AbsDelta.Y;
@@ -280,7 +613,7 @@ public:
 			int32 P2 = 2 * AbsDelta.Z - AbsDelta.Y;
 			for (int32 i = 0; i < AbsDelta.Y; ++i)
 			{
-				AddSphereCells(CurrentCell, RadiusInCells, RadiusSq, GridCellsSet);
+				VisitSphereCells(CurrentCell, RadiusInCells, Func);
 				if (P1 >= 0) { CurrentCell.X += XStep; P1 -= 2 * AbsDelta.Y; }
 				if (P2 >= 0) { CurrentCell.Z += ZStep; P2 -= 2 * AbsDelta.Y; }
 				P1 += 2 * AbsDelta.X;
@@ -295,7 +628,7 @@ public:
 			int32 P2 = 2 * AbsDelta.Y - AbsDelta.Z;
 			for (int32 i = 0; i < AbsDelta.Z; ++i)
 			{
-				AddSphereCells(CurrentCell, RadiusInCells, RadiusSq, GridCellsSet);
+				VisitSphereCells(CurrentCell, RadiusInCells, Func);
 				if (P1 >= 0) { CurrentCell.X += XStep; P1 -= 2 * AbsDelta.Z; }
 				if (P2 >= 0) { CurrentCell.Y += YStep; P2 -= 2 * AbsDelta.Z; }
 				P1 += 2 * AbsDelta.X;
@@ -304,26 +637,12 @@ public:
 			}
 		}
 
-		AddSphereCells(EndCell, RadiusInCells, RadiusSq, GridCellsSet);
-
-		// 转换为数组并排序
-		TArray<FIntVector> ResultArray = GridCellsSet.Array();
-
-		// 按距离Start点的平方距离排序（避免开根号）
-		Algo::Sort(ResultArray, [this, Start](const FIntVector& A, const FIntVector& B)
-			{
-				const FVector WorldA = CoordToLocation(A);
-				const FVector WorldB = CoordToLocation(B);
-				return (WorldA - Start).SizeSquared() < (WorldB - Start).SizeSquared();
-			});
-
-		return ResultArray;
+		VisitSphereCells(EndCell, RadiusInCells, Func);
 	}
 
-	FORCEINLINE void AddSphereCells(const FIntVector& CenterCell, const FIntVector& RadiusInCells, const FVector& RadiusSq, TSet<FIntVector>& GridCells) const
+	template<typename FunctionType>
+	FORCEINLINE void VisitSphereCells(const FIntVector& CenterCell, const FIntVector& RadiusInCells, FunctionType& Func) const
 	{
-		//TRACE_CPUPROFILER_EVENT_SCOPE_STR("AddSphereCells");
-
 		// 分层遍历优化：减少无效循环
 		for (int32 x = -RadiusInCells.X; x <= RadiusInCells.X; ++x)
 		{
@@ -340,7 +659,7 @@ public:
 				const int32 MaxZ = FMath::FloorToInt(RadiusInCells.Z * FMath::Sqrt(RemainingNormSq));
 				for (int32 z = -MaxZ; z <= MaxZ; ++z)
 				{
-					GridCells.Add(CenterCell + FIntVector(x, y, z));
+					Func(CenterCell + FIntVector(x, y, z));
 				}
 			}
 		}
@@ -357,9 +676,11 @@ public:
 		return Bounds;
 	}
 
-	/* Check if the cage point is inside the cage. */
+	/* Check if the cage point is inside the cage. Sparse grids are unbounded up to the key packing range. */
 	FORCEINLINE bool IsInside(const FIntVector& Coord) const
 	{
+		if (ActiveStorage == ENeighborGridStorage::SparseHash) return FSparseCellTable::IsPackable(Coord);
+
 		return (Coord.X >= 0) && (Coord.X < GridSize.X) && (Coord.Y >= 0) && (Coord.Y < GridSize.Y) && (Coord.Z >= 0) && (Coord.Z < GridSize.Z);
 	}
 
@@ -404,6 +725,33 @@ public:
 		return FIntVector(LayerPadding / GridSize.X, LayerPadding % GridSize.X, Z);
 	}
 
+	/* Get the cell index of a coord, or INDEX_NONE if it is outside the grid or, for sparse grids, not occupied. */
+	FORCEINLINE int32 FindCellIndex(const FIntVector& Coord) const
+	{
+		if (ActiveStorage == ENeighborGridStorage::SparseHash) return SparseCells.Find(Coord);
+
+		return IsInside(Coord) ? CoordToIndex(Coord) : INDEX_NONE;
+	}
+
+	/* Same as FindCellIndex, but sparse grids add the cell if missing. Safe to call from registration workers. */
+	FORCEINLINE int32 FindOrAddCellIndex(const FIntVector& Coord)
+	{
+		if (ActiveStorage == ENeighborGridStorage::SparseHash) return IsInside(Coord) ? SparseCells.FindOrAdd(Coord) : INDEX_NONE;
+
+		return IsInside(Coord) ? CoordToIndex(Coord) : INDEX_NONE;
+	}
+
+	/* Inverse of FindCellIndex for a valid cell index. */
+	FORCEINLINE FIntVector CellIndexToCoord(const int32 CellIndex) const
+	{
+		if (ActiveStorage == ENeighborGridStorage::SparseHash) return SparseCells.Coords[CellIndex];
+
+		const int32 LayerSize = GridSize.X * GridSize.Y;
+		const int32 Z = CellIndex / LayerSize;
+		const int32 Y = (CellIndex - Z * LayerSize) / GridSize.X;
+		return FIntVector(CellIndex - Z * LayerSize - Y * GridSize.X, Y, Z);
+	}
+
 	/* Get the index of the cell by the world position. */
 	FORCEINLINE int32 LocationToIndex(const FVector& Location) const
 	{
@@ -421,6 +769,214 @@ public:
 		return Cells[CoordToIndex(Coord)];
 	}
 
+	/* Get subjects in a specific cage cell as a contiguous span. Works with both build modes. */
+	FORCEINLINE TArrayView<const FGridData> GetSubjectsAt(const int32 CellIndex) const
+	{
+		if (ActiveBuildMode == EGridBuildMode::CountingSort)
+		{
+			const int32 Begin = CellOffsets[CellIndex];
+			return TArrayView<const FGridData>(SortedSubjects.GetData() + Begin, CellOffsets[CellIndex + 1] - Begin);
+		}
+
+		return MakeArrayView(SubjectCells[CellIndex].Subjects);
+	}
+
+	FORCEINLINE TArrayView<const FGridData> GetSubjectsAt(const FIntVector& Coord) const
+	{
+		const int32 CellIndex = FindCellIndex(Coord);
+		return CellIndex != INDEX_NONE ? GetSubjectsAt(CellIndex) : TArrayView<const FGridData>();
+	}
+
+	/* Get the SoA view of a cell. Empty unless the grid was built in CountingSort mode. */
+	FORCEINLINE FNeighborGridSoAView GetSubjectsSoAAt(const int32 CellIndex) const
+	{
+		FNeighborGridSoAView View;
+
+		if (ActiveBuildMode == EGridBuildMode::CountingSort)
+		{
+			const int32 Begin = CellOffsets[CellIndex];
+			View.X = SortedX.GetData() + Begin;
+			View.Y = SortedY.GetData() + Begin;
+			View.Z = SortedZ.GetData() + Begin;
+			View.Radius = SortedRadius.GetData() + Begin;
+			View.Hash = SortedHash.GetData() + Begin;
+			View.Data = SortedSubjects.GetData() + Begin;
+			View.Num = CellOffsets[CellIndex + 1] - Begin;
+		}
+
+		return View;
+	}
+
+	/*
+	 * Invoke Func(const FGridData&, float DistSqr) for every subject of the cell whose center is within Range of Center,
+	 * or within Range + its own radius when bAddSubjectRadius is set. SkipHash leaves out one subject, e.g. the querying agent.
+	 * In CountingSort mode the distance test runs 4 candidates at a time over the SoA arrays and only accepted entries are read.
+	 */
+	template<bool bAddSubjectRadius, typename FunctionType>
+	FORCEINLINE void ForEachSubjectInRange(const int32 CellIndex, const FVector3f& Center, const float Range, const uint32 SkipHash, FunctionType&& Func) const
+	{
+		if (ActiveBuildMode == EGridBuildMode::CountingSort)
+		{
+			const FNeighborGridSoAView View = GetSubjectsSoAAt(CellIndex);
+			int32 i = 0;
+
+			const VectorRegister4Float CenterX = VectorSetFloat1(Center.X);
+			const VectorRegister4Float CenterY = VectorSetFloat1(Center.Y);
+			const VectorRegister4Float CenterZ = VectorSetFloat1(Center.Z);
+			const VectorRegister4Float RangeV = VectorSetFloat1(Range);
+			const VectorRegister4Float RangeSqrV = VectorMultiply(RangeV, RangeV);
+
+			for (; i + 4 <= View.Num; i += 4)
+			{
+				const VectorRegister4Float DX = VectorSubtract(VectorLoad(View.X + i), CenterX);
+				const VectorRegister4Float DY = VectorSubtract(VectorLoad(View.Y + i), CenterY);
+				const VectorRegister4Float DZ = VectorSubtract(VectorLoad(View.Z + i), CenterZ);
+				const VectorRegister4Float DistSqr = VectorAdd(VectorAdd(VectorMultiply(DX, DX), VectorMultiply(DY, DY)), VectorMultiply(DZ, DZ));
+
+				VectorRegister4Float LimitSqr = RangeSqrV;
+
+				if constexpr (bAddSubjectRadius)
+				{
+					const VectorRegister4Float Limit = VectorAdd(RangeV, VectorLoad(View.Radius + i));
+					LimitSqr = VectorMultiply(Limit, Limit);
+				}
+
+				uint32 Mask = VectorMaskBits(VectorCompareLE(DistSqr, LimitSqr));
+
+				if (LIKELY(Mask == 0)) continue;
+
+				alignas(16) float DistSqrLanes[4];
+				VectorStoreAligned(DistSqr, DistSqrLanes);
+
+				while (Mask)
+				{
+					const int32 Lane = FMath::CountTrailingZeros(Mask);
+					Mask &= Mask - 1;
+
+					if (UNLIKELY(View.Hash[i + Lane] == SkipHash)) continue;
+
+					Func(View.Data[i + Lane], DistSqrLanes[Lane]);
+				}
+			}
+
+			// 尾部不足4个的候选走标量路径 | the remaining tail falls through to the scalar loop
+			for (; i < View.Num; ++i)
+			{
+				const float DX = View.X[i] - Center.X;
+				const float DY = View.Y[i] - Center.Y;
+				const float DZ = View.Z[i] - Center.Z;
+				const float DistSqr = DX * DX + DY * DY + DZ * DZ;
+				const float Limit = bAddSubjectRadius ? Range + View.Radius[i] : Range;
+
+				if (DistSqr > Limit * Limit || View.Hash[i] == SkipHash) continue;
+
+				Func(View.Data[i], DistSqr);
+			}
+
+			return;
+		}
+
+		for (const FGridData& Data : SubjectCells[CellIndex].Subjects)
+		{
+			const FVector3f Delta = Data.Location - Center;
+			const float DistSqr = Delta.X * Delta.X + Delta.Y * Delta.Y + Delta.Z * Delta.Z;
+			const float Limit = bAddSubjectRadius ? Range + Data.Radius : Range;
+
+			if (DistSqr > Limit * Limit || Data.SubjectHash == SkipHash) continue;
+
+			Func(Data, DistSqr);
+		}
+	}
+
+	template<bool bAddSubjectRadius, typename FunctionType>
+	FORCEINLINE void ForEachSubjectInRange(const FIntVector& Coord, const FVector3f& Center, const float Range, const uint32 SkipHash, FunctionType&& Func) const
+	{
+		const int32 CellIndex = FindCellIndex(Coord);
+
+		if (CellIndex != INDEX_NONE)
+		{
+			ForEachSubjectInRange<bAddSubjectRadius>(CellIndex, Center, Range, SkipHash, Forward<FunctionType>(Func));
+		}
+	}
+
+	//---------------------------------------------Levels------------------------------------------------------------------
+
+	/* Pick the coarse level a subject of this radius belongs to, or INDEX_NONE for the base level. */
+	FORCEINLINE int32 PickCoarseLevel(const float Radius) const
+	{
+		if (CoarseLevels.IsEmpty() || Radius <= CellSize.GetMin() * 0.5f) return INDEX_NONE;
+
+		for (int32 Level = 0; Level < CoarseLevels.Num(); ++Level)
+		{
+			if (Radius <= CoarseLevels[Level].MaxSubjectRadius) return Level;
+		}
+
+		return CoarseLevels.Num() - 1;// larger still, the widened query box covers it
+	}
+
+	FORCEINLINE int32 LevelLocationToIndex(const FNeighborGridLevel& Level, const FVector& Location) const
+	{
+		const FVector Local = (Location - Bounds.Min) * Level.InvCellSize;
+		const int32 X = FMath::Clamp(FMath::FloorToInt(Local.X), 0, Level.GridSize.X - 1);
+		const int32 Y = FMath::Clamp(FMath::FloorToInt(Local.Y), 0, Level.GridSize.Y - 1);
+		const int32 Z = FMath::Clamp(FMath::FloorToInt(Local.Z), 0, Level.GridSize.Z - 1);
+		return X + Level.GridSize.X * (Y + Level.GridSize.Y * Z);
+	}
+
+	/*
+	 * Invoke Func(const FGridData&) for every subject on the coarse levels whose cell overlaps the box Center +- Extent
+	 * widened by the largest radius registered on that level. Every subject lives in exactly one cell, so nothing repeats.
+	 */
+	template<typename FunctionType>
+	FORCEINLINE void ForEachCoarseSubjectInBox(const FVector& Center, const FVector& Extent, FunctionType&& Func) const
+	{
+		for (const FNeighborGridLevel& Level : CoarseLevels)
+		{
+			const float MaxRadius = Level.GetMaxRegisteredRadius();
+			if (MaxRadius <= 0.f) continue;// nothing registered this frame
+
+			const FVector Range = Extent + FVector(MaxRadius);
+			const FVector Min = (Center - Range - Bounds.Min) * Level.InvCellSize;
+			const FVector Max = (Center + Range - Bounds.Min) * Level.InvCellSize;
+
+			const int32 MinX = FMath::Max(FMath::FloorToInt(Min.X), 0), MaxX = FMath::Min(FMath::FloorToInt(Max.X), Level.GridSize.X - 1);
+			const int32 MinY = FMath::Max(FMath::FloorToInt(Min.Y), 0), MaxY = FMath::Min(FMath::FloorToInt(Max.Y), Level.GridSize.Y - 1);
+			const int32 MinZ = FMath::Max(FMath::FloorToInt(Min.Z), 0), MaxZ = FMath::Min(FMath::FloorToInt(Max.Z), Level.GridSize.Z - 1);
+
+			for (int32 z = MinZ; z <= MaxZ; ++z)
+			{
+				for (int32 y = MinY; y <= MaxY; ++y)
+				{
+					int32 CellIndex = MinX + Level.GridSize.X * (y + Level.GridSize.Y * z);
+
+					for (int32 x = MinX; x <= MaxX; ++x, ++CellIndex)
+					{
+						for (const FGridData& Data : Level.Cells[CellIndex].Subjects)
+						{
+							Func(Data);
+						}
+					}
+				}
+			}
+		}
+	}
+
+	/* Coarse level counterpart of ForEachSubjectInRange, same filtering and callback signature. */
+	template<bool bAddSubjectRadius, typename FunctionType>
+	FORCEINLINE void ForEachCoarseSubjectInRange(const FVector3f& Center, const float Range, const uint32 SkipHash, FunctionType&& Func) const
+	{
+		ForEachCoarseSubjectInBox(FVector(Center), FVector(Range), [&](const FGridData& Data)
+		{
+			const FVector3f Delta = Data.Location - Center;
+			const float DistSqr = Delta.X * Delta.X + Delta.Y * Delta.Y + Delta.Z * Delta.Z;
+			const float Limit = bAddSubjectRadius ? Range + Data.Radius : Range;
+
+			if (DistSqr > Limit * Limit || Data.SubjectHash == SkipHash) return;
+
+			Func(Data, DistSqr);
+		});
+	}
+
 	/* Get subjects in a specific cage cell by world 3d-location. */
 	FORCEINLINE FNeighborGridCell& GetCellAt(TArray<FNeighborGridCell>& Cells, const FVector& Location) const
 	{
@@ -0,0 +1,204 @@
+/*
+ * BattleFrame
+ * Created: 2025
+ * Author: Leroy Works, All Rights Reserved.
+ */
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+/**
+ * Open addressing hash from cell coordinate to a dense cell id, used by the
+ * SparseHash grid storage. Ids are handed out in insertion order and stay
+ * stable across Rehash, so per cell arrays indexed by id survive a rehash.
+ * Find and FindOrAdd may run concurrently, Init/Rehash/Compact may not.
+ */
+struct FSparseCellTable
+{
+	static constexpr int64 EmptyKey = -1;// PackKey never sets bit 63
+	static constexpr int32 PendingId = INDEX_NONE;// key claimed, id not yet published
+	static constexpr int32 OverflowId = -2;// key claimed after the table ran out of ids
+	static constexpr int32 CoordBits = 21;
+	static constexpr int32 CoordLimit = 1 << (CoordBits - 1);
+
+	TArray<int64> Keys;
+	TArray<int32> Ids;
+	TArray<FIntVector> Coords;// id -> coord
+	int32 NumCells = 0;// may run past MaxCells while overflowing, clamp with GetNumCells
+	int32 MaxCells = 0;
+	uint32 BucketMask = 0;
+
+	static FORCEINLINE bool IsPackable(const FIntVector& Coord)
+	{
+		return FMath::Abs(Coord.X) < CoordLimit && FMath::Abs(Coord.Y) < CoordLimit && FMath::Abs(Coord.Z) < CoordLimit;
+	}
+
+	static FORCEINLINE int64 PackKey(const FIntVector& Coord)
+	{
+		constexpr int64 Mask = (int64(1) << CoordBits) - 1;
+		return (int64(Coord.X) & Mask) | ((int64(Coord.Y) & Mask) << CoordBits) | ((int64(Coord.Z) & Mask) << (CoordBits * 2));
+	}
+
+	static FORCEINLINE uint32 HashKey(const int64 Key)
+	{
+		return static_cast<uint32>((static_cast<uint64>(Key) * 0x9E3779B97F4A7C15ull) >> 32);
+	}
+
+	FORCEINLINE int32 GetNumCells() const
+	{
+		return FMath::Min(NumCells, MaxCells);
+	}
+
+	FORCEINLINE bool HasOverflowed() const
+	{
+		return NumCells > MaxCells;
+	}
+
+	/* Reset to an empty table with room for InMaxCells ids. Buckets are kept at least twice that, so probes stay short. */
+	void Init(const int32 InMaxCells)
+	{
+		MaxCells = FMath::Max(InMaxCells, 64);
+		const int32 NumBuckets = static_cast<int32>(FMath::RoundUpToPowerOfTwo(static_cast<uint32>(MaxCells) * 2));
+		BucketMask = static_cast<uint32>(NumBuckets - 1);
+
+		Keys.Init(EmptyKey, NumBuckets);
+		Ids.Init(PendingId, NumBuckets);
+		Coords.SetNumUninitialized(MaxCells);
+		NumCells = 0;
+	}
+
+	FORCEINLINE int32 Find(const FIntVector& Coord) const
+	{
+		if (UNLIKELY(MaxCells == 0)) return INDEX_NONE;
+
+		const int64 Key = PackKey(Coord);
+
+		for (uint32 Bucket = HashKey(Key) & BucketMask;; Bucket = (Bucket + 1) & BucketMask)
+		{
+			const int64 Stored = Keys[Bucket];
+
+			if (Stored == Key) return WaitForId(Bucket);
+			if (Stored == EmptyKey) return INDEX_NONE;
+		}
+	}
+
+	/*
+	 * Lock free insert. The thread that wins the key CAS draws the next id and publishes it,
+	 * threads racing on the same coord spin until it is visible. Returns INDEX_NONE once out of ids,
+	 * the caller grows the table before the next frame.
+	 */
+	FORCEINLINE int32 FindOrAdd(const FIntVector& Coord)
+	{
+		if (UNLIKELY(MaxCells == 0)) return INDEX_NONE;
+
+		const int64 Key = PackKey(Coord);
+
+		for (uint32 Bucket = HashKey(Key) & BucketMask;; Bucket = (Bucket + 1) & BucketMask)
+		{
+			int64 Stored = FPlatformAtomics::AtomicRead(&Keys[Bucket]);
+
+			if (Stored == EmptyKey)
+			{
+				// 满了就不再占新桶，保证负载因子不超过一半 | stop claiming buckets once full, so the load factor stays at most one half
+				if (FPlatformAtomics::AtomicRead(&NumCells) >= MaxCells) return INDEX_NONE;
+
+				Stored = FPlatformAtomics::InterlockedCompareExchange(&Keys[Bucket], Key, EmptyKey);
+
+				if (Stored == EmptyKey)
+				{
+					const int32 Id = FPlatformAtomics::InterlockedIncrement(&NumCells) - 1;
+
+					if (UNLIKELY(Id >= MaxCells))
+					{
+						FPlatformAtomics::InterlockedExchange(&Ids[Bucket], OverflowId);
+						return INDEX_NONE;
+					}
+
+					Coords[Id] = Coord;
+					FPlatformAtomics::InterlockedExchange(&Ids[Bucket], Id);
+					return Id;
+				}
+			}
+
+			if (Stored == Key) return WaitForId(Bucket);
+		}
+	}
+
+	/* Rehash into room for at least InMaxCells ids, keeping every id. Overflowed keys are dropped. Single threaded. */
+	void Rehash(const int32 InMaxCells)
+	{
+		const int32 NumValid = GetNumCells();
+		TArray<FIntVector> OldCoords = MoveTemp(Coords);
+
+		Init(FMath::Max(InMaxCells, NumValid));
+
+		for (int32 Id = 0; Id < NumValid; ++Id)
+		{
+			InsertUnsafe(OldCoords[Id], Id);
+		}
+
+		NumCells = NumValid;
+	}
+
+	/*
+	 * Keep only ids for which bKeep(Id) holds and renumber them densely.
+	 * OutRemap maps every old id to its new id or INDEX_NONE. Single threaded.
+	 */
+	template<typename PredicateType>
+	void Compact(PredicateType&& bKeep, TArray<int32>& OutRemap)
+	{
+		const int32 NumValid = GetNumCells();
+		OutRemap.Init(INDEX_NONE, NumValid);
+
+		Keys.Init(EmptyKey, Keys.Num());
+		Ids.Init(PendingId, Ids.Num());
+
+		int32 NewNum = 0;
+
+		for (int32 Id = 0; Id < NumValid; ++Id)
+		{
+			if (!bKeep(Id)) continue;
+
+			Coords[NewNum] = Coords[Id];
+			InsertUnsafe(Coords[NewNum], NewNum);
+			OutRemap[Id] = NewNum++;
+		}
+
+		NumCells = NewNum;
+	}
+
+	SIZE_T GetAllocatedSize() const
+	{
+		return Keys.GetAllocatedSize() + Ids.GetAllocatedSize() + Coords.GetAllocatedSize();
+	}
+
+private:
+
+	FORCEINLINE int32 WaitForId(const uint32 Bucket) const
+	{
+		int32 Id = FPlatformAtomics::AtomicRead(&Ids[Bucket]);
+
+		while (UNLIKELY(Id == PendingId))
+		{
+			FPlatformProcess::Yield();
+			Id = FPlatformAtomics::AtomicRead(&Ids[Bucket]);
+		}
+
+		return Id == OverflowId ? INDEX_NONE : Id;
+	}
+
+	FORCEINLINE void InsertUnsafe(const FIntVector& Coord, const int32 Id)
+	{
+		const int64 Key = PackKey(Coord);
+		uint32 Bucket = HashKey(Key) & BucketMask;
+
+		while (Keys[Bucket] != EmptyKey)
+		{
+			Bucket = (Bucket + 1) & BucketMask;
+		}
+
+		Keys[Bucket] = Key;
+		Ids[Bucket] = Id;
+	}
+};
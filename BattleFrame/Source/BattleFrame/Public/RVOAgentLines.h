@@ -0,0 +1,306 @@
+/*
+* BattleFrame
+* Created: 2025
+* Author: Leroy Works, All Rights Reserved.
+*/
+
+#pragma once
+
+/**
+ * \file       RVOAgentLines.h
+ * \brief      Batched construction of agent ORCA lines.
+ *
+ * Neighbor inputs are gathered into packed float lanes and the whole batch
+ * is processed branch-free. Every lane runs the exact operation sequence of
+ * the scalar reference, with no FMA and no reciprocal estimates, so results
+ * are bit-identical to BuildAgentLinesScalar.
+ */
+
+#include "CoreMinimal.h"
+#include "Math/VectorRegister.h"
+#include "RVOSimulator.h"
+#include "RVOVector2.h"
+#include "RVODefinitions.h"
+
+#if defined(PLATFORM_ALWAYS_HAS_AVX_2) && PLATFORM_ALWAYS_HAS_AVX_2
+#include <immintrin.h>
+#define RVO_AGENT_LINES_AVX2 1
+#else
+#define RVO_AGENT_LINES_AVX2 0
+#endif
+
+namespace RVO {
+	/**
+	 * \brief      Inline capacity of the ORCA line buffers. Lines beyond it spill to the heap.
+	 */
+	constexpr int32 ORCA_INLINE_LINES = 64;
+
+	using FOrcaLineBuffer = TArray<Line, TInlineAllocator<ORCA_INLINE_LINES>>;
+
+	/**
+	 * \brief      Packed per-neighbor inputs of one agent ORCA batch.
+	 */
+	struct FAgentLineBatch {
+		/**
+		 * \brief     Maximum neighbors per batch, a multiple of the widest lane count.
+		 */
+		static constexpr int32 Capacity = 32;
+
+		alignas(32) float RelPosX[Capacity];
+		alignas(32) float RelPosY[Capacity];
+		alignas(32) float RelVelX[Capacity];
+		alignas(32) float RelVelY[Capacity];
+		alignas(32) float CombinedRadius[Capacity];
+		alignas(32) float Ratio[Capacity];
+
+		int32 Num = 0;
+
+		/**
+		 * \brief      Appends one neighbor, computing the relative terms exactly like the scalar path.
+		 */
+		FORCEINLINE void Add(const Vector2& SelfPosition, const Vector2& SelfVelocity, float SelfRadius, const Vector2& OtherPosition, const Vector2& OtherVelocity, float OtherRadius, bool bOtherCanAvoid)
+		{
+			const Vector2 relativePosition = OtherPosition - SelfPosition;
+			const Vector2 relativeVelocity = SelfVelocity - OtherVelocity;
+
+			RelPosX[Num] = relativePosition.x();
+			RelPosY[Num] = relativePosition.y();
+			RelVelX[Num] = relativeVelocity.x();
+			RelVelY[Num] = relativeVelocity.y();
+			CombinedRadius[Num] = SelfRadius + OtherRadius;
+			Ratio[Num] = bOtherCanAvoid ? 0.5f : 1.f;
+			++Num;
+		}
+
+		FORCEINLINE bool IsFull() const { return Num == Capacity; }
+	};
+
+	/**
+	 * \brief      Scalar reference. Mirrors the original per-neighbor RVO2 code.
+	 * \param      OutLines        Receives Batch.Num lines.
+	 */
+	inline void BuildAgentLinesScalar(const FAgentLineBatch& Batch, const Vector2& CurrentVelocity, float invTimeHorizon, float TimeStep, Line* OutLines)
+	{
+		for (int32 i = 0; i < Batch.Num; ++i) {
+			const Vector2 relativePosition(Batch.RelPosX[i], Batch.RelPosY[i]);
+			const Vector2 relativeVelocity(Batch.RelVelX[i], Batch.RelVelY[i]);
+			const float distSq = absSq(relativePosition);
+			const float combinedRadius = Batch.CombinedRadius[i];
+			const float combinedRadiusSq = sqr(combinedRadius);
+
+			Line line;
+			Vector2 u;
+
+			if (distSq > combinedRadiusSq) {
+				/* No collision. */
+				const Vector2 w = relativeVelocity - invTimeHorizon * relativePosition;
+				/* Vector from cutoff center to relative velocity. */
+				const float wLengthSq = absSq(w);
+
+				const float dotProduct1 = w * relativePosition;
+
+				if (dotProduct1 < 0.0f && sqr(dotProduct1) > combinedRadiusSq * wLengthSq) {
+					/* Project on cut-off circle. */
+					const float wLength = std::sqrt(wLengthSq);
+					const Vector2 unitW = w / wLength;
+
+					line.direction = Vector2(unitW.y(), -unitW.x());
+					u = (combinedRadius * invTimeHorizon - wLength) * unitW;
+				}
+				else {
+					/* Project on legs. */
+					const float leg = std::sqrt(distSq - combinedRadiusSq);
+
+					if (det(relativePosition, w) > 0.0f) {
+						/* Project on left leg. */
+						line.direction = Vector2(relativePosition.x() * leg - relativePosition.y() * combinedRadius, relativePosition.x() * combinedRadius + relativePosition.y() * leg) / distSq;
+					}
+					else {
+						/* Project on right leg. */
+						line.direction = -Vector2(relativePosition.x() * leg + relativePosition.y() * combinedRadius, -relativePosition.x() * combinedRadius + relativePosition.y() * leg) / distSq;
+					}
+
+					const float dotProduct2 = relativeVelocity * line.direction;
+
+					u = dotProduct2 * line.direction - relativeVelocity;
+				}
+			}
+			else {
+				/* Collision. Project on cut-off circle of time timeStep. */
+				const float invTimeStep = 1.0f / TimeStep;
+
+				/* Vector from cutoff center to relative velocity. */
+				const Vector2 w = relativeVelocity - invTimeStep * relativePosition;
+
+				const float wLength = abs(w);
+				const Vector2 unitW = w / wLength;
+
+				line.direction = Vector2(unitW.y(), -unitW.x());
+				u = (combinedRadius * invTimeStep - wLength) * unitW;
+			}
+
+			line.point = CurrentVelocity + Batch.Ratio[i] * u;
+			OutLines[i] = line;
+		}
+	}
+
+	/**
+	 * \brief      4-wide lanes on UE's portable vector register, SSE on x64 and NEON on ARM.
+	 */
+	struct FLanes4 {
+		using Reg = VectorRegister4Float;
+		static constexpr int32 Width = 4;
+
+		static FORCEINLINE Reg Set(float V) { return VectorSetFloat1(V); }
+		static FORCEINLINE Reg Load(const float* P) { return VectorLoadAligned(P); }
+		static FORCEINLINE void Store(const Reg& V, float* P) { VectorStoreAligned(V, P); }
+		static FORCEINLINE Reg Add(const Reg& A, const Reg& B) { return VectorAdd(A, B); }
+		static FORCEINLINE Reg Sub(const Reg& A, const Reg& B) { return VectorSubtract(A, B); }
+		static FORCEINLINE Reg Mul(const Reg& A, const Reg& B) { return VectorMultiply(A, B); }
+		static FORCEINLINE Reg Div(const Reg& A, const Reg& B) { return VectorDivide(A, B); }
+		static FORCEINLINE Reg Sqrt(const Reg& A) { return VectorSqrt(A); }
+		static FORCEINLINE Reg Gt(const Reg& A, const Reg& B) { return VectorCompareGT(A, B); }
+		static FORCEINLINE Reg And(const Reg& A, const Reg& B) { return VectorBitwiseAnd(A, B); }
+		static FORCEINLINE Reg Select(const Reg& Mask, const Reg& A, const Reg& B) { return VectorSelect(Mask, A, B); }
+	};
+
+#if RVO_AGENT_LINES_AVX2
+	/**
+	 * \brief      8-wide AVX2 lanes, only compiled when the target guarantees AVX2.
+	 */
+	struct FLanes8 {
+		using Reg = __m256;
+		static constexpr int32 Width = 8;
+
+		static FORCEINLINE Reg Set(float V) { return _mm256_set1_ps(V); }
+		static FORCEINLINE Reg Load(const float* P) { return _mm256_load_ps(P); }
+		static FORCEINLINE void Store(const Reg& V, float* P) { _mm256_store_ps(P, V); }
+		static FORCEINLINE Reg Add(const Reg& A, const Reg& B) { return _mm256_add_ps(A, B); }
+		static FORCEINLINE Reg Sub(const Reg& A, const Reg& B) { return _mm256_sub_ps(A, B); }
+		static FORCEINLINE Reg Mul(const Reg& A, const Reg& B) { return _mm256_mul_ps(A, B); }
+		static FORCEINLINE Reg Div(const Reg& A, const Reg& B) { return _mm256_div_ps(A, B); }
+		static FORCEINLINE Reg Sqrt(const Reg& A) { return _mm256_sqrt_ps(A); }
+		static FORCEINLINE Reg Gt(const Reg& A, const Reg& B) { return _mm256_cmp_ps(A, B, _CMP_GT_OQ); }
+		static FORCEINLINE Reg And(const Reg& A, const Reg& B) { return _mm256_and_ps(A, B); }
+		static FORCEINLINE Reg Select(const Reg& Mask, const Reg& A, const Reg& B) { return _mm256_blendv_ps(B, A, Mask); }
+	};
+#endif
+
+	/**
+	 * \brief      Branch-free lane kernel. Both sides of every branch are evaluated and
+	 *             blended by mask; discarded lanes may hold inf/NaN, which never reach the output.
+	 */
+	template<typename Lanes>
+	FORCEINLINE void BuildAgentLinesLanes(const FAgentLineBatch& Batch, const Vector2& CurrentVelocity, float invTimeHorizon, float TimeStep, Line* OutLines)
+	{
+		using Reg = typename Lanes::Reg;
+
+		const Reg Zero = Lanes::Set(0.0f);
+		const Reg One = Lanes::Set(1.0f);
+		const Reg MinusOne = Lanes::Set(-1.0f);// x * -1 keeps the sign of zero, unlike 0 - x
+		const Reg InvTimeHorizon = Lanes::Set(invTimeHorizon);
+		const Reg InvTimeStep = Lanes::Set(1.0f / TimeStep);
+		const Reg VelX = Lanes::Set(CurrentVelocity.x());
+		const Reg VelY = Lanes::Set(CurrentVelocity.y());
+
+		alignas(32) float DirX[Lanes::Width];
+		alignas(32) float DirY[Lanes::Width];
+		alignas(32) float PointX[Lanes::Width];
+		alignas(32) float PointY[Lanes::Width];
+
+		for (int32 Base = 0; Base < Batch.Num; Base += Lanes::Width) {
+			const Reg rpx = Lanes::Load(Batch.RelPosX + Base);
+			const Reg rpy = Lanes::Load(Batch.RelPosY + Base);
+			const Reg rvx = Lanes::Load(Batch.RelVelX + Base);
+			const Reg rvy = Lanes::Load(Batch.RelVelY + Base);
+			const Reg combinedRadius = Lanes::Load(Batch.CombinedRadius + Base);
+
+			const Reg distSq = Lanes::Add(Lanes::Mul(rpx, rpx), Lanes::Mul(rpy, rpy));
+			const Reg combinedRadiusSq = Lanes::Mul(combinedRadius, combinedRadius);
+			const Reg noCollision = Lanes::Gt(distSq, combinedRadiusSq);
+
+			/* No collision: w relative to the cut-off center. */
+			const Reg wx = Lanes::Sub(rvx, Lanes::Mul(InvTimeHorizon, rpx));
+			const Reg wy = Lanes::Sub(rvy, Lanes::Mul(InvTimeHorizon, rpy));
+			const Reg wLengthSq = Lanes::Add(Lanes::Mul(wx, wx), Lanes::Mul(wy, wy));
+			const Reg dotProduct1 = Lanes::Add(Lanes::Mul(wx, rpx), Lanes::Mul(wy, rpy));
+			const Reg onCutoff = Lanes::And(Lanes::Gt(Zero, dotProduct1), Lanes::Gt(Lanes::Mul(dotProduct1, dotProduct1), Lanes::Mul(combinedRadiusSq, wLengthSq)));
+
+			/* Project on cut-off circle. */
+			const Reg wLength = Lanes::Sqrt(wLengthSq);
+			const Reg invWLength = Lanes::Div(One, wLength);
+			const Reg unitWx = Lanes::Mul(wx, invWLength);
+			const Reg unitWy = Lanes::Mul(wy, invWLength);
+			const Reg cutoffScale = Lanes::Sub(Lanes::Mul(combinedRadius, InvTimeHorizon), wLength);
+			const Reg cutoffDirX = unitWy;
+			const Reg cutoffDirY = Lanes::Mul(unitWx, MinusOne);
+			const Reg cutoffUx = Lanes::Mul(cutoffScale, unitWx);
+			const Reg cutoffUy = Lanes::Mul(cutoffScale, unitWy);
+
+			/* Project on legs. */
+			const Reg leg = Lanes::Sqrt(Lanes::Sub(distSq, combinedRadiusSq));
+			const Reg invDistSq = Lanes::Div(One, distSq);
+			const Reg onLeftLeg = Lanes::Gt(Lanes::Sub(Lanes::Mul(rpx, wy), Lanes::Mul(rpy, wx)), Zero);
+
+			const Reg leftDirX = Lanes::Mul(Lanes::Sub(Lanes::Mul(rpx, leg), Lanes::Mul(rpy, combinedRadius)), invDistSq);
+			const Reg leftDirY = Lanes::Mul(Lanes::Add(Lanes::Mul(rpx, combinedRadius), Lanes::Mul(rpy, leg)), invDistSq);
+			const Reg rightDirX = Lanes::Mul(Lanes::Mul(Lanes::Add(Lanes::Mul(rpx, leg), Lanes::Mul(rpy, combinedRadius)), MinusOne), invDistSq);
+			const Reg rightDirY = Lanes::Mul(Lanes::Mul(Lanes::Add(Lanes::Mul(Lanes::Mul(rpx, MinusOne), combinedRadius), Lanes::Mul(rpy, leg)), MinusOne), invDistSq);
+
+			const Reg legDirX = Lanes::Select(onLeftLeg, leftDirX, rightDirX);
+			const Reg legDirY = Lanes::Select(onLeftLeg, leftDirY, rightDirY);
+			const Reg dotProduct2 = Lanes::Add(Lanes::Mul(rvx, legDirX), Lanes::Mul(rvy, legDirY));
+			const Reg legUx = Lanes::Sub(Lanes::Mul(dotProduct2, legDirX), rvx);
+			const Reg legUy = Lanes::Sub(Lanes::Mul(dotProduct2, legDirY), rvy);
+
+			/* Collision. Project on cut-off circle of time timeStep. */
+			const Reg cwx = Lanes::Sub(rvx, Lanes::Mul(InvTimeStep, rpx));
+			const Reg cwy = Lanes::Sub(rvy, Lanes::Mul(InvTimeStep, rpy));
+			const Reg cwLength = Lanes::Sqrt(Lanes::Add(Lanes::Mul(cwx, cwx), Lanes::Mul(cwy, cwy)));
+			const Reg invCwLength = Lanes::Div(One, cwLength);
+			const Reg cUnitWx = Lanes::Mul(cwx, invCwLength);
+			const Reg cUnitWy = Lanes::Mul(cwy, invCwLength);
+			const Reg collisionScale = Lanes::Sub(Lanes::Mul(combinedRadius, InvTimeStep), cwLength);
+			const Reg collisionDirX = cUnitWy;
+			const Reg collisionDirY = Lanes::Mul(cUnitWx, MinusOne);
+			const Reg collisionUx = Lanes::Mul(collisionScale, cUnitWx);
+			const Reg collisionUy = Lanes::Mul(collisionScale, cUnitWy);
+
+			/* Blend the three cases. */
+			const Reg dirX = Lanes::Select(noCollision, Lanes::Select(onCutoff, cutoffDirX, legDirX), collisionDirX);
+			const Reg dirY = Lanes::Select(noCollision, Lanes::Select(onCutoff, cutoffDirY, legDirY), collisionDirY);
+			const Reg ux = Lanes::Select(noCollision, Lanes::Select(onCutoff, cutoffUx, legUx), collisionUx);
+			const Reg uy = Lanes::Select(noCollision, Lanes::Select(onCutoff, cutoffUy, legUy), collisionUy);
+
+			const Reg ratio = Lanes::Load(Batch.Ratio + Base);
+
+			Lanes::Store(dirX, DirX);
+			Lanes::Store(dirY, DirY);
+			Lanes::Store(Lanes::Add(VelX, Lanes::Mul(ratio, ux)), PointX);
+			Lanes::Store(Lanes::Add(VelY, Lanes::Mul(ratio, uy)), PointY);
+
+			const int32 LaneCount = FMath::Min(Lanes::Width, Batch.Num - Base);
+
+			for (int32 Lane = 0; Lane < LaneCount; ++Lane) {
+				Line& line = OutLines[Base + Lane];
+				line.direction = Vector2(DirX[Lane], DirY[Lane]);
+				line.point = Vector2(PointX[Lane], PointY[Lane]);
+			}
+		}
+	}
+
+	/**
+	 * \brief      Builds Batch.Num agent ORCA lines with the widest lanes available on this target.
+	 * \param      OutLines        Receives Batch.Num lines.
+	 */
+	FORCEINLINE void BuildAgentLines(const FAgentLineBatch& Batch, const Vector2& CurrentVelocity, float invTimeHorizon, float TimeStep, Line* OutLines)
+	{
+#if RVO_AGENT_LINES_AVX2
+		BuildAgentLinesLanes<FLanes8>(Batch, CurrentVelocity, invTimeHorizon, TimeStep, OutLines);
+#elif PLATFORM_ENABLE_VECTORINTRINSICS || PLATFORM_ENABLE_VECTORINTRINSICS_NEON
+		BuildAgentLinesLanes<FLanes4>(Batch, CurrentVelocity, invTimeHorizon, TimeStep, OutLines);
+#else
+		BuildAgentLinesScalar(Batch, CurrentVelocity, invTimeHorizon, TimeStep, OutLines);
+#endif
+	}
+}
@@ -15,4 +15,12 @@ struct BATTLEFRAME_API FAgent
 
 	UPROPERTY(BlueprintReadWrite, EditAnywhere)
 	int32 Score = 1;
+
+	// 模拟LOD，由AgentSimLOD阶段每步写入 | Simulation LOD, written by the AgentSimLOD stage every step
+	int32 SimLODLevel = 0;
+	int32 SimLODPhase = INDEX_NONE;// round robin slot, assigned on first use
+	float SimSkippedTime = 0.f;// time since the last movement update
+	float SimCatchUpTime = 0.f;// skipped time the movement update of this step makes up for
+	bool bSimUpdate = true;
+	bool bSimSkipCosmetics = false;
 };
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "CoreMinimal.h"
+#include "BattleFrameEnums.h"
 #include "Debuff.generated.h" 
 
 USTRUCT(BlueprintType)
@@ -37,6 +38,9 @@ public:
 	UPROPERTY(BlueprintReadWrite, EditAnywhere, meta = (Tooltip = "伤害间隔"))
 	float TemporalDmgInterval = 0.5f;
 
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, meta = (Tooltip = "同类型延时伤害的叠加方式，仅在内联状态效果开启时生效"))
+	EStatusEffectStacking Stacking = EStatusEffectStacking::Stack;
+
 };
 
 USTRUCT(BlueprintType)
@@ -55,6 +59,9 @@ public:
 	UPROPERTY(BlueprintReadWrite, EditAnywhere, meta = (Tooltip = "减速的强度"))
 	float SlowStrength = 1.f;
 
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, meta = (Tooltip = "同类型减速的叠加方式，仅在内联状态效果开启时生效"))
+	EStatusEffectStacking Stacking = EStatusEffectStacking::Stack;
+
 };
 
 USTRUCT(BlueprintType)
@@ -0,0 +1,22 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "GridOwner.generated.h"
+
+class UNeighborGridComponent;
+
+// 单位归属的邻居网格与增量更新记录，不放进FGridData，格子条目因此保持紧凑 | Owning grid and incremental bookkeeping of a subject, kept out of FGridData so cell entries stay compact
+USTRUCT(BlueprintType)
+struct BATTLEFRAME_API FGridOwner
+{
+	GENERATED_BODY()
+
+public:
+
+	static constexpr int32 MultiCellIndex = -2;// registered into every cell its radius overlaps
+
+	UNeighborGridComponent* NeighborGrid = nullptr;// grid that owns this subject's cell entries
+	int32 CellIndex = INDEX_NONE;// cell holding this subject, incremental grid update only
+	uint32 GridStamp = 0;// grid frame this subject was last registered in
+
+};
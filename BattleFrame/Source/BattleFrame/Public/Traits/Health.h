@@ -2,7 +2,6 @@
 
 #include "CoreMinimal.h"
 #include "SubjectHandle.h"
-#include <Containers/Queue.h>
 #include "Health.generated.h"
 
 USTRUCT(BlueprintType)
@@ -27,10 +26,6 @@ public:
 	UPROPERTY(BlueprintReadWrite, EditAnywhere, Meta = (ToolTip = "锁定生命值"))
 	bool bLockHealth = false;
 
-	TQueue<float, EQueueMode::Mpsc> DamageToTake;
-	TQueue<FSubjectHandle, EQueueMode::Mpsc> DamageInstigator;
-	TQueue<FVector, EQueueMode::Mpsc> HitDirection;
-
 	// 默认构造函数
 	FHealth() = default;
 
@@ -0,0 +1,15 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Pooled.generated.h"
+
+
+// 在回收池中等待复用，保留渲染槽位，仍带FDying使其不被当作目标 | Waiting in the recycling pool for reuse. Keeps its render slot, and keeps FDying so nothing targets it
+USTRUCT(BlueprintType)
+struct BATTLEFRAME_API FPooled
+{
+	GENERATED_BODY()
+
+public:
+
+};
@@ -0,0 +1,37 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "UObject/ObjectKey.h"
+#include "Recyclable.generated.h"
+
+
+// 同一配置同一队伍的单位特征布局相同，可互相复用 | Agents of the same config and team share a trait layout and can stand in for each other
+struct FAgentPoolKey
+{
+	TObjectKey<UObject> Config;
+	int32 Team = 0;
+
+	bool operator==(const FAgentPoolKey& Other) const
+	{
+		return Config == Other.Config && Team == Other.Team;
+	}
+
+	friend uint32 GetTypeHash(const FAgentPoolKey& Key)
+	{
+		return HashCombine(GetTypeHash(Key.Config), GetTypeHash(Key.Team));
+	}
+};
+
+// 死亡后回到回收池，而不是销毁 | Goes back to the recycling pool when its death ends instead of despawning
+USTRUCT(BlueprintType)
+struct BATTLEFRAME_API FRecyclable
+{
+	GENERATED_BODY()
+
+public:
+
+	FAgentPoolKey PoolKey;
+
+	uint32 Generation = 0;// bumped each time the agent enters the pool, ghost subjects spawned against an earlier life drop themselves
+
+};
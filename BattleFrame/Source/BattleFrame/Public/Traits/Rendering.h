@@ -17,4 +17,9 @@ public:
 
     FSubjectHandle Renderer = FSubjectHandle();
 
+    // 固定步长插值用的上一步状态 | State before the latest fixed step, for render interpolation
+    FVector PrevLocation = FVector::ZeroVector;
+    FVector PrevDirection = FVector::ForwardVector;
+    uint32 SnapshotStep = 0;
+
 };
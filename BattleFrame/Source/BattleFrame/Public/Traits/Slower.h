@@ -13,6 +13,7 @@ struct BATTLEFRAME_API FSlower
 public:
 
 	FSubjectHandle SlowTarget = FSubjectHandle();
+	uint32 TargetGeneration = 0;// FRecyclable::Generation of the target when spawned
 
 	float SlowTimeout = 4.f;
 	float SlowStrength = 1.f;
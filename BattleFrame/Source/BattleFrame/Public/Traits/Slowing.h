@@ -26,6 +26,7 @@ public:
 
 	TSet<FSubjectHandle> Slowers;
 	float CombinedSlowMult = 1;
+	float InlineSlowMult = 1;// product of the inline slow effects, see FStatusEffects
 
 	FSlowing() {};
 
@@ -34,6 +35,7 @@ public:
 		LockFlag.store(Slowing.LockFlag.load());
 		Slowers = Slowing.Slowers;
 		CombinedSlowMult = Slowing.CombinedSlowMult;
+		InlineSlowMult = Slowing.InlineSlowMult;
 	}
 
 	FSlowing& operator=(const FSlowing& Slowing)
@@ -41,6 +43,7 @@ public:
 		LockFlag.store(Slowing.LockFlag.load());
 		Slowers = Slowing.Slowers;
 		CombinedSlowMult = Slowing.CombinedSlowMult;
+		InlineSlowMult = Slowing.InlineSlowMult;
 		return *this;
 	}
 
@@ -0,0 +1,193 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "SubjectHandle.h"
+#include "BattleFrameEnums.h"
+#include "Traits/Damage.h"
+#include "StatusEffects.generated.h"
+
+enum class EStatusEffectKind : uint8
+{
+	Slow,
+	TemporalDmg
+};
+
+// 一个内联状态效果 | One inline status effect
+struct FStatusEffectSlot
+{
+	FSubjectHandle Instigator = FSubjectHandle();
+	float TimeLeft = 0.f;// slow: until it wears off, temporal damage: until the next segment
+	float Strength = 0.f;// slow: strength, temporal damage: damage still to deal
+	float Interval = 0.f;// temporal damage only
+	int32 SegmentsLeft = 0;// temporal damage only
+	EStatusEffectKind Kind = EStatusEffectKind::Slow;
+	EDmgType DmgType = EDmgType::Normal;
+
+	float GetRemainingTime() const
+	{
+		return Kind == EStatusEffectKind::Slow ? TimeLeft : TimeLeft + Interval * FMath::Max(0, SegmentsLeft - 1);
+	}
+};
+
+/**
+ * Slows and temporal damage kept in a fixed number of slots on the target, an alternative to
+ * spawning FSlower and FTemporalDamager subjects. Applying one is a slot write under the lock,
+ * the battle control ticks every store in one pass.
+ */
+USTRUCT(BlueprintType)
+struct BATTLEFRAME_API FStatusEffects
+{
+	GENERATED_BODY()
+
+private:
+
+	mutable std::atomic<bool> LockFlag{ false };
+
+public:
+
+	void Lock() const
+	{
+		while (LockFlag.exchange(true, std::memory_order_acquire));
+	}
+
+	void Unlock() const
+	{
+		LockFlag.store(false, std::memory_order_release);
+	}
+
+	static constexpr int32 MaxSlots = 8;
+
+	FStatusEffectSlot Slots[MaxSlots];
+	int32 NumSlots = 0;
+	uint8 FxMask = 0;// bit per EDmgType whose material fx this store has turned on
+
+	FStatusEffects() {};
+
+	FStatusEffects(const FStatusEffects& StatusEffects)
+	{
+		LockFlag.store(StatusEffects.LockFlag.load());
+		NumSlots = StatusEffects.NumSlots;
+		FxMask = StatusEffects.FxMask;
+
+		for (int32 i = 0; i < NumSlots; ++i)
+		{
+			Slots[i] = StatusEffects.Slots[i];
+		}
+	}
+
+	FStatusEffects& operator=(const FStatusEffects& StatusEffects)
+	{
+		LockFlag.store(StatusEffects.LockFlag.load());
+		NumSlots = StatusEffects.NumSlots;
+		FxMask = StatusEffects.FxMask;
+
+		for (int32 i = 0; i < NumSlots; ++i)
+		{
+			Slots[i] = StatusEffects.Slots[i];
+		}
+
+		return *this;
+	}
+
+	/* Add an effect by the stacking rule. When every slot is taken the effect with the least time left makes way, unless the new one is shorter still. Call under the lock. */
+	void Apply(const FStatusEffectSlot& Effect, const EStatusEffectStacking Stacking)
+	{
+		if (Stacking != EStatusEffectStacking::Stack)
+		{
+			for (int32 i = 0; i < NumSlots; ++i)
+			{
+				FStatusEffectSlot& Slot = Slots[i];
+
+				if (Slot.Kind != Effect.Kind || Slot.DmgType != Effect.DmgType) continue;
+
+				const bool bStronger = Effect.Strength > Slot.Strength || (Effect.Strength == Slot.Strength && Effect.GetRemainingTime() > Slot.GetRemainingTime());
+
+				if (Stacking == EStatusEffectStacking::Refresh || bStronger)
+				{
+					Slot = Effect;
+				}
+
+				return;
+			}
+		}
+
+		if (NumSlots < MaxSlots)
+		{
+			Slots[NumSlots++] = Effect;
+			return;
+		}
+
+		int32 ShortestIndex = 0;
+
+		for (int32 i = 1; i < NumSlots; ++i)
+		{
+			if (Slots[i].GetRemainingTime() < Slots[ShortestIndex].GetRemainingTime())
+			{
+				ShortestIndex = i;
+			}
+		}
+
+		if (Slots[ShortestIndex].GetRemainingTime() < Effect.GetRemainingTime())
+		{
+			Slots[ShortestIndex] = Effect;
+		}
+	}
+
+	/*
+	 * Advance every slot by DeltaTime and drop the expired ones. OnSegment(Slot, Damage) is called for each temporal damage segment that falls due,
+	 * the last segment deals whatever is left. Returns the product of the live slows, OutFxMask gets a bit per EDmgType still active. Call under the lock.
+	 */
+	template<typename OnSegmentType>
+	float Tick(const float DeltaTime, OnSegmentType&& OnSegment, uint8& OutFxMask)
+	{
+		float SlowMult = 1;
+		OutFxMask = 0;
+
+		for (int32 i = 0; i < NumSlots;)
+		{
+			FStatusEffectSlot& Slot = Slots[i];
+			bool bExpired = false;
+
+			if (Slot.Kind == EStatusEffectKind::Slow)
+			{
+				// 持续时间结束，解除减速
+				bExpired = Slot.TimeLeft <= 0;
+
+				if (!bExpired)
+				{
+					SlowMult *= 1 - Slot.Strength;
+					Slot.TimeLeft -= DeltaTime;
+				}
+			}
+			else
+			{
+				Slot.TimeLeft -= DeltaTime;
+
+				// 倒计时结束，造成一次伤害，最后一段使用剩余伤害值
+				if (Slot.TimeLeft <= 0)
+				{
+					const float ThisSegmentDamage = Slot.SegmentsLeft <= 1 ? Slot.Strength : FMath::Min(Slot.Strength / Slot.SegmentsLeft, Slot.Strength);
+
+					OnSegment(Slot, ThisSegmentDamage);
+
+					Slot.Strength -= ThisSegmentDamage;
+					Slot.SegmentsLeft--;
+					Slot.TimeLeft = Slot.Interval;
+				}
+
+				bExpired = Slot.SegmentsLeft <= 0 || Slot.Strength <= 0;
+			}
+
+			if (bExpired)
+			{
+				Slots[i] = Slots[--NumSlots];
+				continue;
+			}
+
+			OutFxMask |= 1 << static_cast<uint8>(Slot.DmgType);
+			++i;
+		}
+
+		return SlowMult;
+	}
+};
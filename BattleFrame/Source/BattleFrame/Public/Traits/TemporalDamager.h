@@ -15,6 +15,7 @@ struct BATTLEFRAME_API FTemporalDamager
 
 	  FSubjectHandle TemporalDamageInstigator = FSubjectHandle();
 	  FSubjectHandle TemporalDamageTarget = FSubjectHandle();
+	  uint32 TargetGeneration = 0;// FRecyclable::Generation of the target when spawned
 
 	  float TemporalDamageTimeout = 0.5f;
 	  float TemporalDmgInterval = 0.5f;  // 伤害间隔
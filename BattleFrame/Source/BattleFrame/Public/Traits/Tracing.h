@@ -36,6 +36,8 @@ public:
 	UNeighborGridComponent* NeighborGrid = nullptr;
 
 	float TimeLeft = 0.f;
+	float PendingTime = 0.f;// time spent waiting for the trace budget
+	bool bPhaseStaggered = false;
 
 
 	FTracing() {};
@@ -47,6 +49,8 @@ public:
 		NeighborGrid = Tracing.NeighborGrid;
 		TraceResult = Tracing.TraceResult;
 		TimeLeft = Tracing.TimeLeft;
+		PendingTime = Tracing.PendingTime;
+		bPhaseStaggered = Tracing.bPhaseStaggered;
 	}
 
 	FTracing& operator=(const FTracing& Tracing)
@@ -56,6 +60,8 @@ public:
 		NeighborGrid = Tracing.NeighborGrid;
 		TraceResult = Tracing.TraceResult;
 		TimeLeft = Tracing.TimeLeft;
+		PendingTime = Tracing.PendingTime;
+		bPhaseStaggered = Tracing.bPhaseStaggered;
 
 		return *this;
 	}
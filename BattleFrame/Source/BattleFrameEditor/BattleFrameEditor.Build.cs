@@ -20,7 +20,10 @@ public class BattleFrameEditor : ModuleRules
             "Engine",
             "UnrealEd",
             "AssetTools",
-            "BlueprintGraph" 
+            "BlueprintGraph",
+            "ApparatusRuntime",
+            "FlowFieldCanvas",
+            "Json"
         });
     }
 }
@@ -0,0 +1,399 @@
+/*
+* BattleFrame
+* Created: 2025
+* Author: Leroy Works, All Rights Reserved.
+*/
+
+#include "BattleFrameBenchmarkCommandlet.h"
+#include "Engine/Engine.h"
+#include "Engine/World.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "Misc/DateTime.h"
+#include "Dom/JsonObject.h"
+#include "Serialization/JsonWriter.h"
+#include "Serialization/JsonSerializer.h"
+#include "UObject/UObjectGlobals.h"
+
+#include "FlowField.h"
+#include "AgentSpawner.h"
+#include "AgentConfigDataAsset.h"
+#include "NeighborGridActor.h"
+#include "NeighborGridComponent.h"
+#include "BattleFrameBattleControl.h"
+#include "Traits/Navigation.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogBattleFrameBenchmark, Log, All);
+
+namespace BattleFrameBenchmark
+{
+	enum class ELayout : uint8
+	{
+		Clash,// teams evenly around a circle, all heading for the center
+		Blob// every team packed side by side in one square
+	};
+
+	struct FScenario
+	{
+		TSoftObjectPtr<UAgentConfigDataAsset> Config;
+		TArray<int32> AgentCounts = { 10000, 30000, 60000, 100000 };
+		int32 Ticks = 600;
+		int32 WarmupTicks = 60;
+		float DeltaTime = 1.f / 60.f;
+		int32 Teams = 2;
+		ELayout Layout = ELayout::Clash;
+		float Spacing = 150.f;
+		FString OutDir;
+	};
+
+	struct FSamples
+	{
+		TArray<float> Seconds;
+
+		void Add(const float Value) { Seconds.Add(Value); }
+
+		float GetMeanMs() const
+		{
+			if (Seconds.IsEmpty()) return 0.f;
+
+			double Sum = 0.0;
+			for (const float Value : Seconds) Sum += Value;
+			return static_cast<float>(Sum / Seconds.Num() * 1000.0);
+		}
+
+		float GetPercentileMs(const float Percentile) const
+		{
+			if (Seconds.IsEmpty()) return 0.f;
+
+			TArray<float> Sorted = Seconds;
+			Sorted.Sort();
+			const int32 Index = FMath::Clamp(FMath::CeilToInt(Percentile * Sorted.Num()) - 1, 0, Sorted.Num() - 1);
+			return Sorted[Index] * 1000.f;
+		}
+
+		float GetMaxMs() const
+		{
+			return Seconds.IsEmpty() ? 0.f : FMath::Max(Seconds) * 1000.f;
+		}
+
+		float GetTotalMs() const
+		{
+			return GetMeanMs() * Seconds.Num();
+		}
+	};
+
+	struct FRunResult
+	{
+		int32 RequestedAgents = 0;
+		int32 SpawnedAgents = 0;
+		float SpawnSeconds = 0.f;
+		FSamples Tick;
+		TMap<FName, FSamples> Stages;
+		int64 NeighborsExamined = 0;
+		int64 OrcaLinesBuilt = 0;
+		int64 TracesIssued = 0;
+		int64 DamageEvents = 0;
+	};
+
+	static bool ParseScenario(const FString& Params, FScenario& Scenario)
+	{
+		FString ConfigPath;
+
+		if (!FParse::Value(*Params, TEXT("Config="), ConfigPath))
+		{
+			UE_LOG(LogBattleFrameBenchmark, Error, TEXT("Missing -Config=<AgentConfigDataAsset path>"));
+			return false;
+		}
+
+		Scenario.Config = TSoftObjectPtr<UAgentConfigDataAsset>(FSoftObjectPath(ConfigPath));
+
+		FString AgentsList;
+
+		if (FParse::Value(*Params, TEXT("Agents="), AgentsList, false))
+		{
+			TArray<FString> Parts;
+			AgentsList.ParseIntoArray(Parts, TEXT(","));
+
+			Scenario.AgentCounts.Reset();
+
+			for (const FString& Part : Parts)
+			{
+				const int32 Count = FCString::Atoi(*Part);
+				if (Count > 0) Scenario.AgentCounts.Add(Count);
+			}
+		}
+
+		FParse::Value(*Params, TEXT("Ticks="), Scenario.Ticks);
+		FParse::Value(*Params, TEXT("Warmup="), Scenario.WarmupTicks);
+		FParse::Value(*Params, TEXT("DeltaTime="), Scenario.DeltaTime);
+		FParse::Value(*Params, TEXT("Teams="), Scenario.Teams);
+		FParse::Value(*Params, TEXT("Spacing="), Scenario.Spacing);
+
+		FString Layout;
+
+		if (FParse::Value(*Params, TEXT("Layout="), Layout))
+		{
+			Scenario.Layout = Layout.Equals(TEXT("Blob"), ESearchCase::IgnoreCase) ? ELayout::Blob : ELayout::Clash;
+		}
+
+		if (!FParse::Value(*Params, TEXT("Out="), Scenario.OutDir))
+		{
+			Scenario.OutDir = FPaths::Combine(FPaths::ProjectSavedDir(), TEXT("BattleFrameBenchmark"), FDateTime::Now().ToString());
+		}
+
+		Scenario.Ticks = FMath::Max(Scenario.Ticks, 1);
+		Scenario.WarmupTicks = FMath::Max(Scenario.WarmupTicks, 0);
+		Scenario.DeltaTime = FMath::Max(Scenario.DeltaTime, KINDA_SMALL_NUMBER);
+		Scenario.Teams = FMath::Max(Scenario.Teams, 1);
+		Scenario.Spacing = FMath::Max(Scenario.Spacing, 1.f);
+
+		return !Scenario.AgentCounts.IsEmpty();
+	}
+
+	static FRunResult Run(const FScenario& Scenario, const int32 AgentCount)
+	{
+		FRunResult Result;
+		Result.RequestedAgents = AgentCount;
+
+		UWorld* World = UWorld::CreateWorld(EWorldType::Game, false, TEXT("BattleFrameBenchmark"));
+		FWorldContext& WorldContext = GEngine->CreateNewWorldContext(EWorldType::Game);
+		WorldContext.SetCurrentWorld(World);
+
+		World->InitializeActorsForPlay(FURL());
+		World->BeginPlay();
+
+		// 场地按单位数缩放，保证密度不变 | the field scales with the agent count, so density stays the same
+		const int32 PerTeam = FMath::DivideAndRoundUp(AgentCount, Scenario.Teams);
+		const float TeamSide = FMath::Sqrt(static_cast<float>(PerTeam)) * Scenario.Spacing;
+		const float Radius = Scenario.Layout == ELayout::Clash ? FMath::Max(TeamSide * 1.5f, 2000.f) : 0.f;
+		const float FieldSide = Scenario.Layout == ELayout::Clash ? (Radius + TeamSide) * 2.f : TeamSide * Scenario.Teams + TeamSide;
+
+		AFlowField* FlowField = World->SpawnActor<AFlowField>(FVector::ZeroVector, FRotator::ZeroRotator);
+		FlowField->drawCellsInGame = false;
+		FlowField->drawArrowsInGame = false;
+		FlowField->flowFieldSize = FVector(FieldSide, FieldSide, 1000.f);
+		FlowField->cellSize = FMath::Max(FieldSide / 500.f, 150.f);
+		FlowField->goalLocation = FVector::ZeroVector;
+		FlowField->UpdateFlowField();
+
+		ANeighborGridActor* GridActor = World->SpawnActorDeferred<ANeighborGridActor>(ANeighborGridActor::StaticClass(), FTransform::Identity);
+		UNeighborGridComponent* Grid = GridActor->GetComponent();
+		const int32 GridCells = FMath::CeilToInt(FieldSide / Grid->CellSize.X) + 2;
+		Grid->GridSize = FIntVector(GridCells, GridCells, 1);
+		GridActor->FinishSpawning(FTransform::Identity);
+
+		World->SpawnActor<ABattleFrameBattleControl>();
+
+		AAgentSpawner* Spawner = World->SpawnActor<AAgentSpawner>();
+		Spawner->AgentConfigAssets = { Scenario.Config };
+
+		const double SpawnStart = FPlatformTime::Seconds();
+
+		for (int32 Team = 0; Team < Scenario.Teams; ++Team)
+		{
+			const int32 Quantity = FMath::Min(PerTeam, AgentCount - PerTeam * Team);
+			if (Quantity <= 0) break;
+
+			FVector Origin = FVector::ZeroVector;
+
+			if (Scenario.Layout == ELayout::Clash)
+			{
+				const float Angle = 2.f * PI * Team / Scenario.Teams;
+				Origin = FVector(FMath::Cos(Angle), FMath::Sin(Angle), 0.f) * Radius;
+			}
+			else
+			{
+				Origin = FVector((Team - (Scenario.Teams - 1) * 0.5f) * TeamSide, 0.f, 0.f);
+			}
+
+			const FVector2D ToCenter = FVector2D(-Origin).GetSafeNormal();
+
+			TArray<FSubjectHandle> Agents = Spawner->SpawnAgentsByConfigRectangular(true, Scenario.Config, Quantity, Team, Origin, FVector2D(TeamSide, TeamSide),
+				FVector2D::ZeroVector, EInitialDirection::CustomDirection, ToCenter.IsNearlyZero() ? FVector2D(1, 0) : ToCenter);
+
+			// 配置里的流场指向关卡中的Actor，这里换成基准世界里的 | the config's flow field points into a level, use the benchmark one
+			for (FSubjectHandle& Agent : Agents)
+			{
+				if (FNavigation* Navigation = Agent.GetTraitPtr<FNavigation, EParadigm::Unsafe>())
+				{
+					Navigation->FlowFieldToUse = FlowField;
+					Navigation->bIsDirtyData = true;
+				}
+			}
+
+			Result.SpawnedAgents += Agents.Num();
+		}
+
+		Result.SpawnSeconds = static_cast<float>(FPlatformTime::Seconds() - SpawnStart);
+
+		ABattleFrameBattleControl* BattleControl = ABattleFrameBattleControl::GetInstance();
+
+		// 每个阶段上次读取时的运行次数与累计耗时 | each stage's run count and summed time at the previous read
+		TMap<FName, TPair<uint32, double>> StageMarks;
+
+		auto AddFrameStats = [&](const FBattleFrameFrameStats& FrameStats)
+		{
+			Result.NeighborsExamined += FrameStats.NeighborsExamined;
+			Result.OrcaLinesBuilt += FrameStats.OrcaLinesBuilt;
+			Result.TracesIssued += FrameStats.TracesIssued;
+			Result.DamageEvents += FrameStats.DamageEvents;
+		};
+
+		for (int32 TickIndex = 0; TickIndex < Scenario.WarmupTicks + Scenario.Ticks; ++TickIndex)
+		{
+			const double TickStart = FPlatformTime::Seconds();
+			World->Tick(LEVELTICK_All, Scenario.DeltaTime);
+			const float TickSeconds = static_cast<float>(FPlatformTime::Seconds() - TickStart);
+
+			++GFrameCounter;
+
+			if (!BattleControl) continue;
+
+			const bool bMeasured = TickIndex >= Scenario.WarmupTicks;
+
+			// 固定步长下一帧可跑零到多步，只记录本帧运行过的阶段，并累加其每次运行 | with a fixed step a tick runs zero or more steps, only stages that ran count, with every run summed
+			BattleControl->StageTuner.ForEachStage([&](const FBattleFrameStageTuning& Tuning)
+			{
+				TPair<uint32, double>& Mark = StageMarks.FindOrAdd(Tuning.Name, TPair<uint32, double>(0, 0.0));
+
+				if (bMeasured && Tuning.NumRuns != Mark.Key)
+				{
+					Result.Stages.FindOrAdd(Tuning.Name).Add(static_cast<float>(Tuning.TotalSeconds - Mark.Value));
+				}
+
+				Mark = TPair<uint32, double>(Tuning.NumRuns, Tuning.TotalSeconds);
+			});
+
+			if (!bMeasured) continue;
+
+			Result.Tick.Add(TickSeconds);
+
+			// 计数在下一帧开头发布，这里读到的是上一帧的，第一个测量帧读到的仍是预热帧 | counters are published at the start of the next tick, so this reads the previous one, which is still warmup on the first measured tick
+			if (TickIndex > Scenario.WarmupTicks)
+			{
+				AddFrameStats(BattleControl->FrameStats);
+			}
+		}
+
+		// 最后一帧的计数还没发布，这里补上 | the last tick's counters are not published yet, publish them here
+		if (BattleControl && Scenario.Ticks > 0)
+		{
+			BattleControl->PublishFrameStats();
+			AddFrameStats(BattleControl->FrameStats);
+		}
+
+		GEngine->DestroyWorldContext(World);
+		World->DestroyWorld(false);
+		CollectGarbage(GARBAGE_COLLECTION_KEEPFLAGS);
+
+		return Result;
+	}
+
+	static void WriteResults(const FScenario& Scenario, const TArray<FRunResult>& Results)
+	{
+		FString Csv = TEXT("Agents,Stage,MeanMs,P95Ms,MaxMs,TotalMs\n");
+
+		TArray<TSharedPtr<FJsonValue>> JsonRuns;
+
+		for (const FRunResult& Result : Results)
+		{
+			Csv += FString::Printf(TEXT("%d,Tick,%.4f,%.4f,%.4f,%.3f\n"), Result.SpawnedAgents, Result.Tick.GetMeanMs(), Result.Tick.GetPercentileMs(0.95f), Result.Tick.GetMaxMs(), Result.Tick.GetTotalMs());
+
+			TSharedRef<FJsonObject> JsonRun = MakeShared<FJsonObject>();
+			JsonRun->SetNumberField(TEXT("RequestedAgents"), Result.RequestedAgents);
+			JsonRun->SetNumberField(TEXT("SpawnedAgents"), Result.SpawnedAgents);
+			JsonRun->SetNumberField(TEXT("SpawnSeconds"), Result.SpawnSeconds);
+			JsonRun->SetNumberField(TEXT("TickMeanMs"), Result.Tick.GetMeanMs());
+			JsonRun->SetNumberField(TEXT("TickP95Ms"), Result.Tick.GetPercentileMs(0.95f));
+			JsonRun->SetNumberField(TEXT("TickMaxMs"), Result.Tick.GetMaxMs());
+			JsonRun->SetNumberField(TEXT("TickTotalMs"), Result.Tick.GetTotalMs());
+			JsonRun->SetNumberField(TEXT("NeighborsExamined"), Result.NeighborsExamined);
+			JsonRun->SetNumberField(TEXT("OrcaLinesBuilt"), Result.OrcaLinesBuilt);
+			JsonRun->SetNumberField(TEXT("TracesIssued"), Result.TracesIssued);
+			JsonRun->SetNumberField(TEXT("DamageEvents"), Result.DamageEvents);
+
+			TArray<TSharedPtr<FJsonValue>> JsonStages;
+
+			for (const TPair<FName, FSamples>& Pair : Result.Stages)
+			{
+				const FSamples& Samples = Pair.Value;
+				Csv += FString::Printf(TEXT("%d,%s,%.4f,%.4f,%.4f,%.3f\n"), Result.SpawnedAgents, *Pair.Key.ToString(), Samples.GetMeanMs(), Samples.GetPercentileMs(0.95f), Samples.GetMaxMs(), Samples.GetTotalMs());
+
+				TSharedRef<FJsonObject> JsonStage = MakeShared<FJsonObject>();
+				JsonStage->SetStringField(TEXT("Stage"), Pair.Key.ToString());
+				JsonStage->SetNumberField(TEXT("MeanMs"), Samples.GetMeanMs());
+				JsonStage->SetNumberField(TEXT("P95Ms"), Samples.GetPercentileMs(0.95f));
+				JsonStage->SetNumberField(TEXT("MaxMs"), Samples.GetMaxMs());
+				JsonStage->SetNumberField(TEXT("TotalMs"), Samples.GetTotalMs());
+				JsonStages.Add(MakeShared<FJsonValueObject>(JsonStage));
+			}
+
+			JsonRun->SetArrayField(TEXT("Stages"), JsonStages);
+			JsonRuns.Add(MakeShared<FJsonValueObject>(JsonRun));
+		}
+
+		TSharedRef<FJsonObject> JsonRoot = MakeShared<FJsonObject>();
+		JsonRoot->SetStringField(TEXT("Config"), Scenario.Config.ToString());
+		JsonRoot->SetNumberField(TEXT("Ticks"), Scenario.Ticks);
+		JsonRoot->SetNumberField(TEXT("WarmupTicks"), Scenario.WarmupTicks);
+		JsonRoot->SetNumberField(TEXT("DeltaTime"), Scenario.DeltaTime);
+		JsonRoot->SetNumberField(TEXT("Teams"), Scenario.Teams);
+		JsonRoot->SetStringField(TEXT("Layout"), Scenario.Layout == ELayout::Clash ? TEXT("Clash") : TEXT("Blob"));
+		JsonRoot->SetNumberField(TEXT("Spacing"), Scenario.Spacing);
+		JsonRoot->SetArrayField(TEXT("Runs"), JsonRuns);
+
+		FString Json;
+		const TSharedRef<TJsonWriter<>> Writer = TJsonWriterFactory<>::Create(&Json);
+		FJsonSerializer::Serialize(JsonRoot, Writer);
+
+		const FString CsvPath = FPaths::Combine(Scenario.OutDir, TEXT("BattleFrameBenchmark.csv"));
+		const FString JsonPath = FPaths::Combine(Scenario.OutDir, TEXT("BattleFrameBenchmark.json"));
+
+		FFileHelper::SaveStringToFile(Csv, *CsvPath);
+		FFileHelper::SaveStringToFile(Json, *JsonPath);
+
+		UE_LOG(LogBattleFrameBenchmark, Display, TEXT("Wrote %s and %s"), *CsvPath, *JsonPath);
+	}
+}
+
+UBattleFrameBenchmarkCommandlet::UBattleFrameBenchmarkCommandlet()
+{
+	IsClient = false;
+	IsEditor = false;
+	IsServer = false;
+	LogToConsole = true;
+}
+
+int32 UBattleFrameBenchmarkCommandlet::Main(const FString& Params)
+{
+	using namespace BattleFrameBenchmark;
+
+	FScenario Scenario;
+
+	if (!ParseScenario(Params, Scenario))
+	{
+		return 1;
+	}
+
+	if (!Scenario.Config.LoadSynchronous())
+	{
+		UE_LOG(LogBattleFrameBenchmark, Error, TEXT("Could not load agent config %s"), *Scenario.Config.ToString());
+		return 1;
+	}
+
+	TArray<FRunResult> Results;
+
+	for (const int32 AgentCount : Scenario.AgentCounts)
+	{
+		UE_LOG(LogBattleFrameBenchmark, Display, TEXT("Running %d agents, %d ticks after %d warmup"), AgentCount, Scenario.Ticks, Scenario.WarmupTicks);
+
+		FRunResult& Result = Results.Add_GetRef(Run(Scenario, AgentCount));
+
+		UE_LOG(LogBattleFrameBenchmark, Display, TEXT("%d agents: tick mean %.3f ms, p95 %.3f ms, max %.3f ms, spawn %.2f s"),
+			Result.SpawnedAgents, Result.Tick.GetMeanMs(), Result.Tick.GetPercentileMs(0.95f), Result.Tick.GetMaxMs(), Result.SpawnSeconds);
+	}
+
+	WriteResults(Scenario, Results);
+
+	return 0;
+}
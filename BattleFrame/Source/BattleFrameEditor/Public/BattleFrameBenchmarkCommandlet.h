@@ -0,0 +1,31 @@
+/*
+* BattleFrame
+* Created: 2025
+* Author: Leroy Works, All Rights Reserved.
+*/
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+#include "BattleFrameBenchmarkCommandlet.generated.h"
+
+/**
+ * Headless crowd benchmark. Builds a world with a battle control, a neighbor grid and a flow field,
+ * spawns agents in the chosen layout, ticks it with a fixed delta and writes per stage timings to CSV and JSON.
+ *
+ * UnrealEditor-Cmd <Project> -run=BattleFrameBenchmark -nullrhi -Config=/Game/Path/DA_Agent.DA_Agent
+ *     [-Agents=10000,30000,60000,100000] [-Ticks=600] [-Warmup=60] [-DeltaTime=0.0166667]
+ *     [-Teams=2] [-Layout=Clash|Blob] [-Spacing=150] [-Out=<Dir>]
+ */
+UCLASS()
+class BATTLEFRAMEEDITOR_API UBattleFrameBenchmarkCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+
+public:
+
+	UBattleFrameBenchmarkCommandlet();
+
+	virtual int32 Main(const FString& Params) override;
+};